@@ -0,0 +1,144 @@
+// Purpose: Measures process start to first row latency of the contacts CLI. Author: GitHub Copilot
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_PASSWORD "bench"
+#define BENCH_MAX_RUNS 1000
+
+typedef struct {
+    double first_row_ms;
+    double exit_ms;
+} Sample;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+// Runs argv with stdout on a pipe. first_row_ms is the time until marker first appears in the
+// output (0 if it never does); output is discarded, and so is stderr when quiet is set.
+static int run(char* const argv[], char marker, int quiet, Sample* out) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 0;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        if (quiet) {
+            dup2(fds[1], STDERR_FILENO);
+        }
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    out->first_row_ms = 0;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        if (out->first_row_ms == 0 && marker && memchr(buf, marker, (size_t)n)) {
+            out->first_row_ms = now_ms() - start;
+        }
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    out->exit_ms = now_ms() - start;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* label, double* values, int runs) {
+    qsort(values, (size_t)runs, sizeof(double), cmp_double);
+    printf("%-28s min %8.2f ms  median %8.2f ms  max %8.2f ms\n", label, values[0], values[runs / 2], values[runs - 1]);
+}
+
+static int seed(const char* binary, const char* db_path, long rows) {
+    char csv_path[1024];
+    snprintf(csv_path, sizeof(csv_path), "%s.csv", db_path);
+    FILE* csv = fopen(csv_path, "w");
+    if (!csv) {
+        return 0;
+    }
+    fprintf(csv, "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n");
+    for (long i = 0; i < rows; ++i) {
+        fprintf(csv, "Person %ld,555-%07ld,\"%ld Elm St\",p%ld@example.com,%ld.%02ld,2026-%02ld-%02ld,\n", i, i, i, i,
+            i % 1000, i % 100, i % 12 + 1, i % 28 + 1);
+    }
+    if (fclose(csv) != 0) {
+        return 0;
+    }
+    remove(db_path);
+    Sample ignored;
+    char* set_pw[] = { (char*)binary, "--db", (char*)db_path, "--set-password", "--password", BENCH_PASSWORD, NULL };
+    char* import[] = { (char*)binary, "--db", (char*)db_path, "--password", BENCH_PASSWORD, "--import", csv_path, NULL };
+    // A first --set-password reports an error after storing the password; the import checks it.
+    run(set_pw, 0, 1, &ignored);
+    int ok = run(import, 0, 0, &ignored);
+    remove(csv_path);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: startup_bench path/to/contacts [bench.db] [rows] [runs]\n");
+        return 1;
+    }
+    const char* binary = argv[1];
+    const char* db_path = argc > 2 ? argv[2] : "startup_bench.db";
+    long rows = argc > 3 ? strtol(argv[3], NULL, 10) : 10000;
+    int runs = argc > 4 ? atoi(argv[4]) : 30;
+    if (rows < 1 || runs < 1 || runs > BENCH_MAX_RUNS) {
+        fprintf(stderr, "rows must be positive and runs 1-%d.\n", BENCH_MAX_RUNS);
+        return 1;
+    }
+    if (!seed(binary, db_path, rows)) {
+        fprintf(stderr, "Failed to create %s with %s.\n", db_path, binary);
+        return 1;
+    }
+
+    // Every run includes opening the database and verifying the password, as a user would see it.
+    static double first_row[BENCH_MAX_RUNS];
+    static double list_exit[BENCH_MAX_RUNS];
+    static double stats_exit[BENCH_MAX_RUNS];
+    char* list[] = { (char*)binary, "--db", (char*)db_path, "--password", BENCH_PASSWORD, "--list", "--json", NULL };
+    char* stats[] = { (char*)binary, "--db", (char*)db_path, "--password", BENCH_PASSWORD, "--stats", NULL };
+    for (int i = 0; i < runs; ++i) {
+        Sample s;
+        Sample t;
+        if (!run(list, '{', 0, &s) || !run(stats, 0, 0, &t)) {
+            fprintf(stderr, "Benchmark command failed.\n");
+            return 1;
+        }
+        first_row[i] = s.first_row_ms;
+        list_exit[i] = s.exit_ms;
+        stats_exit[i] = t.exit_ms;
+    }
+    printf("%ld rows, %d runs\n", rows, runs);
+    report("--list: start to first row", first_row, runs);
+    report("--list: start to exit", list_exit, runs);
+    report("--stats: start to exit", stats_exit, runs);
+    remove(db_path);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// Purpose: Multi-buffered asynchronous file writer (io_uring or a pwrite thread). Author: GitHub Copilot
+#ifndef CONTACTS_AIO_H
+#define CONTACTS_AIO_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef enum {
+        AIO_BACKEND_AUTO,
+        AIO_BACKEND_URING,
+        AIO_BACKEND_THREAD,
+        AIO_BACKEND_SYNC
+    } AioBackend;
+
+    // Bypass the page cache (O_DIRECT) where the platform and filesystem allow it.
+    #define AIO_DIRECT 1
+
+    typedef struct AioWriter AioWriter;
+
+    // Creates or truncates path. A backend that is unavailable falls back to the next one
+    // (io_uring, then a pwrite thread, then synchronous writes).
+    AioWriter* aio_writer_open(const char* path, AioBackend backend, int flags);
+    int aio_writer_write(AioWriter* w, const void* data, size_t len);
+    // Waits for every pending write and closes the file; returns 0 if any write failed.
+    int aio_writer_close(AioWriter* w);
+    AioBackend aio_writer_backend(const AioWriter* w);
+    int aio_parse_backend(const char* name, AioBackend* out);
+    const char* aio_backend_name(AioBackend backend);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+// Purpose: Cold tier for settled contacts that have not changed in a long time. Author: GitHub Copilot
+#ifndef CONTACTS_ARCHIVE_H
+#define CONTACTS_ARCHIVE_H
+
+#include "db.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARCHIVE_CHUNK_ROWS 1000
+
+    // Moves contacts with no due amount, no ledger entries and no change logged in the last
+    // older_than_days days into contacts_archive, tags included. Ids are walked in chunks of
+    // chunk_rows (0 means ARCHIVE_CHUNK_ROWS), each in its own short write transaction, so other
+    // writers are never locked out for long. With dry_run only counts.
+    int archive_contacts(Db* db, int64_t older_than_days, size_t chunk_rows, int dry_run, int64_t* out_moved);
+    // Moves one archived contact back under the same id with its tags. Runs inside the caller's
+    // transaction when one is open.
+    int archive_restore(Db* db, int64_t contact_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
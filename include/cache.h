@@ -0,0 +1,28 @@
+// Purpose: Bounded in-process LRU cache of contact records. Author: GitHub Copilot
+#ifndef CONTACTS_CACHE_H
+#define CONTACTS_CACHE_H
+
+#include "contacts.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct ContactCache ContactCache;
+
+    ContactCache* cache_create(size_t max_bytes);
+    void cache_destroy(ContactCache* cache);
+    int cache_get(ContactCache* cache, int64_t id, Contact* out);
+    void cache_put(ContactCache* cache, const Contact* c);
+    void cache_remove(ContactCache* cache, int64_t id);
+    void cache_clear(ContactCache* cache);
+    void cache_get_stats(const ContactCache* cache, ContactCacheStats* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
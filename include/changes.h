@@ -0,0 +1,27 @@
+// Purpose: Change-data-capture log of contact mutations. Author: GitHub Copilot
+#ifndef CONTACTS_CHANGES_H
+#define CONTACTS_CHANGES_H
+
+#include "db.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef enum {
+        CHANGES_FORMAT_PLAIN,
+        CHANGES_FORMAT_JSON,
+        CHANGES_FORMAT_NDJSON
+    } ChangesFormat;
+
+    // Prints every logged change with seq > since, oldest first. out_last receives the highest
+    // sequence printed (or since when there were none) so consumers can resume from it.
+    int changes_print_since(Db* db, int64_t since, ChangesFormat format, FILE* out, int64_t* out_last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
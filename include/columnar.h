@@ -0,0 +1,23 @@
+// Purpose: Columnar binary snapshot export/import. Author: GitHub Copilot
+#ifndef CONTACTS_COLUMNAR_H
+#define CONTACTS_COLUMNAR_H
+
+#include "contacts.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COLUMNAR_BLOCK_ROWS 4096
+
+    // Writes the archive tier too when db->include_archived is set, and fails rather than leave out
+    // archived contacts when it is not.
+    int columnar_write_contacts(Db* db, FILE* out);
+    int columnar_import_contacts(Db* db, FILE* in, int dry_run, int* out_imported);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
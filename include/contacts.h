@@ -3,6 +3,8 @@
 #define CONTACTS_CONTACTS_H
 
 #include "db.h"
+#include "fuzzy_index.h"
+#include "roaring.h"
 #include <stdint.h>
 #include <stdio.h>
 
@@ -15,6 +17,8 @@ extern "C" {
 #define CONTACT_ADDRESS_MAX 200
 #define CONTACT_EMAIL_MAX 200
 #define CONTACT_DUE_DATE_MAX 50
+#define CONTACT_EXTERNAL_ID_MAX 128
+#define CONTACT_AGING_MAX_BUCKETS 16
 
     typedef struct {
         int64_t id;
@@ -24,8 +28,18 @@ extern "C" {
         char email[CONTACT_EMAIL_MAX];
         double due_amount;
         char due_date[CONTACT_DUE_DATE_MAX];
+        char external_id[CONTACT_EXTERNAL_ID_MAX];
     } Contact;
 
+    typedef struct {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+        size_t max_bytes;
+    } ContactCacheStats;
+
     typedef struct {
         int total_contacts;
         int due_contacts;
@@ -49,17 +63,110 @@ extern "C" {
         char earliest_due_date[CONTACT_DUE_DATE_MAX];
         char latest_due_date[CONTACT_DUE_DATE_MAX];
         int by_letter[27];
+        ContactCacheStats cache;
     } ContactStats;
 
+    typedef struct {
+        char label[24];
+        int from_days;
+        int to_days;
+        int count;
+        double amount;
+    } ContactAgingBucket;
+
+    typedef struct {
+        ContactAgingBucket buckets[CONTACT_AGING_MAX_BUCKETS];
+        size_t bucket_count;
+        int no_due_date;
+        int invalid_due_date;
+    } ContactAging;
+
+    // Borrowed column text: ptr is NUL-terminated and len excludes the terminator.
+    typedef struct {
+        const char* ptr;
+        size_t len;
+    } ContactField;
+
+    // A row as stored by SQLite, without copying. Only valid until the callback returns.
+    typedef struct {
+        int64_t id;
+        ContactField name;
+        ContactField phone;
+        ContactField address;
+        ContactField email;
+        double due_amount;
+        ContactField due_date;
+        ContactField external_id;
+    } ContactView;
+
+    // Receives each row of contacts_foreach; return 0 to stop early.
+    typedef int (*ContactViewFn)(void* ctx, const ContactView* row);
+
+    // NULL members do not filter; name_like is a LIKE pattern, where a --where expression and ids
+    // a set of contact ids such as a tag selection (see tags.h).
+    typedef struct {
+        const char* name_like;
+        const char* where;
+        const Roaring* ids;
+    } ContactFilter;
+
+    typedef enum {
+        CONTACT_SORT_STORED = 0,
+        CONTACT_SORT_NAME,
+        CONTACT_SORT_PHONE,
+        CONTACT_SORT_DUE_DATE,
+        CONTACT_SORT_ID
+    } ContactSort;
+
     int contacts_add(Db* db, const Contact* c, int64_t* out_id);
-    int contacts_update(Db* db, const Contact* c);
-    int contacts_delete(Db* db, int64_t id);
+    // *out_changed (optional) is 1 when a row with that id existed; 0 is still a success.
+    int contacts_update(Db* db, const Contact* c, int* out_changed);
+    int contacts_delete(Db* db, int64_t id, int* out_changed);
+    int contacts_delete_all(Db* db);
     int contacts_get_by_id(Db* db, int64_t id, Contact* out);
     int contacts_list(Db* db, int json, FILE* out);
     int contacts_search_by_name(Db* db, const char* name, int json, FILE* out);
+    int contacts_list_where(Db* db, const char* expr, int json, FILE* out);
+    int contacts_list_filter(Db* db, const ContactFilter* filter, int json, FILE* out);
+    // Visits matching rows in sort order (CONTACT_SORT_STORED is the --sort setting); filter may be NULL.
+    // The list, search and where printers and the CSV export are built on it.
+    int contacts_foreach(Db* db, const ContactFilter* filter, ContactSort sort, ContactViewFn fn, void* ctx);
+    // Contacts with from_day <= due_day <= to_day (days since 1970-01-01), soonest first; limit <= 0 means all.
+    int contacts_list_upcoming(Db* db, int64_t from_day, int64_t to_day, int limit, int json, FILE* out);
+    // Returns 0 when no contact is due after after_day.
+    int contacts_next_due_day(Db* db, int64_t after_day, int64_t* out_day);
+    // The n largest due amounts, largest first (ties by id), read off idx_contacts_due_amount.
+    int contacts_top_debtors(Db* db, size_t n, int json, FILE* out);
+    // The n contacts due before today with the largest due_amount * days overdue, largest first
+    // (ties by id). Computed in one streaming pass with a bounded heap.
+    int contacts_top_overdue(Db* db, int64_t today, size_t n, int json, FILE* out);
     int contacts_stats(Db* db, ContactStats* out);
+    int contacts_stats_parallel(Db* db, int jobs, ContactStats* out);
+    // Statistics over the contacts in ids only; scans just the id ranges the set occupies.
+    int contacts_stats_subset(Db* db, const Roaring* ids, ContactStats* out);
+    void contacts_stats_combine(ContactStats* out, const ContactStats* part);
+    void contacts_aging_defaults(ContactAging* aging);
+    int contacts_aging_add_bucket(ContactAging* aging, const char* label, int from_days, int to_days);
+    int contacts_aging(Db* db, ContactAging* aging);
     int contacts_set_sort_mode(Db* db, const char* mode);
     int contacts_get_sort_mode(Db* db, char* mode, size_t mode_len);
+    int64_t contacts_row_hash(const Contact* c);
+    // Binds the epoch day of due_date, or NULL when it is empty or invalid.
+    void contacts_bind_due_day(sqlite3_stmt* stmt, int index, const char* due_date);
+    // Views the current row of a statement selecting id, name, phone, address, email, due_amount,
+    // due_date, external_id; the view lasts until the statement is stepped again.
+    void contacts_view_row(sqlite3_stmt* stmt, ContactView* out);
+    void contacts_view_of(const Contact* c, ContactView* out);
+    // Copies a view into a Contact that outlives it, truncating long fields.
+    void contacts_view_copy(const ContactView* view, Contact* out);
+    // Prints one contact in list format; tenant is shown when not NULL.
+    void contacts_print(FILE* out, const ContactView* c, const char* tenant, int json);
+    int contacts_cache_enable(Db* db, size_t max_bytes);
+    void contacts_invalidate_caches(Db* db);
+    int contacts_search_prefix(Db* db, const char* prefix, int64_t* ids, size_t max_ids, size_t* out_count);
+    int contacts_search_fuzzy(Db* db, const char* query, int max_distance, FuzzyMatch* out, size_t max_out,
+        size_t* out_count);
+    int contacts_print_ids(Db* db, const int64_t* ids, size_t count, int json, FILE* out);
 
 #ifdef __cplusplus
 }
@@ -3,14 +3,51 @@
 #define CONTACTS_CSV_H
 
 #include "contacts.h"
+#include "stream.h"
+#include <stddef.h>
 #include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define CSV_CHECKPOINT_ROWS 100000
+
+    typedef struct {
+        int inserted;
+        int updated;
+        int unchanged;
+        int deleted;
+        int failed;
+    } CsvSyncResult;
+
     int csv_write_contacts(Db* db, FILE* out);
     int csv_import_contacts(Db* db, FILE* in, int strict, int dry_run, int* out_imported, int* out_failed);
+    int csv_sync_contacts(Db* db, FILE* in, int strict, int dry_run, int delete_missing, CsvSyncResult* out);
+    int csv_write_contacts_stream(Db* db, Stream* out);
+    // Serial export of the contacts matching filter, in the same order as a full export.
+    int csv_write_contacts_filter(Db* db, Stream* out, const ContactFilter* filter);
+    int csv_write_contacts_parallel(Db* db, Stream* out, int jobs, int ordered);
+    // The header names the columns: they are matched to contact fields by name ("Due Amount" and
+    // "due_amount" both match DueAmount), and column_map ("Name=FullName,Phone=Mobile") overrides
+    // single fields. Unmapped columns are skipped without being copied. Without column_map a header
+    // with no Name column is read positionally.
+    int csv_import_contacts_stream(Db* db, Stream* in, const char* column_map, int strict, int dry_run,
+        int* out_imported, int* out_failed);
+    // Imports path committing every commit_rows records (0 means CSV_CHECKPOINT_ROWS). Each commit
+    // stores the file identity, byte offset and totals in settings; with resume the import continues
+    // after the last commit of an interrupted run of the same file. Totals cover every run, and on
+    // failure they are the ones committed so far.
+    // Same validation and insert path as the CSV import, for NDJSON or a JSON array of objects whose
+    // keys name the columns as a CSV header would. A malformed NDJSON line fails only that row.
+    int csv_import_contacts_json(Db* db, Stream* in, int strict, int dry_run, int* out_imported, int* out_failed);
+    int csv_import_contacts_checkpointed(Db* db, const char* path, const char* column_map, int strict,
+        size_t commit_rows, int resume, int* out_imported, int* out_failed);
+    int csv_sync_contacts_stream(Db* db, Stream* in, const char* column_map, int strict, int dry_run,
+        int delete_missing, CsvSyncResult* out);
+    // Posts ContactId,Date,Amount[,Memo] rows to the ledger in one transaction; charges are positive and
+    // payments negative.
+    int csv_import_ledger_stream(Db* db, Stream* in, int strict, int dry_run, int* out_imported, int* out_failed);
 
 #ifdef __cplusplus
 }
@@ -10,17 +10,49 @@
 extern "C" {
 #endif
 
+// Bump when db_init changes the schema; stored in PRAGMA user_version.
+#define DB_SCHEMA_VERSION 7
+#define DB_TENANT_MAX 64
+#define DB_SHARD_PATH_MAX 1024
+
     typedef struct {
         const char* path;
         sqlite3* handle;
+        struct ContactCache* cache;
+        struct NameIndex* name_index;
+        struct FuzzyIndex* fuzzy_index;
+        // Tag bitmaps loaded by tags_get (see tags.h).
+        struct TagCache* tag_cache;
+        // Approximate statistics loaded by sketch_load (see sketch.h).
+        struct ContactSketch* sketch;
+        // Opened by db_open_for_read without write access; tenant shards follow the same mode.
+        int read_only;
+        // Listing, search, export and stats also read contacts_archive (see archive.h).
+        int include_archived;
+        // Tenant databases opened by shard_open (see shard.h); closed with this Db.
+        struct DbShard* shards;
+        size_t shard_count;
     } Db;
 
+    typedef struct DbShard {
+        char tenant[DB_TENANT_MAX];
+        char path[DB_SHARD_PATH_MAX];
+        Db db;
+    } DbShard;
+
     int db_open(Db* db, const char* path);
+    // Read-only open for commands that never write. Falls back to db_open + db_init when the file
+    // is missing or its schema is older than DB_SCHEMA_VERSION. Call db_close even on failure.
+    int db_open_for_read(Db* db, const char* path);
     void db_close(Db* db);
+    // Extra read-only connection for worker threads; close it with sqlite3_close.
+    sqlite3* db_open_reader(const char* path);
     int db_init(Db* db);
     int db_begin(Db* db);
     int db_commit(Db* db);
     int db_rollback(Db* db);
+    // FROM clause for contact readers: contacts, or both tiers under that name when include_archived is set.
+    const char* db_contacts_source(const Db* db);
     int db_set_setting(Db* db, const char* key, const char* value);
     int db_get_setting(Db* db, const char* key, char* value, size_t value_len);
 
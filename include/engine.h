@@ -0,0 +1,53 @@
+// Purpose: Thread-safe embedding API over a pool of database connections. Author: GitHub Copilot
+#ifndef CONTACTS_ENGINE_H
+#define CONTACTS_ENGINE_H
+
+#include "contacts.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENGINE_MESSAGE_MAX 256
+
+    typedef enum {
+        ENGINE_OK = 0,
+        ENGINE_INVALID,
+        ENGINE_NOT_FOUND,
+        ENGINE_AUTH,
+        ENGINE_BUSY,
+        ENGINE_DB,
+        ENGINE_NO_MEMORY
+    } EngineStatus;
+
+    typedef struct {
+        EngineStatus code;
+        char message[ENGINE_MESSAGE_MAX];
+    } EngineError;
+
+    typedef struct Engine Engine;
+
+    // Every call may run on any thread and borrows one pooled connection for its duration; with
+    // more threads than connections, callers wait for a free one. Row callbacks get borrowed views
+    // (see contacts_foreach) and run while the connection is held, so they must not call back into
+    // an engine with a single connection.
+    // err may be NULL; on failure it receives the code and a message, nothing goes to stderr.
+    // Without pthreads the pool has one connection and calls must come from one thread.
+    EngineStatus engine_open(const char* path, const char* password, int connections, Engine** out, EngineError* err);
+    void engine_close(Engine* engine);
+    EngineStatus engine_get(Engine* engine, int64_t id, Contact* out, EngineError* err);
+    EngineStatus engine_add(Engine* engine, const Contact* c, int64_t* out_id, EngineError* err);
+    EngineStatus engine_update(Engine* engine, const Contact* c, EngineError* err);
+    EngineStatus engine_delete(Engine* engine, int64_t id, EngineError* err);
+    EngineStatus engine_list(Engine* engine, ContactViewFn fn, void* ctx, EngineError* err);
+    EngineStatus engine_search(Engine* engine, const char* name, ContactViewFn fn, void* ctx, EngineError* err);
+    EngineStatus engine_where(Engine* engine, const char* expr, ContactViewFn fn, void* ctx, EngineError* err);
+    EngineStatus engine_stats(Engine* engine, ContactStats* out, EngineError* err);
+    const char* engine_status_name(EngineStatus status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
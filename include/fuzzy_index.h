@@ -0,0 +1,31 @@
+// Purpose: BK-tree over casefolded contact names for bounded edit-distance search. Author: GitHub Copilot
+#ifndef CONTACTS_FUZZY_INDEX_H
+#define CONTACTS_FUZZY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct FuzzyIndex FuzzyIndex;
+
+    typedef struct {
+        int64_t id;
+        int distance;
+    } FuzzyMatch;
+
+    FuzzyIndex* fuzzy_index_create(void);
+    void fuzzy_index_destroy(FuzzyIndex* index);
+    int fuzzy_index_add(FuzzyIndex* index, const char* name, int64_t id);
+    int fuzzy_index_remove(FuzzyIndex* index, const char* name, int64_t id);
+    size_t fuzzy_index_search(const FuzzyIndex* index, const char* query, int max_distance,
+        FuzzyMatch* out, size_t max_out);
+    int fuzzy_edit_distance(const char* a, size_t a_len, const char* b, size_t b_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+// Purpose: Streaming reader for flat JSON objects, one per line or in a top-level array. Author: GitHub Copilot
+#ifndef CONTACTS_JSON_H
+#define CONTACTS_JSON_H
+
+#include "stream.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_MAX_SLOTS 16
+
+    typedef struct JsonReader JsonReader;
+
+    JsonReader* json_reader_open(Stream* in);
+    void json_reader_close(JsonReader* r);
+    // Reads the next object. The input is either one object per line (NDJSON) or one array of them,
+    // decided by its first character. Members whose key slot_of maps to 0..slot_count-1 are
+    // stored as text in values[slot]: strings unescaped, numbers and booleans as written. null,
+    // nested values and absent keys leave NULL. Values stay valid until the next call.
+    // Returns 1 per object, 0 at the end, -1 for a malformed line that was skipped, and -2 when the
+    // input cannot be parsed further.
+    int json_read_object(JsonReader* r, int (*slot_of)(const char* key), char** values, size_t slot_count);
+    // Line of the input the reader has reached, starting at 1.
+    uint64_t json_reader_line(const JsonReader* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
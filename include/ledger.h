@@ -0,0 +1,41 @@
+// Purpose: Per-contact charges and payments with running balances. Author: GitHub Copilot
+#ifndef CONTACTS_LEDGER_H
+#define CONTACTS_LEDGER_H
+
+#include "db.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LEDGER_MEMO_MAX 128
+
+    // Charges are positive amounts and payments negative. Posting an entry updates contacts.balance
+    // and the monthly checkpoints in the same statement (see the ledger triggers in db.c).
+    typedef struct {
+        int64_t id;
+        int64_t contact_id;
+        int64_t day;
+        double amount;
+        char memo[LEDGER_MEMO_MAX];
+    } LedgerEntry;
+
+    // Months since year 0 (year * 12 + month - 1); checkpoints are keyed by it.
+    int64_t ledger_month_of(int64_t day);
+    // day is days since 1970-01-01; amount must be non-zero. memo may be NULL.
+    int ledger_post(Db* db, int64_t contact_id, int64_t day, double amount, const char* memo, int64_t* out_id);
+    // The maintained running balance of one contact.
+    int ledger_balance(Db* db, int64_t contact_id, double* out);
+    // Balance after every entry dated on or before day; contact_id 0 means the whole book. Reads the
+    // last checkpoint before day's month and sums only that month's entries.
+    int ledger_balance_at(Db* db, int64_t contact_id, int64_t day, double* out);
+    // The contact's entries in date order with the running balance after each.
+    int ledger_print(Db* db, int64_t contact_id, int json, FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
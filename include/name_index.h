@@ -0,0 +1,27 @@
+// Purpose: Sorted in-memory index of casefolded contact names for prefix lookup. Author: GitHub Copilot
+#ifndef CONTACTS_NAME_INDEX_H
+#define CONTACTS_NAME_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct NameIndex NameIndex;
+
+    NameIndex* name_index_create(void);
+    void name_index_destroy(NameIndex* index);
+    int name_index_append(NameIndex* index, const char* name, int64_t id);
+    int name_index_build(NameIndex* index);
+    int name_index_insert(NameIndex* index, const char* name, int64_t id);
+    int name_index_remove(NameIndex* index, const char* name, int64_t id);
+    size_t name_index_prefix(const NameIndex* index, const char* prefix, int64_t* ids, size_t max_ids);
+    size_t name_index_count(const NameIndex* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+// Purpose: Filter expression parser that compiles to parameterized SQL. Author: GitHub Copilot
+#ifndef CONTACTS_QUERY_H
+#define CONTACTS_QUERY_H
+
+#include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QUERY_SQL_MAX 2048
+#define QUERY_TEXT_MAX 2048
+#define QUERY_MAX_PARAMS 32
+#define QUERY_ERROR_MAX 160
+
+    typedef enum {
+        QUERY_PARAM_TEXT,
+        QUERY_PARAM_REAL,
+        QUERY_PARAM_INT
+    } QueryParamType;
+
+    typedef struct {
+        QueryParamType type;
+        size_t text_off;
+        double real;
+        int64_t integer;
+    } QueryParam;
+
+    typedef struct {
+        char sql[QUERY_SQL_MAX];
+        size_t sql_len;
+        char text[QUERY_TEXT_MAX];
+        size_t text_len;
+        QueryParam params[QUERY_MAX_PARAMS];
+        int param_count;
+        char error[QUERY_ERROR_MAX];
+    } Query;
+
+    int query_compile(const char* expr, Query* out);
+    int query_bind(const Query* q, sqlite3_stmt* stmt, int first_index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
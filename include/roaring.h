@@ -0,0 +1,44 @@
+// Purpose: Compressed bitmap (roaring) sets of 32-bit contact ids. Author: GitHub Copilot
+#ifndef CONTACTS_ROARING_H
+#define CONTACTS_ROARING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    // Values are split into chunks of 65536 by their high 16 bits. A chunk holds a sorted array of
+    // low halves while it has at most 4096 members, and a 8 KiB bitset above that.
+    typedef struct Roaring Roaring;
+
+    // Receives members in ascending order; return 0 to stop early.
+    typedef int (*RoaringFn)(void* ctx, uint32_t value);
+
+    Roaring* roaring_create(void);
+    void roaring_destroy(Roaring* r);
+    Roaring* roaring_copy(const Roaring* r);
+    int roaring_add(Roaring* r, uint32_t value);
+    int roaring_remove(Roaring* r, uint32_t value);
+    int roaring_contains(const Roaring* r, uint32_t value);
+    uint64_t roaring_cardinality(const Roaring* r);
+    // In place: r = r & other, r = r | other, r = r & ~other.
+    int roaring_and(Roaring* r, const Roaring* other);
+    int roaring_or(Roaring* r, const Roaring* other);
+    int roaring_andnot(Roaring* r, const Roaring* other);
+    int roaring_foreach(const Roaring* r, RoaringFn fn, void* ctx);
+    // Non-empty chunks in ascending order; chunk i covers key << 16 through (key << 16) | 0xFFFF.
+    size_t roaring_chunk_count(const Roaring* r);
+    uint16_t roaring_chunk_key(const Roaring* r, size_t i);
+    size_t roaring_serialized_size(const Roaring* r);
+    // Writes roaring_serialized_size(r) bytes; the format is the same on every platform.
+    void roaring_serialize(const Roaring* r, unsigned char* out);
+    // Returns NULL when data is truncated or inconsistent.
+    Roaring* roaring_deserialize(const void* data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+// Purpose: Tenant shard map routing contacts across several SQLite files. Author: GitHub Copilot
+#ifndef CONTACTS_SHARD_H
+#define CONTACTS_SHARD_H
+
+#include "contacts.h"
+#include "db.h"
+#include "sketch.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    // The shard map lives in the main database; each tenant's contacts live in their own file.
+    int shard_register(Db* db, const char* tenant, const char* path);
+    // Opens every registered tenant, or only `tenant` when not NULL, into db->shards (sorted by tenant).
+    int shard_open(Db* db, const char* tenant);
+    // Scatter-gather across db->shards, merged by name (NOCASE), then tenant, then id.
+    int shard_list(Db* db, const char* name_pattern, int json, FILE* out);
+    int shard_stats(Db* db, int jobs, ContactStats* out);
+    // Merges every tenant's sketch; the result has no sample.
+    int shard_sketch(Db* db, ContactSketch* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
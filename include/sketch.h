@@ -0,0 +1,88 @@
+// Purpose: Approximate statistics sketches kept current from the change log. Author: GitHub Copilot
+#ifndef CONTACTS_SKETCH_H
+#define CONTACTS_SKETCH_H
+
+#include "db.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKETCH_HLL_BITS 12
+#define SKETCH_HLL_REGISTERS (1 << SKETCH_HLL_BITS)
+// DDSketch buckets with 1% relative error; bucket i holds values in (gamma^(i-1), gamma^i].
+#define SKETCH_DD_ALPHA 0.01
+#define SKETCH_DD_MIN_INDEX (-128)
+#define SKETCH_DD_BUCKETS 1024
+#define SKETCH_SAMPLE_MAX 64
+
+    // Distinct count with about 1.6% standard error; insert-only.
+    typedef struct {
+        uint8_t reg[SKETCH_HLL_REGISTERS];
+    } Hll;
+
+    // Quantiles of positive values within SKETCH_DD_ALPHA relative error. Counts can be decremented,
+    // so an edited amount is moved rather than counted twice.
+    typedef struct {
+        int64_t counts[SKETCH_DD_BUCKETS];
+        int64_t total;
+    } DdSketch;
+
+    typedef struct ContactSketch {
+        int64_t seq;             // last contact_changes row applied
+        int64_t contacts;
+        uint64_t stale;          // removals HLL cannot forget since the last rebuild
+        Hll email_domains;
+        Hll area_codes;
+        DdSketch amounts;        // due_amount > 0 only
+        int64_t sample[SKETCH_SAMPLE_MAX];
+        size_t sample_count;
+        uint64_t sample_seen;
+        uint64_t rng;
+    } ContactSketch;
+
+    typedef struct {
+        int64_t seq;
+        int64_t contacts;
+        uint64_t email_domains;
+        uint64_t area_codes;
+        int64_t amounts;
+        double p50;
+        double p90;
+        double p99;
+        size_t sample_count;
+        int64_t sample[SKETCH_SAMPLE_MAX];
+    } SketchStats;
+
+    void hll_add(Hll* h, uint64_t hash);
+    void hll_merge(Hll* h, const Hll* other);
+    uint64_t hll_estimate(const Hll* h);
+    void ddsketch_add(DdSketch* s, double value, int64_t delta);
+    void ddsketch_merge(DdSketch* s, const DdSketch* other);
+    // 0 when the sketch is empty.
+    double ddsketch_quantile(const DdSketch* s, double q);
+
+    // Brings the stored sketch up to date with contact_changes and saves it. Bulk writes (imports,
+    // archiving, --delete-all) and db_init call this after they commit. Inside an open transaction it
+    // does nothing. Once removals reach a tenth of the book the sketch is rebuilt, so distinct counts
+    // forget deleted values.
+    int sketch_refresh(Db* db);
+    // Same, inside the caller's open write transaction. Single-row writes call it before their own
+    // COMMIT, so the stored sketch takes each change atomically and without a second transaction.
+    int sketch_apply_pending(Db* db);
+    // Recomputes everything from the contacts table.
+    int sketch_rebuild(Db* db);
+    // Current sketch, applying pending changes in memory when the database is read-only.
+    int sketch_load(Db* db, ContactSketch* out);
+    // Combines another book's sketch; the sample is dropped because ids are per database.
+    void sketch_merge(ContactSketch* into, const ContactSketch* from);
+    void sketch_summarize(const ContactSketch* sketch, SketchStats* out);
+    void sketch_invalidate(Db* db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
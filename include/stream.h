@@ -0,0 +1,47 @@
+// Purpose: Buffered byte streams with optional gzip/zstd compression. Author: GitHub Copilot
+#ifndef CONTACTS_STREAM_H
+#define CONTACTS_STREAM_H
+
+#include "aio.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef enum {
+        STREAM_CODEC_AUTO,
+        STREAM_CODEC_PLAIN,
+        STREAM_CODEC_GZIP,
+        STREAM_CODEC_ZSTD
+    } StreamCodec;
+
+    typedef struct Stream Stream;
+
+    StreamCodec stream_codec_for_path(const char* path);
+    // Both return NULL on failure without closing the file. STREAM_CODEC_AUTO sniffs the magic
+    // number when reading and means plain when writing.
+    Stream* stream_open_writer(FILE* file, StreamCodec codec, int owns_file);
+    Stream* stream_open_reader(FILE* file, StreamCodec codec, int owns_file);
+    // Writes path through an AioWriter so output overlaps with formatting; flags take AIO_DIRECT.
+    Stream* stream_open_file_writer(const char* path, StreamCodec codec, AioBackend backend, int flags);
+    int stream_write(Stream* s, const void* data, size_t len);
+    int stream_puts(Stream* s, const char* str);
+    int stream_putc(Stream* s, int c);
+    int stream_getc(Stream* s);
+    void stream_ungetc(Stream* s);
+    // Decoded bytes read so far, counting any skipped with stream_skip.
+    uint64_t stream_tell(const Stream* s);
+    // Moves the read offset n decoded bytes forward; 0 if the input ends first.
+    int stream_skip(Stream* s, uint64_t n);
+    int stream_error(const Stream* s);
+    int stream_close(Stream* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
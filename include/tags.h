@@ -0,0 +1,46 @@
+// Purpose: Contact tags with lazily loaded roaring bitmap indexes. Author: GitHub Copilot
+#ifndef CONTACTS_TAGS_H
+#define CONTACTS_TAGS_H
+
+#include "contacts.h"
+#include "db.h"
+#include "roaring.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAG_NAME_MAX 64
+#define TAGS_MAX_OPS 32
+
+    typedef enum {
+        TAGS_OR,
+        TAGS_AND,
+        TAGS_NOT
+    } TagsOpKind;
+
+    typedef struct {
+        TagsOpKind kind;
+        const char* tag;
+    } TagsOp;
+
+    // Tag names are 1-64 characters of letters, digits and _ . : -
+    int tags_valid_name(const char* tag);
+    // Adds the tag to (or removes it from) every contact matching filter, in one transaction.
+    // A tag that loses its last contact is deleted. Contact ids must fit in 32 bits.
+    int tags_update(Db* db, const char* tag, int add, const ContactFilter* filter, int* out_changed);
+    // The tag's members, loaded on first use and owned by db; 0 for an unknown tag.
+    int tags_get(Db* db, const char* tag, const Roaring** out);
+    // Applies ops left to right. Starts from no contacts when the first op is TAGS_OR, otherwise
+    // from all of them. The caller destroys the result.
+    Roaring* tags_select(Db* db, const TagsOp* ops, size_t count);
+    int tags_print(Db* db, int json, FILE* out);
+    // Drops loaded bitmaps; called whenever contacts are deleted.
+    void tags_invalidate(Db* db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
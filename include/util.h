@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #define UTIL_MAX_LINE 1024
+#define UTIL_FNV64_INIT 14695981039346656037ULL
 
     int util_read_line(FILE* in, char* buf, size_t len);
     void util_trim(char* s);
@@ -25,8 +26,29 @@ extern "C" {
     void util_print_json_string(FILE* out, const char* s);
     int util_parse_iso_date(const char* input, struct tm* out);
     int util_due_days(const char* due_date, int* days_out);
+    int util_due_days_at(const char* due_date, time_t now, int* days_out);
+    // Days since 1970-01-01 for a date accepted by util_parse_iso_date, without calling mktime.
+    int util_epoch_day(const char* date, int64_t* out);
+    int64_t util_local_epoch_day(time_t when);
+    time_t util_epoch_day_start(int64_t day);
+    // Inverse of util_epoch_day: the proleptic Gregorian year, month (1-12) and day of month.
+    void util_civil_from_days(int64_t day, int* year, int* month, int* mday);
+    void util_format_epoch_day(int64_t day, char* out, size_t len);
     void util_format_iso_date(time_t when, char* out, size_t len);
     void util_copy_str(char* dest, size_t dest_len, const char* src);
+    uint64_t util_fnv1a64(uint64_t hash, const void* data, size_t len);
+    uint32_t util_crc32(uint32_t crc, const void* data, size_t len);
+
+    // Library code reports failures through util_error rather than writing to stderr. The last
+    // message is kept per thread; it is echoed to stderr only after util_set_error_echo(1), which
+    // the CLI calls at start-up.
+#if defined(__GNUC__)
+    __attribute__((format(printf, 1, 2)))
+#endif
+    void util_error(const char* fmt, ...);
+    const char* util_last_error(void);
+    void util_clear_error(void);
+    void util_set_error_echo(int enabled);
 
 #ifdef __cplusplus
 }
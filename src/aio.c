@@ -0,0 +1,570 @@
+// Purpose: Multi-buffered asynchronous file writer (io_uring or a pwrite thread). Author: GitHub Copilot
+#if defined(__linux__)
+#define _GNU_SOURCE
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "aio.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Three buffers: one being filled while up to two are with the kernel. Sizes and file offsets
+// stay multiples of AIO_ALIGN so full buffers can be written with O_DIRECT.
+#define AIO_BUFFER (1024 * 1024)
+#define AIO_BUFFERS 3
+#define AIO_ALIGN 4096
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t done;
+    int64_t offset;
+    int busy;
+} AioBuffer;
+
+#ifdef HAVE_IO_URING
+typedef struct {
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+} Ring;
+#endif
+
+struct AioWriter {
+#if defined(_WIN32)
+    FILE* file;
+#else
+    int fd;
+#endif
+    int direct;
+    AioBackend backend;
+    AioBuffer bufs[AIO_BUFFERS];
+    size_t cur;
+    int64_t offset;
+    int error;
+    int failed;
+#ifdef HAVE_IO_URING
+    Ring ring;
+#endif
+#ifdef HAVE_PTHREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t queue[AIO_BUFFERS];
+    size_t queue_head;
+    size_t queue_count;
+    int closing;
+#endif
+};
+
+// error is shared with the pwrite thread; the writer side only reads it through aio_wait.
+static void aio_set_error(AioWriter* w, int err) {
+    if (!err) {
+        return;
+    }
+    w->failed = 1;
+#ifdef HAVE_PTHREADS
+    if (w->backend == AIO_BACKEND_THREAD) {
+        pthread_mutex_lock(&w->lock);
+        w->error = w->error ? w->error : err;
+        pthread_mutex_unlock(&w->lock);
+        return;
+    }
+#endif
+    w->error = w->error ? w->error : err;
+}
+
+// Writes the whole range at offset; returns 0 or an errno value.
+static int aio_write_at(AioWriter* w, const unsigned char* data, size_t len, int64_t offset) {
+#if defined(_WIN32)
+    (void)offset;
+    return fwrite(data, 1, len, w->file) == len ? 0 : EIO;
+#else
+    while (len > 0) {
+        ssize_t n = pwrite(w->fd, data, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return EIO;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+#endif
+}
+
+#ifdef HAVE_IO_URING
+static void ring_free(Ring* r) {
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_map && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_len);
+    }
+    if (r->sq_map) {
+        munmap(r->sq_map, r->sq_map_len);
+    }
+    close(r->fd);
+    memset(r, 0, sizeof(*r));
+}
+
+static int ring_init(Ring* r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        return 0;
+    }
+    // IORING_OP_WRITE arrived in the same kernel release as this feature bit.
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(r->fd);
+        return 0;
+    }
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cq_map_len > r->sq_map_len) {
+        r->sq_map_len = r->cq_map_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        ring_free(r);
+        return 0;
+    }
+    if (single) {
+        r->cq_map = r->sq_map;
+        r->cq_map_len = r->sq_map_len;
+    }
+    else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            ring_free(r);
+            return 0;
+        }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        ring_free(r);
+        return 0;
+    }
+    unsigned char* sq = (unsigned char*)r->sq_map;
+    unsigned char* cq = (unsigned char*)r->cq_map;
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 1;
+}
+
+static int ring_enter(Ring* r, unsigned submit, unsigned wait) {
+    for (;;) {
+        long rc = syscall(__NR_io_uring_enter, r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return errno;
+        }
+    }
+}
+
+// Queues the unwritten part of buffer i; at most AIO_BUFFERS writes are ever in flight.
+static int ring_submit(AioWriter* w, size_t i) {
+    Ring* r = &w->ring;
+    AioBuffer* b = &w->bufs[i];
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = w->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(b->data + b->done);
+    sqe->len = (uint32_t)(b->len - b->done);
+    sqe->off = (uint64_t)(b->offset + (int64_t)b->done);
+    sqe->user_data = i;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return ring_enter(r, 1, 0);
+}
+
+// Blocks for one completion and retires (or resubmits the rest of) its buffer. Returns 0 only
+// when waiting itself failed, after which nothing more will complete.
+static int ring_reap(AioWriter* w) {
+    Ring* r = &w->ring;
+    unsigned head = *r->cq_head;
+    while (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        int err = ring_enter(r, 0, 1);
+        if (err) {
+            aio_set_error(w, err);
+            return 0;
+        }
+    }
+    struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+    size_t i = (size_t)cqe->user_data;
+    int res = cqe->res;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    AioBuffer* b = &w->bufs[i];
+    if (res <= 0) {
+        b->busy = 0;
+        aio_set_error(w, res < 0 ? -res : EIO);
+        return 1;
+    }
+    b->done += (size_t)res;
+    if (b->done < b->len) {
+        int err = ring_submit(w, i);
+        if (err) {
+            b->busy = 0;
+            aio_set_error(w, err);
+        }
+        return 1;
+    }
+    b->busy = 0;
+    return 1;
+}
+#endif
+
+#ifdef HAVE_PTHREADS
+static void* aio_thread_worker(void* arg) {
+    AioWriter* w = (AioWriter*)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->queue_count == 0 && !w->closing) {
+            pthread_cond_wait(&w->changed, &w->lock);
+        }
+        if (w->queue_count == 0) {
+            break;
+        }
+        size_t i = w->queue[w->queue_head];
+        w->queue_head = (w->queue_head + 1) % AIO_BUFFERS;
+        w->queue_count--;
+        AioBuffer* b = &w->bufs[i];
+        int skip = w->error != 0;
+        pthread_mutex_unlock(&w->lock);
+        int err = skip ? 0 : aio_write_at(w, b->data, b->len, b->offset);
+        pthread_mutex_lock(&w->lock);
+        if (err && !w->error) {
+            w->error = err;
+        }
+        b->busy = 0;
+        pthread_cond_broadcast(&w->changed);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+#endif
+
+static void aio_submit(AioWriter* w, size_t i) {
+    AioBuffer* b = &w->bufs[i];
+    b->offset = w->offset;
+    b->done = 0;
+    b->busy = 1;
+    w->offset += (int64_t)b->len;
+#ifdef HAVE_IO_URING
+    if (w->backend == AIO_BACKEND_URING) {
+        int err = ring_submit(w, i);
+        if (err) {
+            b->busy = 0;
+            aio_set_error(w, err);
+        }
+        return;
+    }
+#endif
+#ifdef HAVE_PTHREADS
+    if (w->backend == AIO_BACKEND_THREAD) {
+        pthread_mutex_lock(&w->lock);
+        w->queue[(w->queue_head + w->queue_count) % AIO_BUFFERS] = i;
+        w->queue_count++;
+        pthread_cond_broadcast(&w->changed);
+        pthread_mutex_unlock(&w->lock);
+        return;
+    }
+#endif
+    int err = aio_write_at(w, b->data, b->len, b->offset);
+    b->busy = 0;
+    aio_set_error(w, err);
+}
+
+// Waits until buffer i is no longer being written. Returns 0 once any write has failed.
+static int aio_wait(AioWriter* w, size_t i) {
+#ifdef HAVE_IO_URING
+    if (w->backend == AIO_BACKEND_URING) {
+        while (w->bufs[i].busy) {
+            if (!ring_reap(w)) {
+                break;
+            }
+        }
+        return !w->failed;
+    }
+#endif
+#ifdef HAVE_PTHREADS
+    if (w->backend == AIO_BACKEND_THREAD) {
+        pthread_mutex_lock(&w->lock);
+        while (w->bufs[i].busy) {
+            pthread_cond_wait(&w->changed, &w->lock);
+        }
+        if (w->error) {
+            w->failed = 1;
+        }
+        pthread_mutex_unlock(&w->lock);
+        return !w->failed;
+    }
+#endif
+    return !w->failed;
+}
+
+static int aio_start(AioWriter* w, AioBackend backend) {
+#ifdef HAVE_IO_URING
+    if (backend == AIO_BACKEND_AUTO || backend == AIO_BACKEND_URING) {
+        if (ring_init(&w->ring, 4)) {
+            w->backend = AIO_BACKEND_URING;
+            return 1;
+        }
+        backend = AIO_BACKEND_THREAD;
+    }
+#endif
+#ifdef HAVE_PTHREADS
+    if (backend != AIO_BACKEND_SYNC) {
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->changed, NULL);
+        if (pthread_create(&w->thread, NULL, aio_thread_worker, w) == 0) {
+            w->backend = AIO_BACKEND_THREAD;
+            return 1;
+        }
+        pthread_cond_destroy(&w->changed);
+        pthread_mutex_destroy(&w->lock);
+    }
+#endif
+    (void)backend;
+    w->backend = AIO_BACKEND_SYNC;
+    return 1;
+}
+
+static int aio_open_file(AioWriter* w, const char* path, int flags) {
+#if defined(_WIN32)
+    if (flags & AIO_DIRECT) {
+        util_error("Direct I/O is not supported on this platform; writing through the cache.");
+    }
+    w->file = fopen(path, "wb");
+    return w->file != NULL;
+#else
+    int mode = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+    mode |= O_CLOEXEC;
+#endif
+    if (flags & AIO_DIRECT) {
+#ifdef O_DIRECT
+        w->fd = open(path, mode | O_DIRECT, 0666);
+        if (w->fd >= 0) {
+            w->direct = 1;
+            return 1;
+        }
+        if (errno != EINVAL) {
+            return 0;
+        }
+        util_error("Direct I/O is not supported for %s; writing through the cache.", path);
+#else
+        util_error("Direct I/O is not supported on this platform; writing through the cache.");
+#endif
+    }
+    w->fd = open(path, mode, 0666);
+    return w->fd >= 0;
+#endif
+}
+
+AioWriter* aio_writer_open(const char* path, AioBackend backend, int flags) {
+    if (!path) {
+        return NULL;
+    }
+    AioWriter* w = (AioWriter*)calloc(1, sizeof(AioWriter));
+    if (!w) {
+        return NULL;
+    }
+    for (size_t i = 0; i < AIO_BUFFERS; ++i) {
+        w->bufs[i].data = (unsigned char*)aligned_alloc(AIO_ALIGN, AIO_BUFFER);
+        if (!w->bufs[i].data) {
+            for (size_t j = 0; j < i; ++j) {
+                free(w->bufs[j].data);
+            }
+            free(w);
+            return NULL;
+        }
+    }
+    if (!aio_open_file(w, path, flags)) {
+        util_error("Failed to open %s: %s", path, strerror(errno));
+        for (size_t i = 0; i < AIO_BUFFERS; ++i) {
+            free(w->bufs[i].data);
+        }
+        free(w);
+        return NULL;
+    }
+#if defined(_WIN32)
+    backend = AIO_BACKEND_SYNC;
+#endif
+    aio_start(w, backend);
+    return w;
+}
+
+int aio_writer_write(AioWriter* w, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len > 0 && !w->failed) {
+        AioBuffer* b = &w->bufs[w->cur];
+        size_t take = AIO_BUFFER - b->len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(b->data + b->len, p, take);
+        b->len += take;
+        p += take;
+        len -= take;
+        if (b->len == AIO_BUFFER) {
+            aio_submit(w, w->cur);
+            w->cur = (w->cur + 1) % AIO_BUFFERS;
+            if (!aio_wait(w, w->cur)) {
+                break;
+            }
+            w->bufs[w->cur].len = 0;
+        }
+    }
+    return !w->failed;
+}
+
+// The tail is rarely a whole number of blocks, so it is written after O_DIRECT is switched off.
+static void aio_flush_tail(AioWriter* w) {
+    AioBuffer* b = &w->bufs[w->cur];
+    if (b->len == 0 || w->failed) {
+        return;
+    }
+#if !defined(_WIN32) && defined(O_DIRECT)
+    if (w->direct && b->len % AIO_ALIGN != 0) {
+        for (size_t i = 0; i < AIO_BUFFERS; ++i) {
+            aio_wait(w, i);
+        }
+        int fl = fcntl(w->fd, F_GETFL);
+        if (fl < 0 || fcntl(w->fd, F_SETFL, fl & ~O_DIRECT) < 0) {
+            aio_set_error(w, errno);
+            return;
+        }
+        aio_set_error(w, aio_write_at(w, b->data, b->len, w->offset));
+        w->offset += (int64_t)b->len;
+        return;
+    }
+#endif
+    aio_submit(w, w->cur);
+}
+
+int aio_writer_close(AioWriter* w) {
+    if (!w) {
+        return 0;
+    }
+    aio_flush_tail(w);
+    for (size_t i = 0; i < AIO_BUFFERS; ++i) {
+        aio_wait(w, i);
+    }
+#ifdef HAVE_IO_URING
+    if (w->backend == AIO_BACKEND_URING) {
+        ring_free(&w->ring);
+    }
+#endif
+#ifdef HAVE_PTHREADS
+    if (w->backend == AIO_BACKEND_THREAD) {
+        pthread_mutex_lock(&w->lock);
+        w->closing = 1;
+        pthread_cond_broadcast(&w->changed);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->changed);
+        pthread_mutex_destroy(&w->lock);
+    }
+#endif
+    int err = w->error;
+#if defined(_WIN32)
+    if (fclose(w->file) != 0 && !err) {
+        err = EIO;
+    }
+#else
+    if (close(w->fd) != 0 && !err) {
+        err = errno;
+    }
+#endif
+    if (err) {
+        util_error("Write failed: %s", strerror(err));
+    }
+    for (size_t i = 0; i < AIO_BUFFERS; ++i) {
+        free(w->bufs[i].data);
+    }
+    free(w);
+    return err == 0;
+}
+
+AioBackend aio_writer_backend(const AioWriter* w) {
+    return w ? w->backend : AIO_BACKEND_SYNC;
+}
+
+int aio_parse_backend(const char* name, AioBackend* out) {
+    static const AioBackend all[] = { AIO_BACKEND_AUTO, AIO_BACKEND_URING, AIO_BACKEND_THREAD, AIO_BACKEND_SYNC };
+    for (size_t i = 0; name && i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (strcmp(name, aio_backend_name(all[i])) == 0) {
+            *out = all[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* aio_backend_name(AioBackend backend) {
+    switch (backend) {
+    case AIO_BACKEND_URING:
+        return "uring";
+    case AIO_BACKEND_THREAD:
+        return "thread";
+    case AIO_BACKEND_SYNC:
+        return "sync";
+    default:
+        return "auto";
+    }
+}
@@ -0,0 +1,187 @@
+// Purpose: Cold tier for settled contacts that have not changed in a long time. Author: GitHub Copilot
+#include "archive.h"
+#include "contacts.h"
+#include "sketch.h"
+#include "util.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+
+#define ARCHIVE_COLUMNS "id, name, phone, address, email, due_amount, due_date, external_id, row_hash, due_day, balance"
+
+// Rows of contacts c with ?1 < id <= ?2 that are settled and were last changed before ?3. Contacts
+// older than the change log have no entry and count as untouched.
+#define ARCHIVE_COLD_ROWS \
+    " FROM contacts c WHERE c.id > ?1 AND c.id <= ?2 AND COALESCE(c.due_amount, 0) = 0" \
+    " AND NOT EXISTS (SELECT 1 FROM ledger l WHERE l.contact_id = c.id)" \
+    " AND COALESCE((SELECT x.changed_at FROM contact_changes x WHERE x.contact_id = c.id" \
+    " ORDER BY x.seq DESC LIMIT 1), '') < ?3"
+
+enum {
+    ARCHIVE_BOUND,
+    ARCHIVE_COUNT,
+    ARCHIVE_COPY,
+    ARCHIVE_COPY_TAGS,
+    ARCHIVE_DELETE,
+    ARCHIVE_STMTS
+};
+
+static const char* archive_sql[ARCHIVE_STMTS] = {
+    "SELECT MAX(id) FROM (SELECT id FROM contacts WHERE id > ?1 ORDER BY id LIMIT ?2);",
+    "SELECT COUNT(*)" ARCHIVE_COLD_ROWS ";",
+    "INSERT INTO contacts_archive(" ARCHIVE_COLUMNS ") SELECT c.id, c.name, c.phone, c.address, c.email,"
+    " c.due_amount, c.due_date, c.external_id, c.row_hash, c.due_day, c.balance" ARCHIVE_COLD_ROWS ";",
+    "INSERT INTO contact_tags_archive(contact_id, tag) SELECT contact_id, tag FROM contact_tags"
+    " WHERE contact_id IN (SELECT id FROM contacts_archive WHERE id > ?1 AND id <= ?2);",
+    // Rows archived by an earlier run are no longer in contacts, so only this chunk's copies match.
+    "DELETE FROM contacts WHERE id > ?1 AND id <= ?2"
+    " AND id IN (SELECT id FROM contacts_archive WHERE id > ?1 AND id <= ?2);",
+};
+
+static int archive_cutoff(sqlite3* handle, int64_t older_than_days, char* out, size_t out_len) {
+    char modifier[48];
+    snprintf(modifier, sizeof(modifier), "-%lld days", (long long)older_than_days);
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(handle, "SELECT strftime('%Y-%m-%dT%H:%M:%fZ', 'now', ?);", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, modifier, -1, SQLITE_TRANSIENT);
+    int ok = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0);
+    if (ok) {
+        util_copy_str(out, out_len, (const char*)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+static int archive_step(sqlite3_stmt* stmt, int64_t after, int64_t upto, const char* cutoff) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, after);
+    sqlite3_bind_int64(stmt, 2, upto);
+    if (sqlite3_bind_parameter_count(stmt) >= 3) {
+        sqlite3_bind_text(stmt, 3, cutoff, -1, SQLITE_TRANSIENT);
+    }
+    int rc = sqlite3_step(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+// Moves or counts the cold rows among the next chunk_rows ids after *after and advances it;
+// *done is set once no ids are left.
+static int archive_chunk(Db* db, sqlite3_stmt** stmts, size_t chunk_rows, const char* cutoff, int dry_run,
+    int64_t* after, int64_t* moved, int* done) {
+    sqlite3_stmt* bound = stmts[ARCHIVE_BOUND];
+    if (!dry_run && sqlite3_exec(db->handle, "BEGIN IMMEDIATE;", NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int ok = archive_step(bound, *after, (int64_t)chunk_rows, cutoff);
+    *done = !ok || sqlite3_column_type(bound, 0) == SQLITE_NULL;
+    int64_t upto = *done ? *after : sqlite3_column_int64(bound, 0);
+    sqlite3_reset(bound);
+    if (ok && !*done && dry_run) {
+        ok = archive_step(stmts[ARCHIVE_COUNT], *after, upto, cutoff);
+        *moved += ok ? sqlite3_column_int64(stmts[ARCHIVE_COUNT], 0) : 0;
+        sqlite3_reset(stmts[ARCHIVE_COUNT]);
+    }
+    else if (ok && !*done) {
+        ok = archive_step(stmts[ARCHIVE_COPY], *after, upto, cutoff);
+        int copied = sqlite3_changes(db->handle);
+        ok = ok && archive_step(stmts[ARCHIVE_COPY_TAGS], *after, upto, cutoff) &&
+            archive_step(stmts[ARCHIVE_DELETE], *after, upto, cutoff);
+        *moved += ok ? copied : 0;
+    }
+    if (!dry_run) {
+        if (ok && sqlite3_exec(db->handle, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+            ok = 0;
+        }
+        if (!ok) {
+            sqlite3_exec(db->handle, "ROLLBACK;", NULL, NULL, NULL);
+        }
+    }
+    *after = upto;
+    return ok;
+}
+
+int archive_contacts(Db* db, int64_t older_than_days, size_t chunk_rows, int dry_run, int64_t* out_moved) {
+    if (!db || !db->handle || older_than_days < 0) {
+        return 0;
+    }
+    if (!sqlite3_get_autocommit(db->handle)) {
+        util_error("Archiving manages its own transactions.");
+        return 0;
+    }
+    char cutoff[64];
+    if (!archive_cutoff(db->handle, older_than_days, cutoff, sizeof(cutoff))) {
+        return 0;
+    }
+    sqlite3_stmt* stmts[ARCHIVE_STMTS] = { NULL };
+    int ok = 1;
+    for (int i = 0; i < ARCHIVE_STMTS && ok; ++i) {
+        ok = sqlite3_prepare_v2(db->handle, archive_sql[i], -1, &stmts[i], NULL) == SQLITE_OK;
+    }
+    int64_t after = 0;
+    int64_t moved = 0;
+    int done = 0;
+    while (ok && !done) {
+        ok = archive_chunk(db, stmts, chunk_rows > 0 ? chunk_rows : ARCHIVE_CHUNK_ROWS, cutoff, dry_run, &after,
+            &moved, &done);
+    }
+    for (int i = 0; i < ARCHIVE_STMTS; ++i) {
+        sqlite3_finalize(stmts[i]);
+    }
+    if (!dry_run && moved > 0) {
+        contacts_invalidate_caches(db);
+        sketch_refresh(db);
+    }
+    if (out_moved) {
+        *out_moved = moved;
+    }
+    return ok;
+}
+
+static int exec_id(sqlite3* handle, const char* sql, int64_t id) {
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, id);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+int archive_restore(Db* db, int64_t contact_id) {
+    if (!db || !db->handle || contact_id <= 0) {
+        return 0;
+    }
+    int own = sqlite3_get_autocommit(db->handle);
+    // A savepoint undoes a half-finished restore without touching the caller's transaction.
+    if (sqlite3_exec(db->handle, "SAVEPOINT archive_restore;", NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int ok = exec_id(db->handle,
+        "INSERT INTO contacts(" ARCHIVE_COLUMNS ") SELECT " ARCHIVE_COLUMNS " FROM contacts_archive WHERE id = ?;",
+        contact_id);
+    if (ok && sqlite3_changes(db->handle) == 0) {
+        util_error("Contact %lld is not archived.", (long long)contact_id);
+        ok = 0;
+    }
+    ok = ok &&
+        exec_id(db->handle, "INSERT OR IGNORE INTO tags(name) SELECT tag FROM contact_tags_archive WHERE contact_id = ?;",
+            contact_id) &&
+        exec_id(db->handle,
+            "INSERT OR IGNORE INTO contact_tags(tag, contact_id) SELECT tag, contact_id FROM contact_tags_archive"
+            " WHERE contact_id = ?;",
+            contact_id) &&
+        exec_id(db->handle, "DELETE FROM contacts_archive WHERE id = ?;", contact_id);
+    if (!ok) {
+        sqlite3_exec(db->handle, "ROLLBACK TO archive_restore;", NULL, NULL, NULL);
+    }
+    if (sqlite3_exec(db->handle, "RELEASE archive_restore;", NULL, NULL, NULL) != SQLITE_OK) {
+        ok = 0;
+    }
+    contacts_invalidate_caches(db);
+    if (ok && own) {
+        sketch_refresh(db);
+    }
+    return ok;
+}
@@ -0,0 +1,257 @@
+// Purpose: Bounded in-process LRU cache of contact records. Author: GitHub Copilot
+#include "cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_FIELDS 6
+#define CACHE_MIN_BUCKETS 64
+
+typedef struct CacheEntry {
+    struct CacheEntry* prev;
+    struct CacheEntry* next;
+    struct CacheEntry* chain;
+    int64_t id;
+    double due_amount;
+    size_t size;
+    uint16_t len[CACHE_FIELDS];
+    char data[];
+} CacheEntry;
+
+struct ContactCache {
+    CacheEntry** buckets;
+    size_t bucket_count;
+    CacheEntry* head;
+    CacheEntry* tail;
+    size_t entries;
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+static size_t cache_bucket(const ContactCache* cache, int64_t id) {
+    uint64_t h = (uint64_t)id * 11400714819323198485ULL;
+    return (size_t)(h >> 32) & (cache->bucket_count - 1);
+}
+
+static void cache_unlink(ContactCache* cache, CacheEntry* e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        cache->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        cache->tail = e->prev;
+    }
+    e->prev = NULL;
+    e->next = NULL;
+}
+
+static void cache_push_front(ContactCache* cache, CacheEntry* e) {
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = e;
+    }
+    cache->head = e;
+    if (!cache->tail) {
+        cache->tail = e;
+    }
+}
+
+static CacheEntry* cache_find(const ContactCache* cache, int64_t id, CacheEntry*** link_out) {
+    CacheEntry** link = &cache->buckets[cache_bucket(cache, id)];
+    while (*link && (*link)->id != id) {
+        link = &(*link)->chain;
+    }
+    if (link_out) {
+        *link_out = link;
+    }
+    return *link;
+}
+
+static void cache_drop(ContactCache* cache, CacheEntry* e) {
+    CacheEntry** link = NULL;
+    cache_find(cache, e->id, &link);
+    *link = e->chain;
+    cache_unlink(cache, e);
+    cache->entries--;
+    cache->bytes -= e->size;
+    free(e);
+}
+
+static void cache_grow(ContactCache* cache) {
+    size_t count = cache->bucket_count * 2;
+    CacheEntry** buckets = (CacheEntry**)calloc(count, sizeof(CacheEntry*));
+    if (!buckets) {
+        return;
+    }
+    CacheEntry** old = cache->buckets;
+    size_t old_count = cache->bucket_count;
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+    for (size_t i = 0; i < old_count; ++i) {
+        CacheEntry* e = old[i];
+        while (e) {
+            CacheEntry* next = e->chain;
+            size_t b = cache_bucket(cache, e->id);
+            e->chain = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+ContactCache* cache_create(size_t max_bytes) {
+    if (max_bytes == 0) {
+        return NULL;
+    }
+    ContactCache* cache = (ContactCache*)calloc(1, sizeof(ContactCache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->bucket_count = CACHE_MIN_BUCKETS;
+    cache->buckets = (CacheEntry**)calloc(cache->bucket_count, sizeof(CacheEntry*));
+    if (!cache->buckets) {
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+void cache_destroy(ContactCache* cache) {
+    if (!cache) {
+        return;
+    }
+    cache_clear(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+int cache_get(ContactCache* cache, int64_t id, Contact* out) {
+    if (!cache || !out) {
+        return 0;
+    }
+    CacheEntry* e = cache_find(cache, id, NULL);
+    if (!e) {
+        cache->misses++;
+        return 0;
+    }
+    cache->hits++;
+    if (cache->head != e) {
+        cache_unlink(cache, e);
+        cache_push_front(cache, e);
+    }
+
+    char* dest[CACHE_FIELDS] = { out->name, out->phone, out->address, out->email, out->due_date, out->external_id };
+    const char* p = e->data;
+    for (int i = 0; i < CACHE_FIELDS; ++i) {
+        memcpy(dest[i], p, e->len[i]);
+        dest[i][e->len[i]] = '\0';
+        p += e->len[i];
+    }
+    out->id = e->id;
+    out->due_amount = e->due_amount;
+    return 1;
+}
+
+void cache_put(ContactCache* cache, const Contact* c) {
+    if (!cache || !c || c->id <= 0) {
+        return;
+    }
+    const char* src[CACHE_FIELDS] = { c->name, c->phone, c->address, c->email, c->due_date, c->external_id };
+    uint16_t len[CACHE_FIELDS];
+    size_t data_len = 0;
+    for (int i = 0; i < CACHE_FIELDS; ++i) {
+        len[i] = (uint16_t)strlen(src[i]);
+        data_len += len[i];
+    }
+    size_t size = sizeof(CacheEntry) + data_len;
+    if (size > cache->max_bytes) {
+        return;
+    }
+
+    CacheEntry* old = cache_find(cache, c->id, NULL);
+    if (old) {
+        cache_drop(cache, old);
+    }
+    while (cache->tail && cache->bytes + size > cache->max_bytes) {
+        cache_drop(cache, cache->tail);
+        cache->evictions++;
+    }
+
+    CacheEntry* e = (CacheEntry*)malloc(size);
+    if (!e) {
+        return;
+    }
+    e->id = c->id;
+    e->due_amount = c->due_amount;
+    e->size = size;
+    char* p = e->data;
+    for (int i = 0; i < CACHE_FIELDS; ++i) {
+        e->len[i] = len[i];
+        memcpy(p, src[i], len[i]);
+        p += len[i];
+    }
+
+    if (cache->entries >= cache->bucket_count) {
+        cache_grow(cache);
+    }
+    size_t b = cache_bucket(cache, e->id);
+    e->chain = cache->buckets[b];
+    cache->buckets[b] = e;
+    cache_push_front(cache, e);
+    cache->entries++;
+    cache->bytes += size;
+}
+
+void cache_remove(ContactCache* cache, int64_t id) {
+    if (!cache) {
+        return;
+    }
+    CacheEntry* e = cache_find(cache, id, NULL);
+    if (e) {
+        cache_drop(cache, e);
+    }
+}
+
+void cache_clear(ContactCache* cache) {
+    if (!cache) {
+        return;
+    }
+    CacheEntry* e = cache->head;
+    while (e) {
+        CacheEntry* next = e->next;
+        free(e);
+        e = next;
+    }
+    memset(cache->buckets, 0, cache->bucket_count * sizeof(CacheEntry*));
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->entries = 0;
+    cache->bytes = 0;
+}
+
+void cache_get_stats(const ContactCache* cache, ContactCacheStats* out) {
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if (!cache) {
+        return;
+    }
+    out->hits = cache->hits;
+    out->misses = cache->misses;
+    out->evictions = cache->evictions;
+    out->entries = cache->entries;
+    out->bytes = cache->bytes;
+    out->max_bytes = cache->max_bytes;
+}
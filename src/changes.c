@@ -0,0 +1,81 @@
+// Purpose: Change-data-capture log of contact mutations. Author: GitHub Copilot
+#include "changes.h"
+#include "util.h"
+
+#include <sqlite3.h>
+
+// contact_changes is filled by triggers on contacts (see db_init), so every writer logs its changes
+// inside its own transaction and bulk imports pay one extra row insert per contact.
+
+static const char* column_text(sqlite3_stmt* stmt, int col) {
+    const char* value = (const char*)sqlite3_column_text(stmt, col);
+    return value ? value : "";
+}
+
+static void print_change_json(FILE* out, sqlite3_stmt* stmt) {
+    fprintf(out, "{\"seq\":%lld,\"op\":", (long long)sqlite3_column_int64(stmt, 0));
+    util_print_json_string(out, column_text(stmt, 1));
+    fprintf(out, ",\"id\":%lld,\"changed_at\":", (long long)sqlite3_column_int64(stmt, 2));
+    util_print_json_string(out, column_text(stmt, 10));
+    fprintf(out, ",\"name\":");
+    util_print_json_string(out, column_text(stmt, 3));
+    fprintf(out, ",\"phone\":");
+    util_print_json_string(out, column_text(stmt, 4));
+    fprintf(out, ",\"address\":");
+    util_print_json_string(out, column_text(stmt, 5));
+    fprintf(out, ",\"email\":");
+    util_print_json_string(out, column_text(stmt, 6));
+    fprintf(out, ",\"due_amount\":%.15g,\"due_date\":", sqlite3_column_double(stmt, 7));
+    util_print_json_string(out, column_text(stmt, 8));
+    fprintf(out, ",\"external_id\":");
+    if (sqlite3_column_type(stmt, 9) == SQLITE_NULL) {
+        fprintf(out, "null");
+    }
+    else {
+        util_print_json_string(out, column_text(stmt, 9));
+    }
+    fprintf(out, "}");
+}
+
+int changes_print_since(Db* db, int64_t since, ChangesFormat format, FILE* out, int64_t* out_last) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    const char* sql = "SELECT seq, op, contact_id, name, phone, address, email, due_amount, due_date, external_id,"
+        " changed_at FROM contact_changes WHERE seq > ? ORDER BY seq;";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, since);
+    int64_t last = since;
+    int first = 1;
+    if (format == CHANGES_FORMAT_JSON) {
+        fprintf(out, "[");
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        last = sqlite3_column_int64(stmt, 0);
+        if (format == CHANGES_FORMAT_PLAIN) {
+            fprintf(out, "%lld\t%s\t%lld\t%s\t%s\n", (long long)last, column_text(stmt, 1),
+                (long long)sqlite3_column_int64(stmt, 2), column_text(stmt, 10), column_text(stmt, 3));
+            continue;
+        }
+        if (format == CHANGES_FORMAT_JSON && !first) {
+            fprintf(out, ",");
+        }
+        print_change_json(out, stmt);
+        if (format == CHANGES_FORMAT_NDJSON) {
+            fprintf(out, "\n");
+        }
+        first = 0;
+    }
+    if (format == CHANGES_FORMAT_JSON) {
+        fprintf(out, "]\n");
+    }
+    sqlite3_finalize(stmt);
+    if (out_last) {
+        *out_last = last;
+    }
+    return rc == SQLITE_DONE;
+}
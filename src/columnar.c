@@ -0,0 +1,598 @@
+// Purpose: Columnar binary snapshot export/import. Author: GitHub Copilot
+#include "columnar.h"
+#include "sketch.h"
+#include "util.h"
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Layout: magic, version and column count, then blocks of up to COLUMNAR_BLOCK_ROWS rows. A block
+// is its row count followed by one chunk per column (encoding byte, payload length, payload). A
+// zero row count ends the blocks; the footer holds the total row count, a CRC32 of every byte
+// before it and a closing magic. Fixed-width integers are little-endian, lengths are LEB128.
+#define COLUMNAR_MAGIC "CMCOLV01"
+#define COLUMNAR_END_MAGIC "CMCOLEND"
+#define COLUMNAR_MAGIC_LEN 8
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_DICT_SLOTS (COLUMNAR_BLOCK_ROWS * 2)
+#define COLUMNAR_MAX_CHUNK (64u * 1024u * 1024u)
+
+// Addresses and emails are split at their last ',' / '@' so the repetitive tails (city, domain)
+// get their own dictionary-friendly columns; the tail keeps the separator, so joining is lossless.
+enum {
+    COL_NAME,
+    COL_PHONE,
+    COL_STREET,
+    COL_CITY,
+    COL_EMAIL_LOCAL,
+    COL_EMAIL_DOMAIN,
+    COL_DUE_DATE,
+    COL_EXTERNAL_ID,
+    COL_STRINGS
+};
+
+enum {
+    ENC_PLAIN = 0,
+    ENC_DICT = 1,
+    ENC_F64 = 2
+};
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+} ByteBuf;
+
+typedef struct {
+    ByteBuf bytes;
+    uint32_t off[COLUMNAR_BLOCK_ROWS];
+    uint32_t len[COLUMNAR_BLOCK_ROWS];
+} StrColumn;
+
+typedef struct {
+    FILE* out;
+    uint32_t crc;
+    int ok;
+    size_t rows;
+    StrColumn cols[COL_STRINGS];
+    double amounts[COLUMNAR_BLOCK_ROWS];
+    ByteBuf plain;
+    ByteBuf dict;
+    int32_t slots[COLUMNAR_DICT_SLOTS];
+    uint32_t codes[COLUMNAR_BLOCK_ROWS];
+    uint32_t dict_rows[COLUMNAR_BLOCK_ROWS];
+} ColumnarWriter;
+
+typedef struct {
+    FILE* in;
+    uint32_t crc;
+    StrColumn cols[COL_STRINGS];
+    ByteBuf amounts;
+    const char* error;
+} ColumnarReader;
+
+static int buf_reserve(ByteBuf* b, size_t extra) {
+    if (b->len + extra <= b->cap) {
+        return 1;
+    }
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) {
+        cap *= 2;
+    }
+    unsigned char* data = (unsigned char*)realloc(b->data, cap);
+    if (!data) {
+        return 0;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 1;
+}
+
+static int buf_put(ByteBuf* b, const void* data, size_t len) {
+    if (!buf_reserve(b, len)) {
+        return 0;
+    }
+    if (len) {
+        memcpy(b->data + b->len, data, len);
+    }
+    b->len += len;
+    return 1;
+}
+
+static int buf_put_varint(ByteBuf* b, uint32_t v) {
+    unsigned char tmp[5];
+    size_t n = 0;
+    do {
+        unsigned char byte = (unsigned char)(v & 0x7F);
+        v >>= 7;
+        tmp[n++] = (unsigned char)(byte | (v ? 0x80 : 0));
+    } while (v);
+    return buf_put(b, tmp, n);
+}
+
+static int buf_get_varint(const ByteBuf* b, size_t* pos, uint32_t* out) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= b->len) {
+            return 0;
+        }
+        unsigned char byte = b->data[(*pos)++];
+        if (shift == 28 && (byte & 0x70)) {
+            return 0;
+        }
+        v |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void put_le32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint32_t get_le32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static uint64_t get_le64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static size_t split_at_last(const char* s, size_t len, char sep) {
+    for (size_t i = len; i > 0; --i) {
+        if (s[i - 1] == sep) {
+            return i - 1;
+        }
+    }
+    return len;
+}
+
+static const char* column_str(sqlite3_stmt* stmt, int col, size_t* len) {
+    const char* s = (const char*)sqlite3_column_text(stmt, col);
+    *len = s ? (size_t)sqlite3_column_bytes(stmt, col) : 0;
+    return s ? s : "";
+}
+
+static void writer_emit(ColumnarWriter* w, const void* data, size_t len) {
+    if (!w->ok || len == 0) {
+        return;
+    }
+    if (fwrite(data, 1, len, w->out) != len) {
+        w->ok = 0;
+        return;
+    }
+    w->crc = util_crc32(w->crc, data, len);
+}
+
+static void writer_chunk(ColumnarWriter* w, unsigned char enc, const ByteBuf* payload) {
+    unsigned char head[5];
+    head[0] = enc;
+    put_le32(head + 1, (uint32_t)payload->len);
+    writer_emit(w, head, sizeof(head));
+    writer_emit(w, payload->data, payload->len);
+}
+
+static void writer_append(ColumnarWriter* w, int col, const char* s, size_t len) {
+    StrColumn* c = &w->cols[col];
+    c->off[w->rows] = (uint32_t)c->bytes.len;
+    c->len[w->rows] = (uint32_t)len;
+    if (!buf_put(&c->bytes, s, len)) {
+        w->ok = 0;
+    }
+}
+
+// Builds both encodings for the block and keeps whichever is smaller.
+static void writer_encode_strings(ColumnarWriter* w, const StrColumn* col) {
+    ByteBuf* plain = &w->plain;
+    ByteBuf* dict = &w->dict;
+    plain->len = 0;
+    dict->len = 0;
+    int ok = 1;
+    for (size_t r = 0; r < w->rows && ok; ++r) {
+        ok = buf_put_varint(plain, col->len[r]) && buf_put(plain, col->bytes.data + col->off[r], col->len[r]);
+    }
+
+    memset(w->slots, 0xFF, sizeof(w->slots));
+    uint32_t dict_count = 0;
+    for (size_t r = 0; r < w->rows; ++r) {
+        const unsigned char* s = col->bytes.data + col->off[r];
+        uint32_t len = col->len[r];
+        size_t slot = (size_t)util_fnv1a64(UTIL_FNV64_INIT, s, len) & (COLUMNAR_DICT_SLOTS - 1);
+        while (w->slots[slot] >= 0) {
+            uint32_t other = w->dict_rows[w->slots[slot]];
+            if (col->len[other] == len && memcmp(col->bytes.data + col->off[other], s, len) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (COLUMNAR_DICT_SLOTS - 1);
+        }
+        if (w->slots[slot] < 0) {
+            w->slots[slot] = (int32_t)dict_count;
+            w->dict_rows[dict_count++] = (uint32_t)r;
+        }
+        w->codes[r] = (uint32_t)w->slots[slot];
+    }
+    ok = ok && buf_put_varint(dict, dict_count);
+    for (uint32_t d = 0; d < dict_count && ok; ++d) {
+        uint32_t r = w->dict_rows[d];
+        ok = buf_put_varint(dict, col->len[r]) && buf_put(dict, col->bytes.data + col->off[r], col->len[r]);
+    }
+    for (size_t r = 0; r < w->rows && ok; ++r) {
+        ok = buf_put_varint(dict, w->codes[r]);
+    }
+    if (!ok) {
+        w->ok = 0;
+        return;
+    }
+    if (dict->len < plain->len) {
+        writer_chunk(w, ENC_DICT, dict);
+    }
+    else {
+        writer_chunk(w, ENC_PLAIN, plain);
+    }
+}
+
+static void writer_flush_block(ColumnarWriter* w) {
+    if (w->rows == 0 || !w->ok) {
+        return;
+    }
+    unsigned char head[4];
+    put_le32(head, (uint32_t)w->rows);
+    writer_emit(w, head, sizeof(head));
+    for (int c = 0; c < COL_STRINGS; ++c) {
+        writer_encode_strings(w, &w->cols[c]);
+        w->cols[c].bytes.len = 0;
+    }
+    w->plain.len = 0;
+    if (!buf_reserve(&w->plain, w->rows * 8)) {
+        w->ok = 0;
+        return;
+    }
+    for (size_t r = 0; r < w->rows; ++r) {
+        uint64_t bits;
+        memcpy(&bits, &w->amounts[r], sizeof(bits));
+        put_le64(w->plain.data + r * 8, bits);
+    }
+    w->plain.len = w->rows * 8;
+    writer_chunk(w, ENC_F64, &w->plain);
+    w->rows = 0;
+}
+
+int columnar_write_contacts(Db* db, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    // A snapshot is a copy of the book, so it never leaves the archive tier out silently.
+    sqlite3_stmt* stmt = NULL;
+    if (!db->include_archived &&
+        sqlite3_prepare_v2(db->handle, "SELECT COUNT(*) FROM contacts_archive;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) > 0) {
+        util_error("%lld archived contacts would be left out of the snapshot; include the archive tier.",
+            (long long)sqlite3_column_int64(stmt, 0));
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    sqlite3_finalize(stmt);
+    char* sql = sqlite3_mprintf("SELECT name, phone, address, email, due_amount, due_date, external_id FROM %s"
+        " ORDER BY name COLLATE NOCASE;", db_contacts_source(db));
+    stmt = NULL;
+    int prepared = sql && sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) == SQLITE_OK;
+    sqlite3_free(sql);
+    if (!prepared) {
+        return 0;
+    }
+    ColumnarWriter* w = (ColumnarWriter*)calloc(1, sizeof(ColumnarWriter));
+    if (!w) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    w->out = out;
+    w->ok = 1;
+    for (int c = 0; c < COL_STRINGS; ++c) {
+        w->ok = w->ok && buf_reserve(&w->cols[c].bytes, 4096);
+    }
+
+    unsigned char header[COLUMNAR_MAGIC_LEN + 8];
+    memcpy(header, COLUMNAR_MAGIC, COLUMNAR_MAGIC_LEN);
+    put_le32(header + COLUMNAR_MAGIC_LEN, COLUMNAR_VERSION);
+    put_le32(header + COLUMNAR_MAGIC_LEN + 4, COL_STRINGS + 1);
+    writer_emit(w, header, sizeof(header));
+
+    uint64_t total = 0;
+    int rc = SQLITE_DONE;
+    while (w->ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        size_t len = 0;
+        const char* s = column_str(stmt, 0, &len);
+        writer_append(w, COL_NAME, s, len);
+        s = column_str(stmt, 1, &len);
+        writer_append(w, COL_PHONE, s, len);
+        s = column_str(stmt, 2, &len);
+        size_t cut = split_at_last(s, len, ',');
+        writer_append(w, COL_STREET, s, cut);
+        writer_append(w, COL_CITY, s + cut, len - cut);
+        s = column_str(stmt, 3, &len);
+        cut = split_at_last(s, len, '@');
+        writer_append(w, COL_EMAIL_LOCAL, s, cut);
+        writer_append(w, COL_EMAIL_DOMAIN, s + cut, len - cut);
+        s = column_str(stmt, 5, &len);
+        writer_append(w, COL_DUE_DATE, s, len);
+        s = column_str(stmt, 6, &len);
+        writer_append(w, COL_EXTERNAL_ID, s, len);
+        w->amounts[w->rows] = sqlite3_column_double(stmt, 4);
+        total++;
+        if (++w->rows == COLUMNAR_BLOCK_ROWS) {
+            writer_flush_block(w);
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        w->ok = 0;
+    }
+    writer_flush_block(w);
+
+    unsigned char footer[12];
+    put_le32(footer, 0);
+    put_le64(footer + 4, total);
+    writer_emit(w, footer, sizeof(footer));
+    unsigned char tail[4 + COLUMNAR_MAGIC_LEN];
+    put_le32(tail, w->crc);
+    memcpy(tail + 4, COLUMNAR_END_MAGIC, COLUMNAR_MAGIC_LEN);
+    int ok = w->ok && fwrite(tail, 1, sizeof(tail), out) == sizeof(tail) && fflush(out) == 0;
+
+    for (int c = 0; c < COL_STRINGS; ++c) {
+        free(w->cols[c].bytes.data);
+    }
+    free(w->plain.data);
+    free(w->dict.data);
+    free(w);
+    return ok;
+}
+
+static int reader_take(ColumnarReader* r, void* dest, size_t len) {
+    if (len && fread(dest, 1, len, r->in) != len) {
+        return 0;
+    }
+    r->crc = util_crc32(r->crc, dest, len);
+    return 1;
+}
+
+static int reader_chunk(ColumnarReader* r, ByteBuf* dest, unsigned char* enc) {
+    unsigned char head[5];
+    if (!reader_take(r, head, sizeof(head))) {
+        return 0;
+    }
+    *enc = head[0];
+    uint32_t len = get_le32(head + 1);
+    if (len > COLUMNAR_MAX_CHUNK) {
+        return 0;
+    }
+    dest->len = 0;
+    if (!buf_reserve(dest, len ? len : 1) || !reader_take(r, dest->data, len)) {
+        return 0;
+    }
+    dest->len = len;
+    return 1;
+}
+
+static int reader_decode_strings(StrColumn* col, unsigned char enc, size_t rows) {
+    const ByteBuf* b = &col->bytes;
+    size_t pos = 0;
+    uint32_t len = 0;
+    if (enc == ENC_PLAIN) {
+        for (size_t r = 0; r < rows; ++r) {
+            if (!buf_get_varint(b, &pos, &len) || len > b->len - pos) {
+                return 0;
+            }
+            col->off[r] = (uint32_t)pos;
+            col->len[r] = len;
+            pos += len;
+        }
+        return pos == b->len;
+    }
+    if (enc != ENC_DICT) {
+        return 0;
+    }
+    uint32_t dict_count = 0;
+    if (!buf_get_varint(b, &pos, &dict_count) || dict_count == 0 || dict_count > rows) {
+        return 0;
+    }
+    uint32_t dict_off[COLUMNAR_BLOCK_ROWS];
+    uint32_t dict_len[COLUMNAR_BLOCK_ROWS];
+    for (uint32_t d = 0; d < dict_count; ++d) {
+        if (!buf_get_varint(b, &pos, &len) || len > b->len - pos) {
+            return 0;
+        }
+        dict_off[d] = (uint32_t)pos;
+        dict_len[d] = len;
+        pos += len;
+    }
+    for (size_t r = 0; r < rows; ++r) {
+        uint32_t code = 0;
+        if (!buf_get_varint(b, &pos, &code) || code >= dict_count) {
+            return 0;
+        }
+        col->off[r] = dict_off[code];
+        col->len[r] = dict_len[code];
+    }
+    return pos == b->len;
+}
+
+static size_t slice_append(char* dest, size_t cap, size_t used, const StrColumn* col, size_t row) {
+    size_t len = col->len[row];
+    if (used + len >= cap) {
+        len = cap - 1 - used;
+    }
+    memcpy(dest + used, col->bytes.data + col->off[row], len);
+    dest[used + len] = '\0';
+    return used + len;
+}
+
+static void reader_row_to_contact(const ColumnarReader* r, size_t row, Contact* c) {
+    memset(c, 0, sizeof(*c));
+    slice_append(c->name, sizeof(c->name), 0, &r->cols[COL_NAME], row);
+    slice_append(c->phone, sizeof(c->phone), 0, &r->cols[COL_PHONE], row);
+    size_t used = slice_append(c->address, sizeof(c->address), 0, &r->cols[COL_STREET], row);
+    slice_append(c->address, sizeof(c->address), used, &r->cols[COL_CITY], row);
+    used = slice_append(c->email, sizeof(c->email), 0, &r->cols[COL_EMAIL_LOCAL], row);
+    slice_append(c->email, sizeof(c->email), used, &r->cols[COL_EMAIL_DOMAIN], row);
+    slice_append(c->due_date, sizeof(c->due_date), 0, &r->cols[COL_DUE_DATE], row);
+    slice_append(c->external_id, sizeof(c->external_id), 0, &r->cols[COL_EXTERNAL_ID], row);
+    uint64_t bits = get_le64(r->amounts.data + row * 8);
+    memcpy(&c->due_amount, &bits, sizeof(bits));
+}
+
+static int reader_insert(sqlite3_stmt* stmt, const Contact* c) {
+    sqlite3_bind_text(stmt, 1, c->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, c->phone, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, c->address, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, c->email, -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 5, c->due_amount);
+    sqlite3_bind_text(stmt, 6, c->due_date, -1, SQLITE_STATIC);
+    if (c->external_id[0]) {
+        sqlite3_bind_text(stmt, 7, c->external_id, -1, SQLITE_STATIC);
+    }
+    else {
+        sqlite3_bind_null(stmt, 7);
+    }
+    sqlite3_bind_int64(stmt, 8, contacts_row_hash(c));
+    contacts_bind_due_day(stmt, 9, c->due_date);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Returns the number of rows read, or -1 when the stream is malformed or an insert fails.
+static int64_t reader_run(ColumnarReader* r, sqlite3_stmt* insert) {
+    unsigned char header[COLUMNAR_MAGIC_LEN + 8];
+    if (!reader_take(r, header, sizeof(header)) || memcmp(header, COLUMNAR_MAGIC, COLUMNAR_MAGIC_LEN) != 0 ||
+        get_le32(header + COLUMNAR_MAGIC_LEN) != COLUMNAR_VERSION ||
+        get_le32(header + COLUMNAR_MAGIC_LEN + 4) != COL_STRINGS + 1) {
+        r->error = "Not a columnar contacts snapshot.";
+        return -1;
+    }
+
+    int64_t total = 0;
+    for (;;) {
+        unsigned char head[4];
+        if (!reader_take(r, head, sizeof(head))) {
+            return -1;
+        }
+        size_t rows = get_le32(head);
+        if (rows == 0) {
+            break;
+        }
+        if (rows > COLUMNAR_BLOCK_ROWS) {
+            return -1;
+        }
+        unsigned char enc = 0;
+        for (int c = 0; c < COL_STRINGS; ++c) {
+            if (!reader_chunk(r, &r->cols[c].bytes, &enc) || !reader_decode_strings(&r->cols[c], enc, rows)) {
+                return -1;
+            }
+        }
+        if (!reader_chunk(r, &r->amounts, &enc) || enc != ENC_F64 || r->amounts.len != rows * 8) {
+            return -1;
+        }
+        for (size_t row = 0; row < rows; ++row) {
+            Contact c;
+            reader_row_to_contact(r, row, &c);
+            if (!c.name[0]) {
+                return -1;
+            }
+            if (insert && !reader_insert(insert, &c)) {
+                r->error = "Failed to insert a contact from the snapshot; nothing was imported.";
+                return -1;
+            }
+        }
+        total += (int64_t)rows;
+    }
+
+    unsigned char count[8];
+    if (!reader_take(r, count, sizeof(count))) {
+        return -1;
+    }
+    uint32_t expected = r->crc;
+    unsigned char tail[4 + COLUMNAR_MAGIC_LEN];
+    if (fread(tail, 1, sizeof(tail), r->in) != sizeof(tail) ||
+        memcmp(tail + 4, COLUMNAR_END_MAGIC, COLUMNAR_MAGIC_LEN) != 0 ||
+        get_le64(count) != (uint64_t)total) {
+        return -1;
+    }
+    if (get_le32(tail) != expected) {
+        r->error = "Columnar snapshot checksum mismatch; nothing was imported.";
+        return -1;
+    }
+    return total;
+}
+
+int columnar_import_contacts(Db* db, FILE* in, int dry_run, int* out_imported) {
+    if (!db || !db->handle || !in) {
+        return 0;
+    }
+    ColumnarReader* r = (ColumnarReader*)calloc(1, sizeof(ColumnarReader));
+    if (!r) {
+        return 0;
+    }
+    r->in = in;
+
+    sqlite3_stmt* insert = NULL;
+    int ok = 1;
+    if (!dry_run) {
+        const char* sql =
+            "INSERT INTO contacts(name, phone, address, email, due_amount, due_date, external_id, row_hash, due_day)"
+            " VALUES(?,?,?,?,?,?,?,?,?);";
+        ok = sqlite3_prepare_v2(db->handle, sql, -1, &insert, NULL) == SQLITE_OK;
+        if (ok) {
+            contacts_invalidate_caches(db);
+            ok = db_begin(db);
+        }
+    }
+
+    int64_t imported = ok ? reader_run(r, insert) : -1;
+    sqlite3_finalize(insert);
+    if (ok && imported < 0) {
+        util_error("%s", r->error ? r->error : "Columnar snapshot is truncated or corrupt; nothing was imported.");
+        ok = 0;
+    }
+    if (!dry_run && insert) {
+        if (ok && !db_commit(db)) {
+            ok = 0;
+        }
+        if (!ok) {
+            db_rollback(db);
+        }
+        contacts_invalidate_caches(db);
+        if (ok) {
+            sketch_refresh(db);
+        }
+    }
+
+    for (int c = 0; c < COL_STRINGS; ++c) {
+        free(r->cols[c].bytes.data);
+    }
+    free(r->amounts.data);
+    free(r);
+    if (ok && out_imported) {
+        *out_imported = (int)imported;
+    }
+    return ok;
+}
@@ -1,29 +1,203 @@
 // Purpose: Contact data model and business logic. Author: GitHub Copilot
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "contacts.h"
+#include "cache.h"
+#include "fuzzy_index.h"
+#include "name_index.h"
+#include "query.h"
+#include "sketch.h"
+#include "tags.h"
 #include "util.h"
 
 #include <ctype.h>
+#include <limits.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 static const char* default_sort_mode = "name";
 
-static const char* sort_clause_for_mode(const char* mode) {
-    if (!mode) {
-        return "ORDER BY name COLLATE NOCASE";
+static ContactSort sort_for_mode(const char* mode) {
+    if (mode && strcmp(mode, "phone") == 0) {
+        return CONTACT_SORT_PHONE;
+    }
+    if (mode && strcmp(mode, "due_date") == 0) {
+        return CONTACT_SORT_DUE_DATE;
+    }
+    return CONTACT_SORT_NAME;
+}
+
+static void bind_external_id(sqlite3_stmt* stmt, int idx, const char* external_id) {
+    if (external_id && external_id[0]) {
+        sqlite3_bind_text(stmt, idx, external_id, -1, SQLITE_TRANSIENT);
+    }
+    else {
+        sqlite3_bind_null(stmt, idx);
+    }
+}
+
+static void copy_column_text(char* dest, size_t dest_len, sqlite3_stmt* stmt, int col) {
+    const unsigned char* v = sqlite3_column_text(stmt, col);
+    snprintf(dest, dest_len, "%s", v ? (const char*)v : "");
+}
+
+int64_t contacts_row_hash(const Contact* c) {
+    if (!c) {
+        return 0;
+    }
+    const char* fields[] = { c->name, c->phone, c->address, c->email, c->due_date };
+    uint64_t h = UTIL_FNV64_INIT;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        h = util_fnv1a64(h, fields[i], strlen(fields[i]));
+        h = util_fnv1a64(h, "\x1f", 1);
+    }
+    double amount = c->due_amount == 0.0 ? 0.0 : c->due_amount;
+    h = util_fnv1a64(h, &amount, sizeof(amount));
+    return (int64_t)h;
+}
+
+static int fetch_name(Db* db, int64_t id, char* name, size_t name_len) {
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT name FROM contacts WHERE id=?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, id);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        copy_column_text(name, name_len, stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static void drop_name_indexes(Db* db) {
+    name_index_destroy(db->name_index);
+    db->name_index = NULL;
+    fuzzy_index_destroy(db->fuzzy_index);
+    db->fuzzy_index = NULL;
+}
+
+// Applies one row change to the loaded name indexes; on any mismatch an index is dropped and reloaded lazily.
+static void name_indexes_note(Db* db, int64_t id, const char* old_name, const char* new_name) {
+    if (db->name_index) {
+        int ok = 1;
+        if (old_name) {
+            ok = name_index_remove(db->name_index, old_name, id);
+        }
+        if (ok && new_name) {
+            ok = name_index_insert(db->name_index, new_name, id);
+        }
+        if (!ok) {
+            name_index_destroy(db->name_index);
+            db->name_index = NULL;
+        }
+    }
+    if (db->fuzzy_index) {
+        int ok = 1;
+        if (old_name) {
+            ok = fuzzy_index_remove(db->fuzzy_index, old_name, id);
+        }
+        if (ok && new_name) {
+            ok = fuzzy_index_add(db->fuzzy_index, new_name, id);
+        }
+        if (!ok) {
+            fuzzy_index_destroy(db->fuzzy_index);
+            db->fuzzy_index = NULL;
+        }
+    }
+}
+
+static NameIndex* load_name_index(Db* db) {
+    if (db->name_index) {
+        return db->name_index;
+    }
+    NameIndex* index = name_index_create();
+    sqlite3_stmt* stmt = NULL;
+    if (!index || sqlite3_prepare_v2(db->handle, "SELECT id, name FROM contacts;", -1, &stmt, NULL) != SQLITE_OK) {
+        name_index_destroy(index);
+        return NULL;
+    }
+    int ok = 1;
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        ok = name_index_append(index, name ? (const char*)name : "", sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    if (!ok || rc != SQLITE_DONE || !name_index_build(index)) {
+        name_index_destroy(index);
+        return NULL;
+    }
+    db->name_index = index;
+    return index;
+}
+
+static FuzzyIndex* load_fuzzy_index(Db* db) {
+    if (db->fuzzy_index) {
+        return db->fuzzy_index;
     }
-    if (strcmp(mode, "name") == 0) {
-        return "ORDER BY name COLLATE NOCASE";
+    FuzzyIndex* index = fuzzy_index_create();
+    sqlite3_stmt* stmt = NULL;
+    if (!index || sqlite3_prepare_v2(db->handle, "SELECT id, name FROM contacts;", -1, &stmt, NULL) != SQLITE_OK) {
+        fuzzy_index_destroy(index);
+        return NULL;
     }
-    if (strcmp(mode, "phone") == 0) {
-        return "ORDER BY phone COLLATE NOCASE";
+    int ok = 1;
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        ok = fuzzy_index_add(index, name ? (const char*)name : "", sqlite3_column_int64(stmt, 0));
     }
-    if (strcmp(mode, "due_date") == 0) {
-        return "ORDER BY due_date COLLATE NOCASE";
+    sqlite3_finalize(stmt);
+    if (!ok || rc != SQLITE_DONE) {
+        fuzzy_index_destroy(index);
+        return NULL;
     }
-    return "ORDER BY name COLLATE NOCASE";
+    db->fuzzy_index = index;
+    return index;
+}
+
+void contacts_bind_due_day(sqlite3_stmt* stmt, int index, const char* due_date) {
+    int64_t day = 0;
+    if (due_date && due_date[0] && util_epoch_day(due_date, &day)) {
+        sqlite3_bind_int64(stmt, index, day);
+    }
+    else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+// A single-row write outside any transaction runs in its own, so the stored sketch takes the change
+// before COMMIT. Inside a caller's transaction the caller refreshes the sketch once it commits.
+static int mutation_begin(Db* db, int* own) {
+    util_clear_error();
+    *own = sqlite3_get_autocommit(db->handle);
+    return !*own || sqlite3_exec(db->handle, "BEGIN IMMEDIATE;", NULL, NULL, NULL) == SQLITE_OK;
+}
+
+static int mutation_end(Db* db, int own, int ok) {
+    if (!own) {
+        return ok;
+    }
+    if (ok && sketch_apply_pending(db) && sqlite3_exec(db->handle, "COMMIT;", NULL, NULL, NULL) == SQLITE_OK) {
+        return 1;
+    }
+    // ROLLBACK clears the connection's error, so its message is kept unless the write reported one.
+    if (!util_last_error()[0]) {
+        util_error("SQLite error: %s", sqlite3_errmsg(db->handle));
+    }
+    sqlite3_exec(db->handle, "ROLLBACK;", NULL, NULL, NULL);
+    return 0;
 }
 
 int contacts_add(Db* db, const Contact* c, int64_t* out_id) {
@@ -31,8 +205,8 @@ int contacts_add(Db* db, const Contact* c, int64_t* out_id) {
         return 0;
     }
     const char* sql =
-        "INSERT INTO contacts(name, phone, address, email, due_amount, due_date)"
-        " VALUES(?,?,?,?,?,?);";
+        "INSERT INTO contacts(name, phone, address, email, due_amount, due_date, external_id, row_hash, due_day)"
+        " VALUES(?,?,?,?,?,?,?,?,?);";
     sqlite3_stmt* stmt = NULL;
     if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
@@ -43,23 +217,36 @@ int contacts_add(Db* db, const Contact* c, int64_t* out_id) {
     sqlite3_bind_text(stmt, 4, c->email, -1, SQLITE_TRANSIENT);
     sqlite3_bind_double(stmt, 5, c->due_amount);
     sqlite3_bind_text(stmt, 6, c->due_date, -1, SQLITE_TRANSIENT);
+    bind_external_id(stmt, 7, c->external_id);
+    sqlite3_bind_int64(stmt, 8, contacts_row_hash(c));
+    contacts_bind_due_day(stmt, 9, c->due_date);
+    int own = 0;
+    if (!mutation_begin(db, &own)) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
     int rc = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
-    if (rc != SQLITE_DONE) {
+    int64_t id = (int64_t)sqlite3_last_insert_rowid(db->handle);
+    if (!mutation_end(db, own, rc == SQLITE_DONE)) {
         return 0;
     }
+    name_indexes_note(db, id, NULL, c->name);
     if (out_id) {
-        *out_id = (int64_t)sqlite3_last_insert_rowid(db->handle);
+        *out_id = id;
     }
     return 1;
 }
 
-int contacts_update(Db* db, const Contact* c) {
+int contacts_update(Db* db, const Contact* c, int* out_changed) {
     if (!db || !db->handle || !c || c->id <= 0) {
         return 0;
     }
     const char* sql =
-        "UPDATE contacts SET name=?, phone=?, address=?, email=?, due_amount=?, due_date=? WHERE id=?;";
+        "UPDATE contacts SET name=?, phone=?, address=?, email=?, due_amount=?, due_date=?,"
+        " external_id=?, row_hash=?, due_day=? WHERE id=?;";
+    char old_name[CONTACT_NAME_MAX] = { 0 };
+    int indexed = (db->name_index || db->fuzzy_index) && fetch_name(db, c->id, old_name, sizeof(old_name));
     sqlite3_stmt* stmt = NULL;
     if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
@@ -70,33 +257,97 @@ int contacts_update(Db* db, const Contact* c) {
     sqlite3_bind_text(stmt, 4, c->email, -1, SQLITE_TRANSIENT);
     sqlite3_bind_double(stmt, 5, c->due_amount);
     sqlite3_bind_text(stmt, 6, c->due_date, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 7, c->id);
+    bind_external_id(stmt, 7, c->external_id);
+    sqlite3_bind_int64(stmt, 8, contacts_row_hash(c));
+    contacts_bind_due_day(stmt, 9, c->due_date);
+    sqlite3_bind_int64(stmt, 10, c->id);
+    int own = 0;
+    if (!mutation_begin(db, &own)) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
     int rc = sqlite3_step(stmt);
+    int changed = sqlite3_changes(db->handle) > 0;
     sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE;
+    cache_remove(db->cache, c->id);
+    if (!mutation_end(db, own, rc == SQLITE_DONE)) {
+        return 0;
+    }
+    if (indexed) {
+        name_indexes_note(db, c->id, old_name, c->name);
+    }
+    if (out_changed) {
+        *out_changed = changed;
+    }
+    return 1;
 }
 
-int contacts_delete(Db* db, int64_t id) {
+int contacts_delete(Db* db, int64_t id, int* out_changed) {
     if (!db || !db->handle || id <= 0) {
         return 0;
     }
     const char* sql = "DELETE FROM contacts WHERE id=?;";
+    char old_name[CONTACT_NAME_MAX] = { 0 };
+    int indexed = (db->name_index || db->fuzzy_index) && fetch_name(db, id, old_name, sizeof(old_name));
     sqlite3_stmt* stmt = NULL;
     if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
     }
     sqlite3_bind_int64(stmt, 1, id);
+    int own = 0;
+    if (!mutation_begin(db, &own)) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
     int rc = sqlite3_step(stmt);
+    int changed = sqlite3_changes(db->handle) > 0;
     sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE;
+    cache_remove(db->cache, id);
+    if (rc == SQLITE_CONSTRAINT) {
+        util_error("Contact %lld has ledger entries and cannot be deleted.", (long long)id);
+    }
+    if (!mutation_end(db, own, rc == SQLITE_DONE)) {
+        return 0;
+    }
+    if (indexed && changed) {
+        name_indexes_note(db, id, old_name, NULL);
+    }
+    // Deleting a contact removes its tag rows too.
+    tags_invalidate(db);
+    if (out_changed) {
+        *out_changed = changed;
+    }
+    return 1;
+}
+
+int contacts_delete_all(Db* db) {
+    if (!db || !db->handle) {
+        return 0;
+    }
+    char* err = NULL;
+    // The whole book goes, ledger history included; checkpoints first so the ledger triggers have nothing to shift.
+    int rc = sqlite3_exec(db->handle,
+        "DELETE FROM ledger_checkpoints; DELETE FROM ledger; DELETE FROM contacts; DELETE FROM contacts_archive;", NULL,
+        NULL, &err);
+    contacts_invalidate_caches(db);
+    if (rc != SQLITE_OK) {
+        util_error("SQLite error: %s", err ? err : "unknown");
+        sqlite3_free(err);
+        return 0;
+    }
+    sketch_refresh(db);
+    return 1;
 }
 
 int contacts_get_by_id(Db* db, int64_t id, Contact* out) {
     if (!db || !db->handle || !out || id <= 0) {
         return 0;
     }
+    if (cache_get(db->cache, id, out)) {
+        return 1;
+    }
     const char* sql =
-        "SELECT id, name, phone, address, email, due_amount, due_date FROM contacts WHERE id=?;";
+        "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM contacts WHERE id=?;";
     sqlite3_stmt* stmt = NULL;
     if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
@@ -111,7 +362,9 @@ int contacts_get_by_id(Db* db, int64_t id, Contact* out) {
         snprintf(out->email, sizeof(out->email), "%s", (const char*)sqlite3_column_text(stmt, 4));
         out->due_amount = sqlite3_column_double(stmt, 5);
         snprintf(out->due_date, sizeof(out->due_date), "%s", (const char*)sqlite3_column_text(stmt, 6));
+        copy_column_text(out->external_id, sizeof(out->external_id), stmt, 7);
         sqlite3_finalize(stmt);
+        cache_put(db->cache, out);
         return 1;
     }
     sqlite3_finalize(stmt);
@@ -138,31 +391,46 @@ static void print_due_notice(FILE* out, const char* due_date) {
     }
 }
 
-static void print_contact_plain(FILE* out, const Contact* c) {
+static void print_contact_plain(FILE* out, const ContactView* c, const char* tenant) {
     fprintf(out, "\tID\t: %lld\n", (long long)c->id);
-    fprintf(out, "\t\t\tName      : %s\n", c->name);
-    fprintf(out, "\t\t\tPhone     : %s\n", c->phone);
-    fprintf(out, "\t\t\tAddress   : %s\n", c->address);
-    fprintf(out, "\t\t\tEmail     : %s\n", c->email);
+    if (tenant) {
+        fprintf(out, "\t\t\tTenant    : %s\n", tenant);
+    }
+    fprintf(out, "\t\t\tName      : %.*s\n", (int)c->name.len, c->name.ptr);
+    fprintf(out, "\t\t\tPhone     : %.*s\n", (int)c->phone.len, c->phone.ptr);
+    fprintf(out, "\t\t\tAddress   : %.*s\n", (int)c->address.len, c->address.ptr);
+    fprintf(out, "\t\t\tEmail     : %.*s\n", (int)c->email.len, c->email.ptr);
     fprintf(out, "\t\t\tDue Amt   : %.2f\n", c->due_amount);
-    fprintf(out, "\t\t\tDue Date  : %s\n", c->due_date);
-    print_due_notice(out, c->due_date);
+    fprintf(out, "\t\t\tDue Date  : %.*s\n", (int)c->due_date.len, c->due_date.ptr);
+    if (c->external_id.len) {
+        fprintf(out, "\t\t\tExt ID    : %.*s\n", (int)c->external_id.len, c->external_id.ptr);
+    }
+    print_due_notice(out, c->due_date.ptr);
 }
 
-static void print_contact_json(FILE* out, const Contact* c, int trailing_comma) {
+static void print_contact_json(FILE* out, const ContactView* c, const char* tenant, int trailing_comma) {
     fprintf(out, "{");
     fprintf(out, "\"id\":%lld,", (long long)c->id);
+    if (tenant) {
+        fprintf(out, "\"tenant\":");
+        util_print_json_string(out, tenant);
+        fprintf(out, ",");
+    }
     fprintf(out, "\"name\":");
-    util_print_json_string(out, c->name);
+    util_print_json_string(out, c->name.ptr);
     fprintf(out, ",\"phone\":");
-    util_print_json_string(out, c->phone);
+    util_print_json_string(out, c->phone.ptr);
     fprintf(out, ",\"address\":");
-    util_print_json_string(out, c->address);
+    util_print_json_string(out, c->address.ptr);
     fprintf(out, ",\"email\":");
-    util_print_json_string(out, c->email);
+    util_print_json_string(out, c->email.ptr);
     fprintf(out, ",\"due_amount\":%.2f,", c->due_amount);
     fprintf(out, "\"due_date\":");
-    util_print_json_string(out, c->due_date);
+    util_print_json_string(out, c->due_date.ptr);
+    if (c->external_id.len) {
+        fprintf(out, ",\"external_id\":");
+        util_print_json_string(out, c->external_id.ptr);
+    }
     fprintf(out, "}%s", trailing_comma ? "," : "");
 }
 
@@ -175,98 +443,543 @@ static void print_today(FILE* out) {
     fprintf(out, "\nToday is %s\n\n", today);
 }
 
-static int list_query(Db* db, const char* where_clause, const char* param, int json, FILE* out, int show_today) {
-    char sort_mode[32] = { 0 };
-    if (!contacts_get_sort_mode(db, sort_mode, sizeof(sort_mode))) {
-        snprintf(sort_mode, sizeof(sort_mode), "%s", default_sort_mode);
+static void view_field(sqlite3_stmt* stmt, int col, ContactField* out) {
+    // sqlite3_column_bytes must follow sqlite3_column_text so it measures the converted text.
+    const unsigned char* v = sqlite3_column_text(stmt, col);
+    out->ptr = v ? (const char*)v : "";
+    out->len = v ? (size_t)sqlite3_column_bytes(stmt, col) : 0;
+}
+
+static void view_text(const char* s, ContactField* out) {
+    out->ptr = s;
+    out->len = strlen(s);
+}
+
+static void copy_field(char* dest, size_t dest_len, const ContactField* f) {
+    size_t n = f->len < dest_len - 1 ? f->len : dest_len - 1;
+    memcpy(dest, f->ptr, n);
+    dest[n] = '\0';
+}
+
+void contacts_view_row(sqlite3_stmt* stmt, ContactView* out) {
+    out->id = sqlite3_column_int64(stmt, 0);
+    view_field(stmt, 1, &out->name);
+    view_field(stmt, 2, &out->phone);
+    view_field(stmt, 3, &out->address);
+    view_field(stmt, 4, &out->email);
+    out->due_amount = sqlite3_column_double(stmt, 5);
+    view_field(stmt, 6, &out->due_date);
+    view_field(stmt, 7, &out->external_id);
+}
+
+void contacts_view_of(const Contact* c, ContactView* out) {
+    out->id = c->id;
+    view_text(c->name, &out->name);
+    view_text(c->phone, &out->phone);
+    view_text(c->address, &out->address);
+    view_text(c->email, &out->email);
+    out->due_amount = c->due_amount;
+    view_text(c->due_date, &out->due_date);
+    view_text(c->external_id, &out->external_id);
+}
+
+void contacts_view_copy(const ContactView* view, Contact* out) {
+    out->id = view->id;
+    copy_field(out->name, sizeof(out->name), &view->name);
+    copy_field(out->phone, sizeof(out->phone), &view->phone);
+    copy_field(out->address, sizeof(out->address), &view->address);
+    copy_field(out->email, sizeof(out->email), &view->email);
+    out->due_amount = view->due_amount;
+    copy_field(out->due_date, sizeof(out->due_date), &view->due_date);
+    copy_field(out->external_id, sizeof(out->external_id), &view->external_id);
+}
+
+void contacts_print(FILE* out, const ContactView* c, const char* tenant, int json) {
+    if (json) {
+        print_contact_json(out, c, tenant, 0);
     }
-    char sql[512];
-    snprintf(sql, sizeof(sql),
-        "SELECT id, name, phone, address, email, due_amount, due_date FROM contacts %s %s;",
-        where_clause ? where_clause : "",
-        sort_clause_for_mode(sort_mode));
-    sqlite3_stmt* stmt = NULL;
-    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    else {
+        print_contact_plain(out, c, tenant);
+        fprintf(out, "\n");
+    }
+}
+
+typedef struct {
+    FILE* out;
+    int json;
+    int show_today;
+    int started;
+    int first;
+} PrintRows;
+
+// The heading is printed with the first row, or by print_rows_end, so a failed query prints nothing.
+static void print_rows_begin(PrintRows* p) {
+    if (p->started) {
+        return;
+    }
+    p->started = 1;
+    if (p->json) {
+        fprintf(p->out, "[");
+    }
+    else if (p->show_today) {
+        print_today(p->out);
+    }
+}
+
+static int print_rows_next(void* ctx, const ContactView* row) {
+    PrintRows* p = (PrintRows*)ctx;
+    print_rows_begin(p);
+    if (p->json && !p->first) {
+        fprintf(p->out, ",");
+    }
+    contacts_print(p->out, row, NULL, p->json);
+    p->first = 0;
+    return 1;
+}
+
+static int print_rows_end(PrintRows* p, int ok) {
+    if (!ok) {
         return 0;
     }
-    if (param) {
-        sqlite3_bind_text(stmt, 1, param, -1, SQLITE_TRANSIENT);
+    print_rows_begin(p);
+    if (p->json) {
+        fprintf(p->out, "]\n");
     }
+    return 1;
+}
 
-    int first = 1;
-    if (!json && show_today) {
-        print_today(out);
+static const char* sort_clause(Db* db, ContactSort sort) {
+    if (sort == CONTACT_SORT_STORED) {
+        char sort_mode[32] = { 0 };
+        if (!contacts_get_sort_mode(db, sort_mode, sizeof(sort_mode))) {
+            snprintf(sort_mode, sizeof(sort_mode), "%s", default_sort_mode);
+        }
+        sort = sort_for_mode(sort_mode);
     }
-    if (json) {
-        fprintf(out, "[");
-    }
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Contact c = { 0 };
-        c.id = sqlite3_column_int64(stmt, 0);
-        snprintf(c.name, sizeof(c.name), "%s", (const char*)sqlite3_column_text(stmt, 1));
-        snprintf(c.phone, sizeof(c.phone), "%s", (const char*)sqlite3_column_text(stmt, 2));
-        snprintf(c.address, sizeof(c.address), "%s", (const char*)sqlite3_column_text(stmt, 3));
-        snprintf(c.email, sizeof(c.email), "%s", (const char*)sqlite3_column_text(stmt, 4));
-        c.due_amount = sqlite3_column_double(stmt, 5);
-        snprintf(c.due_date, sizeof(c.due_date), "%s", (const char*)sqlite3_column_text(stmt, 6));
-
-        if (json) {
-            if (!first) {
-                fprintf(out, ",");
-            }
-            print_contact_json(out, &c, 0);
+    switch (sort) {
+    case CONTACT_SORT_PHONE:
+        return "ORDER BY phone COLLATE NOCASE, id";
+    case CONTACT_SORT_DUE_DATE:
+        return "ORDER BY due_date COLLATE NOCASE, id";
+    case CONTACT_SORT_ID:
+        return "ORDER BY id";
+    case CONTACT_SORT_NAME:
+    case CONTACT_SORT_STORED:
+        break;
+    }
+    return "ORDER BY name COLLATE NOCASE, id";
+}
+
+// Terms are ANDed; with ids the first two parameters are an id range, bound by the caller.
+static sqlite3_stmt* prepare_list_query(Db* db, int id_range, const char* name_like, const Query* query,
+    ContactSort sort) {
+    char* query_term = query ? sqlite3_mprintf("(%s)", query->sql) : NULL;
+    const char* terms[3];
+    size_t n = 0;
+    if (id_range) {
+        terms[n++] = "id BETWEEN ? AND ?";
+    }
+    if (name_like) {
+        terms[n++] = "name LIKE ? COLLATE NOCASE";
+    }
+    if (query_term) {
+        terms[n++] = query_term;
+    }
+    char* sql = (query && !query_term) ? NULL : sqlite3_mprintf(
+        "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM %s%s%s%s%s%s%s %s;",
+        db_contacts_source(db), n > 0 ? " WHERE " : "", n > 0 ? terms[0] : "",
+        n > 1 ? " AND " : "", n > 1 ? terms[1] : "",
+        n > 2 ? " AND " : "", n > 2 ? terms[2] : "",
+        sort_clause(db, sort));
+    sqlite3_free(query_term);
+    if (!sql) {
+        return NULL;
+    }
+    sqlite3_stmt* stmt = NULL;
+    int rc = sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        return NULL;
+    }
+    int index = id_range ? 3 : 1;
+    if (name_like) {
+        sqlite3_bind_text(stmt, index++, name_like, -1, SQLITE_TRANSIENT);
+    }
+    if (query && !query_bind(query, stmt, index)) {
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    return stmt;
+}
+
+// Hands each row of stmt in ids (all rows when ids is NULL) to fn until it returns 0, which sets
+// *stopped. Returns 0 only when stepping fails.
+static int foreach_row(sqlite3_stmt* stmt, const Roaring* ids, ContactViewFn fn, void* ctx, int* stopped) {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        // Only the id is read before the membership test, so SQLite can skip loading other rows.
+        int64_t id = sqlite3_column_int64(stmt, 0);
+        if (ids && (id < 0 || id > (int64_t)UINT32_MAX || !roaring_contains(ids, (uint32_t)id))) {
+            continue;
         }
-        else {
-            print_contact_plain(out, &c);
-            fprintf(out, "\n");
+        ContactView view;
+        contacts_view_row(stmt, &view);
+        if (!fn(ctx, &view)) {
+            if (stopped) {
+                *stopped = 1;
+            }
+            return 1;
         }
-        first = 0;
     }
+    return rc == SQLITE_DONE;
+}
 
-    if (json) {
-        fprintf(out, "]\n");
+int contacts_foreach(Db* db, const ContactFilter* filter, ContactSort sort, ContactViewFn fn, void* ctx) {
+    if (!db || !db->handle || !fn) {
+        return 0;
+    }
+    const char* name_like = filter ? filter->name_like : NULL;
+    const char* where = filter ? filter->where : NULL;
+    const Roaring* ids = filter ? filter->ids : NULL;
+    Query query;
+    if (where && !query_compile(where, &query)) {
+        util_error("Invalid filter: %s", query.error);
+        return 0;
+    }
+    sqlite3_stmt* stmt = prepare_list_query(db, ids != NULL, name_like, where ? &query : NULL, sort);
+    if (!stmt) {
+        return 0;
+    }
+    // An id set is scanned one 65536-id chunk at a time in id order, otherwise over the span from
+    // its first chunk to its last.
+    size_t chunks = roaring_chunk_count(ids);
+    size_t ranges = !ids ? 1 : sort == CONTACT_SORT_ID ? chunks : chunks > 0;
+    int ok = 1;
+    int stopped = 0;
+    for (size_t i = 0; ok && !stopped && i < ranges; ++i) {
+        if (ids) {
+            size_t last = sort == CONTACT_SORT_ID ? i : chunks - 1;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64(stmt, 1, (int64_t)roaring_chunk_key(ids, i) << 16);
+            sqlite3_bind_int64(stmt, 2, ((int64_t)roaring_chunk_key(ids, last) << 16) | 0xFFFF);
+        }
+        ok = foreach_row(stmt, ids, fn, ctx, &stopped);
     }
-
     sqlite3_finalize(stmt);
-    return 1;
+    return ok;
+}
+
+static int list_query(Db* db, const ContactFilter* filter, int json, FILE* out, int show_today) {
+    PrintRows p = { out, json, show_today, 0, 1 };
+    return print_rows_end(&p, contacts_foreach(db, filter, CONTACT_SORT_STORED, print_rows_next, &p));
 }
 
 int contacts_list(Db* db, int json, FILE* out) {
     if (!db || !db->handle || !out) {
         return 0;
     }
-    return list_query(db, NULL, NULL, json, out, 1);
+    return list_query(db, NULL, json, out, 1);
 }
 
 int contacts_search_by_name(Db* db, const char* name, int json, FILE* out) {
     if (!db || !db->handle || !name || !out) {
         return 0;
     }
-    return list_query(db, "WHERE name LIKE ? COLLATE NOCASE", name, json, out, 0);
+    ContactFilter filter = { name, NULL, NULL };
+    return list_query(db, &filter, json, out, 0);
 }
 
-int contacts_stats(Db* db, ContactStats* out) {
+int contacts_list_where(Db* db, const char* expr, int json, FILE* out) {
+    if (!db || !db->handle || !expr || !out) {
+        return 0;
+    }
+    ContactFilter filter = { NULL, expr, NULL };
+    return list_query(db, &filter, json, out, 0);
+}
+
+int contacts_list_filter(Db* db, const ContactFilter* filter, int json, FILE* out) {
     if (!db || !db->handle || !out) {
         return 0;
     }
-    memset(out, 0, sizeof(*out));
-    const char* sql = "SELECT name, phone, address, email, due_amount, due_date FROM contacts;";
+    return list_query(db, filter, json, out, 0);
+}
+
+int contacts_list_upcoming(Db* db, int64_t from_day, int64_t to_day, int limit, int json, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    // Walks idx_contacts_due_day from from_day, so the cost is one seek plus the rows printed.
+    const char* sql = "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM contacts"
+        " WHERE due_day BETWEEN ? AND ? ORDER BY due_day, id LIMIT ?;";
     sqlite3_stmt* stmt = NULL;
     if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
     }
-    int has_due_amount = 0;
-    int has_valid_due_date = 0;
-    time_t earliest_time = 0;
-    time_t latest_time = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    sqlite3_bind_int64(stmt, 1, from_day);
+    sqlite3_bind_int64(stmt, 2, to_day);
+    sqlite3_bind_int(stmt, 3, limit > 0 ? limit : -1);
+    PrintRows p = { out, json, 0, 0, 1 };
+    int ok = print_rows_end(&p, foreach_row(stmt, NULL, print_rows_next, &p, NULL));
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+int contacts_next_due_day(Db* db, int64_t after_day, int64_t* out_day) {
+    if (!db || !db->handle || !out_day) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT MIN(due_day) FROM contacts WHERE due_day > ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, after_day);
+    int found = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    if (found) {
+        *out_day = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+int contacts_top_debtors(Db* db, size_t n, int json, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    // Walks idx_contacts_due_amount from the top and stops after n rows; only ties are sorted.
+    const char* sql = "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM contacts"
+        " WHERE due_amount > 0 ORDER BY due_amount DESC, id LIMIT ?;";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, n > (size_t)INT64_MAX ? INT64_MAX : (sqlite3_int64)n);
+    PrintRows p = { out, json, 0, 0, 1 };
+    int ok = print_rows_end(&p, foreach_row(stmt, NULL, print_rows_next, &p, NULL));
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+typedef struct {
+    double score;
+    int64_t id;
+} TopEntry;
+
+// Heap order: the root is the entry that would be dropped first (lowest score, then highest id).
+static int top_before(const TopEntry* a, const TopEntry* b) {
+    return a->score < b->score || (a->score == b->score && a->id > b->id);
+}
+
+static void top_sift_down(TopEntry* heap, size_t count, size_t i) {
+    for (;;) {
+        size_t low = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        if (l < count && top_before(&heap[l], &heap[low])) {
+            low = l;
+        }
+        if (r < count && top_before(&heap[r], &heap[low])) {
+            low = r;
+        }
+        if (low == i) {
+            return;
+        }
+        TopEntry t = heap[i];
+        heap[i] = heap[low];
+        heap[low] = t;
+        i = low;
+    }
+}
+
+static void top_push(TopEntry* heap, size_t* count, size_t cap, TopEntry e) {
+    if (*count < cap) {
+        size_t i = (*count)++;
+        heap[i] = e;
+        while (i > 0 && top_before(&heap[i], &heap[(i - 1) / 2])) {
+            TopEntry t = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    }
+    else if (top_before(&heap[0], &e)) {
+        heap[0] = e;
+        top_sift_down(heap, cap, 0);
+    }
+}
+
+int contacts_top_overdue(Db* db, int64_t today, size_t n, int json, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    if (n == 0) {
+        return contacts_print_ids(db, NULL, 0, json, out);
+    }
+    // One pass over the overdue range of idx_contacts_due_day keeps the best n in a min-heap, so memory
+    // is O(n) and nothing is sorted but the survivors.
+    const char* sql = "SELECT id, due_amount, due_day FROM contacts WHERE due_day < ? AND due_amount > 0;";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, today);
+    size_t cap = 0;
+    size_t count = 0;
+    TopEntry* heap = NULL;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == cap && cap < n) {
+            size_t grown_cap = cap ? cap * 2 : 64;
+            grown_cap = grown_cap > n ? n : grown_cap;
+            TopEntry* grown = (TopEntry*)realloc(heap, grown_cap * sizeof(TopEntry));
+            if (!grown) {
+                break;
+            }
+            heap = grown;
+            cap = grown_cap;
+        }
+        TopEntry e;
+        e.id = sqlite3_column_int64(stmt, 0);
+        e.score = sqlite3_column_double(stmt, 1) * (double)(today - sqlite3_column_int64(stmt, 2));
+        top_push(heap, &count, n, e);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        free(heap);
+        return 0;
+    }
+
+    // Pop the root to the back until the heap is empty, leaving the array best first.
+    int64_t* ids = (int64_t*)malloc((count ? count : 1) * sizeof(int64_t));
+    if (!ids) {
+        free(heap);
+        return 0;
+    }
+    for (size_t left = count; left > 0; --left) {
+        ids[left - 1] = heap[0].id;
+        heap[0] = heap[left - 1];
+        top_sift_down(heap, left - 1, 0);
+    }
+    free(heap);
+    int ok = contacts_print_ids(db, ids, count, json, out);
+    free(ids);
+    return ok;
+}
+
+// Amounts are summed per block of ids and the block sums folded in id order, so the floating-point
+// total is the same whether the table is scanned by one thread or split across several.
+#define STATS_SUM_BLOCK_IDS 4096
+#define STATS_MAX_JOBS 64
+#define AGING_MAX_TABLE_DAYS 4096
+
+// "Now" as a local calendar day plus the seconds elapsed since its midnight, captured once per
+// report so rows are classified with integer day arithmetic instead of mktime.
+typedef struct {
+    int64_t today;
+    long long since_midnight;
+} StatsClock;
+
+typedef struct {
+    int lo;
+    int hi;
+    signed char* slot;
+    ContactAging* aging;
+} AgingIndex;
+
+typedef struct {
+    ContactStats stats;
+    int has_due_amount;
+    int has_valid_due_date;
+    int64_t earliest_day;
+    int64_t latest_day;
+    AgingIndex* aging;
+    double* block_sums;
+    size_t block_count;
+    size_t block_cap;
+} StatsPartial;
+
+static int stats_push_block(StatsPartial* p, double sum) {
+    if (p->block_count == p->block_cap) {
+        size_t cap = p->block_cap ? p->block_cap * 2 : 16;
+        double* grown = (double*)realloc(p->block_sums, cap * sizeof(double));
+        if (!grown) {
+            return 0;
+        }
+        p->block_sums = grown;
+        p->block_cap = cap;
+    }
+    p->block_sums[p->block_count++] = sum;
+    return 1;
+}
+
+static StatsClock stats_clock(time_t now) {
+    StatsClock clock;
+    clock.today = util_local_epoch_day(now);
+    struct tm midnight;
+#if defined(_WIN32)
+    localtime_s(&midnight, &now);
+#else
+    localtime_r(&now, &midnight);
+#endif
+    midnight.tm_hour = 0;
+    midnight.tm_min = 0;
+    midnight.tm_sec = 0;
+    midnight.tm_isdst = -1;
+    time_t start = mktime(&midnight);
+    clock.since_midnight = start == (time_t)-1 ? 0 : (long long)(now - start);
+    return clock;
+}
+
+static int aging_bucket_for(const AgingIndex* index, int64_t days) {
+    if (days >= index->lo && days <= index->hi) {
+        return index->slot[days - index->lo];
+    }
+    const ContactAging* aging = index->aging;
+    for (size_t i = 0; i < aging->bucket_count; ++i) {
+        if (days >= aging->buckets[i].from_days && days <= aging->buckets[i].to_days) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Accumulates rows with first_id <= id <= last_id in id order, skipping ids not in ids when it is
+// set; ties keep the lowest id.
+static int stats_scan(sqlite3* handle, const char* source, int64_t first_id, int64_t last_id, const Roaring* ids,
+    const StatsClock* clock, StatsPartial* p) {
+    char* sql = sqlite3_mprintf("SELECT name, phone, address, email, due_amount, due_date, id FROM %s"
+        " WHERE id BETWEEN ? AND ? ORDER BY id;", source);
+    sqlite3_stmt* stmt = NULL;
+    int prepared = sql && sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK;
+    sqlite3_free(sql);
+    if (!prepared) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, first_id);
+    sqlite3_bind_int64(stmt, 2, last_id);
+    ContactStats* out = &p->stats;
+    int64_t block = 0;
+    int in_block = 0;
+    double block_sum = 0.0;
+    int ok = 1;
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t id = sqlite3_column_int64(stmt, 6);
+        if (ids && (id < 0 || id > (int64_t)UINT32_MAX || !roaring_contains(ids, (uint32_t)id))) {
+            continue;
+        }
         const unsigned char* name = sqlite3_column_text(stmt, 0);
         const unsigned char* phone = sqlite3_column_text(stmt, 1);
         const unsigned char* address = sqlite3_column_text(stmt, 2);
         const unsigned char* email = sqlite3_column_text(stmt, 3);
         double due_amount = sqlite3_column_double(stmt, 4);
         const unsigned char* due_date = sqlite3_column_text(stmt, 5);
+        int64_t row_block = id / STATS_SUM_BLOCK_IDS;
+        if (in_block && row_block != block) {
+            ok = stats_push_block(p, block_sum);
+            block_sum = 0.0;
+        }
+        block = row_block;
+        in_block = 1;
         out->total_contacts++;
         if (!phone || !phone[0]) {
             out->missing_phone++;
@@ -279,26 +992,32 @@ int contacts_stats(Db* db, ContactStats* out) {
         }
         if (due_amount > 0.0) {
             out->due_contacts++;
-            out->total_due_amount += due_amount;
-            if (!has_due_amount || due_amount < out->min_due_amount) {
+            block_sum += due_amount;
+            if (!p->has_due_amount || due_amount < out->min_due_amount) {
                 out->min_due_amount = due_amount;
                 util_copy_str(out->min_due_name, sizeof(out->min_due_name),
                     name ? (const char*)name : "");
             }
-            if (!has_due_amount || due_amount > out->max_due_amount) {
+            if (!p->has_due_amount || due_amount > out->max_due_amount) {
                 out->max_due_amount = due_amount;
                 util_copy_str(out->max_due_name, sizeof(out->max_due_name),
                     name ? (const char*)name : "");
             }
-            has_due_amount = 1;
+            p->has_due_amount = 1;
         }
         else {
             out->no_due_contacts++;
         }
         if (due_date && due_date[0]) {
             out->due_date_present++;
-            int days = 0;
-            if (util_due_days((const char*)due_date, &days)) {
+            int64_t due_day = 0;
+            if (util_epoch_day((const char*)due_date, &due_day)) {
+                // Same rounding as util_due_days: whole days from now until the due date's midnight.
+                long long seconds = (long long)(due_day - clock->today) * 86400LL - clock->since_midnight;
+                long long days = seconds / 86400LL;
+                if (seconds < 0 && (seconds % 86400LL) != 0) {
+                    days -= 1;
+                }
                 if (days < 0) {
                     out->overdue_contacts++;
                 }
@@ -313,30 +1032,38 @@ int contacts_stats(Db* db, ContactStats* out) {
                     out->due_later_contacts++;
                 }
 
-                struct tm due_tm = { 0 };
-                if (util_parse_iso_date((const char*)due_date, &due_tm)) {
-                    time_t due_time = mktime(&due_tm);
-                    if (due_time != (time_t)-1) {
-                        if (!has_valid_due_date || due_time < earliest_time) {
-                            earliest_time = due_time;
-                            util_copy_str(out->earliest_due_date, sizeof(out->earliest_due_date),
-                                (const char*)due_date);
-                        }
-                        if (!has_valid_due_date || due_time > latest_time) {
-                            latest_time = due_time;
-                            util_copy_str(out->latest_due_date, sizeof(out->latest_due_date),
-                                (const char*)due_date);
-                        }
-                        has_valid_due_date = 1;
+                if (!p->has_valid_due_date || due_day < p->earliest_day) {
+                    p->earliest_day = due_day;
+                    util_copy_str(out->earliest_due_date, sizeof(out->earliest_due_date),
+                        (const char*)due_date);
+                }
+                if (!p->has_valid_due_date || due_day > p->latest_day) {
+                    p->latest_day = due_day;
+                    util_copy_str(out->latest_due_date, sizeof(out->latest_due_date),
+                        (const char*)due_date);
+                }
+                p->has_valid_due_date = 1;
+
+                if (p->aging) {
+                    int bucket = aging_bucket_for(p->aging, due_day - clock->today);
+                    if (bucket >= 0) {
+                        p->aging->aging->buckets[bucket].count++;
+                        p->aging->aging->buckets[bucket].amount += due_amount;
                     }
                 }
             }
             else {
                 out->due_date_invalid++;
+                if (p->aging) {
+                    p->aging->aging->invalid_due_date++;
+                }
             }
         }
         else {
             out->due_date_missing++;
+            if (p->aging) {
+                p->aging->aging->no_due_date++;
+            }
         }
         if (name && name[0]) {
             unsigned char c = (unsigned char)name[0];
@@ -352,12 +1079,339 @@ int contacts_stats(Db* db, ContactStats* out) {
         }
     }
     sqlite3_finalize(stmt);
+    if (ok && in_block) {
+        ok = stats_push_block(p, block_sum);
+    }
+    return ok && rc == SQLITE_DONE;
+}
+
+// Folds a partial covering later ids into p. Strict comparisons keep p's values on ties, which
+// matches the serial scan keeping the first row it saw.
+static int stats_merge(StatsPartial* p, const StatsPartial* next) {
+    ContactStats* out = &p->stats;
+    const ContactStats* in = &next->stats;
+    out->total_contacts += in->total_contacts;
+    out->due_contacts += in->due_contacts;
+    out->no_due_contacts += in->no_due_contacts;
+    out->overdue_contacts += in->overdue_contacts;
+    out->due_today_contacts += in->due_today_contacts;
+    out->due_soon_contacts += in->due_soon_contacts;
+    out->due_later_contacts += in->due_later_contacts;
+    out->due_date_present += in->due_date_present;
+    out->due_date_missing += in->due_date_missing;
+    out->due_date_invalid += in->due_date_invalid;
+    out->missing_phone += in->missing_phone;
+    out->missing_email += in->missing_email;
+    out->missing_address += in->missing_address;
+    for (int i = 0; i < 27; ++i) {
+        out->by_letter[i] += in->by_letter[i];
+    }
+    if (next->has_due_amount) {
+        if (!p->has_due_amount || in->min_due_amount < out->min_due_amount) {
+            out->min_due_amount = in->min_due_amount;
+            memcpy(out->min_due_name, in->min_due_name, sizeof(out->min_due_name));
+        }
+        if (!p->has_due_amount || in->max_due_amount > out->max_due_amount) {
+            out->max_due_amount = in->max_due_amount;
+            memcpy(out->max_due_name, in->max_due_name, sizeof(out->max_due_name));
+        }
+        p->has_due_amount = 1;
+    }
+    if (next->has_valid_due_date) {
+        if (!p->has_valid_due_date || next->earliest_day < p->earliest_day) {
+            p->earliest_day = next->earliest_day;
+            memcpy(out->earliest_due_date, in->earliest_due_date, sizeof(out->earliest_due_date));
+        }
+        if (!p->has_valid_due_date || next->latest_day > p->latest_day) {
+            p->latest_day = next->latest_day;
+            memcpy(out->latest_due_date, in->latest_due_date, sizeof(out->latest_due_date));
+        }
+        p->has_valid_due_date = 1;
+    }
+    for (size_t i = 0; i < next->block_count; ++i) {
+        if (!stats_push_block(p, next->block_sums[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void stats_finish(Db* db, StatsPartial* p, ContactStats* out) {
+    *out = p->stats;
+    out->total_due_amount = 0.0;
+    for (size_t i = 0; i < p->block_count; ++i) {
+        out->total_due_amount += p->block_sums[i];
+    }
     if (out->due_contacts > 0) {
         out->avg_due_amount = out->total_due_amount / out->due_contacts;
     }
+    cache_get_stats(db->cache, &out->cache);
+    free(p->block_sums);
+}
+
+int contacts_stats(Db* db, ContactStats* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    StatsPartial partial;
+    memset(&partial, 0, sizeof(partial));
+    StatsClock clock = stats_clock(time(NULL));
+    if (!stats_scan(db->handle, db_contacts_source(db), INT64_MIN, INT64_MAX, NULL, &clock, &partial)) {
+        free(partial.block_sums);
+        return 0;
+    }
+    stats_finish(db, &partial, out);
     return 1;
 }
 
+int contacts_stats_subset(Db* db, const Roaring* ids, ContactStats* out) {
+    if (!db || !db->handle || !ids || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    StatsPartial partial;
+    memset(&partial, 0, sizeof(partial));
+    StatsClock clock = stats_clock(time(NULL));
+    // Chunks span 16 whole sum blocks, so the total matches a full scan of the same rows.
+    for (size_t i = 0; i < roaring_chunk_count(ids); ++i) {
+        int64_t first = (int64_t)roaring_chunk_key(ids, i) << 16;
+        if (!stats_scan(db->handle, db_contacts_source(db), first, first | 0xFFFF, ids, &clock, &partial)) {
+            free(partial.block_sums);
+            return 0;
+        }
+    }
+    stats_finish(db, &partial, out);
+    return 1;
+}
+
+#ifdef HAVE_PTHREADS
+typedef struct {
+    pthread_t thread;
+    const char* path;
+    const char* source;
+    int64_t first_id;
+    int64_t last_id;
+    const StatsClock* clock;
+    int ok;
+    StatsPartial partial;
+} StatsShard;
+
+static void* stats_worker(void* arg) {
+    StatsShard* shard = (StatsShard*)arg;
+    sqlite3* handle = db_open_reader(shard->path);
+    shard->ok = handle && stats_scan(handle, shard->source, shard->first_id, shard->last_id, NULL, shard->clock,
+        &shard->partial);
+    sqlite3_close(handle);
+    return NULL;
+}
+#endif
+
+int contacts_stats_parallel(Db* db, int jobs, ContactStats* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+#ifdef HAVE_PTHREADS
+    if (jobs > STATS_MAX_JOBS) {
+        jobs = STATS_MAX_JOBS;
+    }
+    const char* path = sqlite3_db_filename(db->handle, "main");
+    if (jobs <= 1 || !path || !path[0]) {
+        return contacts_stats(db, out);
+    }
+    memset(out, 0, sizeof(*out));
+
+    // Holding a read transaction keeps writers out until every worker has finished.
+    if (!db_begin(db)) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    int64_t min_id = 0;
+    int64_t max_id = -1;
+    const char* source = db_contacts_source(db);
+    char* bounds = sqlite3_mprintf("SELECT MIN(id), MAX(id) FROM %s;", source);
+    int ok = bounds && sqlite3_prepare_v2(db->handle, bounds, -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_free(bounds);
+    if (ok && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        min_id = sqlite3_column_int64(stmt, 0);
+        max_id = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    // Shards are whole sum blocks so no block is split between two workers.
+    StatsShard shards[STATS_MAX_JOBS];
+    memset(shards, 0, sizeof(shards));
+    StatsClock clock = stats_clock(time(NULL));
+    int started = 0;
+    int64_t first_block = min_id / STATS_SUM_BLOCK_IDS;
+    int64_t blocks = max_id >= min_id ? max_id / STATS_SUM_BLOCK_IDS - first_block + 1 : 0;
+    int64_t per_shard = blocks / jobs + (blocks % jobs != 0);
+    for (int i = 0; ok && i < jobs && (int64_t)i * per_shard < blocks; ++i) {
+        int64_t block = first_block + (int64_t)i * per_shard;
+        shards[i].path = path;
+        shards[i].source = source;
+        shards[i].first_id = i == 0 ? min_id : block * STATS_SUM_BLOCK_IDS;
+        shards[i].last_id = (int64_t)(i + 1) * per_shard >= blocks ? max_id
+            : (block + per_shard) * STATS_SUM_BLOCK_IDS - 1;
+        shards[i].clock = &clock;
+        if (pthread_create(&shards[i].thread, NULL, stats_worker, &shards[i]) != 0) {
+            ok = 0;
+            break;
+        }
+        started++;
+    }
+
+    StatsPartial total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < started; ++i) {
+        pthread_join(shards[i].thread, NULL);
+        ok = ok && shards[i].ok && stats_merge(&total, &shards[i].partial);
+        free(shards[i].partial.block_sums);
+    }
+    db_commit(db);
+    if (!ok) {
+        free(total.block_sums);
+        return 0;
+    }
+    stats_finish(db, &total, out);
+    return 1;
+#else
+    (void)jobs;
+    return contacts_stats(db, out);
+#endif
+}
+
+// Folds the stats of another database into out; on ties the values already in out are kept.
+void contacts_stats_combine(ContactStats* out, const ContactStats* part) {
+    int had_due = out->due_contacts > 0;
+    int had_dates = out->earliest_due_date[0] != '\0';
+    out->total_contacts += part->total_contacts;
+    out->due_contacts += part->due_contacts;
+    out->no_due_contacts += part->no_due_contacts;
+    out->overdue_contacts += part->overdue_contacts;
+    out->due_today_contacts += part->due_today_contacts;
+    out->due_soon_contacts += part->due_soon_contacts;
+    out->due_later_contacts += part->due_later_contacts;
+    out->due_date_present += part->due_date_present;
+    out->due_date_missing += part->due_date_missing;
+    out->due_date_invalid += part->due_date_invalid;
+    out->missing_phone += part->missing_phone;
+    out->missing_email += part->missing_email;
+    out->missing_address += part->missing_address;
+    out->total_due_amount += part->total_due_amount;
+    for (int i = 0; i < 27; ++i) {
+        out->by_letter[i] += part->by_letter[i];
+    }
+    if (part->due_contacts > 0) {
+        if (!had_due || part->min_due_amount < out->min_due_amount) {
+            out->min_due_amount = part->min_due_amount;
+            memcpy(out->min_due_name, part->min_due_name, sizeof(out->min_due_name));
+        }
+        if (!had_due || part->max_due_amount > out->max_due_amount) {
+            out->max_due_amount = part->max_due_amount;
+            memcpy(out->max_due_name, part->max_due_name, sizeof(out->max_due_name));
+        }
+    }
+    int64_t ours = 0;
+    int64_t theirs = 0;
+    if (part->earliest_due_date[0] && util_epoch_day(part->earliest_due_date, &theirs) &&
+        (!had_dates || (util_epoch_day(out->earliest_due_date, &ours) && theirs < ours))) {
+        memcpy(out->earliest_due_date, part->earliest_due_date, sizeof(out->earliest_due_date));
+    }
+    if (part->latest_due_date[0] && util_epoch_day(part->latest_due_date, &theirs) &&
+        (!had_dates || (util_epoch_day(out->latest_due_date, &ours) && theirs > ours))) {
+        memcpy(out->latest_due_date, part->latest_due_date, sizeof(out->latest_due_date));
+    }
+    out->avg_due_amount = out->due_contacts > 0 ? out->total_due_amount / out->due_contacts : 0.0;
+}
+
+// Open-ended buckets use INT_MIN/INT_MAX; days count from today, negative when overdue.
+void contacts_aging_defaults(ContactAging* aging) {
+    if (!aging) {
+        return;
+    }
+    memset(aging, 0, sizeof(*aging));
+    contacts_aging_add_bucket(aging, "90+ overdue", INT_MIN, -91);
+    contacts_aging_add_bucket(aging, "61-90 overdue", -90, -61);
+    contacts_aging_add_bucket(aging, "31-60 overdue", -60, -31);
+    contacts_aging_add_bucket(aging, "0-30 overdue", -30, 0);
+    contacts_aging_add_bucket(aging, "1-7 days", 1, 7);
+    contacts_aging_add_bucket(aging, "8-14 days", 8, 14);
+    contacts_aging_add_bucket(aging, "15-21 days", 15, 21);
+    contacts_aging_add_bucket(aging, "22-28 days", 22, 28);
+    contacts_aging_add_bucket(aging, "29+ days", 29, INT_MAX);
+}
+
+int contacts_aging_add_bucket(ContactAging* aging, const char* label, int from_days, int to_days) {
+    if (!aging || !label || from_days > to_days || aging->bucket_count >= CONTACT_AGING_MAX_BUCKETS) {
+        return 0;
+    }
+    ContactAgingBucket* bucket = &aging->buckets[aging->bucket_count++];
+    util_copy_str(bucket->label, sizeof(bucket->label), label);
+    bucket->from_days = from_days;
+    bucket->to_days = to_days;
+    bucket->count = 0;
+    bucket->amount = 0.0;
+    return 1;
+}
+
+int contacts_aging(Db* db, ContactAging* aging) {
+    if (!db || !db->handle || !aging) {
+        return 0;
+    }
+    aging->no_due_date = 0;
+    aging->invalid_due_date = 0;
+    AgingIndex index = { 0, -1, NULL, aging };
+    for (size_t i = 0; i < aging->bucket_count; ++i) {
+        aging->buckets[i].count = 0;
+        aging->buckets[i].amount = 0.0;
+    }
+
+    // Finite bucket edges get a dense day -> bucket table; days outside it (open-ended buckets)
+    // fall back to a linear search. Earlier buckets win where ranges overlap.
+    int has_bound = 0;
+    for (size_t i = 0; i < aging->bucket_count; ++i) {
+        int edges[2] = { aging->buckets[i].from_days, aging->buckets[i].to_days };
+        for (int k = 0; k < 2; ++k) {
+            if (edges[k] == INT_MIN || edges[k] == INT_MAX) {
+                continue;
+            }
+            index.lo = !has_bound || edges[k] < index.lo ? edges[k] : index.lo;
+            index.hi = !has_bound || edges[k] > index.hi ? edges[k] : index.hi;
+            has_bound = 1;
+        }
+    }
+    if (has_bound && (long long)index.hi - index.lo < AGING_MAX_TABLE_DAYS) {
+        index.slot = (signed char*)malloc((size_t)(index.hi - index.lo) + 1);
+        if (!index.slot) {
+            return 0;
+        }
+        for (int day = index.lo; day <= index.hi; ++day) {
+            index.slot[day - index.lo] = -1;
+            for (size_t i = 0; i < aging->bucket_count; ++i) {
+                if (day >= aging->buckets[i].from_days && day <= aging->buckets[i].to_days) {
+                    index.slot[day - index.lo] = (signed char)i;
+                    break;
+                }
+            }
+        }
+    }
+    else {
+        index.lo = 0;
+        index.hi = -1;
+    }
+
+    StatsPartial partial;
+    memset(&partial, 0, sizeof(partial));
+    partial.aging = &index;
+    StatsClock clock = stats_clock(time(NULL));
+    int ok = stats_scan(db->handle, db_contacts_source(db), INT64_MIN, INT64_MAX, NULL, &clock, &partial);
+    free(partial.block_sums);
+    free(index.slot);
+    return ok;
+}
+
 int contacts_set_sort_mode(Db* db, const char* mode) {
     if (!db || !db->handle || !mode) {
         return 0;
@@ -378,3 +1432,62 @@ int contacts_get_sort_mode(Db* db, char* mode, size_t mode_len) {
     snprintf(mode, mode_len, "%s", default_sort_mode);
     return 1;
 }
+
+int contacts_cache_enable(Db* db, size_t max_bytes) {
+    if (!db) {
+        return 0;
+    }
+    cache_destroy(db->cache);
+    db->cache = cache_create(max_bytes);
+    return max_bytes == 0 || db->cache != NULL;
+}
+
+void contacts_invalidate_caches(Db* db) {
+    if (db) {
+        cache_clear(db->cache);
+        drop_name_indexes(db);
+        tags_invalidate(db);
+    }
+}
+
+int contacts_search_prefix(Db* db, const char* prefix, int64_t* ids, size_t max_ids, size_t* out_count) {
+    if (!db || !db->handle || !prefix || !ids || !out_count) {
+        return 0;
+    }
+    NameIndex* index = load_name_index(db);
+    if (!index) {
+        return 0;
+    }
+    *out_count = name_index_prefix(index, prefix, ids, max_ids);
+    return 1;
+}
+
+int contacts_search_fuzzy(Db* db, const char* query, int max_distance, FuzzyMatch* out, size_t max_out,
+    size_t* out_count) {
+    if (!db || !db->handle || !query || !out || !out_count || max_distance < 0) {
+        return 0;
+    }
+    FuzzyIndex* index = load_fuzzy_index(db);
+    if (!index) {
+        return 0;
+    }
+    *out_count = fuzzy_index_search(index, query, max_distance, out, max_out);
+    return 1;
+}
+
+int contacts_print_ids(Db* db, const int64_t* ids, size_t count, int json, FILE* out) {
+    if (!db || !db->handle || (!ids && count > 0) || !out) {
+        return 0;
+    }
+    PrintRows p = { out, json, 0, 0, 1 };
+    for (size_t i = 0; i < count; ++i) {
+        Contact c;
+        ContactView view;
+        if (!contacts_get_by_id(db, ids[i], &c)) {
+            continue;
+        }
+        contacts_view_of(&c, &view);
+        print_rows_next(&p, &view);
+    }
+    return print_rows_end(&p, 1);
+}
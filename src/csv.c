@@ -1,80 +1,370 @@
 // Purpose: Robust CSV parsing and writing. Author: GitHub Copilot
 #include "csv.h"
+#include "archive.h"
+#include "json.h"
+#include "ledger.h"
+#include "sketch.h"
+#include "stream.h"
 #include "util.h"
 
+#include <ctype.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
-static void csv_write_field(FILE* out, const char* s) {
-    int need_quote = 0;
-    for (const char* p = s; p && *p; ++p) {
-        if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') {
-            need_quote = 1;
-            break;
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define CSV_COLS 7
+#define CSV_COLS_REQUIRED 6
+#define CSV_COL_EXTERNAL_ID 6
+#define CSV_MAX_JOBS 64
+#define CSV_MAX_COLUMNS 1024
+#define CSV_LEDGER_COLS 4
+#define CSV_LEDGER_COLS_REQUIRED 3
+#define CSV_CHECKPOINT_KEY "import_checkpoint"
+#define CSV_CHECKPOINT_HEAD 4096
+#define CSV_HEADER "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n"
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} CsvBuf;
+
+static int csv_buf_put(CsvBuf* b, const void* data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 1024;
+        while (cap < b->len + len) {
+            cap *= 2;
         }
+        char* grown = (char*)realloc(b->data, cap);
+        if (!grown) {
+            return 0;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    if (len > 0) {
+        memcpy(b->data + b->len, data, len);
+    }
+    b->len += len;
+    return 1;
+}
+
+static int csv_format_field(CsvBuf* b, const ContactField* f) {
+    const char* s = f->ptr;
+    const char* end = f->ptr + f->len;
+    if (strcspn(s, ",\"\r\n") == f->len) {
+        return csv_buf_put(b, s, f->len);
     }
-    if (!need_quote) {
-        fprintf(out, "%s", s ? s : "");
-        return;
+    if (!csv_buf_put(b, "\"", 1)) {
+        return 0;
     }
-    fputc('"', out);
-    for (const char* p = s; p && *p; ++p) {
-        if (*p == '"') {
-            fputc('"', out);
-            fputc('"', out);
+    const char* quote;
+    while ((quote = (const char*)memchr(s, '"', (size_t)(end - s))) != NULL) {
+        if (!csv_buf_put(b, s, (size_t)(quote - s) + 1) || !csv_buf_put(b, "\"", 1)) {
+            return 0;
         }
-        else {
-            fputc(*p, out);
+        s = quote + 1;
+    }
+    return csv_buf_put(b, s, (size_t)(end - s)) && csv_buf_put(b, "\"", 1);
+}
+
+// Formats name, phone, address, email, due_amount, due_date, external_id as one line.
+static int csv_format_row(CsvBuf* b, const ContactView* row) {
+    char due_buf[64];
+    ContactField due;
+    due.ptr = due_buf;
+    due.len = (size_t)snprintf(due_buf, sizeof(due_buf), "%.2f", row->due_amount);
+    const ContactField* fields[CSV_COLS] = { &row->name, &row->phone, &row->address, &row->email, &due,
+        &row->due_date, &row->external_id };
+    for (int i = 0; i < CSV_COLS; ++i) {
+        if ((i > 0 && !csv_buf_put(b, ",", 1)) || !csv_format_field(b, fields[i])) {
+            return 0;
         }
     }
-    fputc('"', out);
+    return csv_buf_put(b, "\n", 1);
 }
 
 int csv_write_contacts(Db* db, FILE* out) {
+    Stream* s = stream_open_writer(out, STREAM_CODEC_PLAIN, 0);
+    if (!s) {
+        return 0;
+    }
+    int ok = csv_write_contacts_stream(db, s);
+    return stream_close(s) && ok;
+}
+
+typedef struct {
+    Stream* out;
+    CsvBuf line;
+    int ok;
+} CsvWriter;
+
+static int csv_write_row(void* ctx, const ContactView* row) {
+    CsvWriter* w = (CsvWriter*)ctx;
+    w->line.len = 0;
+    w->ok = csv_format_row(&w->line, row) && stream_write(w->out, w->line.data, w->line.len);
+    return w->ok;
+}
+
+int csv_write_contacts_stream(Db* db, Stream* out) {
+    return csv_write_contacts_filter(db, out, NULL);
+}
+
+int csv_write_contacts_filter(Db* db, Stream* out, const ContactFilter* filter) {
     if (!db || !db->handle || !out) {
         return 0;
     }
-    fprintf(out, "Name,Phone,Address,Email,DueAmount,DueDate\n");
+    stream_puts(out, CSV_HEADER);
+    CsvWriter w = { out, { 0 }, 1 };
+    int ok = contacts_foreach(db, filter, CONTACT_SORT_NAME, csv_write_row, &w);
+    free(w.line.data);
+    return ok && w.ok;
+}
+
+#ifdef HAVE_PTHREADS
+typedef struct {
+    uint32_t key_len;
+    uint32_t line_len;
+    int64_t id;
+} CsvShardRecord;
+
+typedef struct {
+    pthread_t thread;
+    const char* path;
+    const char* source;
+    int64_t first_id;
+    int64_t last_id;
+    int ordered;
+    int ok;
+    CsvBuf out;
+} CsvShard;
 
-    const char* sql = "SELECT name, phone, address, email, due_amount, due_date FROM contacts ORDER BY name COLLATE NOCASE;";
+typedef struct {
+    const char* pos;
+    const char* end;
+    CsvShardRecord rec;
+    const char* key;
+    const char* line;
+} CsvCursor;
+
+// Each shard reads its rowid range on its own read-only connection. Ordered shards keep the sort
+// key in front of every line so the merge never has to re-parse CSV.
+static void* csv_shard_worker(void* arg) {
+    CsvShard* shard = (CsvShard*)arg;
+    char* sql = sqlite3_mprintf("SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM %s"
+        " WHERE id BETWEEN ? AND ? ORDER BY %s;", shard->source, shard->ordered ? "name COLLATE NOCASE, id" : "id");
+    sqlite3* handle = db_open_reader(shard->path);
     sqlite3_stmt* stmt = NULL;
-    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return 0;
-    }
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* name = (const char*)sqlite3_column_text(stmt, 0);
-        const char* phone = (const char*)sqlite3_column_text(stmt, 1);
-        const char* address = (const char*)sqlite3_column_text(stmt, 2);
-        const char* email = (const char*)sqlite3_column_text(stmt, 3);
-        double due_amount = sqlite3_column_double(stmt, 4);
-        const char* due_date = (const char*)sqlite3_column_text(stmt, 5);
-
-        char due_buf[64];
-        snprintf(due_buf, sizeof(due_buf), "%.2f", due_amount);
-
-        csv_write_field(out, name ? name : "");
-        fputc(',', out);
-        csv_write_field(out, phone ? phone : "");
-        fputc(',', out);
-        csv_write_field(out, address ? address : "");
-        fputc(',', out);
-        csv_write_field(out, email ? email : "");
-        fputc(',', out);
-        csv_write_field(out, due_buf);
-        fputc(',', out);
-        csv_write_field(out, due_date ? due_date : "");
-        fputc('\n', out);
+    int ok = handle && sql && sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK;
+    sqlite3_free(sql);
+    if (ok) {
+        sqlite3_bind_int64(stmt, 1, shard->first_id);
+        sqlite3_bind_int64(stmt, 2, shard->last_id);
     }
+    CsvBuf line = { 0 };
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ContactView row;
+        contacts_view_row(stmt, &row);
+        if (!shard->ordered) {
+            ok = csv_format_row(&shard->out, &row);
+            continue;
+        }
+        line.len = 0;
+        CsvShardRecord rec;
+        rec.key_len = (uint32_t)row.name.len;
+        ok = csv_format_row(&line, &row);
+        rec.line_len = (uint32_t)line.len;
+        rec.id = row.id;
+        ok = ok && csv_buf_put(&shard->out, &rec, sizeof(rec)) && csv_buf_put(&shard->out, row.name.ptr, rec.key_len) &&
+            csv_buf_put(&shard->out, line.data, line.len);
+    }
+    shard->ok = ok && rc == SQLITE_DONE;
+    free(line.data);
     sqlite3_finalize(stmt);
+    sqlite3_close(handle);
+    return NULL;
+}
+
+static int csv_cursor_next(CsvCursor* c) {
+    if (c->pos >= c->end) {
+        return 0;
+    }
+    memcpy(&c->rec, c->pos, sizeof(c->rec));
+    c->key = c->pos + sizeof(c->rec);
+    c->line = c->key + c->rec.key_len;
+    c->pos = c->line + c->rec.line_len;
     return 1;
 }
 
-static int csv_read_record(FILE* in, char** fields, size_t field_count) {
+// Mirrors SQLite's NOCASE collation (ASCII-only folding), then breaks ties by id like the serial export.
+static int csv_cursor_less(const CsvCursor* a, const CsvCursor* b) {
+    size_t n = a->rec.key_len < b->rec.key_len ? a->rec.key_len : b->rec.key_len;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char ca = (unsigned char)a->key[i];
+        unsigned char cb = (unsigned char)b->key[i];
+        ca = (ca >= 'A' && ca <= 'Z') ? (unsigned char)(ca + 32) : ca;
+        cb = (cb >= 'A' && cb <= 'Z') ? (unsigned char)(cb + 32) : cb;
+        if (ca != cb) {
+            return ca < cb;
+        }
+    }
+    if (a->rec.key_len != b->rec.key_len) {
+        return a->rec.key_len < b->rec.key_len;
+    }
+    return a->rec.id < b->rec.id;
+}
+
+static void csv_heap_sift(CsvCursor** heap, size_t count, size_t i) {
+    for (;;) {
+        size_t best = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < count && csv_cursor_less(heap[left], heap[best])) {
+            best = left;
+        }
+        if (right < count && csv_cursor_less(heap[right], heap[best])) {
+            best = right;
+        }
+        if (best == i) {
+            return;
+        }
+        CsvCursor* tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+}
+
+static int csv_merge_shards(CsvShard* shards, int count, Stream* out) {
+    CsvCursor cursors[CSV_MAX_JOBS];
+    CsvCursor* heap[CSV_MAX_JOBS];
+    size_t live = 0;
+    for (int i = 0; i < count; ++i) {
+        cursors[i].pos = shards[i].out.data;
+        cursors[i].end = shards[i].out.data + shards[i].out.len;
+        if (cursors[i].pos && csv_cursor_next(&cursors[i])) {
+            heap[live++] = &cursors[i];
+        }
+    }
+    for (size_t i = live / 2; i-- > 0;) {
+        csv_heap_sift(heap, live, i);
+    }
+    while (live > 0) {
+        CsvCursor* top = heap[0];
+        if (!stream_write(out, top->line, top->rec.line_len)) {
+            return 0;
+        }
+        if (!csv_cursor_next(top)) {
+            heap[0] = heap[--live];
+        }
+        csv_heap_sift(heap, live, 0);
+    }
+    return 1;
+}
+#endif
+
+int csv_write_contacts_parallel(Db* db, Stream* out, int jobs, int ordered) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+#ifdef HAVE_PTHREADS
+    if (jobs > CSV_MAX_JOBS) {
+        jobs = CSV_MAX_JOBS;
+    }
+    // In-memory databases cannot be reopened by the workers.
+    const char* path = sqlite3_db_filename(db->handle, "main");
+    if (jobs <= 1 || !path || !path[0]) {
+        return csv_write_contacts_stream(db, out);
+    }
+
+    // Holding a read transaction keeps writers from committing while the shards are scanned.
+    if (!db_begin(db)) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    int64_t min_id = 0;
+    int64_t max_id = -1;
+    const char* source = db_contacts_source(db);
+    char* bounds = sqlite3_mprintf("SELECT MIN(id), MAX(id) FROM %s;", source);
+    int ok = bounds && sqlite3_prepare_v2(db->handle, bounds, -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_free(bounds);
+    if (ok && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        min_id = sqlite3_column_int64(stmt, 0);
+        max_id = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    CsvShard shards[CSV_MAX_JOBS];
+    memset(shards, 0, sizeof(shards));
+    int started = 0;
+    uint64_t span = (uint64_t)(max_id - min_id) + 1;
+    uint64_t step = span / (uint64_t)jobs + 1;
+    for (int i = 0; ok && max_id >= min_id && i < jobs; ++i) {
+        uint64_t first = (uint64_t)i * step;
+        if (first >= span) {
+            break;
+        }
+        uint64_t last = span - first > step ? first + step - 1 : span - 1;
+        shards[i].path = path;
+        shards[i].source = source;
+        shards[i].first_id = min_id + (int64_t)first;
+        shards[i].last_id = min_id + (int64_t)last;
+        shards[i].ordered = ordered;
+        if (pthread_create(&shards[i].thread, NULL, csv_shard_worker, &shards[i]) != 0) {
+            ok = 0;
+            break;
+        }
+        started++;
+    }
+
+    ok = ok && stream_puts(out, CSV_HEADER);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(shards[i].thread, NULL);
+        ok = ok && shards[i].ok;
+        // Unordered shards are already in id order, so each one is flushed as soon as it is joined.
+        if (ok && !ordered) {
+            ok = stream_write(out, shards[i].out.data, shards[i].out.len);
+            free(shards[i].out.data);
+            shards[i].out.data = NULL;
+        }
+    }
+    if (ok && ordered) {
+        ok = csv_merge_shards(shards, started, out);
+    }
+    for (int i = 0; i < started; ++i) {
+        free(shards[i].out.data);
+    }
+    db_commit(db);
+    return ok;
+#else
+    (void)jobs;
+    (void)ordered;
+    return csv_write_contacts_stream(db, out);
+#endif
+}
+
+// Where each source column of a contact file goes, from its header.
+typedef struct {
+    int slots[CSV_MAX_COLUMNS];  // contact field per source column, -1 to skip it
+    size_t need;                 // columns a row must have to reach every mapped required field
+} CsvColumnMap;
+
+// Without a map column i fills fields[i] and the count is capped at field_count. With one, columns go
+// to their slot, skipped ones are scanned without being copied, and the count is of source columns.
+static int csv_read_record(Stream* in, char** fields, size_t field_count, const CsvColumnMap* map) {
     if (!in || !fields || field_count == 0) {
         return 0;
     }
     size_t field = 0;
+    int slot = map ? map->slots[0] : 0;
     int c;
     int in_quotes = 0;
     size_t cap = 256;
@@ -85,27 +375,27 @@ static int csv_read_record(FILE* in, char** fields, size_t field_count) {
     }
     memset(fields, 0, sizeof(char*) * field_count);
 
-    while ((c = fgetc(in)) != EOF) {
-        if (field >= field_count) {
-            break;
-        }
+    while ((c = stream_getc(in)) != EOF) {
         if (!in_quotes && (c == ',' || c == '\n' || c == '\r')) {
-            buf[len] = '\0';
-            fields[field] = (char*)malloc(len + 1);
-            if (!fields[field]) {
-                free(buf);
-                return -1;
+            if (slot >= 0 && (size_t)slot < field_count) {
+                buf[len] = '\0';
+                fields[slot] = (char*)malloc(len + 1);
+                if (!fields[slot]) {
+                    free(buf);
+                    return -1;
+                }
+                memcpy(fields[slot], buf, len + 1);
             }
-            memcpy(fields[field], buf, len + 1);
             field++;
+            slot = !map ? (int)field : field < CSV_MAX_COLUMNS ? map->slots[field] : -1;
             len = 0;
             if (c == '\n') {
                 break;
             }
             if (c == '\r') {
-                int next = fgetc(in);
+                int next = stream_getc(in);
                 if (next != '\n' && next != EOF) {
-                    ungetc(next, in);
+                    stream_ungetc(in);
                 }
                 break;
             }
@@ -114,15 +404,14 @@ static int csv_read_record(FILE* in, char** fields, size_t field_count) {
 
         if (c == '"') {
             if (in_quotes) {
-                int next = fgetc(in);
+                int next = stream_getc(in);
                 if (next == '"') {
                     c = '"';
                 }
                 else {
                     in_quotes = 0;
                     if (next != EOF) {
-                        ungetc(next, in);
-                        continue;
+                        stream_ungetc(in);
                     }
                     continue;
                 }
@@ -132,6 +421,11 @@ static int csv_read_record(FILE* in, char** fields, size_t field_count) {
                 continue;
             }
         }
+        if (slot < 0) {
+            // A skipped column only tracks quoting; len marks that the field has started.
+            len = 1;
+            continue;
+        }
 
         if (len + 1 >= cap) {
             cap *= 2;
@@ -146,16 +440,16 @@ static int csv_read_record(FILE* in, char** fields, size_t field_count) {
     }
 
     if (len > 0 || field > 0) {
-        if (field < field_count) {
+        if (slot >= 0 && (size_t)slot < field_count) {
             buf[len] = '\0';
-            fields[field] = (char*)malloc(len + 1);
-            if (!fields[field]) {
+            fields[slot] = (char*)malloc(len + 1);
+            if (!fields[slot]) {
                 free(buf);
                 return -1;
             }
-            memcpy(fields[field], buf, len + 1);
-            field++;
+            memcpy(fields[slot], buf, len + 1);
         }
+        field++;
     }
     else {
         free(buf);
@@ -163,7 +457,7 @@ static int csv_read_record(FILE* in, char** fields, size_t field_count) {
     }
 
     free(buf);
-    return (int)field;
+    return (int)(map || field < field_count ? field : field_count);
 }
 
 static void csv_free_fields(char** fields, size_t field_count) {
@@ -173,89 +467,339 @@ static void csv_free_fields(char** fields, size_t field_count) {
     }
 }
 
+static void csv_fields_to_contact(char** fields, Contact* c) {
+    memset(c, 0, sizeof(*c));
+    snprintf(c->name, sizeof(c->name), "%s", fields[0] ? fields[0] : "");
+    snprintf(c->phone, sizeof(c->phone), "%s", fields[1] ? fields[1] : "");
+    snprintf(c->address, sizeof(c->address), "%s", fields[2] ? fields[2] : "");
+    snprintf(c->email, sizeof(c->email), "%s", fields[3] ? fields[3] : "");
+    snprintf(c->due_date, sizeof(c->due_date), "%s", fields[5] ? fields[5] : "");
+    if (!util_parse_double(fields[4] ? fields[4] : "0", &c->due_amount, -1e12, 1e12)) {
+        c->due_amount = 0.0;
+    }
+    if (fields[CSV_COL_EXTERNAL_ID]) {
+        snprintf(c->external_id, sizeof(c->external_id), "%s", fields[CSV_COL_EXTERNAL_ID]);
+    }
+}
+
+// Header names compare case-insensitively with anything but letters and digits dropped, so
+// "Due Amount", "due_amount" and "DueAmount" are the same column.
+static void csv_column_key(const char* name, char* out, size_t len) {
+    size_t n = 0;
+    for (; name && *name && n + 1 < len; ++name) {
+        unsigned char ch = (unsigned char)*name;
+        if (isalnum(ch)) {
+            out[n++] = (char)tolower(ch);
+        }
+    }
+    out[n] = '\0';
+}
+
+// Contact field for a header or --map name, -1 if it names none.
+static int csv_column_field(const char* name) {
+    static const char* const keys[] = { "name", "phone", "address", "email", "dueamount", "duedate", "externalid",
+        "fullname", "mobile", "telephone", "phonenumber", "emailaddress" };
+    static const int fields[] = { 0, 1, 2, 3, 4, 5, 6, 0, 1, 1, 1, 3 };
+    char key[64];
+    csv_column_key(name, key, sizeof(key));
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+        if (strcmp(key, keys[i]) == 0) {
+            return fields[i];
+        }
+    }
+    return -1;
+}
+
+static int csv_find_column(char** names, size_t count, const char* name) {
+    char want[64];
+    char key[64];
+    csv_column_key(name, want, sizeof(want));
+    for (size_t i = 0; i < count; ++i) {
+        csv_column_key(names[i], key, sizeof(key));
+        if (names[i] && strcmp(key, want) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Builds map from the header. Columns are matched by name, then spec ("Name=FullName,Phone=Mobile")
+// overrides single fields. Without spec a header that has no Name column is read positionally.
+static int csv_map_columns(char** names, size_t count, const char* spec, CsvColumnMap* map) {
+    int source[CSV_COLS];
+    for (int f = 0; f < CSV_COLS; ++f) {
+        source[f] = -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        int f = names[i] ? csv_column_field(names[i]) : -1;
+        if (f >= 0 && source[f] < 0) {
+            source[f] = (int)i;
+        }
+    }
+    const char* p = spec;
+    while (p && *p) {
+        size_t n = strcspn(p, ",");
+        char entry[256];
+        util_copy_str(entry, n + 1 < sizeof(entry) ? n + 1 : sizeof(entry), p);
+        p += n + (p[n] == ',');
+        char* eq = strchr(entry, '=');
+        if (eq) {
+            *eq = '\0';
+        }
+        int f = eq ? csv_column_field(entry) : -1;
+        if (f < 0 || !eq[1]) {
+            util_error("Invalid column mapping \"%s\"; use Field=Column.", entry);
+            return 0;
+        }
+        int column = csv_find_column(names, count, eq + 1);
+        if (column < 0) {
+            util_error("Column \"%s\" is not in the header.", eq + 1);
+            return 0;
+        }
+        // A column feeds one field, so an automatic match of the same column is dropped.
+        for (int g = 0; g < CSV_COLS; ++g) {
+            if (source[g] == column) {
+                source[g] = -1;
+            }
+        }
+        source[f] = column;
+    }
+    if (source[0] < 0 && spec) {
+        util_error("The header has no Name column; map one with Name=Column.");
+        return 0;
+    }
+    for (size_t i = 0; i < CSV_MAX_COLUMNS; ++i) {
+        map->slots[i] = -1;
+    }
+    map->need = source[0] < 0 ? CSV_COLS_REQUIRED : 0;
+    for (int f = 0; f < CSV_COLS; ++f) {
+        int column = source[0] < 0 ? f : source[f];
+        if (column >= 0) {
+            map->slots[column] = f;
+        }
+        if (source[0] >= 0 && f < CSV_COLS_REQUIRED && column >= 0 && (size_t)column + 1 > map->need) {
+            map->need = (size_t)column + 1;
+        }
+    }
+    return 1;
+}
+
+// Reads the header record into map: 1 when read, 0 for empty input, -1 on an error.
+static int csv_read_header(Stream* in, const char* spec, CsvColumnMap* map) {
+    char** names = (char**)calloc(CSV_MAX_COLUMNS, sizeof(char*));
+    if (!names) {
+        return -1;
+    }
+    int count = csv_read_record(in, names, CSV_MAX_COLUMNS, NULL);
+    int rc = count > 0 ? (csv_map_columns(names, (size_t)count, spec, map) ? 1 : -1) : count;
+    csv_free_fields(names, CSV_MAX_COLUMNS);
+    free(names);
+    return rc;
+}
+
 int csv_import_contacts(Db* db, FILE* in, int strict, int dry_run, int* out_imported, int* out_failed) {
-    if (!db || !db->handle || !in) {
+    Stream* s = stream_open_reader(in, STREAM_CODEC_AUTO, 0);
+    if (!s) {
         return 0;
     }
-    int imported = 0;
-    int failed = 0;
+    int ok = csv_import_contacts_stream(db, s, NULL, strict, dry_run, out_imported, out_failed);
+    return stream_close(s) && ok;
+}
 
-    char* fields[6];
-    int header_read = 0;
+static void csv_bind_contact(sqlite3_stmt* stmt, const Contact* c) {
+    sqlite3_bind_text(stmt, 1, c->name, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, c->phone, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, c->address, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 4, c->email, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 5, c->due_amount);
+    sqlite3_bind_text(stmt, 6, c->due_date, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 7, contacts_row_hash(c));
+    contacts_bind_due_day(stmt, 9, c->due_date);
+}
+
+static int csv_step_reset(sqlite3_stmt* stmt) {
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Progress of a checkpointed import: the file identity, the offset just past the last committed
+// record and the totals up to it.
+typedef struct {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t head_hash;
+    uint64_t offset;
+    int imported;
+    int failed;
+} CsvCheckpoint;
+
+static int csv_checkpoint_save(Db* db, const CsvCheckpoint* cp) {
+    char value[128];
+    snprintf(value, sizeof(value), "%llu %lld %llx %llu %d %d", (unsigned long long)cp->size,
+        (long long)cp->mtime, (unsigned long long)cp->head_hash, (unsigned long long)cp->offset, cp->imported,
+        cp->failed);
+    return db_set_setting(db, CSV_CHECKPOINT_KEY, value);
+}
+
+static int csv_checkpoint_load(Db* db, CsvCheckpoint* cp) {
+    char value[128];
+    unsigned long long size, head_hash, offset;
+    long long mtime;
+    if (!db_get_setting(db, CSV_CHECKPOINT_KEY, value, sizeof(value)) ||
+        sscanf(value, "%llu %lld %llx %llu %d %d", &size, &mtime, &head_hash, &offset, &cp->imported,
+            &cp->failed) != 6) {
+        return 0;
+    }
+    cp->size = size;
+    cp->mtime = mtime;
+    cp->head_hash = head_hash;
+    cp->offset = offset;
+    return 1;
+}
+
+static int csv_checkpoint_clear(Db* db) {
+    return sqlite3_exec(db->handle, "DELETE FROM settings WHERE key = '" CSV_CHECKPOINT_KEY "';", NULL, NULL,
+        NULL) == SQLITE_OK;
+}
+
+// Size, modification time and a hash of the first CSV_CHECKPOINT_HEAD bytes, read before the
+// stream takes over the file.
+static int csv_file_identity(const char* path, FILE* f, CsvCheckpoint* cp) {
+    struct stat st;
+    unsigned char head[CSV_CHECKPOINT_HEAD];
+    if (stat(path, &st) != 0) {
+        return 0;
+    }
+    size_t n = fread(head, 1, sizeof(head), f);
+    if (ferror(f) || fseek(f, 0, SEEK_SET) != 0) {
+        return 0;
+    }
+    memset(cp, 0, sizeof(*cp));
+    cp->size = (uint64_t)st.st_size;
+    cp->mtime = (int64_t)st.st_mtime;
+    cp->head_hash = util_fnv1a64(UTIL_FNV64_INIT, head, n);
+    return 1;
+}
+
+// Where the import rows come from: CSV records through a header map, or JSON objects.
+typedef struct {
+    Stream* in;
+    const CsvColumnMap* map;  // CSV after its header; NULL for an empty file
+    JsonReader* json;
+    char* fields[CSV_COLS];   // owned for CSV, borrowed from the reader for JSON
+} CsvSource;
 
+// Next row into src->fields: 1 when usable, -1 for a failed row, 0 at the end and -2 when the
+// input cannot be read further.
+static int csv_source_next(CsvSource* src) {
+    if (src->json) {
+        return json_read_object(src->json, csv_column_field, src->fields, CSV_COLS);
+    }
+    csv_free_fields(src->fields, CSV_COLS);
+    if (!src->map) {
+        return 0;
+    }
+    int count = csv_read_record(src->in, src->fields, CSV_COLS, src->map);
+    return count == 0 ? 0 : count > 0 && (size_t)count >= src->map->need ? 1 : -1;
+}
+
+// With cp the rows are committed every commit_rows records, each commit also storing cp with the
+// offset and totals so far; counting starts from the totals already in cp. Without cp the whole
+// input is one transaction.
+static int csv_import_rows(Db* db, CsvSource* src, int strict, int dry_run, CsvCheckpoint* cp, size_t commit_rows,
+    int* out_imported, int* out_failed) {
+    if (!db || !db->handle || !src->in) {
+        return 0;
+    }
+    int imported = cp ? cp->imported : 0;
+    int failed = cp ? cp->failed : 0;
+    size_t pending = 0;
+
+    // One prepared INSERT for the whole file; preparing per row would also recompile the change-log trigger.
+    sqlite3_stmt* insert = NULL;
     if (!dry_run) {
+        const char* sql =
+            "INSERT INTO contacts(name, phone, address, email, due_amount, due_date, row_hash, external_id, due_day)"
+            " VALUES(?,?,?,?,?,?,?,?,?);";
+        if (sqlite3_prepare_v2(db->handle, sql, -1, &insert, NULL) != SQLITE_OK) {
+            return 0;
+        }
+        contacts_invalidate_caches(db);
         if (!db_begin(db)) {
+            sqlite3_finalize(insert);
             return 0;
         }
     }
 
-    while (1) {
-        int count = csv_read_record(in, fields, 6);
-        if (count == 0) {
+    int ok = 1;
+    while (ok) {
+        int next = csv_source_next(src);
+        if (next == 0 || next == -2) {
+            ok = next == 0;
             break;
         }
-        if (count < 0) {
-            failed++;
-            csv_free_fields(fields, 6);
-            if (strict) {
-                if (!dry_run) {
-                    db_rollback(db);
-                }
-                return 0;
-            }
-            continue;
-        }
-        if (!header_read) {
-            header_read = 1;
-            csv_free_fields(fields, 6);
-            continue;
-        }
-        if (count < 6) {
-            failed++;
-            csv_free_fields(fields, 6);
-            if (strict) {
-                if (!dry_run) {
-                    db_rollback(db);
+        int row_ok = next > 0;
+        if (row_ok && !dry_run) {
+            Contact c;
+            csv_fields_to_contact(src->fields, &c);
+            row_ok = c.name[0] != '\0';
+            if (row_ok) {
+                csv_bind_contact(insert, &c);
+                if (c.external_id[0]) {
+                    sqlite3_bind_text(insert, 8, c.external_id, -1, SQLITE_TRANSIENT);
                 }
-                return 0;
+                row_ok = csv_step_reset(insert);
             }
-            continue;
         }
-        Contact c = { 0 };
-        snprintf(c.name, sizeof(c.name), "%s", fields[0] ? fields[0] : "");
-        snprintf(c.phone, sizeof(c.phone), "%s", fields[1] ? fields[1] : "");
-        snprintf(c.address, sizeof(c.address), "%s", fields[2] ? fields[2] : "");
-        snprintf(c.email, sizeof(c.email), "%s", fields[3] ? fields[3] : "");
-        snprintf(c.due_date, sizeof(c.due_date), "%s", fields[5] ? fields[5] : "");
-        if (!util_parse_double(fields[4] ? fields[4] : "0", &c.due_amount, -1e12, 1e12)) {
-            c.due_amount = 0.0;
-        }
-        int64_t id = 0;
-        int ok = 1;
-        if (!dry_run) {
-            ok = contacts_add(db, &c, &id);
-        }
-        if (ok) {
+        if (row_ok) {
             imported++;
         }
         else {
             failed++;
-            if (strict) {
-                csv_free_fields(fields, 6);
-                if (!dry_run) {
-                    db_rollback(db);
-                }
-                return 0;
+            ok = !strict;
+        }
+        if (ok && cp && ++pending >= commit_rows) {
+            CsvCheckpoint saved = *cp;
+            saved.offset = stream_tell(src->in);
+            saved.imported = imported;
+            saved.failed = failed;
+            ok = csv_checkpoint_save(db, &saved) && db_commit(db);
+            if (ok) {
+                *cp = saved;
             }
+            ok = ok && db_begin(db);
+            pending = 0;
         }
-        csv_free_fields(fields, 6);
+    }
+    sqlite3_finalize(insert);
+    if (!src->json) {
+        csv_free_fields(src->fields, CSV_COLS);
     }
 
+    // A read or decompression error looks like end of input to the parser; never commit a prefix.
+    if (stream_error(src->in)) {
+        ok = 0;
+    }
     if (!dry_run) {
-        if (!db_commit(db)) {
+        // A finished import leaves nothing to resume.
+        if (ok && cp) {
+            ok = csv_checkpoint_clear(db);
+        }
+        if (!ok || !db_commit(db)) {
             db_rollback(db);
+            if (cp) {
+                // Earlier chunks stay committed.
+                sketch_refresh(db);
+            }
             return 0;
         }
+        contacts_invalidate_caches(db);
+        sketch_refresh(db);
+    }
+    if (!ok) {
+        return 0;
     }
 
     if (out_imported) {
@@ -266,3 +810,371 @@ int csv_import_contacts(Db* db, FILE* in, int strict, int dry_run, int* out_impo
     }
     return 1;
 }
+
+// Reads the header of a contact file and points src at its rows.
+static int csv_open_source(CsvSource* src, Stream* in, const char* column_map, CsvColumnMap* map) {
+    memset(src, 0, sizeof(*src));
+    src->in = in;
+    int header = csv_read_header(in, column_map, map);
+    src->map = header > 0 ? map : NULL;
+    return header >= 0;
+}
+
+int csv_import_contacts_stream(Db* db, Stream* in, const char* column_map, int strict, int dry_run, int* out_imported,
+    int* out_failed) {
+    CsvColumnMap map;
+    CsvSource src;
+    return in && csv_open_source(&src, in, column_map, &map) &&
+        csv_import_rows(db, &src, strict, dry_run, NULL, 0, out_imported, out_failed);
+}
+
+int csv_import_contacts_json(Db* db, Stream* in, int strict, int dry_run, int* out_imported, int* out_failed) {
+    CsvSource src;
+    memset(&src, 0, sizeof(src));
+    src.in = in;
+    src.json = json_reader_open(in);
+    if (!src.json) {
+        return 0;
+    }
+    int ok = csv_import_rows(db, &src, strict, dry_run, NULL, 0, out_imported, out_failed);
+    json_reader_close(src.json);
+    return ok;
+}
+
+int csv_import_contacts_checkpointed(Db* db, const char* path, const char* column_map, int strict, size_t commit_rows,
+    int resume, int* out_imported, int* out_failed) {
+    if (!db || !db->handle || !path) {
+        return 0;
+    }
+    if (!sqlite3_get_autocommit(db->handle)) {
+        util_error("Checkpointed imports manage their own transactions.");
+        return 0;
+    }
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        util_error("Failed to open import file %s.", path);
+        return 0;
+    }
+    CsvCheckpoint cp;
+    if (!csv_file_identity(path, f, &cp)) {
+        fclose(f);
+        return 0;
+    }
+    if (resume) {
+        CsvCheckpoint saved;
+        if (!csv_checkpoint_load(db, &saved)) {
+            util_error("No interrupted import to resume.");
+            fclose(f);
+            return 0;
+        }
+        if (saved.size != cp.size || saved.mtime != cp.mtime || saved.head_hash != cp.head_hash) {
+            util_error("%s does not match the interrupted import.", path);
+            fclose(f);
+            return 0;
+        }
+        cp = saved;
+    }
+    else if (!csv_checkpoint_clear(db)) {
+        fclose(f);
+        return 0;
+    }
+    Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 1);
+    if (!in) {
+        fclose(f);
+        return 0;
+    }
+    CsvColumnMap map;
+    CsvSource src;
+    int ok = csv_open_source(&src, in, column_map, &map);
+    // A resumed import maps the header again, then skips the rows already committed.
+    uint64_t at = stream_tell(in);
+    if (ok && src.map && cp.offset > at && !stream_skip(in, cp.offset - at)) {
+        util_error("%s ends before the checkpoint offset.", path);
+        ok = 0;
+    }
+    ok = ok && csv_import_rows(db, &src, strict, 0, &cp, commit_rows > 0 ? commit_rows : CSV_CHECKPOINT_ROWS,
+        out_imported, out_failed);
+    ok = stream_close(in) && ok;
+    if (!ok) {
+        if (out_imported) {
+            *out_imported = cp.imported;
+        }
+        if (out_failed) {
+            *out_failed = cp.failed;
+        }
+    }
+    return ok;
+}
+
+// Fills the ledger INSERT from one record; 0 when a field is invalid.
+static int csv_bind_ledger(sqlite3_stmt* stmt, char** fields) {
+    int64_t contact_id = 0;
+    int64_t day = 0;
+    double amount = 0.0;
+    if (!fields[0] || !util_parse_i64(fields[0], &contact_id, 1, INT64_MAX) || !fields[1] ||
+        !util_epoch_day(fields[1], &day) || !fields[2] || !util_parse_double(fields[2], &amount, -1e12, 1e12) ||
+        amount == 0.0) {
+        return 0;
+    }
+    if (stmt) {
+        sqlite3_bind_int64(stmt, 1, contact_id);
+        sqlite3_bind_int64(stmt, 2, day);
+        sqlite3_bind_int64(stmt, 3, ledger_month_of(day));
+        sqlite3_bind_double(stmt, 4, amount);
+        sqlite3_bind_text(stmt, 5, fields[3] ? fields[3] : "", -1, SQLITE_TRANSIENT);
+    }
+    return 1;
+}
+
+int csv_import_ledger_stream(Db* db, Stream* in, int strict, int dry_run, int* out_imported, int* out_failed) {
+    if (!db || !db->handle || !in) {
+        return 0;
+    }
+    int imported = 0;
+    int failed = 0;
+    char* fields[CSV_LEDGER_COLS];
+    int header_read = 0;
+
+    // The ledger triggers keep balances and checkpoints current row by row, inside this transaction.
+    sqlite3_stmt* insert = NULL;
+    if (!dry_run) {
+        const char* sql = "INSERT INTO ledger(contact_id, day, month, amount, memo) VALUES(?,?,?,?,?);";
+        if (sqlite3_prepare_v2(db->handle, sql, -1, &insert, NULL) != SQLITE_OK) {
+            return 0;
+        }
+        if (!db_begin(db)) {
+            sqlite3_finalize(insert);
+            return 0;
+        }
+    }
+
+    int ok = 1;
+    while (ok) {
+        int count = csv_read_record(in, fields, CSV_LEDGER_COLS, NULL);
+        if (count == 0) {
+            break;
+        }
+        if (count < 0 || !header_read) {
+            failed += count < 0;
+            ok = count > 0 || !strict;
+            header_read = header_read || count > 0;
+            csv_free_fields(fields, CSV_LEDGER_COLS);
+            continue;
+        }
+        int row_ok = count >= CSV_LEDGER_COLS_REQUIRED && csv_bind_ledger(insert, fields);
+        if (row_ok && insert) {
+            row_ok = csv_step_reset(insert);
+        }
+        csv_free_fields(fields, CSV_LEDGER_COLS);
+        if (row_ok) {
+            imported++;
+        }
+        else {
+            failed++;
+            ok = !strict;
+        }
+    }
+    sqlite3_finalize(insert);
+
+    if (stream_error(in)) {
+        ok = 0;
+    }
+    if (!dry_run && (!ok || !db_commit(db))) {
+        db_rollback(db);
+        return 0;
+    }
+    if (!ok) {
+        return 0;
+    }
+    if (out_imported) {
+        *out_imported = imported;
+    }
+    if (out_failed) {
+        *out_failed = failed;
+    }
+    return 1;
+}
+
+static int csv_sync_apply(Db* db, sqlite3_stmt** stmts, const Contact* c, int dry_run, CsvSyncResult* out) {
+    sqlite3_stmt* lookup = stmts[0];
+    sqlite3_stmt* insert = stmts[1];
+    sqlite3_stmt* update = stmts[2];
+    sqlite3_stmt* seen = stmts[3];
+
+    sqlite3_bind_text(seen, 1, c->external_id, -1, SQLITE_TRANSIENT);
+    if (!csv_step_reset(seen)) {
+        return 0;
+    }
+
+    sqlite3_bind_text(lookup, 1, c->external_id, -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(lookup);
+    int exists = rc == SQLITE_ROW;
+    int64_t id = exists ? sqlite3_column_int64(lookup, 0) : 0;
+    int same = exists && sqlite3_column_type(lookup, 1) != SQLITE_NULL &&
+        sqlite3_column_int64(lookup, 1) == contacts_row_hash(c);
+    int archived = exists && sqlite3_column_int(lookup, 2);
+    sqlite3_reset(lookup);
+    sqlite3_clear_bindings(lookup);
+    if (!exists && rc != SQLITE_DONE) {
+        return 0;
+    }
+
+    // An unchanged archived contact stays archived; a changed one comes back before the update.
+    if (same) {
+        out->unchanged++;
+        return 1;
+    }
+    if (archived && !dry_run && !archive_restore(db, id)) {
+        return 0;
+    }
+    if (!dry_run) {
+        sqlite3_stmt* stmt = exists ? update : insert;
+        csv_bind_contact(stmt, c);
+        if (exists) {
+            sqlite3_bind_int64(stmt, 8, id);
+        }
+        else {
+            sqlite3_bind_text(stmt, 8, c->external_id, -1, SQLITE_TRANSIENT);
+        }
+        if (!csv_step_reset(stmt)) {
+            return 0;
+        }
+    }
+    if (exists) {
+        out->updated++;
+    }
+    else {
+        out->inserted++;
+    }
+    return 1;
+}
+
+// Archived contacts came from the same source, so they are pruned as well.
+static int csv_sync_delete_missing(Db* db, int dry_run, CsvSyncResult* out) {
+    const char* tables[2] = { "contacts", "contacts_archive" };
+    out->deleted = 0;
+    for (int i = 0; i < 2; ++i) {
+        // Contacts with ledger entries are kept; archived ones never have any.
+        char* sql = sqlite3_mprintf("%s FROM %s WHERE external_id IS NOT NULL"
+            " AND external_id NOT IN (SELECT external_id FROM temp.sync_seen)"
+            " AND id NOT IN (SELECT contact_id FROM ledger);", dry_run ? "SELECT COUNT(*)" : "DELETE", tables[i]);
+        sqlite3_stmt* stmt = NULL;
+        int prepared = sql && sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) == SQLITE_OK;
+        sqlite3_free(sql);
+        if (!prepared) {
+            return 0;
+        }
+        int rc = sqlite3_step(stmt);
+        if (dry_run && rc == SQLITE_ROW) {
+            out->deleted += sqlite3_column_int(stmt, 0);
+        }
+        else if (!dry_run && rc == SQLITE_DONE) {
+            out->deleted += sqlite3_changes(db->handle);
+        }
+        sqlite3_finalize(stmt);
+        if (rc != (dry_run ? SQLITE_ROW : SQLITE_DONE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int csv_sync_contacts(Db* db, FILE* in, int strict, int dry_run, int delete_missing, CsvSyncResult* out) {
+    Stream* s = stream_open_reader(in, STREAM_CODEC_AUTO, 0);
+    if (!s) {
+        return 0;
+    }
+    int ok = csv_sync_contacts_stream(db, s, NULL, strict, dry_run, delete_missing, out);
+    return stream_close(s) && ok;
+}
+
+int csv_sync_contacts_stream(Db* db, Stream* in, const char* column_map, int strict, int dry_run, int delete_missing,
+    CsvSyncResult* out) {
+    if (!db || !db->handle || !in || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    CsvColumnMap map;
+    int header = csv_read_header(in, column_map, &map);
+    if (header < 0) {
+        return 0;
+    }
+
+    const char* setup =
+        "CREATE TEMP TABLE IF NOT EXISTS sync_seen(external_id TEXT PRIMARY KEY);"
+        "DELETE FROM temp.sync_seen;";
+    if (sqlite3_exec(db->handle, setup, NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+
+    const char* sql[4] = {
+        "SELECT id, row_hash, 0 FROM contacts WHERE external_id=?1"
+        " UNION ALL SELECT id, row_hash, 1 FROM contacts_archive WHERE external_id=?1;",
+        "INSERT INTO contacts(name, phone, address, email, due_amount, due_date, row_hash, external_id, due_day)"
+        " VALUES(?,?,?,?,?,?,?,?,?);",
+        "UPDATE contacts SET name=?, phone=?, address=?, email=?, due_amount=?, due_date=?, row_hash=?,"
+        " due_day=?9 WHERE id=?8;",
+        "INSERT OR IGNORE INTO temp.sync_seen(external_id) VALUES(?);",
+    };
+    sqlite3_stmt* stmts[4] = { NULL, NULL, NULL, NULL };
+    int ok = 1;
+    for (int i = 0; i < 4 && ok; ++i) {
+        ok = sqlite3_prepare_v2(db->handle, sql[i], -1, &stmts[i], NULL) == SQLITE_OK;
+    }
+    if (ok) {
+        ok = db_begin(db);
+    }
+    if (!ok) {
+        for (int i = 0; i < 4; ++i) {
+            sqlite3_finalize(stmts[i]);
+        }
+        return 0;
+    }
+
+    char* fields[CSV_COLS];
+    while (ok && header > 0) {
+        int count = csv_read_record(in, fields, CSV_COLS, &map);
+        if (count == 0) {
+            break;
+        }
+        int row_ok = count > 0 && (size_t)count >= map.need;
+        Contact c;
+        if (row_ok) {
+            csv_fields_to_contact(fields, &c);
+            row_ok = c.name[0] && c.external_id[0];
+        }
+        csv_free_fields(fields, CSV_COLS);
+        if (row_ok) {
+            row_ok = csv_sync_apply(db, stmts, &c, dry_run, out);
+        }
+        if (!row_ok) {
+            out->failed++;
+            if (strict) {
+                ok = 0;
+            }
+        }
+    }
+
+    if (stream_error(in)) {
+        ok = 0;
+    }
+    if (ok && delete_missing) {
+        ok = csv_sync_delete_missing(db, dry_run, out);
+    }
+    for (int i = 0; i < 4; ++i) {
+        sqlite3_finalize(stmts[i]);
+    }
+    if (!ok || dry_run) {
+        db_rollback(db);
+        return ok;
+    }
+    int committed = db_commit(db);
+    if (!committed) {
+        db_rollback(db);
+    }
+    contacts_invalidate_caches(db);
+    if (committed) {
+        sketch_refresh(db);
+    }
+    return committed;
+}
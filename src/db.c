@@ -1,15 +1,24 @@
 // Purpose: SQLite database wrapper and schema management. Author: GitHub Copilot
 #include "db.h"
+#include "cache.h"
+#include "fuzzy_index.h"
+#include "name_index.h"
+#include "sketch.h"
+#include "tags.h"
+#include "util.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define DB_CONTACT_COLUMNS "id, name, phone, address, email, due_amount, due_date, external_id, row_hash, due_day, balance"
+
 static int db_exec(sqlite3* db, const char* sql) {
     char* errmsg = NULL;
     int rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
     if (rc != SQLITE_OK) {
         if (errmsg) {
-            fprintf(stderr, "SQLite error: %s\n", errmsg);
+            util_error("SQLite error: %s", errmsg);
             sqlite3_free(errmsg);
         }
         return 0;
@@ -17,14 +26,94 @@ static int db_exec(sqlite3* db, const char* sql) {
     return 1;
 }
 
-int db_open(Db* db, const char* path) {
-    if (!db || !path) {
+static int db_column_exists(sqlite3* db, const char* table, const char* column) {
+    char sql[128];
+    snprintf(sql, sizeof(sql), "PRAGMA table_info(%s);", table);
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
         return 0;
     }
+    int found = 0;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        if (name && strcmp((const char*)name, column) == 0) {
+            found = 1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// CREATE TABLE IF NOT EXISTS never adds columns to a table created by an older schema.
+static int db_ensure_column(sqlite3* db, const char* table, const char* column, const char* decl) {
+    if (db_column_exists(db, table, column)) {
+        return 1;
+    }
+    char sql[256];
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s;", table, column, decl);
+    return db_exec(db, sql);
+}
+
+// due_day mirrors due_date as days since 1970-01-01 so upcoming dates can be read off an index.
+static int db_backfill_due_day(sqlite3* db) {
+    sqlite3_stmt* select = NULL;
+    sqlite3_stmt* update = NULL;
+    int ok = sqlite3_prepare_v2(db, "SELECT id, due_date FROM contacts WHERE due_date <> '';", -1, &select, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "UPDATE contacts SET due_day=? WHERE id=?;", -1, &update, NULL) == SQLITE_OK &&
+        db_exec(db, "BEGIN;");
+    if (!ok) {
+        sqlite3_finalize(select);
+        sqlite3_finalize(update);
+        return 0;
+    }
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(select)) == SQLITE_ROW) {
+        int64_t day = 0;
+        if (!util_epoch_day((const char*)sqlite3_column_text(select, 1), &day)) {
+            continue;
+        }
+        sqlite3_bind_int64(update, 1, day);
+        sqlite3_bind_int64(update, 2, sqlite3_column_int64(select, 0));
+        ok = sqlite3_step(update) == SQLITE_DONE;
+        sqlite3_reset(update);
+    }
+    ok = ok && rc == SQLITE_DONE;
+    sqlite3_finalize(select);
+    sqlite3_finalize(update);
+    return db_exec(db, ok ? "COMMIT;" : "ROLLBACK;") && ok;
+}
+
+static int db_user_version(sqlite3* db) {
+    sqlite3_stmt* stmt = NULL;
+    int version = -1;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static void db_reset(Db* db, const char* path) {
     db->path = path;
     db->handle = NULL;
+    db->cache = NULL;
+    db->name_index = NULL;
+    db->fuzzy_index = NULL;
+    db->tag_cache = NULL;
+    db->sketch = NULL;
+    db->read_only = 0;
+    db->include_archived = 0;
+    db->shards = NULL;
+    db->shard_count = 0;
+}
+
+int db_open(Db* db, const char* path) {
+    if (!db || !path) {
+        return 0;
+    }
+    db_reset(db, path);
     if (sqlite3_open(path, &db->handle) != SQLITE_OK) {
-        fprintf(stderr, "Failed to open database: %s\n", sqlite3_errmsg(db->handle));
+        util_error("Failed to open database: %s", sqlite3_errmsg(db->handle));
         sqlite3_close(db->handle);
         db->handle = NULL;
         return 0;
@@ -35,7 +124,50 @@ int db_open(Db* db, const char* path) {
     return 1;
 }
 
+int db_open_for_read(Db* db, const char* path) {
+    if (!db || !path) {
+        return 0;
+    }
+    db_reset(db, path);
+    if (sqlite3_open_v2(path, &db->handle, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK) {
+        sqlite3_busy_timeout(db->handle, 5000);
+        if (db_user_version(db->handle) >= DB_SCHEMA_VERSION) {
+            db->read_only = 1;
+            return 1;
+        }
+    }
+    sqlite3_close(db->handle);
+    db->handle = NULL;
+    return db_open(db, path) && db_init(db);
+}
+
+sqlite3* db_open_reader(const char* path) {
+    sqlite3* handle = NULL;
+    if (!path || sqlite3_open_v2(path, &handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+        sqlite3_close(handle);
+        return NULL;
+    }
+    sqlite3_busy_timeout(handle, 5000);
+    return handle;
+}
+
 void db_close(Db* db) {
+    if (db) {
+        cache_destroy(db->cache);
+        db->cache = NULL;
+        name_index_destroy(db->name_index);
+        db->name_index = NULL;
+        fuzzy_index_destroy(db->fuzzy_index);
+        db->fuzzy_index = NULL;
+        tags_invalidate(db);
+        sketch_invalidate(db);
+        for (size_t i = 0; i < db->shard_count; ++i) {
+            db_close(&db->shards[i].db);
+        }
+        free(db->shards);
+        db->shards = NULL;
+        db->shard_count = 0;
+    }
     if (db && db->handle) {
         sqlite3_close(db->handle);
         db->handle = NULL;
@@ -46,6 +178,10 @@ int db_init(Db* db) {
     if (!db || !db->handle) {
         return 0;
     }
+    // Every statement below is idempotent, but running them costs a write transaction per start.
+    if (db_user_version(db->handle) >= DB_SCHEMA_VERSION) {
+        return 1;
+    }
     const char* schema =
         "BEGIN;"
         "CREATE TABLE IF NOT EXISTS contacts ("
@@ -55,7 +191,11 @@ int db_init(Db* db) {
         "address TEXT,"
         "email TEXT,"
         "due_amount REAL DEFAULT 0,"
-        "due_date TEXT"
+        "due_date TEXT,"
+        "external_id TEXT,"
+        "row_hash INTEGER,"
+        "due_day INTEGER,"
+        "balance REAL NOT NULL DEFAULT 0"
         ");"
         "CREATE TABLE IF NOT EXISTS settings ("
         "key TEXT PRIMARY KEY,"
@@ -65,9 +205,160 @@ int db_init(Db* db) {
         "id INTEGER PRIMARY KEY CHECK (id = 1),"
         "hash TEXT NOT NULL"
         ");"
+        "CREATE TABLE IF NOT EXISTS shards ("
+        "tenant TEXT PRIMARY KEY,"
+        "path TEXT NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS contact_changes ("
+        "seq INTEGER PRIMARY KEY,"
+        "op TEXT NOT NULL,"
+        "contact_id INTEGER NOT NULL,"
+        "name TEXT,"
+        "phone TEXT,"
+        "address TEXT,"
+        "email TEXT,"
+        "due_amount REAL,"
+        "due_date TEXT,"
+        "external_id TEXT,"
+        "changed_at TEXT NOT NULL DEFAULT (strftime('%Y-%m-%dT%H:%M:%fZ', 'now'))"
+        ");"
+        "CREATE TABLE IF NOT EXISTS tags ("
+        "name TEXT PRIMARY KEY,"
+        "bitmap BLOB"
+        ");"
+        "CREATE TABLE IF NOT EXISTS contact_tags ("
+        "tag TEXT NOT NULL REFERENCES tags(name) ON DELETE CASCADE,"
+        "contact_id INTEGER NOT NULL REFERENCES contacts(id) ON DELETE CASCADE,"
+        "PRIMARY KEY (tag, contact_id)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS ledger ("
+        "id INTEGER PRIMARY KEY,"
+        "contact_id INTEGER NOT NULL REFERENCES contacts(id) ON DELETE CASCADE,"
+        "day INTEGER NOT NULL,"
+        "month INTEGER NOT NULL,"
+        "amount REAL NOT NULL,"
+        "memo TEXT"
+        ");"
+        "CREATE TABLE IF NOT EXISTS ledger_checkpoints ("
+        "contact_id INTEGER NOT NULL,"
+        "month INTEGER NOT NULL,"
+        "balance REAL NOT NULL,"
+        "PRIMARY KEY (contact_id, month)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS contacts_archive ("
+        "id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL,"
+        "phone TEXT,"
+        "address TEXT,"
+        "email TEXT,"
+        "due_amount REAL DEFAULT 0,"
+        "due_date TEXT,"
+        "external_id TEXT,"
+        "row_hash INTEGER,"
+        "due_day INTEGER,"
+        "balance REAL NOT NULL DEFAULT 0,"
+        "archived_at TEXT NOT NULL DEFAULT (strftime('%Y-%m-%dT%H:%M:%fZ', 'now'))"
+        ");"
+        "CREATE TABLE IF NOT EXISTS contact_tags_archive ("
+        "contact_id INTEGER NOT NULL REFERENCES contacts_archive(id) ON DELETE CASCADE,"
+        "tag TEXT NOT NULL,"
+        "PRIMARY KEY (contact_id, tag)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS sketches ("
+        "name TEXT PRIMARY KEY,"
+        "seq INTEGER NOT NULL,"
+        "data BLOB NOT NULL"
+        ");"
         "COMMIT;";
+    // Change log triggers: inserts and updates record the new row image, deletes the old one.
+    // Updates that only touch derived columns (row_hash, due_day) are not logged. Moving a row
+    // between tiers is logged as 'archive' or 'restore': the archive copy is written before the
+    // hot row goes and removed only after it is back, and ids are never reused. Schema 7 changed
+    // the op of the first two triggers, so older copies are replaced.
+    const char* triggers =
+        "DROP TRIGGER IF EXISTS contacts_log_insert;"
+        "DROP TRIGGER IF EXISTS contacts_log_delete;"
+        "CREATE TRIGGER IF NOT EXISTS contacts_log_insert AFTER INSERT ON contacts BEGIN "
+        "INSERT INTO contact_changes(op, contact_id, name, phone, address, email, due_amount, due_date, external_id)"
+        " VALUES(CASE WHEN EXISTS (SELECT 1 FROM contacts_archive WHERE id = NEW.id) THEN 'restore' ELSE 'insert' END,"
+        " NEW.id, NEW.name, NEW.phone, NEW.address, NEW.email, NEW.due_amount, NEW.due_date,"
+        " NEW.external_id); END;"
+        "CREATE TRIGGER IF NOT EXISTS contacts_log_update"
+        " AFTER UPDATE OF name, phone, address, email, due_amount, due_date, external_id ON contacts BEGIN "
+        "INSERT INTO contact_changes(op, contact_id, name, phone, address, email, due_amount, due_date, external_id)"
+        " VALUES('update', NEW.id, NEW.name, NEW.phone, NEW.address, NEW.email, NEW.due_amount, NEW.due_date,"
+        " NEW.external_id); END;"
+        "CREATE TRIGGER IF NOT EXISTS contacts_log_delete AFTER DELETE ON contacts BEGIN "
+        "INSERT INTO contact_changes(op, contact_id, name, phone, address, email, due_amount, due_date, external_id)"
+        " VALUES(CASE WHEN EXISTS (SELECT 1 FROM contacts_archive WHERE id = OLD.id) THEN 'archive' ELSE 'delete' END,"
+        " OLD.id, OLD.name, OLD.phone, OLD.address, OLD.email, OLD.due_amount, OLD.due_date, OLD.external_id); END;"
+        // Archived contacts pruned by --sync or --delete-all are real deletes; restore is not.
+        "CREATE TRIGGER IF NOT EXISTS contacts_archive_log_delete AFTER DELETE ON contacts_archive"
+        " WHEN NOT EXISTS (SELECT 1 FROM contacts WHERE id = OLD.id) BEGIN "
+        "INSERT INTO contact_changes(op, contact_id, name, phone, address, email, due_amount, due_date, external_id)"
+        " VALUES('delete', OLD.id, OLD.name, OLD.phone, OLD.address, OLD.email, OLD.due_amount, OLD.due_date,"
+        " OLD.external_id); END;"
+        // tags.bitmap caches the serialized members; any membership change marks it stale.
+        "CREATE TRIGGER IF NOT EXISTS contact_tags_stale_insert AFTER INSERT ON contact_tags BEGIN "
+        "UPDATE tags SET bitmap = NULL WHERE name = NEW.tag AND bitmap IS NOT NULL; END;"
+        "CREATE TRIGGER IF NOT EXISTS contact_tags_stale_delete AFTER DELETE ON contact_tags BEGIN "
+        "UPDATE tags SET bitmap = NULL WHERE name = OLD.tag AND bitmap IS NOT NULL; END;"
+        // Each ledger_checkpoints row is a balance at the end of a month, for one contact or for the
+        // whole book (contact_id 0). A month gets a row on its first entry, seeded from the previous
+        // checkpoint; a back-dated entry also shifts every later checkpoint.
+        "CREATE TRIGGER IF NOT EXISTS ledger_apply_insert AFTER INSERT ON ledger BEGIN "
+        "UPDATE contacts SET balance = balance + NEW.amount WHERE id = NEW.contact_id;"
+        "INSERT OR IGNORE INTO ledger_checkpoints(contact_id, month, balance)"
+        " SELECT k.id, NEW.month, COALESCE((SELECT c.balance FROM ledger_checkpoints c"
+        " WHERE c.contact_id = k.id AND c.month < NEW.month ORDER BY c.month DESC LIMIT 1), 0)"
+        " FROM (SELECT NEW.contact_id AS id UNION ALL SELECT 0) k;"
+        "UPDATE ledger_checkpoints SET balance = balance + NEW.amount"
+        " WHERE contact_id IN (NEW.contact_id, 0) AND month >= NEW.month; END;"
+        "CREATE TRIGGER IF NOT EXISTS ledger_apply_delete AFTER DELETE ON ledger BEGIN "
+        "UPDATE contacts SET balance = balance - OLD.amount WHERE id = OLD.contact_id;"
+        "UPDATE ledger_checkpoints SET balance = balance - OLD.amount"
+        " WHERE contact_id IN (OLD.contact_id, 0) AND month >= OLD.month; END;"
+        // Ledger history is never rewritten, so a contact with entries cannot be deleted.
+        "CREATE TRIGGER IF NOT EXISTS contacts_ledger_keep BEFORE DELETE ON contacts"
+        " WHEN EXISTS (SELECT 1 FROM ledger WHERE contact_id = OLD.id) BEGIN "
+        "SELECT RAISE(ABORT, 'contact has ledger entries'); END;"
+        "CREATE TRIGGER IF NOT EXISTS contacts_ledger_delete AFTER DELETE ON contacts BEGIN "
+        "DELETE FROM ledger_checkpoints WHERE contact_id = OLD.id; END;"
+        // External ids stay unique across both tiers; only archive_restore may reuse an archived one.
+        "CREATE TRIGGER IF NOT EXISTS contacts_archive_key BEFORE INSERT ON contacts"
+        " WHEN NEW.external_id IS NOT NULL BEGIN "
+        "SELECT RAISE(ABORT, 'external_id belongs to an archived contact') WHERE EXISTS"
+        " (SELECT 1 FROM contacts_archive WHERE external_id = NEW.external_id AND id IS NOT NEW.id); END;";
+    const char* indexes =
+        "CREATE UNIQUE INDEX IF NOT EXISTS idx_contacts_external_id ON contacts(external_id);"
+        "CREATE INDEX IF NOT EXISTS idx_contacts_name ON contacts(name COLLATE NOCASE);"
+        "CREATE INDEX IF NOT EXISTS idx_contacts_due_amount ON contacts(due_amount);"
+        "CREATE INDEX IF NOT EXISTS idx_contacts_due_date ON contacts(due_date);"
+        "CREATE INDEX IF NOT EXISTS idx_contacts_due_day ON contacts(due_day);"
+        "CREATE INDEX IF NOT EXISTS idx_contact_tags_contact ON contact_tags(contact_id);"
+        "CREATE INDEX IF NOT EXISTS idx_ledger_contact ON ledger(contact_id, day);"
+        "CREATE INDEX IF NOT EXISTS idx_ledger_day ON ledger(day);"
+        "CREATE INDEX IF NOT EXISTS idx_contact_changes_contact ON contact_changes(contact_id, seq);"
+        "CREATE UNIQUE INDEX IF NOT EXISTS idx_contacts_archive_external_id ON contacts_archive(external_id);";
 
-    return db_exec(db->handle, schema);
+    if (!db_exec(db->handle, schema)) {
+        return 0;
+    }
+    int had_due_day = db_column_exists(db->handle, "contacts", "due_day");
+    if (!db_ensure_column(db->handle, "contacts", "external_id", "TEXT") ||
+        !db_ensure_column(db->handle, "contacts", "row_hash", "INTEGER") ||
+        !db_ensure_column(db->handle, "contacts", "due_day", "INTEGER") ||
+        !db_ensure_column(db->handle, "contacts", "balance", "REAL NOT NULL DEFAULT 0")) {
+        return 0;
+    }
+    if (!had_due_day && !db_backfill_due_day(db->handle)) {
+        return 0;
+    }
+    char version[64];
+    snprintf(version, sizeof(version), "PRAGMA user_version = %d;", DB_SCHEMA_VERSION);
+    // The first sketch is built here, so --stats --approx never has to scan the table.
+    return db_exec(db->handle, indexes) && db_exec(db->handle, triggers) && sketch_refresh(db) &&
+        db_exec(db->handle, version);
 }
 
 int db_begin(Db* db) {
@@ -91,6 +382,14 @@ int db_rollback(Db* db) {
     return db_exec(db->handle, "ROLLBACK;");
 }
 
+const char* db_contacts_source(const Db* db) {
+    if (!db || !db->include_archived) {
+        return "contacts";
+    }
+    return "(SELECT " DB_CONTACT_COLUMNS " FROM main.contacts UNION ALL SELECT " DB_CONTACT_COLUMNS
+        " FROM main.contacts_archive) AS contacts";
+}
+
 int db_set_setting(Db* db, const char* key, const char* value) {
     if (!db || !db->handle || !key || !value) {
         return 0;
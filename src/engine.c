@@ -0,0 +1,318 @@
+// Purpose: Thread-safe embedding API over a pool of database connections. Author: GitHub Copilot
+#include "engine.h"
+#include "auth.h"
+#include "query.h"
+#include "util.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define ENGINE_MAX_CONNECTIONS 64
+#define ENGINE_BUSY_TIMEOUT_MS 5000
+
+struct Engine {
+    char* path;
+    Db* conns;
+    size_t count;
+    size_t* idle;
+    size_t idle_count;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+#endif
+};
+
+static EngineStatus engine_fail(EngineError* err, EngineStatus code, const char* fmt, ...) {
+    if (err) {
+        err->code = code;
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(err->message, sizeof(err->message), fmt, args);
+        va_end(args);
+    }
+    return code;
+}
+
+static EngineStatus engine_ok(EngineError* err) {
+    if (err) {
+        err->code = ENGINE_OK;
+        err->message[0] = '\0';
+    }
+    return ENGINE_OK;
+}
+
+// Prefers the message the library reported on this thread, then SQLite's own.
+static EngineStatus engine_db_fail(Db* db, EngineError* err) {
+    int rc = db && db->handle ? sqlite3_errcode(db->handle) : SQLITE_ERROR;
+    EngineStatus code = (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) ? ENGINE_BUSY : ENGINE_DB;
+    const char* message = util_last_error();
+    if (!message[0]) {
+        message = db && db->handle ? sqlite3_errmsg(db->handle) : "database error";
+    }
+    return engine_fail(err, code, "%s", message);
+}
+
+static Db* engine_acquire(Engine* engine) {
+    util_clear_error();
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&engine->lock);
+    while (engine->idle_count == 0) {
+        pthread_cond_wait(&engine->released, &engine->lock);
+    }
+    Db* db = &engine->conns[engine->idle[--engine->idle_count]];
+    pthread_mutex_unlock(&engine->lock);
+    return db;
+#else
+    return &engine->conns[engine->idle[--engine->idle_count]];
+#endif
+}
+
+static void engine_release(Engine* engine, Db* db) {
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&engine->lock);
+    engine->idle[engine->idle_count++] = (size_t)(db - engine->conns);
+    pthread_cond_signal(&engine->released);
+    pthread_mutex_unlock(&engine->lock);
+#else
+    engine->idle[engine->idle_count++] = (size_t)(db - engine->conns);
+#endif
+}
+
+static EngineStatus engine_validate(const Contact* c, EngineError* err) {
+    if (!c || !c->name[0]) {
+        return engine_fail(err, ENGINE_INVALID, "Name is required.");
+    }
+    struct tm tmp;
+    if (c->due_date[0] && !util_parse_iso_date(c->due_date, &tmp)) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid due date format. Use YYYY-MM-DD.");
+    }
+    // Also rejects NaN and infinities.
+    if (!(c->due_amount >= -1e12 && c->due_amount <= 1e12)) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid due amount.");
+    }
+    return ENGINE_OK;
+}
+
+static void engine_free(Engine* engine) {
+    for (size_t i = 0; i < engine->count; ++i) {
+        db_close(&engine->conns[i]);
+    }
+    free(engine->conns);
+    free(engine->idle);
+    free(engine->path);
+    free(engine);
+}
+
+EngineStatus engine_open(const char* path, const char* password, int connections, Engine** out, EngineError* err) {
+    if (!path || !password || !out || connections < 1 || connections > ENGINE_MAX_CONNECTIONS) {
+        return engine_fail(err, ENGINE_INVALID, "Need a path, a password, an output and 1-%d connections.",
+            ENGINE_MAX_CONNECTIONS);
+    }
+    *out = NULL;
+#ifndef HAVE_PTHREADS
+    connections = 1;
+#endif
+    util_clear_error();
+    Engine* engine = (Engine*)calloc(1, sizeof(Engine));
+    if (!engine) {
+        return engine_fail(err, ENGINE_NO_MEMORY, "Out of memory.");
+    }
+    size_t path_len = strlen(path) + 1;
+    engine->path = (char*)malloc(path_len);
+    engine->conns = (Db*)calloc((size_t)connections, sizeof(Db));
+    engine->idle = (size_t*)calloc((size_t)connections, sizeof(size_t));
+    if (!engine->path || !engine->conns || !engine->idle) {
+        engine_free(engine);
+        return engine_fail(err, ENGINE_NO_MEMORY, "Out of memory.");
+    }
+    memcpy(engine->path, path, path_len);
+
+    // The first connection creates or migrates the schema and checks the password.
+    for (int i = 0; i < connections; ++i) {
+        Db* db = &engine->conns[i];
+        int ok = db_open(db, engine->path);
+        engine->count++;
+        if (ok && i == 0) {
+            ok = db_init(db);
+        }
+        if (!ok) {
+            EngineStatus status = engine_db_fail(db, err);
+            engine_free(engine);
+            return status;
+        }
+        sqlite3_busy_timeout(db->handle, ENGINE_BUSY_TIMEOUT_MS);
+        engine->idle[engine->idle_count++] = (size_t)i;
+        if (i == 0) {
+            char hash[256];
+            if (!db_get_password_hash(db, hash, sizeof(hash))) {
+                engine_free(engine);
+                return engine_fail(err, ENGINE_AUTH, "Password not set.");
+            }
+            if (!auth_verify_password(db, password)) {
+                engine_free(engine);
+                return engine_fail(err, ENGINE_AUTH, "Invalid password.");
+            }
+        }
+    }
+#ifdef HAVE_PTHREADS
+    pthread_mutex_init(&engine->lock, NULL);
+    pthread_cond_init(&engine->released, NULL);
+#endif
+    *out = engine;
+    return engine_ok(err);
+}
+
+void engine_close(Engine* engine) {
+    if (!engine) {
+        return;
+    }
+#ifdef HAVE_PTHREADS
+    pthread_cond_destroy(&engine->released);
+    pthread_mutex_destroy(&engine->lock);
+#endif
+    engine_free(engine);
+}
+
+EngineStatus engine_get(Engine* engine, int64_t id, Contact* out, EngineError* err) {
+    if (!engine || !out || id <= 0) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid ID.");
+    }
+    Db* db = engine_acquire(engine);
+    EngineStatus status = engine_ok(err);
+    if (!contacts_get_by_id(db, id, out)) {
+        int rc = sqlite3_errcode(db->handle);
+        status = (rc == SQLITE_OK || rc == SQLITE_DONE || rc == SQLITE_ROW)
+            ? engine_fail(err, ENGINE_NOT_FOUND, "Contact %lld not found.", (long long)id)
+            : engine_db_fail(db, err);
+    }
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_add(Engine* engine, const Contact* c, int64_t* out_id, EngineError* err) {
+    if (!engine) {
+        return engine_fail(err, ENGINE_INVALID, "No engine.");
+    }
+    EngineStatus status = engine_validate(c, err);
+    if (status != ENGINE_OK) {
+        return status;
+    }
+    Db* db = engine_acquire(engine);
+    status = contacts_add(db, c, out_id) ? engine_ok(err) : engine_db_fail(db, err);
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_update(Engine* engine, const Contact* c, EngineError* err) {
+    if (!engine || !c || c->id <= 0) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid ID.");
+    }
+    EngineStatus status = engine_validate(c, err);
+    if (status != ENGINE_OK) {
+        return status;
+    }
+    Db* db = engine_acquire(engine);
+    int changed = 0;
+    if (!contacts_update(db, c, &changed)) {
+        status = engine_db_fail(db, err);
+    }
+    else if (!changed) {
+        status = engine_fail(err, ENGINE_NOT_FOUND, "Contact %lld not found.", (long long)c->id);
+    }
+    else {
+        status = engine_ok(err);
+    }
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_delete(Engine* engine, int64_t id, EngineError* err) {
+    if (!engine || id <= 0) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid ID.");
+    }
+    Db* db = engine_acquire(engine);
+    EngineStatus status;
+    int changed = 0;
+    if (!contacts_delete(db, id, &changed)) {
+        status = engine_db_fail(db, err);
+    }
+    else if (!changed) {
+        status = engine_fail(err, ENGINE_NOT_FOUND, "Contact %lld not found.", (long long)id);
+    }
+    else {
+        status = engine_ok(err);
+    }
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_list(Engine* engine, ContactViewFn fn, void* ctx, EngineError* err) {
+    if (!engine || !fn) {
+        return engine_fail(err, ENGINE_INVALID, "Need an engine and a row callback.");
+    }
+    Db* db = engine_acquire(engine);
+    EngineStatus status = contacts_foreach(db, NULL, CONTACT_SORT_STORED, fn, ctx) ? engine_ok(err) : engine_db_fail(db, err);
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_search(Engine* engine, const char* name, ContactViewFn fn, void* ctx, EngineError* err) {
+    if (!engine || !name || !fn) {
+        return engine_fail(err, ENGINE_INVALID, "Need an engine, a name and a row callback.");
+    }
+    ContactFilter filter = { name, NULL, NULL };
+    Db* db = engine_acquire(engine);
+    EngineStatus status = contacts_foreach(db, &filter, CONTACT_SORT_STORED, fn, ctx) ? engine_ok(err) : engine_db_fail(db, err);
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_where(Engine* engine, const char* expr, ContactViewFn fn, void* ctx, EngineError* err) {
+    if (!engine || !expr || !fn) {
+        return engine_fail(err, ENGINE_INVALID, "Need an engine, a filter and a row callback.");
+    }
+    Query query;
+    if (!query_compile(expr, &query)) {
+        return engine_fail(err, ENGINE_INVALID, "Invalid filter: %s", query.error);
+    }
+    ContactFilter filter = { NULL, expr, NULL };
+    Db* db = engine_acquire(engine);
+    EngineStatus status = contacts_foreach(db, &filter, CONTACT_SORT_STORED, fn, ctx) ? engine_ok(err) : engine_db_fail(db, err);
+    engine_release(engine, db);
+    return status;
+}
+
+EngineStatus engine_stats(Engine* engine, ContactStats* out, EngineError* err) {
+    if (!engine || !out) {
+        return engine_fail(err, ENGINE_INVALID, "Need an engine and an output.");
+    }
+    Db* db = engine_acquire(engine);
+    EngineStatus status = contacts_stats(db, out) ? engine_ok(err) : engine_db_fail(db, err);
+    engine_release(engine, db);
+    return status;
+}
+
+const char* engine_status_name(EngineStatus status) {
+    switch (status) {
+    case ENGINE_OK:
+        return "ok";
+    case ENGINE_INVALID:
+        return "invalid";
+    case ENGINE_NOT_FOUND:
+        return "not found";
+    case ENGINE_AUTH:
+        return "auth";
+    case ENGINE_BUSY:
+        return "busy";
+    case ENGINE_DB:
+        return "database";
+    case ENGINE_NO_MEMORY:
+        return "no memory";
+    }
+    return "unknown";
+}
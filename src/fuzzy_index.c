@@ -0,0 +1,418 @@
+// Purpose: BK-tree over casefolded contact names for bounded edit-distance search. Author: GitHub Copilot
+#include "fuzzy_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZY_NONE 0u
+#define FUZZY_STACK_KEY 256
+
+typedef struct {
+    uint32_t key_off;
+    uint32_t key_len;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t edge;
+    uint32_t extra;
+    int64_t id;
+} BkNode;
+
+typedef struct {
+    int64_t id;
+    uint32_t next;
+} BkIdLink;
+
+struct FuzzyIndex {
+    BkNode* nodes;
+    size_t node_count;
+    size_t node_cap;
+    BkIdLink* links;
+    size_t link_count;
+    size_t link_cap;
+    uint32_t free_link;
+    char* keys;
+    size_t keys_used;
+    size_t keys_cap;
+};
+
+// Query-side state for Myers' bit-parallel Levenshtein; patterns up to 64 bytes use one machine word.
+typedef struct {
+    const unsigned char* s;
+    size_t len;
+    uint64_t peq[256];
+} Pattern;
+
+static void pattern_init(Pattern* p, const char* s, size_t len) {
+    memset(p->peq, 0, sizeof(p->peq));
+    p->s = (const unsigned char*)s;
+    p->len = len;
+    if (len <= 64) {
+        for (size_t i = 0; i < len; ++i) {
+            p->peq[p->s[i]] |= 1ULL << i;
+        }
+    }
+}
+
+static int dp_distance(const unsigned char* a, size_t n, const unsigned char* b, size_t m) {
+    int stack_row[FUZZY_STACK_KEY + 1];
+    int* row = stack_row;
+    if (m + 1 > FUZZY_STACK_KEY + 1) {
+        row = (int*)malloc((m + 1) * sizeof(int));
+        if (!row) {
+            return (int)(n > m ? n : m);
+        }
+    }
+    for (size_t j = 0; j <= m; ++j) {
+        row[j] = (int)j;
+    }
+    for (size_t i = 1; i <= n; ++i) {
+        int diag = row[0];
+        row[0] = (int)i;
+        for (size_t j = 1; j <= m; ++j) {
+            int up = row[j];
+            int best = diag + (a[i - 1] == b[j - 1] ? 0 : 1);
+            if (up + 1 < best) {
+                best = up + 1;
+            }
+            if (row[j - 1] + 1 < best) {
+                best = row[j - 1] + 1;
+            }
+            diag = up;
+            row[j] = best;
+        }
+    }
+    int d = row[m];
+    if (row != stack_row) {
+        free(row);
+    }
+    return d;
+}
+
+static int pattern_distance(const Pattern* p, const char* text, size_t n) {
+    const unsigned char* t = (const unsigned char*)text;
+    size_t m = p->len;
+    if (m == 0) {
+        return (int)n;
+    }
+    if (m > 64) {
+        return dp_distance(p->s, m, t, n);
+    }
+    uint64_t mask = m == 64 ? ~0ULL : ((1ULL << m) - 1);
+    uint64_t high = 1ULL << (m - 1);
+    uint64_t pv = mask;
+    uint64_t mv = 0;
+    int score = (int)m;
+    for (size_t j = 0; j < n; ++j) {
+        uint64_t eq = p->peq[t[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) {
+            score++;
+        }
+        else if (mh & high) {
+            score--;
+        }
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = (mh | ~(xv | ph)) & mask;
+        mv = ph & xv & mask;
+    }
+    return score;
+}
+
+int fuzzy_edit_distance(const char* a, size_t a_len, const char* b, size_t b_len) {
+    if (!a || !b) {
+        return -1;
+    }
+    Pattern p;
+    pattern_init(&p, a, a_len);
+    return pattern_distance(&p, b, b_len);
+}
+
+static char fold_char(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static const char* fold_temp(const char* s, size_t len, char* stack_buf, char** heap_out) {
+    char* dest = stack_buf;
+    *heap_out = NULL;
+    if (len > FUZZY_STACK_KEY) {
+        *heap_out = (char*)malloc(len);
+        if (!*heap_out) {
+            return NULL;
+        }
+        dest = *heap_out;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        dest[i] = fold_char(s[i]);
+    }
+    return dest;
+}
+
+static int grow(void** items, size_t* cap, size_t need, size_t item_size) {
+    if (need <= *cap) {
+        return 1;
+    }
+    size_t next = *cap ? *cap : 256;
+    while (next < need) {
+        next *= 2;
+    }
+    void* p = realloc(*items, next * item_size);
+    if (!p) {
+        return 0;
+    }
+    *items = p;
+    *cap = next;
+    return 1;
+}
+
+static int new_node(FuzzyIndex* index, const char* key, size_t len, int64_t id, uint32_t edge, uint32_t* out) {
+    if (index->node_count >= UINT32_MAX || index->keys_used + len > UINT32_MAX) {
+        return 0;
+    }
+    if (!grow((void**)&index->nodes, &index->node_cap, index->node_count + 1, sizeof(BkNode)) ||
+        !grow((void**)&index->keys, &index->keys_cap, index->keys_used + len, 1)) {
+        return 0;
+    }
+    memcpy(index->keys + index->keys_used, key, len);
+    BkNode* node = &index->nodes[index->node_count];
+    memset(node, 0, sizeof(*node));
+    node->key_off = (uint32_t)index->keys_used;
+    node->key_len = (uint32_t)len;
+    node->edge = edge;
+    node->id = id;
+    index->keys_used += len;
+    *out = (uint32_t)index->node_count++;
+    return 1;
+}
+
+static int node_add_id(FuzzyIndex* index, BkNode* node, int64_t id) {
+    if (node->id == 0) {
+        node->id = id;
+        return 1;
+    }
+    uint32_t slot = index->free_link;
+    if (slot != FUZZY_NONE) {
+        index->free_link = index->links[slot].next;
+    }
+    else {
+        if (index->link_count == 0) {
+            index->link_count = 1;
+        }
+        if (index->link_count >= UINT32_MAX ||
+            !grow((void**)&index->links, &index->link_cap, index->link_count + 1, sizeof(BkIdLink))) {
+            return 0;
+        }
+        slot = (uint32_t)index->link_count++;
+    }
+    index->links[slot].id = id;
+    index->links[slot].next = node->extra;
+    node->extra = slot;
+    return 1;
+}
+
+static int node_remove_id(FuzzyIndex* index, BkNode* node, int64_t id) {
+    if (node->id == id) {
+        if (node->extra != FUZZY_NONE) {
+            uint32_t slot = node->extra;
+            node->id = index->links[slot].id;
+            node->extra = index->links[slot].next;
+            index->links[slot].next = index->free_link;
+            index->free_link = slot;
+        }
+        else {
+            node->id = 0;
+        }
+        return 1;
+    }
+    uint32_t* link = &node->extra;
+    while (*link != FUZZY_NONE) {
+        uint32_t slot = *link;
+        if (index->links[slot].id == id) {
+            *link = index->links[slot].next;
+            index->links[slot].next = index->free_link;
+            index->free_link = slot;
+            return 1;
+        }
+        link = &index->links[slot].next;
+    }
+    return 0;
+}
+
+// Finds the node holding exactly this folded key, creating it (and the path to it) when create is set.
+static BkNode* find_node(FuzzyIndex* index, const char* key, size_t len, int create, int64_t id, int* created) {
+    *created = 0;
+    if (index->node_count == 0) {
+        uint32_t root = 0;
+        if (!create || !new_node(index, key, len, id, 0, &root)) {
+            return NULL;
+        }
+        *created = 1;
+        return &index->nodes[root];
+    }
+    Pattern p;
+    pattern_init(&p, key, len);
+    uint32_t cur = 0;
+    for (;;) {
+        BkNode* node = &index->nodes[cur];
+        uint32_t d = (uint32_t)pattern_distance(&p, index->keys + node->key_off, node->key_len);
+        if (d == 0) {
+            return node;
+        }
+        uint32_t child = node->first_child;
+        while (child != FUZZY_NONE && index->nodes[child].edge != d) {
+            child = index->nodes[child].next_sibling;
+        }
+        if (child != FUZZY_NONE) {
+            cur = child;
+            continue;
+        }
+        if (!create) {
+            return NULL;
+        }
+        uint32_t added = 0;
+        if (!new_node(index, key, len, id, d, &added)) {
+            return NULL;
+        }
+        node = &index->nodes[cur];
+        index->nodes[added].next_sibling = node->first_child;
+        node->first_child = added;
+        *created = 1;
+        return &index->nodes[added];
+    }
+}
+
+FuzzyIndex* fuzzy_index_create(void) {
+    return (FuzzyIndex*)calloc(1, sizeof(FuzzyIndex));
+}
+
+void fuzzy_index_destroy(FuzzyIndex* index) {
+    if (!index) {
+        return;
+    }
+    free(index->nodes);
+    free(index->links);
+    free(index->keys);
+    free(index);
+}
+
+int fuzzy_index_add(FuzzyIndex* index, const char* name, int64_t id) {
+    if (!index || !name || id <= 0) {
+        return 0;
+    }
+    size_t len = strlen(name);
+    char stack_buf[FUZZY_STACK_KEY];
+    char* heap = NULL;
+    const char* key = fold_temp(name, len, stack_buf, &heap);
+    if (!key) {
+        return 0;
+    }
+    int created = 0;
+    BkNode* node = find_node(index, key, len, 1, id, &created);
+    int ok = node && (created || node_add_id(index, node, id));
+    free(heap);
+    return ok;
+}
+
+int fuzzy_index_remove(FuzzyIndex* index, const char* name, int64_t id) {
+    if (!index || !name) {
+        return 0;
+    }
+    size_t len = strlen(name);
+    char stack_buf[FUZZY_STACK_KEY];
+    char* heap = NULL;
+    const char* key = fold_temp(name, len, stack_buf, &heap);
+    if (!key) {
+        return 0;
+    }
+    int created = 0;
+    BkNode* node = find_node(index, key, len, 0, 0, &created);
+    free(heap);
+    return node && node_remove_id(index, node, id);
+}
+
+static int compare_matches(const void* a, const void* b) {
+    const FuzzyMatch* x = (const FuzzyMatch*)a;
+    const FuzzyMatch* y = (const FuzzyMatch*)b;
+    if (x->distance != y->distance) {
+        return x->distance < y->distance ? -1 : 1;
+    }
+    if (x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    return 0;
+}
+
+static int push_match(FuzzyMatch** items, size_t* count, size_t* cap, int64_t id, int distance) {
+    if (!grow((void**)items, cap, *count + 1, sizeof(FuzzyMatch))) {
+        return 0;
+    }
+    (*items)[*count].id = id;
+    (*items)[*count].distance = distance;
+    (*count)++;
+    return 1;
+}
+
+size_t fuzzy_index_search(const FuzzyIndex* index, const char* query, int max_distance,
+    FuzzyMatch* out, size_t max_out) {
+    if (!index || !query || !out || max_distance < 0 || index->node_count == 0) {
+        return 0;
+    }
+    size_t len = strlen(query);
+    char stack_buf[FUZZY_STACK_KEY];
+    char* heap = NULL;
+    const char* key = fold_temp(query, len, stack_buf, &heap);
+    if (!key) {
+        return 0;
+    }
+    Pattern p;
+    pattern_init(&p, key, len);
+
+    uint32_t* stack = NULL;
+    size_t stack_len = 0;
+    size_t stack_cap = 0;
+    FuzzyMatch* matches = NULL;
+    size_t match_count = 0;
+    size_t match_cap = 0;
+    int ok = grow((void**)&stack, &stack_cap, 1, sizeof(uint32_t));
+    if (ok) {
+        stack[stack_len++] = 0;
+    }
+    uint32_t k = (uint32_t)max_distance;
+    while (ok && stack_len > 0) {
+        const BkNode* node = &index->nodes[stack[--stack_len]];
+        uint32_t d = (uint32_t)pattern_distance(&p, index->keys + node->key_off, node->key_len);
+        if (d <= k) {
+            if (node->id != 0) {
+                ok = push_match(&matches, &match_count, &match_cap, node->id, (int)d);
+            }
+            for (uint32_t slot = node->extra; ok && slot != FUZZY_NONE; slot = index->links[slot].next) {
+                ok = push_match(&matches, &match_count, &match_cap, index->links[slot].id, (int)d);
+            }
+        }
+        uint32_t lo = d > k ? d - k : 1;
+        uint32_t hi = d + k;
+        for (uint32_t child = node->first_child; ok && child != FUZZY_NONE; child = index->nodes[child].next_sibling) {
+            uint32_t edge = index->nodes[child].edge;
+            if (edge >= lo && edge <= hi) {
+                ok = grow((void**)&stack, &stack_cap, stack_len + 1, sizeof(uint32_t));
+                if (ok) {
+                    stack[stack_len++] = child;
+                }
+            }
+        }
+    }
+
+    size_t found = 0;
+    if (ok && match_count > 0) {
+        qsort(matches, match_count, sizeof(FuzzyMatch), compare_matches);
+        found = match_count < max_out ? match_count : max_out;
+        memcpy(out, matches, found * sizeof(FuzzyMatch));
+    }
+    free(matches);
+    free(stack);
+    free(heap);
+    return found;
+}
@@ -0,0 +1,374 @@
+// Purpose: Streaming reader for flat JSON objects, one per line or in a top-level array. Author: GitHub Copilot
+#include "json.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_NONE (-2)
+
+enum {
+    JSON_MODE_START,
+    JSON_MODE_LINES,
+    JSON_MODE_ARRAY,
+    JSON_MODE_DONE
+};
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} JsonBuf;
+
+struct JsonReader {
+    Stream* in;
+    int mode;
+    int peeked;      // next character when already read, JSON_NONE otherwise
+    uint64_t line;
+    size_t objects;  // read from the array so far, so the next one needs a comma
+    JsonBuf key;
+    // One buffer per slot, reused for every object, so reading allocates only while values grow.
+    JsonBuf values[JSON_MAX_SLOTS];
+};
+
+JsonReader* json_reader_open(Stream* in) {
+    if (!in) {
+        return NULL;
+    }
+    JsonReader* r = (JsonReader*)calloc(1, sizeof(JsonReader));
+    if (!r) {
+        return NULL;
+    }
+    r->in = in;
+    r->mode = JSON_MODE_START;
+    r->peeked = JSON_NONE;
+    r->line = 1;
+    return r;
+}
+
+void json_reader_close(JsonReader* r) {
+    if (!r) {
+        return;
+    }
+    free(r->key.data);
+    for (size_t i = 0; i < JSON_MAX_SLOTS; ++i) {
+        free(r->values[i].data);
+    }
+    free(r);
+}
+
+uint64_t json_reader_line(const JsonReader* r) {
+    return r ? r->line : 0;
+}
+
+static int json_peek(JsonReader* r) {
+    if (r->peeked == JSON_NONE) {
+        r->peeked = stream_getc(r->in);
+    }
+    return r->peeked;
+}
+
+static int json_next(JsonReader* r) {
+    int c = json_peek(r);
+    r->peeked = JSON_NONE;
+    if (c == '\n') {
+        r->line++;
+    }
+    return c;
+}
+
+// An NDJSON object ends with its line, so a truncated one stops at the newline instead of reading on
+// into the next object.
+static int json_skip_ws(JsonReader* r) {
+    int c;
+    while ((c = json_peek(r)) == ' ' || c == '\t' || c == '\r' || (c == '\n' && r->mode != JSON_MODE_LINES)) {
+        json_next(r);
+    }
+    return c;
+}
+
+static int json_put(JsonBuf* b, const char* data, size_t len) {
+    if (b->len + len + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap < b->len + len + 1) {
+            cap *= 2;
+        }
+        char* grown = (char*)realloc(b->data, cap);
+        if (!grown) {
+            return 0;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return 1;
+}
+
+static int json_hex4(JsonReader* r, unsigned* out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int c = json_next(r);
+        int d = c >= '0' && c <= '9' ? c - '0'
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+            : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) {
+            return 0;
+        }
+        v = v * 16 + (unsigned)d;
+    }
+    *out = v;
+    return 1;
+}
+
+static int json_put_utf8(JsonBuf* b, unsigned cp) {
+    char s[4];
+    size_t n;
+    if (cp < 0x80) {
+        s[0] = (char)cp;
+        n = 1;
+    }
+    else if (cp < 0x800) {
+        s[0] = (char)(0xC0 | (cp >> 6));
+        s[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    }
+    else if (cp < 0x10000) {
+        s[0] = (char)(0xE0 | (cp >> 12));
+        s[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        s[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    }
+    else {
+        s[0] = (char)(0xF0 | (cp >> 18));
+        s[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        s[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        s[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return !b || json_put(b, s, n);
+}
+
+// Reads a string after its opening quote, unescaped into b, or only past it when b is NULL.
+static int json_string(JsonReader* r, JsonBuf* b) {
+    for (;;) {
+        int c = json_next(r);
+        if (c == '"') {
+            return 1;
+        }
+        if (c == EOF || c < 0x20) {
+            return 0;
+        }
+        if (c == '\\') {
+            c = json_next(r);
+            unsigned cp = 0;
+            switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                if (!json_hex4(r, &cp)) {
+                    return 0;
+                }
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    unsigned low = 0;
+                    if (json_next(r) != '\\' || json_next(r) != 'u' || !json_hex4(r, &low) || low < 0xDC00 ||
+                        low > 0xDFFF) {
+                        return 0;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (cp >= 0xDC00 && cp < 0xE000) {
+                    return 0;
+                }
+                if (!json_put_utf8(b, cp)) {
+                    return 0;
+                }
+                continue;
+            default:
+                return 0;
+            }
+        }
+        char ch = (char)c;
+        if (b && !json_put(b, &ch, 1)) {
+            return 0;
+        }
+    }
+}
+
+// Numbers, true, false and null are taken as written; callers parse numbers themselves.
+static int json_scalar(JsonReader* r, JsonBuf* b, int* is_null) {
+    char text[64];
+    size_t n = 0;
+    int c;
+    while ((c = json_peek(r)) != EOF && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\r' &&
+        c != '\n') {
+        if (n + 1 >= sizeof(text)) {
+            return 0;
+        }
+        text[n++] = (char)json_next(r);
+    }
+    text[n] = '\0';
+    *is_null = strcmp(text, "null") == 0;
+    int number = n > 0 && (text[0] == '-' || (text[0] >= '0' && text[0] <= '9')) &&
+        strspn(text, "0123456789+-.eE") == n;
+    if (!number && !*is_null && strcmp(text, "true") != 0 && strcmp(text, "false") != 0) {
+        return 0;
+    }
+    return !b || *is_null || json_put(b, text, n);
+}
+
+// Skips one value of any kind. Nesting is balanced but not otherwise checked.
+static int json_skip(JsonReader* r) {
+    int depth = 0;
+    do {
+        int c = json_skip_ws(r);
+        int is_null = 0;
+        if (c == '"') {
+            json_next(r);
+            if (!json_string(r, NULL)) {
+                return 0;
+            }
+        }
+        else if (c == '{' || c == '[') {
+            json_next(r);
+            depth++;
+        }
+        else if (c == '}' || c == ']' || c == ',' || c == ':') {
+            if (depth == 0) {
+                return 0;
+            }
+            json_next(r);
+            depth -= c == '}' || c == ']';
+        }
+        else if (!json_scalar(r, NULL, &is_null)) {
+            return 0;
+        }
+    } while (depth > 0);
+    return 1;
+}
+
+static int json_object(JsonReader* r, int (*slot_of)(const char* key), char** values, size_t slot_count) {
+    for (size_t i = 0; i < slot_count; ++i) {
+        values[i] = NULL;
+    }
+    if (json_next(r) != '{') {
+        return 0;
+    }
+    int c = json_skip_ws(r);
+    if (c == '}') {
+        json_next(r);
+        return 1;
+    }
+    for (;;) {
+        r->key.len = 0;
+        if (json_next(r) != '"' || !json_put(&r->key, "", 0) || !json_string(r, &r->key) ||
+            json_skip_ws(r) != ':') {
+            return 0;
+        }
+        json_next(r);
+        int slot = slot_of ? slot_of(r->key.data) : -1;
+        c = json_skip_ws(r);
+        if (slot >= 0 && (size_t)slot < slot_count && c != '{' && c != '[') {
+            JsonBuf* b = &r->values[slot];
+            int is_null = 0;
+            b->len = 0;
+            if (c == '"') {
+                json_next(r);
+                if (!json_put(b, "", 0) || !json_string(r, b)) {
+                    return 0;
+                }
+            }
+            else if (!json_scalar(r, b, &is_null)) {
+                return 0;
+            }
+            values[slot] = is_null ? NULL : b->data;
+        }
+        else if (!json_skip(r)) {
+            return 0;
+        }
+        c = json_skip_ws(r);
+        json_next(r);
+        if (c == '}') {
+            return 1;
+        }
+        if (c != ',') {
+            return 0;
+        }
+        json_skip_ws(r);
+    }
+}
+
+static int json_fail(JsonReader* r) {
+    util_error("Invalid JSON at line %llu.", (unsigned long long)r->line);
+    r->mode = JSON_MODE_DONE;
+    return -2;
+}
+
+int json_read_object(JsonReader* r, int (*slot_of)(const char* key), char** values, size_t slot_count) {
+    if (!r || !values || slot_count > JSON_MAX_SLOTS || r->mode == JSON_MODE_DONE) {
+        return r && r->mode == JSON_MODE_DONE ? 0 : -2;
+    }
+    int c = json_skip_ws(r);
+    if (r->mode == JSON_MODE_START) {
+        r->mode = c == '[' ? JSON_MODE_ARRAY : JSON_MODE_LINES;
+        if (c == '[') {
+            json_next(r);
+            c = json_skip_ws(r);
+        }
+    }
+    if (r->mode == JSON_MODE_ARRAY) {
+        if (c == ']') {
+            json_next(r);
+            if (json_skip_ws(r) != EOF) {
+                return json_fail(r);
+            }
+            r->mode = JSON_MODE_DONE;
+            return 0;
+        }
+        if (r->objects > 0) {
+            if (c != ',') {
+                return json_fail(r);
+            }
+            json_next(r);
+            json_skip_ws(r);
+        }
+        if (!json_object(r, slot_of, values, slot_count)) {
+            return json_fail(r);
+        }
+        r->objects++;
+        return 1;
+    }
+    while (c == '\n') {
+        json_next(r);
+        c = json_skip_ws(r);
+    }
+    if (c == EOF) {
+        return 0;
+    }
+    uint64_t line = r->line;
+    if (json_object(r, slot_of, values, slot_count)) {
+        return 1;
+    }
+    // One bad line in NDJSON costs only that line; a failure that consumed its newline is already past it.
+    while (r->line == line && (c = json_next(r)) != EOF && c != '\n') {
+    }
+    return -1;
+}
@@ -0,0 +1,158 @@
+// Purpose: Per-contact charges and payments with running balances. Author: GitHub Copilot
+#include "ledger.h"
+#include "util.h"
+
+#include <sqlite3.h>
+#include <string.h>
+
+int64_t ledger_month_of(int64_t day) {
+    int year, month, mday;
+    util_civil_from_days(day, &year, &month, &mday);
+    return (int64_t)year * 12 + (month - 1);
+}
+
+// First day of the month containing day.
+static int64_t month_start(int64_t day) {
+    int year, month, mday;
+    util_civil_from_days(day, &year, &month, &mday);
+    return day - (mday - 1);
+}
+
+int ledger_post(Db* db, int64_t contact_id, int64_t day, double amount, const char* memo, int64_t* out_id) {
+    if (!db || !db->handle || contact_id <= 0) {
+        return 0;
+    }
+    if (amount == 0.0) {
+        util_error("Ledger amounts must be non-zero.");
+        return 0;
+    }
+    const char* sql = "INSERT INTO ledger(contact_id, day, month, amount, memo) VALUES(?,?,?,?,?);";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, contact_id);
+    sqlite3_bind_int64(stmt, 2, day);
+    sqlite3_bind_int64(stmt, 3, ledger_month_of(day));
+    sqlite3_bind_double(stmt, 4, amount);
+    sqlite3_bind_text(stmt, 5, memo ? memo : "", -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc == SQLITE_CONSTRAINT) {
+        util_error("Contact %lld not found.", (long long)contact_id);
+        return 0;
+    }
+    if (rc != SQLITE_DONE) {
+        return 0;
+    }
+    if (out_id) {
+        *out_id = sqlite3_last_insert_rowid(db->handle);
+    }
+    return 1;
+}
+
+int ledger_balance(Db* db, int64_t contact_id, double* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT balance FROM contacts WHERE id = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, contact_id);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        *out = sqlite3_column_double(stmt, 0);
+    }
+    else {
+        util_error("Contact %lld not found.", (long long)contact_id);
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+int ledger_balance_at(Db* db, int64_t contact_id, int64_t day, double* out) {
+    if (!db || !db->handle || !out || contact_id < 0) {
+        return 0;
+    }
+    double unused;
+    if (contact_id > 0 && !ledger_balance(db, contact_id, &unused)) {
+        return 0;
+    }
+    const char* base_sql = "SELECT balance FROM ledger_checkpoints WHERE contact_id = ? AND month < ?"
+        " ORDER BY month DESC LIMIT 1;";
+    const char* tail_sql = contact_id > 0
+        ? "SELECT TOTAL(amount) FROM ledger WHERE contact_id = ? AND day BETWEEN ? AND ?;"
+        : "SELECT TOTAL(amount) FROM ledger WHERE day BETWEEN ?2 AND ?3;";
+    sqlite3_stmt* base = NULL;
+    sqlite3_stmt* tail = NULL;
+    if (sqlite3_prepare_v2(db->handle, base_sql, -1, &base, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db->handle, tail_sql, -1, &tail, NULL) != SQLITE_OK) {
+        sqlite3_finalize(base);
+        return 0;
+    }
+    sqlite3_bind_int64(base, 1, contact_id);
+    sqlite3_bind_int64(base, 2, ledger_month_of(day));
+    sqlite3_bind_int64(tail, 1, contact_id);
+    sqlite3_bind_int64(tail, 2, month_start(day));
+    sqlite3_bind_int64(tail, 3, day);
+    int rc = sqlite3_step(base);
+    double balance = rc == SQLITE_ROW ? sqlite3_column_double(base, 0) : 0.0;
+    int ok = rc == SQLITE_ROW || rc == SQLITE_DONE;
+    if (ok && sqlite3_step(tail) == SQLITE_ROW) {
+        *out = balance + sqlite3_column_double(tail, 0);
+    }
+    else {
+        ok = 0;
+    }
+    sqlite3_finalize(base);
+    sqlite3_finalize(tail);
+    return ok;
+}
+
+int ledger_print(Db* db, int64_t contact_id, int json, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    double unused;
+    if (!ledger_balance(db, contact_id, &unused)) {
+        return 0;
+    }
+    const char* sql = "SELECT id, day, amount, memo FROM ledger WHERE contact_id = ? ORDER BY day, id;";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, contact_id);
+    if (json) {
+        fprintf(out, "[");
+    }
+    else {
+        fprintf(out, "%-10s %14s %14s  %s\n", "Date", "Amount", "Balance", "Memo");
+    }
+    double balance = 0.0;
+    int first = 1;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        char date[16];
+        const unsigned char* memo = sqlite3_column_text(stmt, 3);
+        double amount = sqlite3_column_double(stmt, 2);
+        balance += amount;
+        util_format_epoch_day(sqlite3_column_int64(stmt, 1), date, sizeof(date));
+        if (json) {
+            fprintf(out, "%s{\"id\":%lld,\"date\":\"%s\",\"amount\":%.2f,\"balance\":%.2f,\"memo\":", first ? "" : ",",
+                (long long)sqlite3_column_int64(stmt, 0), date, amount, balance);
+            util_print_json_string(out, memo ? (const char*)memo : "");
+            fprintf(out, "}");
+        }
+        else {
+            fprintf(out, "%-10s %14.2f %14.2f  %s\n", date, amount, balance, memo ? (const char*)memo : "");
+        }
+        first = 0;
+    }
+    sqlite3_finalize(stmt);
+    if (json) {
+        fprintf(out, "]\n");
+    }
+    return rc == SQLITE_DONE;
+}
@@ -1,10 +1,19 @@
 // Purpose: CLI entry point, argument parsing, and interactive menu. Author: GitHub Copilot
+#include "archive.h"
 #include "auth.h"
+#include "changes.h"
+#include "columnar.h"
 #include "contacts.h"
 #include "csv.h"
 #include "db.h"
+#include "ledger.h"
+#include "shard.h"
+#include "sketch.h"
+#include "stream.h"
+#include "tags.h"
 #include "util.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <sqlite3.h>
 #include <stdint.h>
@@ -13,7 +22,14 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #define DEFAULT_DB_PATH "contacts.db"
+#define DEFAULT_MENU_CACHE_BYTES (1024 * 1024)
+#define DEFAULT_PREFIX_LIMIT 20
+#define DEFAULT_FUZZY_DISTANCE 2
 
 typedef struct {
     const char* db_path;
@@ -23,18 +39,50 @@ typedef struct {
     int strict;
     int force;
     int menu;
+    int delete_missing;
+    int unordered;
+    int direct;
 
     int do_list;
     int do_stats;
+    int do_aging;
+    int approx;
+    int do_top_debtors;
+    int do_top_overdue;
     int do_add;
     int do_edit;
     int do_delete;
     int do_delete_all;
     int do_search;
+    int do_prefix;
+    int do_fuzzy;
+    int do_where;
+    int do_upcoming;
+    int do_changes;
+    int do_add_tenant;
+    int all_tenants;
+    int ndjson;
+    int serve;
     int do_export;
     int do_import;
+    int do_import_json;
+    int do_sync;
+    int do_export_bin;
+    int do_import_bin;
     int do_sort;
     int do_set_password;
+    int do_tags;
+    int do_charge;
+    int do_payment;
+    int do_ledger;
+    int do_import_ledger;
+    int do_balance_at;
+    int do_add_tag;
+    int do_remove_tag;
+    int do_archive;
+    int do_restore;
+    int include_archived;
+    int resume;
 
     const char* name;
     const char* phone;
@@ -44,11 +92,41 @@ typedef struct {
     const char* due_date;
     const char* id;
     const char* search;
+    const char* prefix;
+    const char* fuzzy;
+    const char* where;
+    const char* upcoming;
+    const char* top_count;
+    const char* ledger_amount;
+    const char* ledger_on;
+    const char* memo;
+    const char* import_ledger_path;
+    const char* balance_at;
+    const char* older_than;
+    const char* checkpoint;
+    const char* column_map;
+    const char* changes_since;
+    const char* within;
+    const char* max_distance;
+    const char* limit;
     const char* export_path;
     const char* import_path;
+    const char* import_json_path;
+    const char* sync_path;
+    const char* export_bin_path;
+    const char* import_bin_path;
     const char* sort_mode;
     const char* password;
     const char* current_password;
+    const char* cache_bytes;
+    const char* tenant;
+    const char* new_tenant;
+    const char* new_tenant_path;
+    const char* jobs;
+    const char* io_backend;
+    const char* edit_tag;
+    TagsOp tag_ops[TAGS_MAX_OPS];
+    size_t tag_op_count;
 } Options;
 
 static void print_usage(FILE* out) {
@@ -58,14 +136,40 @@ static void print_usage(FILE* out) {
         "  contacts [--db path] [--menu]\n"
         "  contacts --list [--json]\n"
         "  contacts --search \"name\" [--json]\n"
+        "  contacts --prefix \"na\" [--limit N] [--json]\n"
+        "  contacts --search-fuzzy \"name\" [--max-distance K] [--limit N] [--json]\n"
+        "  contacts --where \"due>100 AND email:*@acme.com\" [--json]\n"
+        "  contacts --upcoming N [--within DAYS] [--serve] [--json]\n"
+        "  contacts --top-debtors N [--json]\n"
+        "  contacts --top-overdue N [--json]\n"
+        "  contacts --changes-since SEQ [--json|--ndjson]\n"
+        "  contacts --tags [--json]\n"
+        "  contacts --add-tag|--remove-tag TAG (--id ID | --where EXPR | --search \"name\" | --tag T ...)\n"
+        "  contacts --tag A [--and-tag B] [--or-tag C] [--not-tag D] [--list|--search|--where|--export|--stats]\n"
+        "  contacts --charge X|--payment X --id ID [--on DATE] [--memo TEXT]\n"
+        "  contacts --ledger --id ID [--json]\n"
+        "  contacts --balance-at DATE [--id ID] [--json]\n"
+        "  contacts --import-ledger file.csv[.gz|.zst] [--dry-run] [--strict]\n"
+        "  contacts --add-tenant NAME path.db\n"
+        "  contacts --tenant NAME <command>\n"
+        "  contacts --all-tenants --list|--search \"name\"|--stats [--json]\n"
         "  contacts --add --name N [--phone P] [--address A] [--email E] [--due X] [--due-date D]\n"
         "  contacts --edit --id ID [--name N] [--phone P] [--address A] [--email E] [--due X] [--due-date D]\n"
         "  contacts --delete --id ID\n"
         "  contacts --delete-all --force\n"
-        "  contacts --export file.csv\n"
-        "  contacts --import file.csv [--dry-run] [--strict]\n"
+        "  contacts --export file.csv[.gz|.zst] [--jobs N [--unordered]] [--io uring|thread|sync] [--direct]\n"
+        "  contacts --import file.csv[.gz|.zst] [--dry-run] [--strict]\n"
+        "  contacts --import file.csv[.gz|.zst] --checkpoint N | --resume [--strict]\n"
+        "  contacts --sync file.csv [--delete-missing] [--dry-run] [--strict]\n"
+        "  contacts --import|--sync file.csv --map Name=FullName,Phone=Mobile\n"
+        "  contacts --import-json file.ndjson|file.json[.gz|.zst] [--dry-run] [--strict]\n"
+        "  contacts --export-bin file.cmcol\n"
+        "  contacts --import-bin file.cmcol [--dry-run]\n"
+        "  contacts --archive --older-than DAYS [--dry-run] [--backup]\n"
+        "  contacts --restore --id ID\n"
         "  contacts --sort name|phone|due_date\n"
-        "  contacts --stats [--json]\n"
+        "  contacts --stats [--json] [--jobs N | --approx]\n"
+        "  contacts --aging [--json]\n"
         "  contacts --set-password [--password P] [--current-password P]\n"
         "Options:\n"
         "  --db PATH           Database path (default contacts.db)\n"
@@ -74,9 +178,36 @@ static void print_usage(FILE* out) {
         "  --backup            Create DB backup before destructive ops\n"
         "  --strict            Abort on first CSV error\n"
         "  --force             Required for delete-all\n"
+        "  --delete-missing    Sync: delete keyed contacts absent from the file\n"
+        "  --cache-bytes N     LRU record cache size (default 0, menu 1 MiB)\n"
+        "  --limit N           Maximum results for --prefix/--search-fuzzy (default 20)\n"
+        "  --max-distance K    Edit distance for --search-fuzzy (default 2)\n"
+        "  --jobs N            Reader threads for --export (merged back into name order) and --stats\n"
+        "  --approx            --stats from stored sketches: distinct domains/area codes, due p50/p90/p99\n"
+        "  --checkpoint N      --import commits every N rows so an interrupted import can --resume\n"
+        "  --resume            Continue the interrupted checkpointed --import of the same file\n"
+        "  --map F=COL,...     --import/--sync: read field F from header column COL; others match by name\n"
+        "  --include-archived  --list/--search/--where/--export/--export-bin/--stats also read archived contacts\n"
+        "  --tag T             Select contacts tagged T; --and-tag, --or-tag and --not-tag apply in order\n"
+        "  --on DATE           Ledger entry date for --charge/--payment (default today)\n"
+        "  --tenant NAME       Run the command against that tenant's database\n"
+        "  --all-tenants       Merge --list/--search/--stats across every tenant database\n"
+        "  --within DAYS       Limit --upcoming to contacts due in the next DAYS days\n"
+        "  --serve             Keep --upcoming running and report contacts as they come due\n"
+        "  --unordered         With --jobs, write rows in id order without the merge\n"
+        "  --io BACKEND        Export writer: auto (default), uring, thread or sync\n"
+        "  --direct            Export with O_DIRECT so a large dump bypasses the page cache\n"
         "  --menu              Interactive menu mode\n");
 }
 
+static double now_seconds(void) {
+    struct timespec ts;
+    if (timespec_get(&ts, TIME_UTC) != TIME_UTC) {
+        return 0.0;
+    }
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static void print_json_string_or_null(FILE* out, const char* value) {
     if (!out) {
         return;
@@ -89,6 +220,56 @@ static void print_json_string_or_null(FILE* out, const char* value) {
     }
 }
 
+static void print_sketch_plain(FILE* out, const SketchStats* stats) {
+    fprintf(out, "\nApproximate statistics (as of change %lld):\n", (long long)stats->seq);
+    fprintf(out, "  Contacts: %lld\n", (long long)stats->contacts);
+    fprintf(out, "  Distinct email domains: ~%llu\n", (unsigned long long)stats->email_domains);
+    fprintf(out, "  Distinct area codes: ~%llu\n", (unsigned long long)stats->area_codes);
+    fprintf(out, "  Contacts with due amounts: %lld\n", (long long)stats->amounts);
+    fprintf(out, "  Due amount p50/p90/p99: %.2f / %.2f / %.2f\n", stats->p50, stats->p90, stats->p99);
+    if (stats->sample_count > 0) {
+        fprintf(out, "  Sample ids:");
+        for (size_t i = 0; i < stats->sample_count; ++i) {
+            fprintf(out, " %lld", (long long)stats->sample[i]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static void print_sketch_json(FILE* out, const SketchStats* stats) {
+    fprintf(out, "{\"approximate\":true,\"seq\":%lld,\"total\":%lld,", (long long)stats->seq,
+        (long long)stats->contacts);
+    fprintf(out, "\"email_domains\":%llu,\"area_codes\":%llu,", (unsigned long long)stats->email_domains,
+        (unsigned long long)stats->area_codes);
+    fprintf(out, "\"due\":%lld,\"due_p50\":%.2f,\"due_p90\":%.2f,\"due_p99\":%.2f,\"sample\":[",
+        (long long)stats->amounts, stats->p50, stats->p90, stats->p99);
+    for (size_t i = 0; i < stats->sample_count; ++i) {
+        fprintf(out, "%s%lld", i ? "," : "", (long long)stats->sample[i]);
+    }
+    fprintf(out, "]}\n");
+}
+
+// --stats --approx: reads the stored sketches, so the cost does not grow with the book.
+static int print_sketch(Db* db, int all_tenants, int json) {
+    ContactSketch* sketch = (ContactSketch*)malloc(sizeof(ContactSketch));
+    if (!sketch) {
+        return 0;
+    }
+    int ok = all_tenants ? shard_sketch(db, sketch) : sketch_load(db, sketch);
+    if (ok) {
+        SketchStats stats;
+        sketch_summarize(sketch, &stats);
+        if (json) {
+            print_sketch_json(stdout, &stats);
+        }
+        else {
+            print_sketch_plain(stdout, &stats);
+        }
+    }
+    free(sketch);
+    return ok;
+}
+
 static void print_stats_plain(FILE* out, const ContactStats* stats) {
     if (!out || !stats) {
         return;
@@ -150,6 +331,17 @@ static void print_stats_plain(FILE* out, const ContactStats* stats) {
     if (stats->by_letter[26] > 0) {
         fprintf(out, "  #: %d\n", stats->by_letter[26]);
     }
+
+    const ContactCacheStats* cache = &stats->cache;
+    if (cache->max_bytes > 0) {
+        uint64_t lookups = cache->hits + cache->misses;
+        fprintf(out, "\nRecord cache:\n");
+        fprintf(out, "  Entries: %zu (%zu of %zu bytes)\n", cache->entries, cache->bytes, cache->max_bytes);
+        fprintf(out, "  Hits: %llu, Misses: %llu, Evictions: %llu\n",
+            (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+            (unsigned long long)cache->evictions);
+        fprintf(out, "  Hit rate: %.1f%%\n", lookups ? 100.0 * (double)cache->hits / (double)lookups : 0.0);
+    }
 }
 
 static void print_stats_json(FILE* out, const ContactStats* stats) {
@@ -201,7 +393,123 @@ static void print_stats_json(FILE* out, const ContactStats* stats) {
         }
         fprintf(out, "%d", stats->by_letter[i]);
     }
-    fprintf(out, "]}\n");
+    fprintf(out, "],\"cache\":");
+    const ContactCacheStats* cache = &stats->cache;
+    if (cache->max_bytes > 0) {
+        uint64_t lookups = cache->hits + cache->misses;
+        fprintf(out, "{\"entries\":%zu,\"bytes\":%zu,\"max_bytes\":%zu,", cache->entries, cache->bytes, cache->max_bytes);
+        fprintf(out, "\"hits\":%llu,\"misses\":%llu,\"evictions\":%llu,",
+            (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+            (unsigned long long)cache->evictions);
+        fprintf(out, "\"hit_rate\":%.4f}", lookups ? (double)cache->hits / (double)lookups : 0.0);
+    }
+    else {
+        fprintf(out, "null");
+    }
+    fprintf(out, "}\n");
+}
+
+static void print_aging_plain(FILE* out, const ContactAging* aging) {
+    if (!out || !aging) {
+        return;
+    }
+    fprintf(out, "\nDue date aging:\n");
+    for (size_t i = 0; i < aging->bucket_count; ++i) {
+        const ContactAgingBucket* bucket = &aging->buckets[i];
+        fprintf(out, "  %-14s %8d  %14.2f\n", bucket->label, bucket->count, bucket->amount);
+    }
+    fprintf(out, "\nMissing due date: %d\n", aging->no_due_date);
+    fprintf(out, "Invalid due date: %d\n", aging->invalid_due_date);
+}
+
+static void print_aging_json(FILE* out, const ContactAging* aging) {
+    if (!out || !aging) {
+        return;
+    }
+    fprintf(out, "{\"buckets\":[");
+    for (size_t i = 0; i < aging->bucket_count; ++i) {
+        const ContactAgingBucket* bucket = &aging->buckets[i];
+        fprintf(out, "%s{\"label\":", i > 0 ? "," : "");
+        util_print_json_string(out, bucket->label);
+        fprintf(out, ",\"from_days\":");
+        if (bucket->from_days == INT_MIN) {
+            fprintf(out, "null");
+        }
+        else {
+            fprintf(out, "%d", bucket->from_days);
+        }
+        fprintf(out, ",\"to_days\":");
+        if (bucket->to_days == INT_MAX) {
+            fprintf(out, "null");
+        }
+        else {
+            fprintf(out, "%d", bucket->to_days);
+        }
+        fprintf(out, ",\"count\":%d,\"amount\":%.2f}", bucket->count, bucket->amount);
+    }
+    fprintf(out, "],\"no_due_date\":%d,\"invalid_due_date\":%d}\n", aging->no_due_date, aging->invalid_due_date);
+}
+
+#ifdef HAVE_PTHREADS
+// Blocks until the wall clock reaches when; an absolute deadline stays correct across suspend.
+static void sleep_until(time_t when) {
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    struct timespec deadline = { 0 };
+    deadline.tv_sec = when;
+    pthread_mutex_lock(&lock);
+    while (time(NULL) < when) {
+        if (pthread_cond_timedwait(&cond, &lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+#endif
+
+// Sleeps until local midnight of the next day anything is due, then reports every contact whose
+// due day has arrived since the last report. A sleep never runs past the next midnight, so a
+// contact added or moved earlier meanwhile is picked up by the daily indexed MIN(due_day) check.
+static int serve_upcoming(Db* db, int64_t announced_day, int json) {
+#ifdef HAVE_PTHREADS
+    for (;;) {
+        fflush(stdout);
+        int64_t tomorrow = util_local_epoch_day(time(NULL)) + 1;
+        int64_t next_day = tomorrow;
+        if (!contacts_next_due_day(db, announced_day, &next_day) || next_day > tomorrow) {
+            next_day = tomorrow;
+        }
+        time_t wake = util_epoch_day_start(next_day);
+        if (wake == (time_t)-1) {
+            return 0;
+        }
+        sleep_until(wake);
+        int64_t today = util_local_epoch_day(time(NULL));
+        if (today <= announced_day) {
+            continue;
+        }
+        int64_t due = today + 1;
+        if (!contacts_next_due_day(db, announced_day, &due) || due > today) {
+            announced_day = today;
+            continue;
+        }
+        if (!json) {
+            char date[16];
+            util_format_iso_date(time(NULL), date, sizeof(date));
+            printf("\nDue today (%s):\n", date);
+        }
+        if (!contacts_list_upcoming(db, announced_day + 1, today, 0, json, stdout)) {
+            return 0;
+        }
+        announced_day = today;
+    }
+#else
+    (void)db;
+    (void)announced_day;
+    (void)json;
+    fprintf(stderr, "--serve requires a build with thread support.\n");
+    return 0;
+#endif
 }
 
 static int prompt_line(const char* label, char* buf, size_t len) {
@@ -346,12 +654,26 @@ static int parse_args(int argc, char** argv, Options* opt) {
         else if (strcmp(arg, "--menu") == 0) {
             opt->menu = 1;
         }
+        else if (strcmp(arg, "--delete-missing") == 0) {
+            opt->delete_missing = 1;
+        }
         else if (strcmp(arg, "--list") == 0) {
             opt->do_list = 1;
         }
         else if (strcmp(arg, "--stats") == 0) {
             opt->do_stats = 1;
         }
+        else if (strcmp(arg, "--approx") == 0) {
+            opt->approx = 1;
+        }
+        else if (strcmp(arg, "--aging") == 0) {
+            opt->do_aging = 1;
+        }
+        else if ((strcmp(arg, "--top-debtors") == 0 || strcmp(arg, "--top-overdue") == 0) && i + 1 < argc) {
+            opt->do_top_debtors = strcmp(arg, "--top-debtors") == 0;
+            opt->do_top_overdue = !opt->do_top_debtors;
+            opt->top_count = argv[++i];
+        }
         else if (strcmp(arg, "--add") == 0) {
             opt->do_add = 1;
         }
@@ -368,14 +690,149 @@ static int parse_args(int argc, char** argv, Options* opt) {
             opt->do_search = 1;
             opt->search = argv[++i];
         }
+        else if (strcmp(arg, "--prefix") == 0 && i + 1 < argc) {
+            opt->do_prefix = 1;
+            opt->prefix = argv[++i];
+        }
+        else if (strcmp(arg, "--search-fuzzy") == 0 && i + 1 < argc) {
+            opt->do_fuzzy = 1;
+            opt->fuzzy = argv[++i];
+        }
+        else if (strcmp(arg, "--upcoming") == 0 && i + 1 < argc) {
+            opt->do_upcoming = 1;
+            opt->upcoming = argv[++i];
+        }
+        else if (strcmp(arg, "--within") == 0 && i + 1 < argc) {
+            opt->within = argv[++i];
+        }
+        else if (strcmp(arg, "--changes-since") == 0 && i + 1 < argc) {
+            opt->do_changes = 1;
+            opt->changes_since = argv[++i];
+        }
+        else if (strcmp(arg, "--tenant") == 0 && i + 1 < argc) {
+            opt->tenant = argv[++i];
+        }
+        else if (strcmp(arg, "--all-tenants") == 0) {
+            opt->all_tenants = 1;
+        }
+        else if (strcmp(arg, "--add-tenant") == 0 && i + 2 < argc) {
+            opt->do_add_tenant = 1;
+            opt->new_tenant = argv[++i];
+            opt->new_tenant_path = argv[++i];
+        }
+        else if (strcmp(arg, "--tags") == 0) {
+            opt->do_tags = 1;
+        }
+        else if ((strcmp(arg, "--add-tag") == 0 || strcmp(arg, "--remove-tag") == 0) && i + 1 < argc) {
+            opt->do_add_tag = strcmp(arg, "--add-tag") == 0;
+            opt->do_remove_tag = !opt->do_add_tag;
+            opt->edit_tag = argv[++i];
+        }
+        else if ((strcmp(arg, "--tag") == 0 || strcmp(arg, "--or-tag") == 0 || strcmp(arg, "--and-tag") == 0 ||
+            strcmp(arg, "--not-tag") == 0) && i + 1 < argc) {
+            if (opt->tag_op_count == TAGS_MAX_OPS) {
+                fprintf(stderr, "At most %d tag filters are allowed.\n", TAGS_MAX_OPS);
+                return 0;
+            }
+            TagsOp* op = &opt->tag_ops[opt->tag_op_count++];
+            op->kind = strcmp(arg, "--and-tag") == 0 ? TAGS_AND : strcmp(arg, "--not-tag") == 0 ? TAGS_NOT : TAGS_OR;
+            op->tag = argv[++i];
+        }
+        else if (strcmp(arg, "--ndjson") == 0) {
+            opt->ndjson = 1;
+        }
+        else if (strcmp(arg, "--serve") == 0) {
+            opt->serve = 1;
+        }
+        else if (strcmp(arg, "--where") == 0 && i + 1 < argc) {
+            opt->do_where = 1;
+            opt->where = argv[++i];
+        }
+        else if (strcmp(arg, "--max-distance") == 0 && i + 1 < argc) {
+            opt->max_distance = argv[++i];
+        }
+        else if (strcmp(arg, "--limit") == 0 && i + 1 < argc) {
+            opt->limit = argv[++i];
+        }
+        else if (strcmp(arg, "--jobs") == 0 && i + 1 < argc) {
+            opt->jobs = argv[++i];
+        }
+        else if (strcmp(arg, "--unordered") == 0) {
+            opt->unordered = 1;
+        }
+        else if (strcmp(arg, "--io") == 0 && i + 1 < argc) {
+            opt->io_backend = argv[++i];
+        }
+        else if (strcmp(arg, "--direct") == 0) {
+            opt->direct = 1;
+        }
         else if (strcmp(arg, "--export") == 0 && i + 1 < argc) {
             opt->do_export = 1;
             opt->export_path = argv[++i];
         }
+        else if ((strcmp(arg, "--charge") == 0 || strcmp(arg, "--payment") == 0) && i + 1 < argc) {
+            opt->do_charge = strcmp(arg, "--charge") == 0;
+            opt->do_payment = !opt->do_charge;
+            opt->ledger_amount = argv[++i];
+        }
+        else if (strcmp(arg, "--on") == 0 && i + 1 < argc) {
+            opt->ledger_on = argv[++i];
+        }
+        else if (strcmp(arg, "--memo") == 0 && i + 1 < argc) {
+            opt->memo = argv[++i];
+        }
+        else if (strcmp(arg, "--ledger") == 0) {
+            opt->do_ledger = 1;
+        }
+        else if (strcmp(arg, "--balance-at") == 0 && i + 1 < argc) {
+            opt->do_balance_at = 1;
+            opt->balance_at = argv[++i];
+        }
+        else if (strcmp(arg, "--archive") == 0) {
+            opt->do_archive = 1;
+        }
+        else if (strcmp(arg, "--older-than") == 0 && i + 1 < argc) {
+            opt->older_than = argv[++i];
+        }
+        else if (strcmp(arg, "--restore") == 0) {
+            opt->do_restore = 1;
+        }
+        else if (strcmp(arg, "--include-archived") == 0) {
+            opt->include_archived = 1;
+        }
+        else if (strcmp(arg, "--checkpoint") == 0 && i + 1 < argc) {
+            opt->checkpoint = argv[++i];
+        }
+        else if (strcmp(arg, "--resume") == 0) {
+            opt->resume = 1;
+        }
+        else if (strcmp(arg, "--map") == 0 && i + 1 < argc) {
+            opt->column_map = argv[++i];
+        }
+        else if (strcmp(arg, "--import-ledger") == 0 && i + 1 < argc) {
+            opt->do_import_ledger = 1;
+            opt->import_ledger_path = argv[++i];
+        }
         else if (strcmp(arg, "--import") == 0 && i + 1 < argc) {
             opt->do_import = 1;
             opt->import_path = argv[++i];
         }
+        else if (strcmp(arg, "--import-json") == 0 && i + 1 < argc) {
+            opt->do_import_json = 1;
+            opt->import_json_path = argv[++i];
+        }
+        else if (strcmp(arg, "--sync") == 0 && i + 1 < argc) {
+            opt->do_sync = 1;
+            opt->sync_path = argv[++i];
+        }
+        else if (strcmp(arg, "--export-bin") == 0 && i + 1 < argc) {
+            opt->do_export_bin = 1;
+            opt->export_bin_path = argv[++i];
+        }
+        else if (strcmp(arg, "--import-bin") == 0 && i + 1 < argc) {
+            opt->do_import_bin = 1;
+            opt->import_bin_path = argv[++i];
+        }
         else if (strcmp(arg, "--sort") == 0 && i + 1 < argc) {
             opt->do_sort = 1;
             opt->sort_mode = argv[++i];
@@ -389,6 +846,9 @@ static int parse_args(int argc, char** argv, Options* opt) {
         else if (strcmp(arg, "--current-password") == 0 && i + 1 < argc) {
             opt->current_password = argv[++i];
         }
+        else if (strcmp(arg, "--cache-bytes") == 0 && i + 1 < argc) {
+            opt->cache_bytes = argv[++i];
+        }
         else if (strcmp(arg, "--name") == 0 && i + 1 < argc) {
             opt->name = argv[++i];
         }
@@ -440,7 +900,275 @@ static int do_backup_if_requested(const Options* opt, const char* db_path) {
     return 1;
 }
 
+// Scatter-gather reads over every tenant database registered in the main one.
+static int handle_all_tenants(Db* db, const Options* opt) {
+    if (opt->do_tags || opt->do_add_tag || opt->do_remove_tag || opt->tag_op_count > 0) {
+        fprintf(stderr, "Tags belong to one database; use --tenant NAME instead of --all-tenants.\n");
+        return 0;
+    }
+    if (opt->include_archived) {
+        fprintf(stderr, "The archive belongs to one database; use --tenant NAME instead of --all-tenants.\n");
+        return 0;
+    }
+    if (!shard_open(db, NULL)) {
+        return 0;
+    }
+    if (opt->do_list) {
+        return shard_list(db, NULL, opt->json, stdout);
+    }
+    if (opt->do_search) {
+        char pattern[256];
+        snprintf(pattern, sizeof(pattern), "%%%s%%", opt->search ? opt->search : "");
+        return shard_list(db, pattern, opt->json, stdout);
+    }
+    if (opt->do_stats && opt->approx) {
+        return print_sketch(db, 1, opt->json);
+    }
+    if (opt->do_stats) {
+        long jobs = 1;
+        if (opt->jobs && !util_parse_long(opt->jobs, &jobs, 1, 64)) {
+            fprintf(stderr, "Invalid jobs.\n");
+            return 0;
+        }
+        ContactStats stats;
+        if (!shard_stats(db, (int)jobs, &stats)) {
+            return 0;
+        }
+        if (opt->json) {
+            print_stats_json(stdout, &stats);
+        }
+        else {
+            print_stats_plain(stdout, &stats);
+        }
+        return 1;
+    }
+    fprintf(stderr, "--all-tenants supports --list, --search and --stats.\n");
+    return 0;
+}
+
+static int tag_contacts(Db* db, const Options* opt, ContactFilter* filter) {
+    Roaring* one = NULL;
+    if (opt->id) {
+        int64_t id = 0;
+        if (!util_parse_i64(opt->id, &id, 1, (int64_t)UINT32_MAX)) {
+            fprintf(stderr, "Invalid ID.\n");
+            return 0;
+        }
+        one = roaring_create();
+        if (!one || !roaring_add(one, (uint32_t)id) || (filter->ids && !roaring_and(one, filter->ids))) {
+            roaring_destroy(one);
+            return 0;
+        }
+        filter->ids = one;
+    }
+    else if (!filter->ids && !filter->where && !filter->name_like) {
+        fprintf(stderr, "--add-tag and --remove-tag need --id, --where, --search or a tag filter.\n");
+        return 0;
+    }
+    int changed = 0;
+    int ok = tags_update(db, opt->edit_tag, opt->do_add_tag, filter, &changed);
+    roaring_destroy(one);
+    if (ok && opt->do_add_tag) {
+        printf("Tagged %d contact%s with %s\n", changed, changed == 1 ? "" : "s", opt->edit_tag);
+    }
+    else if (ok) {
+        printf("Removed %s from %d contact%s\n", opt->edit_tag, changed, changed == 1 ? "" : "s");
+    }
+    return ok;
+}
+
+// Tag commands, and --list/--search/--where/--export/--stats restricted to a tag selection.
+static int handle_tags(Db* db, const Options* opt) {
+    if (opt->do_tags) {
+        return tags_print(db, opt->json, stdout);
+    }
+    if (opt->do_prefix || opt->do_fuzzy || opt->do_upcoming || opt->do_changes || opt->do_aging || opt->do_top_debtors ||
+        opt->do_top_overdue) {
+        fprintf(stderr, "Tag filters apply to --list, --search, --where, --export and --stats.\n");
+        return 0;
+    }
+    if (opt->do_stats && (opt->do_where || opt->do_search || opt->approx)) {
+        fprintf(stderr, "--stats takes tag filters only.\n");
+        return 0;
+    }
+    Roaring* selected = NULL;
+    if (opt->tag_op_count > 0 && !(selected = tags_select(db, opt->tag_ops, opt->tag_op_count))) {
+        return 0;
+    }
+    char pattern[256];
+    ContactFilter filter = { NULL, opt->where, selected };
+    if (opt->do_search) {
+        snprintf(pattern, sizeof(pattern), "%%%s%%", opt->search ? opt->search : "");
+        filter.name_like = pattern;
+    }
+    int ok = 1;
+    if (opt->do_add_tag || opt->do_remove_tag) {
+        ok = tag_contacts(db, opt, &filter);
+    }
+    else if (opt->do_stats) {
+        ContactStats stats;
+        ok = contacts_stats_subset(db, selected, &stats);
+        if (ok && opt->json) {
+            print_stats_json(stdout, &stats);
+        }
+        else if (ok) {
+            print_stats_plain(stdout, &stats);
+        }
+    }
+    else if (opt->do_export) {
+        // Tagged exports always run serially; --jobs is ignored.
+        AioBackend backend = AIO_BACKEND_AUTO;
+        Stream* out = NULL;
+        if (opt->io_backend && !aio_parse_backend(opt->io_backend, &backend)) {
+            fprintf(stderr, "Invalid I/O backend. Use auto, uring, thread or sync.\n");
+            ok = 0;
+        }
+        else if (!(out = stream_open_file_writer(opt->export_path, stream_codec_for_path(opt->export_path), backend,
+            opt->direct ? AIO_DIRECT : 0))) {
+            ok = 0;
+        }
+        else {
+            ok = csv_write_contacts_filter(db, out, &filter);
+            ok = stream_close(out) && ok;
+        }
+    }
+    else {
+        ok = contacts_list_filter(db, &filter, opt->json, stdout);
+    }
+    roaring_destroy(selected);
+    return ok;
+}
+
+// --charge, --payment, --ledger, --balance-at and --import-ledger.
+static int handle_ledger(Db* db, const Options* opt) {
+    if (opt->do_import_ledger) {
+        if (!do_backup_if_requested(opt, db->path)) {
+            return 0;
+        }
+        FILE* f = fopen(opt->import_ledger_path, "rb");
+        if (!f) {
+            perror("Failed to open ledger file");
+            return 0;
+        }
+        Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 1);
+        if (!in) {
+            fclose(f);
+            return 0;
+        }
+        int imported = 0, failed = 0;
+        int ok = csv_import_ledger_stream(db, in, opt->strict, opt->dry_run, &imported, &failed);
+        ok = stream_close(in) && ok;
+        printf("Posted: %d, Failed: %d\n", imported, failed);
+        return ok;
+    }
+    int64_t id = 0;
+    if (opt->id && !util_parse_i64(opt->id, &id, 1, INT64_MAX)) {
+        fprintf(stderr, "Invalid ID.\n");
+        return 0;
+    }
+    if (opt->do_balance_at) {
+        int64_t day = 0;
+        double balance = 0.0;
+        if (!util_epoch_day(opt->balance_at, &day)) {
+            fprintf(stderr, "Invalid date format. Use YYYY-MM-DD.\n");
+            return 0;
+        }
+        if (!ledger_balance_at(db, id, day, &balance)) {
+            return 0;
+        }
+        if (opt->json) {
+            printf("{\"date\":\"%s\",", opt->balance_at);
+            if (id > 0) {
+                printf("\"id\":%lld,", (long long)id);
+            }
+            printf("\"balance\":%.2f}\n", balance);
+        }
+        else {
+            printf("Balance at %s: %.2f\n", opt->balance_at, balance);
+        }
+        return 1;
+    }
+    if (!opt->id) {
+        fprintf(stderr, "%s requires --id\n", opt->do_ledger ? "--ledger" : opt->do_charge ? "--charge" : "--payment");
+        return 0;
+    }
+    if (opt->do_ledger) {
+        return ledger_print(db, id, opt->json, stdout);
+    }
+    double amount = 0.0;
+    int64_t day = util_local_epoch_day(time(NULL));
+    if (!util_parse_double(opt->ledger_amount, &amount, 0.0, 1e12) || amount == 0.0) {
+        fprintf(stderr, "Invalid amount.\n");
+        return 0;
+    }
+    if (opt->ledger_on && !util_epoch_day(opt->ledger_on, &day)) {
+        fprintf(stderr, "Invalid date format. Use YYYY-MM-DD.\n");
+        return 0;
+    }
+    double balance = 0.0;
+    if (!ledger_post(db, id, day, opt->do_charge ? amount : -amount, opt->memo, NULL) ||
+        !ledger_balance(db, id, &balance)) {
+        return 0;
+    }
+    printf("Posted %s of %.2f to contact %lld; balance %.2f\n", opt->do_charge ? "charge" : "payment", amount,
+        (long long)id, balance);
+    return 1;
+}
+
+// --archive moves cold contacts out of the table every default query reads; --restore brings one back.
+static int handle_archive(Db* db, const Options* opt) {
+    if (opt->do_restore) {
+        int64_t id = 0;
+        if (!opt->id || !util_parse_i64(opt->id, &id, 1, INT64_MAX)) {
+            fprintf(stderr, "--restore requires a valid --id\n");
+            return 0;
+        }
+        if (!archive_restore(db, id)) {
+            return 0;
+        }
+        printf("Contact %lld restored.\n", (long long)id);
+        return 1;
+    }
+    long days = 0;
+    if (!opt->older_than || !util_parse_long(opt->older_than, &days, 0, 36500)) {
+        fprintf(stderr, "--archive requires --older-than DAYS\n");
+        return 0;
+    }
+    if (!opt->dry_run && !do_backup_if_requested(opt, db->path)) {
+        return 0;
+    }
+    int64_t moved = 0;
+    if (!archive_contacts(db, days, 0, opt->dry_run, &moved)) {
+        return 0;
+    }
+    printf("%s: %lld\n", opt->dry_run ? "Would archive" : "Archived", (long long)moved);
+    return 1;
+}
+
 static int handle_non_interactive(Db* db, const Options* opt) {
+    if (opt->include_archived && (opt->approx || opt->tag_op_count > 0 || opt->do_tags || opt->do_add_tag ||
+        opt->do_remove_tag || !(opt->do_list || opt->do_search || opt->do_where || opt->do_export || opt->do_export_bin ||
+        opt->do_stats))) {
+        fprintf(stderr, "--include-archived applies to --list, --search, --where, --export, --export-bin and --stats.\n");
+        return 0;
+    }
+    if ((opt->checkpoint || opt->resume) && (!opt->do_import || opt->dry_run)) {
+        fprintf(stderr, "--checkpoint and --resume apply to --import without --dry-run.\n");
+        return 0;
+    }
+    if (opt->column_map && !(opt->do_import || opt->do_sync)) {
+        fprintf(stderr, "--map applies to --import and --sync.\n");
+        return 0;
+    }
+    if (opt->do_archive || opt->do_restore) {
+        return handle_archive(db, opt);
+    }
+    if (opt->do_charge || opt->do_payment || opt->do_ledger || opt->do_balance_at || opt->do_import_ledger) {
+        return handle_ledger(db, opt);
+    }
+    if (opt->do_tags || opt->do_add_tag || opt->do_remove_tag || opt->tag_op_count > 0) {
+        return handle_tags(db, opt);
+    }
     if (opt->do_list) {
         return contacts_list(db, opt->json, stdout);
     }
@@ -449,9 +1177,100 @@ static int handle_non_interactive(Db* db, const Options* opt) {
         snprintf(pattern, sizeof(pattern), "%%%s%%", opt->search ? opt->search : "");
         return contacts_search_by_name(db, pattern, opt->json, stdout);
     }
+    if (opt->do_upcoming) {
+        long limit = 0;
+        long within = -1;
+        if (!util_parse_long(opt->upcoming, &limit, 0, 1000000)) {
+            fprintf(stderr, "Invalid upcoming count.\n");
+            return 0;
+        }
+        if (opt->within && !util_parse_long(opt->within, &within, 0, 36500)) {
+            fprintf(stderr, "Invalid window.\n");
+            return 0;
+        }
+        int64_t today = util_local_epoch_day(time(NULL));
+        int64_t last_day = within < 0 ? INT64_MAX : today + within;
+        if (!contacts_list_upcoming(db, today, last_day, (int)limit, opt->json, stdout)) {
+            return 0;
+        }
+        return !opt->serve || serve_upcoming(db, today, opt->json);
+    }
+    if (opt->do_top_debtors || opt->do_top_overdue) {
+        long n = 0;
+        if (!util_parse_long(opt->top_count, &n, 1, 1000000)) {
+            fprintf(stderr, "Invalid top count.\n");
+            return 0;
+        }
+        if (opt->do_top_debtors) {
+            return contacts_top_debtors(db, (size_t)n, opt->json, stdout);
+        }
+        return contacts_top_overdue(db, util_local_epoch_day(time(NULL)), (size_t)n, opt->json, stdout);
+    }
+    if (opt->do_changes) {
+        int64_t since = 0;
+        if (!util_parse_i64(opt->changes_since, &since, 0, INT64_MAX)) {
+            fprintf(stderr, "Invalid sequence number.\n");
+            return 0;
+        }
+        ChangesFormat format = opt->ndjson ? CHANGES_FORMAT_NDJSON : opt->json ? CHANGES_FORMAT_JSON : CHANGES_FORMAT_PLAIN;
+        return changes_print_since(db, since, format, stdout, NULL);
+    }
+    if (opt->do_where) {
+        return contacts_list_where(db, opt->where, opt->json, stdout);
+    }
+    if (opt->do_prefix) {
+        long limit = DEFAULT_PREFIX_LIMIT;
+        if (opt->limit && !util_parse_long(opt->limit, &limit, 1, 100000)) {
+            fprintf(stderr, "Invalid limit.\n");
+            return 0;
+        }
+        int64_t* ids = (int64_t*)malloc((size_t)limit * sizeof(int64_t));
+        if (!ids) {
+            return 0;
+        }
+        size_t count = 0;
+        int ok = contacts_search_prefix(db, opt->prefix, ids, (size_t)limit, &count) &&
+            contacts_print_ids(db, ids, count, opt->json, stdout);
+        free(ids);
+        return ok;
+    }
+    if (opt->do_fuzzy) {
+        long limit = DEFAULT_PREFIX_LIMIT;
+        long distance = DEFAULT_FUZZY_DISTANCE;
+        if (opt->limit && !util_parse_long(opt->limit, &limit, 1, 100000)) {
+            fprintf(stderr, "Invalid limit.\n");
+            return 0;
+        }
+        if (opt->max_distance && !util_parse_long(opt->max_distance, &distance, 0, 16)) {
+            fprintf(stderr, "Invalid max distance.\n");
+            return 0;
+        }
+        FuzzyMatch* matches = (FuzzyMatch*)malloc((size_t)limit * sizeof(FuzzyMatch));
+        int64_t* ids = (int64_t*)malloc((size_t)limit * sizeof(int64_t));
+        size_t count = 0;
+        int ok = matches && ids &&
+            contacts_search_fuzzy(db, opt->fuzzy, (int)distance, matches, (size_t)limit, &count);
+        if (ok) {
+            for (size_t i = 0; i < count; ++i) {
+                ids[i] = matches[i].id;
+            }
+            ok = contacts_print_ids(db, ids, count, opt->json, stdout);
+        }
+        free(ids);
+        free(matches);
+        return ok;
+    }
+    if (opt->do_stats && opt->approx) {
+        return print_sketch(db, 0, opt->json);
+    }
     if (opt->do_stats) {
+        long jobs = 1;
+        if (opt->jobs && !util_parse_long(opt->jobs, &jobs, 1, 64)) {
+            fprintf(stderr, "Invalid jobs.\n");
+            return 0;
+        }
         ContactStats stats;
-        if (!contacts_stats(db, &stats)) {
+        if (!contacts_stats_parallel(db, (int)jobs, &stats)) {
             return 0;
         }
         if (opt->json) {
@@ -462,6 +1281,20 @@ static int handle_non_interactive(Db* db, const Options* opt) {
         }
         return 1;
     }
+    if (opt->do_aging) {
+        ContactAging aging;
+        contacts_aging_defaults(&aging);
+        if (!contacts_aging(db, &aging)) {
+            return 0;
+        }
+        if (opt->json) {
+            print_aging_json(stdout, &aging);
+        }
+        else {
+            print_aging_plain(stdout, &aging);
+        }
+        return 1;
+    }
     if (opt->do_add) {
         if (!opt->name) {
             fprintf(stderr, "--add requires --name\n");
@@ -524,7 +1357,7 @@ static int handle_non_interactive(Db* db, const Options* opt) {
             }
             c.due_amount = v;
         }
-        if (!contacts_update(db, &c)) {
+        if (!contacts_update(db, &c, NULL)) {
             return 0;
         }
         printf("Updated contact %lld\n", (long long)c.id);
@@ -540,7 +1373,7 @@ static int handle_non_interactive(Db* db, const Options* opt) {
             fprintf(stderr, "Invalid ID.\n");
             return 0;
         }
-        if (!contacts_delete(db, id)) {
+        if (!contacts_delete(db, id, NULL)) {
             return 0;
         }
         printf("Deleted contact %lld\n", (long long)id);
@@ -554,39 +1387,137 @@ static int handle_non_interactive(Db* db, const Options* opt) {
         if (!do_backup_if_requested(opt, db->path)) {
             return 0;
         }
-        const char* sql = "DELETE FROM contacts;";
-        char* err = NULL;
-        if (sqlite3_exec(db->handle, sql, NULL, NULL, &err) != SQLITE_OK) {
-            fprintf(stderr, "SQLite error: %s\n", err ? err : "unknown");
-            sqlite3_free(err);
+        if (!contacts_delete_all(db)) {
             return 0;
         }
         printf("All contacts deleted.\n");
         return 1;
     }
     if (opt->do_export) {
-        FILE* f = fopen(opt->export_path, "wb");
-        if (!f) {
-            perror("Failed to open export file");
+        long jobs = 1;
+        if (opt->jobs && !util_parse_long(opt->jobs, &jobs, 1, 64)) {
+            fprintf(stderr, "Invalid jobs.\n");
             return 0;
         }
-        int ok = csv_write_contacts(db, f);
-        fclose(f);
-        return ok;
+        AioBackend backend = AIO_BACKEND_AUTO;
+        if (opt->io_backend && !aio_parse_backend(opt->io_backend, &backend)) {
+            fprintf(stderr, "Invalid I/O backend. Use auto, uring, thread or sync.\n");
+            return 0;
+        }
+        Stream* out = stream_open_file_writer(opt->export_path, stream_codec_for_path(opt->export_path), backend,
+            opt->direct ? AIO_DIRECT : 0);
+        if (!out) {
+            return 0;
+        }
+        int ok = opt->jobs ? csv_write_contacts_parallel(db, out, (int)jobs, !opt->unordered)
+            : csv_write_contacts_stream(db, out);
+        return stream_close(out) && ok;
     }
     if (opt->do_import) {
         if (!do_backup_if_requested(opt, db->path)) {
             return 0;
         }
+        int imported = 0, failed = 0;
+        if (opt->checkpoint || opt->resume) {
+            long rows = 0;
+            if (opt->checkpoint && !util_parse_long(opt->checkpoint, &rows, 1, LONG_MAX)) {
+                fprintf(stderr, "Invalid checkpoint interval.\n");
+                return 0;
+            }
+            int ok = csv_import_contacts_checkpointed(db, opt->import_path, opt->column_map, opt->strict, (size_t)rows,
+                opt->resume, &imported, &failed);
+            printf("Imported: %d, Failed: %d\n", imported, failed);
+            return ok;
+        }
         FILE* f = fopen(opt->import_path, "rb");
         if (!f) {
             perror("Failed to open import file");
             return 0;
         }
+        Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 1);
+        if (!in) {
+            fclose(f);
+            return 0;
+        }
+        int ok = csv_import_contacts_stream(db, in, opt->column_map, opt->strict, opt->dry_run, &imported, &failed);
+        ok = stream_close(in) && ok;
+        printf("Imported: %d, Failed: %d\n", imported, failed);
+        return ok;
+    }
+    if (opt->do_import_json) {
+        if (!do_backup_if_requested(opt, db->path)) {
+            return 0;
+        }
+        FILE* f = fopen(opt->import_json_path, "rb");
+        if (!f) {
+            perror("Failed to open import file");
+            return 0;
+        }
+        Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 1);
+        if (!in) {
+            fclose(f);
+            return 0;
+        }
         int imported = 0, failed = 0;
-        int ok = csv_import_contacts(db, f, opt->strict, opt->dry_run, &imported, &failed);
-        fclose(f);
+        double started = now_seconds();
+        int ok = csv_import_contacts_json(db, in, opt->strict, opt->dry_run, &imported, &failed);
+        double elapsed = now_seconds() - started;
+        uint64_t bytes = stream_tell(in);
+        ok = stream_close(in) && ok;
         printf("Imported: %d, Failed: %d\n", imported, failed);
+        if (ok && elapsed > 0.0) {
+            printf("Throughput: %.0f rows/s, %.1f MB/s\n", (imported + failed) / elapsed, bytes / elapsed / 1e6);
+        }
+        return ok;
+    }
+    if (opt->do_sync) {
+        if (!do_backup_if_requested(opt, db->path)) {
+            return 0;
+        }
+        FILE* f = fopen(opt->sync_path, "rb");
+        if (!f) {
+            perror("Failed to open sync file");
+            return 0;
+        }
+        Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 1);
+        if (!in) {
+            fclose(f);
+            return 0;
+        }
+        CsvSyncResult result;
+        int ok = csv_sync_contacts_stream(db, in, opt->column_map, opt->strict, opt->dry_run, opt->delete_missing, &result);
+        ok = stream_close(in) && ok;
+        printf("Inserted: %d, Updated: %d, Unchanged: %d, Deleted: %d, Failed: %d\n",
+            result.inserted, result.updated, result.unchanged, result.deleted, result.failed);
+        return ok;
+    }
+    if (opt->do_export_bin) {
+        FILE* f = fopen(opt->export_bin_path, "wb");
+        if (!f) {
+            perror("Failed to open export file");
+            return 0;
+        }
+        int ok = columnar_write_contacts(db, f);
+        if (fclose(f) != 0) {
+            ok = 0;
+        }
+        return ok;
+    }
+    if (opt->do_import_bin) {
+        if (!do_backup_if_requested(opt, db->path)) {
+            return 0;
+        }
+        FILE* f = fopen(opt->import_bin_path, "rb");
+        if (!f) {
+            perror("Failed to open import file");
+            return 0;
+        }
+        int imported = 0;
+        int ok = columnar_import_contacts(db, f, opt->dry_run, &imported);
+        fclose(f);
+        if (ok) {
+            printf("Imported: %d\n", imported);
+        }
         return ok;
     }
     if (opt->do_sort) {
@@ -717,7 +1648,7 @@ static int interactive_menu(Db* db, const Options* opt) {
                 }
                 util_copy_str(c.due_date, sizeof(c.due_date), buf);
             }
-            if (!contacts_update(db, &c)) {
+            if (!contacts_update(db, &c, NULL)) {
                 printf("Failed to update contact.\n");
             }
             else {
@@ -737,7 +1668,7 @@ static int interactive_menu(Db* db, const Options* opt) {
             if (confirm[0] != 'y' && confirm[0] != 'Y') {
                 continue;
             }
-            if (!contacts_delete(db, id)) {
+            if (!contacts_delete(db, id, NULL)) {
                 printf("Failed to delete contact.\n");
             }
             else {
@@ -797,7 +1728,15 @@ static int interactive_menu(Db* db, const Options* opt) {
     }
 }
 
+// Commands that only read can skip schema setup and open the database without write locks.
+static int is_read_only(const Options* opt, int interactive) {
+    return !interactive && !(opt->do_add || opt->do_edit || opt->do_delete || opt->do_delete_all || opt->do_import || opt->do_import_json ||
+        opt->do_sync || opt->do_import_bin || opt->do_sort || opt->do_set_password || opt->do_add_tenant || opt->do_add_tag || opt->do_remove_tag ||
+        opt->do_charge || opt->do_payment || opt->do_import_ledger || opt->do_archive || opt->do_restore);
+}
+
 int main(int argc, char** argv) {
+    util_set_error_echo(1);
     Options opt;
     if (!parse_args(argc, argv, &opt)) {
         return 1;
@@ -805,32 +1744,75 @@ int main(int argc, char** argv) {
 
     int interactive = opt.menu;
     if (!interactive) {
-        if (!(opt.do_list || opt.do_stats || opt.do_add || opt.do_edit || opt.do_delete || opt.do_delete_all ||
-            opt.do_search || opt.do_export || opt.do_import || opt.do_sort || opt.do_set_password)) {
+        if (!(opt.do_list || opt.do_stats || opt.do_aging || opt.do_top_debtors || opt.do_top_overdue || opt.do_add || opt.do_edit || opt.do_delete || opt.do_delete_all ||
+            opt.do_search || opt.do_prefix || opt.do_fuzzy || opt.do_where || opt.do_upcoming || opt.do_changes || opt.do_add_tenant || opt.do_export || opt.do_import || opt.do_import_json || opt.do_sync || opt.do_export_bin || opt.do_import_bin || opt.do_sort || opt.do_set_password || opt.do_tags || opt.do_add_tag || opt.do_remove_tag ||
+            opt.do_charge || opt.do_payment || opt.do_ledger || opt.do_balance_at || opt.do_import_ledger ||
+            opt.do_archive || opt.do_restore || opt.tag_op_count > 0)) {
             interactive = 1;
         }
     }
 
     Db db;
-    if (!db_open(&db, opt.db_path)) {
+    int opened = is_read_only(&opt, interactive) ? db_open_for_read(&db, opt.db_path)
+        : db_open(&db, opt.db_path) && db_init(&db);
+    if (!opened) {
+        db_close(&db);
         return 1;
     }
-    if (!db_init(&db)) {
+
+    if (!ensure_auth(&db, interactive, &opt)) {
         db_close(&db);
         return 1;
     }
 
-    if (!ensure_auth(&db, interactive, &opt)) {
+    if (opt.do_add_tenant) {
+        int ok = shard_register(&db, opt.new_tenant, opt.new_tenant_path);
+        if (ok) {
+            printf("Tenant %s stored in %s\n", opt.new_tenant, opt.new_tenant_path);
+        }
+        db_close(&db);
+        return ok ? 0 : 1;
+    }
+    if (opt.all_tenants) {
+        int ok = !interactive && handle_all_tenants(&db, &opt);
+        db_close(&db);
+        return ok ? 0 : 1;
+    }
+    // Commands for one tenant run on its own file; the main database only holds auth and the shard map.
+    Db* target = &db;
+    if (opt.tenant && opt.do_set_password) {
+        fprintf(stderr, "The password belongs to the main database; omit --tenant.\n");
+        db_close(&db);
+        return 1;
+    }
+    if (opt.tenant) {
+        if (!shard_open(&db, opt.tenant)) {
+            db_close(&db);
+            return 1;
+        }
+        target = &db.shards[0].db;
+    }
+
+    target->include_archived = opt.include_archived;
+
+    long cache_bytes = interactive ? DEFAULT_MENU_CACHE_BYTES : 0;
+    if (opt.cache_bytes && !util_parse_long(opt.cache_bytes, &cache_bytes, 0, LONG_MAX)) {
+        fprintf(stderr, "Invalid cache size.\n");
+        db_close(&db);
+        return 1;
+    }
+    if (!contacts_cache_enable(target, (size_t)cache_bytes)) {
+        fprintf(stderr, "Failed to allocate record cache.\n");
         db_close(&db);
         return 1;
     }
 
     int ok = 1;
     if (interactive) {
-        ok = interactive_menu(&db, &opt);
+        ok = interactive_menu(target, &opt);
     }
     else {
-        ok = handle_non_interactive(&db, &opt);
+        ok = handle_non_interactive(target, &opt);
     }
 
     db_close(&db);
@@ -0,0 +1,286 @@
+// Purpose: Sorted in-memory index of casefolded contact names for prefix lookup. Author: GitHub Copilot
+#include "name_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_INDEX_FOLD_STACK 256
+#define NAME_INDEX_COMPACT_MIN 4096
+
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+    int64_t id;
+} NameEntry;
+
+struct NameIndex {
+    NameEntry* entries;
+    size_t count;
+    size_t cap;
+    char* keys;
+    size_t keys_used;
+    size_t keys_cap;
+    size_t keys_garbage;
+};
+
+// Matches SQLite's NOCASE collation, which folds ASCII letters only.
+static char fold_char(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static void fold_into(char* dest, const char* src, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        dest[i] = fold_char(src[i]);
+    }
+}
+
+static int compare_keys(const char* a, size_t a_len, int64_t a_id, const char* b, size_t b_len, int64_t b_id) {
+    size_t n = a_len < b_len ? a_len : b_len;
+    int r = memcmp(a, b, n);
+    if (r != 0) {
+        return r;
+    }
+    if (a_len != b_len) {
+        return a_len < b_len ? -1 : 1;
+    }
+    if (a_id != b_id) {
+        return a_id < b_id ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_entries(const NameIndex* index, const NameEntry* a, const NameEntry* b) {
+    return compare_keys(index->keys + a->off, a->len, a->id, index->keys + b->off, b->len, b->id);
+}
+
+static size_t lower_bound(const NameIndex* index, const char* key, size_t len, int64_t id) {
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const NameEntry* e = &index->entries[mid];
+        if (compare_keys(index->keys + e->off, e->len, e->id, key, len, id) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void merge_sort(const NameIndex* index, NameEntry* a, NameEntry* tmp, size_t n) {
+    if (n < 2) {
+        return;
+    }
+    size_t half = n / 2;
+    merge_sort(index, a, tmp, half);
+    merge_sort(index, a + half, tmp, n - half);
+    size_t i = 0;
+    size_t j = half;
+    size_t k = 0;
+    while (i < half && j < n) {
+        if (compare_entries(index, &a[j], &a[i]) < 0) {
+            tmp[k++] = a[j++];
+        }
+        else {
+            tmp[k++] = a[i++];
+        }
+    }
+    while (i < half) {
+        tmp[k++] = a[i++];
+    }
+    while (j < n) {
+        tmp[k++] = a[j++];
+    }
+    memcpy(a, tmp, n * sizeof(NameEntry));
+}
+
+static int reserve_entries(NameIndex* index, size_t extra) {
+    if (index->count + extra <= index->cap) {
+        return 1;
+    }
+    size_t cap = index->cap ? index->cap : 256;
+    while (cap < index->count + extra) {
+        cap *= 2;
+    }
+    NameEntry* entries = (NameEntry*)realloc(index->entries, cap * sizeof(NameEntry));
+    if (!entries) {
+        return 0;
+    }
+    index->entries = entries;
+    index->cap = cap;
+    return 1;
+}
+
+static int store_key(NameIndex* index, const char* name, uint32_t* off_out, uint32_t* len_out) {
+    size_t len = strlen(name);
+    if (len > UINT32_MAX || index->keys_used + len > UINT32_MAX) {
+        return 0;
+    }
+    if (index->keys_used + len > index->keys_cap) {
+        size_t cap = index->keys_cap ? index->keys_cap : 4096;
+        while (cap < index->keys_used + len) {
+            cap *= 2;
+        }
+        char* keys = (char*)realloc(index->keys, cap);
+        if (!keys) {
+            return 0;
+        }
+        index->keys = keys;
+        index->keys_cap = cap;
+    }
+    fold_into(index->keys + index->keys_used, name, len);
+    *off_out = (uint32_t)index->keys_used;
+    *len_out = (uint32_t)len;
+    index->keys_used += len;
+    return 1;
+}
+
+static void compact_keys(NameIndex* index) {
+    size_t cap = index->keys_used - index->keys_garbage + 1;
+    char* keys = (char*)malloc(cap);
+    if (!keys) {
+        return;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < index->count; ++i) {
+        NameEntry* e = &index->entries[i];
+        memcpy(keys + used, index->keys + e->off, e->len);
+        e->off = (uint32_t)used;
+        used += e->len;
+    }
+    free(index->keys);
+    index->keys = keys;
+    index->keys_used = used;
+    index->keys_cap = cap;
+    index->keys_garbage = 0;
+}
+
+// Folds into a stack buffer when it fits; the caller frees *heap_out.
+static const char* fold_temp(const char* s, size_t len, char* stack_buf, char** heap_out) {
+    char* dest = stack_buf;
+    *heap_out = NULL;
+    if (len > NAME_INDEX_FOLD_STACK) {
+        *heap_out = (char*)malloc(len);
+        if (!*heap_out) {
+            return NULL;
+        }
+        dest = *heap_out;
+    }
+    fold_into(dest, s, len);
+    return dest;
+}
+
+NameIndex* name_index_create(void) {
+    return (NameIndex*)calloc(1, sizeof(NameIndex));
+}
+
+void name_index_destroy(NameIndex* index) {
+    if (!index) {
+        return;
+    }
+    free(index->entries);
+    free(index->keys);
+    free(index);
+}
+
+int name_index_append(NameIndex* index, const char* name, int64_t id) {
+    if (!index || !name || !reserve_entries(index, 1)) {
+        return 0;
+    }
+    NameEntry* e = &index->entries[index->count];
+    if (!store_key(index, name, &e->off, &e->len)) {
+        return 0;
+    }
+    e->id = id;
+    index->count++;
+    return 1;
+}
+
+int name_index_build(NameIndex* index) {
+    if (!index) {
+        return 0;
+    }
+    if (index->count < 2) {
+        return 1;
+    }
+    NameEntry* tmp = (NameEntry*)malloc(index->count * sizeof(NameEntry));
+    if (!tmp) {
+        return 0;
+    }
+    merge_sort(index, index->entries, tmp, index->count);
+    free(tmp);
+    return 1;
+}
+
+int name_index_insert(NameIndex* index, const char* name, int64_t id) {
+    if (!index || !name || !reserve_entries(index, 1)) {
+        return 0;
+    }
+    NameEntry e;
+    if (!store_key(index, name, &e.off, &e.len)) {
+        return 0;
+    }
+    e.id = id;
+    size_t pos = lower_bound(index, index->keys + e.off, e.len, id);
+    memmove(&index->entries[pos + 1], &index->entries[pos], (index->count - pos) * sizeof(NameEntry));
+    index->entries[pos] = e;
+    index->count++;
+    return 1;
+}
+
+int name_index_remove(NameIndex* index, const char* name, int64_t id) {
+    if (!index || !name) {
+        return 0;
+    }
+    size_t len = strlen(name);
+    char stack_buf[NAME_INDEX_FOLD_STACK];
+    char* heap = NULL;
+    const char* key = fold_temp(name, len, stack_buf, &heap);
+    if (!key) {
+        return 0;
+    }
+    size_t pos = lower_bound(index, key, len, id);
+    int found = pos < index->count &&
+        compare_keys(index->keys + index->entries[pos].off, index->entries[pos].len, index->entries[pos].id,
+            key, len, id) == 0;
+    free(heap);
+    if (!found) {
+        return 0;
+    }
+    index->keys_garbage += index->entries[pos].len;
+    memmove(&index->entries[pos], &index->entries[pos + 1], (index->count - pos - 1) * sizeof(NameEntry));
+    index->count--;
+    if (index->keys_garbage > NAME_INDEX_COMPACT_MIN && index->keys_garbage * 2 > index->keys_used) {
+        compact_keys(index);
+    }
+    return 1;
+}
+
+size_t name_index_prefix(const NameIndex* index, const char* prefix, int64_t* ids, size_t max_ids) {
+    if (!index || !prefix || !ids) {
+        return 0;
+    }
+    size_t len = strlen(prefix);
+    char stack_buf[NAME_INDEX_FOLD_STACK];
+    char* heap = NULL;
+    const char* key = fold_temp(prefix, len, stack_buf, &heap);
+    if (!key) {
+        return 0;
+    }
+    size_t found = 0;
+    for (size_t pos = lower_bound(index, key, len, INT64_MIN); pos < index->count && found < max_ids; ++pos) {
+        const NameEntry* e = &index->entries[pos];
+        if (e->len < len || memcmp(index->keys + e->off, key, len) != 0) {
+            break;
+        }
+        ids[found++] = e->id;
+    }
+    free(heap);
+    return found;
+}
+
+size_t name_index_count(const NameIndex* index) {
+    return index ? index->count : 0;
+}
@@ -0,0 +1,349 @@
+// Purpose: Filter expression parser that compiles to parameterized SQL. Author: GitHub Copilot
+#include "query.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+    FIELD_TEXT,
+    FIELD_REAL,
+    FIELD_INT,
+    FIELD_DATE
+} FieldKind;
+
+typedef struct {
+    const char* name;
+    const char* column;
+    FieldKind kind;
+} QueryField;
+
+static const QueryField query_fields[] = {
+    { "name", "name", FIELD_TEXT },
+    { "phone", "phone", FIELD_TEXT },
+    { "address", "address", FIELD_TEXT },
+    { "email", "email", FIELD_TEXT },
+    { "external_id", "external_id", FIELD_TEXT },
+    { "due", "due_amount", FIELD_REAL },
+    { "due_amount", "due_amount", FIELD_REAL },
+    { "due_date", "due_date", FIELD_DATE },
+    { "id", "id", FIELD_INT },
+};
+
+typedef struct {
+    const char* p;
+    Query* q;
+    int depth;
+} Parser;
+
+static int fail(Parser* ps, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(ps->q->error, sizeof(ps->q->error), fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+static int emit(Parser* ps, const char* s) {
+    size_t len = strlen(s);
+    Query* q = ps->q;
+    if (q->sql_len + len + 1 > sizeof(q->sql)) {
+        return fail(ps, "Expression too long");
+    }
+    memcpy(q->sql + q->sql_len, s, len + 1);
+    q->sql_len += len;
+    return 1;
+}
+
+static QueryParam* add_param(Parser* ps, QueryParamType type) {
+    Query* q = ps->q;
+    if (q->param_count >= QUERY_MAX_PARAMS) {
+        fail(ps, "Too many conditions (max %d)", QUERY_MAX_PARAMS);
+        return NULL;
+    }
+    QueryParam* param = &q->params[q->param_count++];
+    memset(param, 0, sizeof(*param));
+    param->type = type;
+    return param;
+}
+
+static int add_text_param(Parser* ps, const char* s, size_t len) {
+    Query* q = ps->q;
+    if (q->text_len + len + 1 > sizeof(q->text)) {
+        return fail(ps, "Expression too long");
+    }
+    QueryParam* param = add_param(ps, QUERY_PARAM_TEXT);
+    if (!param) {
+        return 0;
+    }
+    param->text_off = q->text_len;
+    memcpy(q->text + q->text_len, s, len);
+    q->text[q->text_len + len] = '\0';
+    q->text_len += len + 1;
+    return 1;
+}
+
+static int equals_nocase(const char* a, const char* b, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void skip_space(Parser* ps) {
+    while (*ps->p && isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static int at_keyword(Parser* ps, const char* kw) {
+    skip_space(ps);
+    size_t len = strlen(kw);
+    if (strlen(ps->p) < len || !equals_nocase(ps->p, kw, len)) {
+        return 0;
+    }
+    char next = ps->p[len];
+    return next == '\0' || next == '(' || isspace((unsigned char)next);
+}
+
+static int read_value(Parser* ps, char* buf, size_t len) {
+    size_t n = 0;
+    if (*ps->p == '"') {
+        ps->p++;
+        while (*ps->p && *ps->p != '"') {
+            if (*ps->p == '\\' && ps->p[1]) {
+                ps->p++;
+            }
+            if (n + 1 >= len) {
+                return fail(ps, "Value too long");
+            }
+            buf[n++] = *ps->p++;
+        }
+        if (*ps->p != '"') {
+            return fail(ps, "Unterminated quoted value");
+        }
+        ps->p++;
+    }
+    else {
+        while (*ps->p && !isspace((unsigned char)*ps->p) && *ps->p != ')') {
+            if (n + 1 >= len) {
+                return fail(ps, "Value too long");
+            }
+            buf[n++] = *ps->p++;
+        }
+    }
+    buf[n] = '\0';
+    return 1;
+}
+
+// Translates * and ? wildcards to a LIKE pattern with '\' escaping literal % and _.
+static int glob_to_like(const char* value, char* out, size_t out_len) {
+    size_t n = 0;
+    int has_wildcard = 0;
+    for (const char* v = value; *v; ++v) {
+        char c = *v;
+        if (n + 3 >= out_len) {
+            break;
+        }
+        if (c == '*') {
+            out[n++] = '%';
+            has_wildcard = 1;
+        }
+        else if (c == '?') {
+            out[n++] = '_';
+            has_wildcard = 1;
+        }
+        else if (c == '%' || c == '_' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = c;
+        }
+        else {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return has_wildcard;
+}
+
+static int parse_term(Parser* ps) {
+    skip_space(ps);
+    const char* start = ps->p;
+    while (*ps->p && (isalnum((unsigned char)*ps->p) || *ps->p == '_')) {
+        ps->p++;
+    }
+    size_t name_len = (size_t)(ps->p - start);
+    if (name_len == 0) {
+        return *start ? fail(ps, "Expected a field near '%.20s'", start) : fail(ps, "Expected a condition");
+    }
+    const QueryField* field = NULL;
+    for (size_t i = 0; i < sizeof(query_fields) / sizeof(query_fields[0]); ++i) {
+        if (strlen(query_fields[i].name) == name_len && equals_nocase(query_fields[i].name, start, name_len)) {
+            field = &query_fields[i];
+            break;
+        }
+    }
+    if (!field) {
+        return fail(ps, "Unknown field '%.*s'", (int)name_len, start);
+    }
+
+    skip_space(ps);
+    const char* op = NULL;
+    static const char* ops[] = { "<=", ">=", "!=", "=", "<", ">", ":" };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strncmp(ps->p, ops[i], strlen(ops[i])) == 0) {
+            op = ops[i];
+            ps->p += strlen(ops[i]);
+            break;
+        }
+    }
+    if (!op) {
+        return fail(ps, "Expected an operator after '%s'", field->name);
+    }
+    skip_space(ps);
+    char value[256];
+    if (!read_value(ps, value, sizeof(value))) {
+        return 0;
+    }
+
+    const char* sql_op = strcmp(op, ":") == 0 ? "=" : strcmp(op, "!=") == 0 ? "<>" : op;
+    char clause[160];
+    if (field->kind == FIELD_REAL || field->kind == FIELD_INT) {
+        QueryParam* param = add_param(ps, field->kind == FIELD_REAL ? QUERY_PARAM_REAL : QUERY_PARAM_INT);
+        if (!param) {
+            return 0;
+        }
+        if (field->kind == FIELD_REAL && !util_parse_double(value, &param->real, -1e12, 1e12)) {
+            return fail(ps, "Invalid number '%s' for %s", value, field->name);
+        }
+        if (field->kind == FIELD_INT && !util_parse_i64(value, &param->integer, INT64_MIN, INT64_MAX)) {
+            return fail(ps, "Invalid integer '%s' for %s", value, field->name);
+        }
+        snprintf(clause, sizeof(clause), "%s %s ?", field->column, sql_op);
+        return emit(ps, clause);
+    }
+
+    char like[512];
+    if (strcmp(op, ":") == 0 && glob_to_like(value, like, sizeof(like))) {
+        snprintf(clause, sizeof(clause), "%s LIKE ? ESCAPE '\\'", field->column);
+        return add_text_param(ps, like, strlen(like)) && emit(ps, clause);
+    }
+    if (field->kind == FIELD_DATE) {
+        struct tm tmv;
+        if (!util_parse_iso_date(value, &tmv)) {
+            return fail(ps, "Invalid date '%s' (expected YYYY-MM-DD)", value);
+        }
+        if (sql_op[0] == '<' && strcmp(sql_op, "<>") != 0) {
+            snprintf(clause, sizeof(clause), "(%s <> '' AND %s %s ?)", field->column, field->column, sql_op);
+        }
+        else {
+            snprintf(clause, sizeof(clause), "%s %s ?", field->column, sql_op);
+        }
+        return add_text_param(ps, value, strlen(value)) && emit(ps, clause);
+    }
+    snprintf(clause, sizeof(clause), "%s %s ? COLLATE NOCASE", field->column, sql_op);
+    return add_text_param(ps, value, strlen(value)) && emit(ps, clause);
+}
+
+static int parse_or(Parser* ps);
+
+static int parse_unary(Parser* ps) {
+    skip_space(ps);
+    if (at_keyword(ps, "NOT")) {
+        ps->p += 3;
+        return emit(ps, "NOT ") && parse_unary(ps);
+    }
+    if (*ps->p == '(') {
+        if (++ps->depth > 32) {
+            return fail(ps, "Expression nested too deeply");
+        }
+        ps->p++;
+        if (!emit(ps, "(") || !parse_or(ps)) {
+            return 0;
+        }
+        skip_space(ps);
+        if (*ps->p != ')') {
+            return fail(ps, "Missing ')'");
+        }
+        ps->p++;
+        ps->depth--;
+        return emit(ps, ")");
+    }
+    return parse_term(ps);
+}
+
+static int parse_and(Parser* ps) {
+    if (!parse_unary(ps)) {
+        return 0;
+    }
+    for (;;) {
+        skip_space(ps);
+        if (*ps->p == '\0' || *ps->p == ')' || at_keyword(ps, "OR")) {
+            return 1;
+        }
+        if (at_keyword(ps, "AND")) {
+            ps->p += 3;
+        }
+        if (!emit(ps, " AND ") || !parse_unary(ps)) {
+            return 0;
+        }
+    }
+}
+
+static int parse_or(Parser* ps) {
+    if (!parse_and(ps)) {
+        return 0;
+    }
+    while (at_keyword(ps, "OR")) {
+        ps->p += 2;
+        if (!emit(ps, " OR ") || !parse_and(ps)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int query_compile(const char* expr, Query* out) {
+    if (!expr || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    Parser ps = { expr, out, 0 };
+    if (!emit(&ps, "(") || !parse_or(&ps)) {
+        return 0;
+    }
+    skip_space(&ps);
+    if (*ps.p != '\0') {
+        return fail(&ps, "Unexpected '%.20s'", ps.p);
+    }
+    return emit(&ps, ")");
+}
+
+int query_bind(const Query* q, sqlite3_stmt* stmt, int first_index) {
+    if (!q || !stmt) {
+        return 0;
+    }
+    for (int i = 0; i < q->param_count; ++i) {
+        const QueryParam* param = &q->params[i];
+        int idx = first_index + i;
+        int rc = SQLITE_OK;
+        switch (param->type) {
+        case QUERY_PARAM_TEXT:
+            rc = sqlite3_bind_text(stmt, idx, q->text + param->text_off, -1, SQLITE_STATIC);
+            break;
+        case QUERY_PARAM_REAL:
+            rc = sqlite3_bind_double(stmt, idx, param->real);
+            break;
+        case QUERY_PARAM_INT:
+            rc = sqlite3_bind_int64(stmt, idx, param->integer);
+            break;
+        }
+        if (rc != SQLITE_OK) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,684 @@
+// Purpose: Compressed bitmap (roaring) sets of 32-bit contact ids. Author: GitHub Copilot
+#include "roaring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_WORDS 1024
+#define ROARING_MAGIC "CRB1"
+#define ROARING_HEADER 8
+#define ROARING_CHUNK_HEADER 8
+
+enum {
+    ROARING_AND,
+    ROARING_OR,
+    ROARING_ANDNOT
+};
+
+// A chunk is an array while bits is NULL, otherwise a bitset of ROARING_WORDS words.
+typedef struct {
+    uint16_t key;
+    uint32_t card;
+    uint32_t cap;
+    uint16_t* array;
+    uint64_t* bits;
+} RoaringChunk;
+
+struct Roaring {
+    RoaringChunk* chunks;
+    size_t count;
+    size_t cap;
+};
+
+static int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    while (x) {
+        x &= x - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static void chunk_free(RoaringChunk* c) {
+    free(c->array);
+    free(c->bits);
+    c->array = NULL;
+    c->bits = NULL;
+    c->card = 0;
+    c->cap = 0;
+}
+
+static int chunk_reserve(RoaringChunk* c, uint32_t n) {
+    if (n <= c->cap) {
+        return 1;
+    }
+    uint32_t cap = c->cap ? c->cap : 4;
+    while (cap < n) {
+        cap *= 2;
+    }
+    if (cap > ROARING_ARRAY_MAX) {
+        cap = ROARING_ARRAY_MAX;
+    }
+    uint16_t* grown = (uint16_t*)realloc(c->array, cap * sizeof(uint16_t));
+    if (!grown) {
+        return 0;
+    }
+    c->array = grown;
+    c->cap = cap;
+    return 1;
+}
+
+static int chunk_to_bitset(RoaringChunk* c) {
+    uint64_t* bits = (uint64_t*)calloc(ROARING_WORDS, sizeof(uint64_t));
+    if (!bits) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < c->card; ++i) {
+        bits[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+    }
+    free(c->array);
+    c->array = NULL;
+    c->cap = 0;
+    c->bits = bits;
+    return 1;
+}
+
+// Turns a bitset that dropped to ROARING_ARRAY_MAX members or fewer back into an array.
+static int chunk_shrink(RoaringChunk* c) {
+    if (!c->bits || c->card > ROARING_ARRAY_MAX) {
+        return 1;
+    }
+    uint16_t* array = (uint16_t*)malloc((c->card ? c->card : 1) * sizeof(uint16_t));
+    if (!array) {
+        return 0;
+    }
+    uint32_t n = 0;
+    for (uint32_t w = 0; w < ROARING_WORDS; ++w) {
+        for (uint64_t word = c->bits[w]; word; word &= word - 1) {
+            array[n++] = (uint16_t)(w * 64 + (uint32_t)ctz64(word));
+        }
+    }
+    free(c->bits);
+    c->bits = NULL;
+    c->array = array;
+    c->cap = c->card ? c->card : 1;
+    return 1;
+}
+
+static int chunk_from_words(RoaringChunk* c, uint16_t key, uint64_t* bits) {
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    c->bits = bits;
+    for (uint32_t w = 0; w < ROARING_WORDS; ++w) {
+        c->card += (uint32_t)popcount64(bits[w]);
+    }
+    return chunk_shrink(c);
+}
+
+static int chunk_copy(RoaringChunk* dst, const RoaringChunk* src) {
+    *dst = *src;
+    dst->array = NULL;
+    dst->bits = NULL;
+    if (src->bits) {
+        dst->bits = (uint64_t*)malloc(ROARING_WORDS * sizeof(uint64_t));
+        if (!dst->bits) {
+            return 0;
+        }
+        memcpy(dst->bits, src->bits, ROARING_WORDS * sizeof(uint64_t));
+        return 1;
+    }
+    dst->cap = src->card ? src->card : 1;
+    dst->array = (uint16_t*)malloc(dst->cap * sizeof(uint16_t));
+    if (!dst->array) {
+        return 0;
+    }
+    memcpy(dst->array, src->array, src->card * sizeof(uint16_t));
+    return 1;
+}
+
+// Lowest index with array[i] >= low.
+static uint32_t array_lower_bound(const uint16_t* array, uint32_t card, uint16_t low) {
+    uint32_t lo = 0;
+    uint32_t hi = card;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (array[mid] < low) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int chunk_contains(const RoaringChunk* c, uint16_t low) {
+    if (c->bits) {
+        return (c->bits[low >> 6] >> (low & 63)) & 1;
+    }
+    uint32_t i = array_lower_bound(c->array, c->card, low);
+    return i < c->card && c->array[i] == low;
+}
+
+// Index of the chunk with key, or the index it would be inserted at.
+static size_t chunk_find(const Roaring* r, uint16_t key, int* found) {
+    size_t lo = 0;
+    size_t hi = r->count;
+    // Ids mostly arrive in ascending order, so try the last chunk first.
+    if (hi > 0 && r->chunks[hi - 1].key <= key) {
+        lo = hi - 1;
+    }
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->chunks[mid].key < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    *found = lo < r->count && r->chunks[lo].key == key;
+    return lo;
+}
+
+static RoaringChunk* chunk_insert(Roaring* r, size_t pos, uint16_t key) {
+    if (r->count == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 4;
+        RoaringChunk* grown = (RoaringChunk*)realloc(r->chunks, cap * sizeof(RoaringChunk));
+        if (!grown) {
+            return NULL;
+        }
+        r->chunks = grown;
+        r->cap = cap;
+    }
+    memmove(&r->chunks[pos + 1], &r->chunks[pos], (r->count - pos) * sizeof(RoaringChunk));
+    r->count++;
+    RoaringChunk* c = &r->chunks[pos];
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    return c;
+}
+
+static void chunk_erase(Roaring* r, size_t pos) {
+    chunk_free(&r->chunks[pos]);
+    memmove(&r->chunks[pos], &r->chunks[pos + 1], (r->count - pos - 1) * sizeof(RoaringChunk));
+    r->count--;
+}
+
+Roaring* roaring_create(void) {
+    return (Roaring*)calloc(1, sizeof(Roaring));
+}
+
+void roaring_destroy(Roaring* r) {
+    if (!r) {
+        return;
+    }
+    for (size_t i = 0; i < r->count; ++i) {
+        chunk_free(&r->chunks[i]);
+    }
+    free(r->chunks);
+    free(r);
+}
+
+Roaring* roaring_copy(const Roaring* r) {
+    if (!r) {
+        return NULL;
+    }
+    Roaring* copy = roaring_create();
+    if (!copy) {
+        return NULL;
+    }
+    copy->chunks = (RoaringChunk*)malloc((r->count ? r->count : 1) * sizeof(RoaringChunk));
+    if (!copy->chunks) {
+        free(copy);
+        return NULL;
+    }
+    copy->cap = r->count ? r->count : 1;
+    for (size_t i = 0; i < r->count; ++i) {
+        if (!chunk_copy(&copy->chunks[i], &r->chunks[i])) {
+            chunk_free(&copy->chunks[i]);
+            roaring_destroy(copy);
+            return NULL;
+        }
+        copy->count++;
+    }
+    return copy;
+}
+
+int roaring_add(Roaring* r, uint32_t value) {
+    if (!r) {
+        return 0;
+    }
+    uint16_t key = (uint16_t)(value >> 16);
+    uint16_t low = (uint16_t)(value & 0xFFFF);
+    int found = 0;
+    size_t pos = chunk_find(r, key, &found);
+    RoaringChunk* c = found ? &r->chunks[pos] : chunk_insert(r, pos, key);
+    if (!c) {
+        return 0;
+    }
+    if (c->bits) {
+        uint64_t mask = 1ULL << (low & 63);
+        if (!(c->bits[low >> 6] & mask)) {
+            c->bits[low >> 6] |= mask;
+            c->card++;
+        }
+        return 1;
+    }
+    uint32_t i = (c->card == 0 || c->array[c->card - 1] < low) ? c->card : array_lower_bound(c->array, c->card, low);
+    if (i < c->card && c->array[i] == low) {
+        return 1;
+    }
+    if (c->card == ROARING_ARRAY_MAX) {
+        if (!chunk_to_bitset(c)) {
+            return 0;
+        }
+        c->bits[low >> 6] |= 1ULL << (low & 63);
+        c->card++;
+        return 1;
+    }
+    if (!chunk_reserve(c, c->card + 1)) {
+        if (c->card == 0) {
+            chunk_erase(r, pos);
+        }
+        return 0;
+    }
+    memmove(&c->array[i + 1], &c->array[i], (c->card - i) * sizeof(uint16_t));
+    c->array[i] = low;
+    c->card++;
+    return 1;
+}
+
+int roaring_remove(Roaring* r, uint32_t value) {
+    if (!r) {
+        return 0;
+    }
+    int found = 0;
+    size_t pos = chunk_find(r, (uint16_t)(value >> 16), &found);
+    uint16_t low = (uint16_t)(value & 0xFFFF);
+    if (!found || !chunk_contains(&r->chunks[pos], low)) {
+        return 1;
+    }
+    RoaringChunk* c = &r->chunks[pos];
+    if (c->card == 1) {
+        chunk_erase(r, pos);
+        return 1;
+    }
+    if (c->bits) {
+        c->bits[low >> 6] &= ~(1ULL << (low & 63));
+        c->card--;
+        return chunk_shrink(c);
+    }
+    uint32_t i = array_lower_bound(c->array, c->card, low);
+    memmove(&c->array[i], &c->array[i + 1], (c->card - i - 1) * sizeof(uint16_t));
+    c->card--;
+    return 1;
+}
+
+int roaring_contains(const Roaring* r, uint32_t value) {
+    if (!r) {
+        return 0;
+    }
+    int found = 0;
+    size_t pos = chunk_find(r, (uint16_t)(value >> 16), &found);
+    return found && chunk_contains(&r->chunks[pos], (uint16_t)(value & 0xFFFF));
+}
+
+uint64_t roaring_cardinality(const Roaring* r) {
+    uint64_t total = 0;
+    for (size_t i = 0; r && i < r->count; ++i) {
+        total += r->chunks[i].card;
+    }
+    return total;
+}
+
+static int array_op(const RoaringChunk* a, const RoaringChunk* b, int op, RoaringChunk* out) {
+    uint32_t cap = op == ROARING_AND ? (a->card < b->card ? a->card : b->card)
+        : op == ROARING_OR ? a->card + b->card : a->card;
+    out->array = (uint16_t*)malloc((cap ? cap : 1) * sizeof(uint16_t));
+    if (!out->array) {
+        return 0;
+    }
+    out->cap = cap ? cap : 1;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint32_t n = 0;
+    while (i < a->card && j < b->card) {
+        uint16_t x = a->array[i];
+        uint16_t y = b->array[j];
+        if (x < y) {
+            if (op != ROARING_AND) {
+                out->array[n++] = x;
+            }
+            i++;
+        }
+        else if (y < x) {
+            if (op == ROARING_OR) {
+                out->array[n++] = y;
+            }
+            j++;
+        }
+        else {
+            if (op != ROARING_ANDNOT) {
+                out->array[n++] = x;
+            }
+            i++;
+            j++;
+        }
+    }
+    for (; op != ROARING_AND && i < a->card; ++i) {
+        out->array[n++] = a->array[i];
+    }
+    for (; op == ROARING_OR && j < b->card; ++j) {
+        out->array[n++] = b->array[j];
+    }
+    out->card = n;
+    // A union of two arrays can outgrow the array limit.
+    return n <= ROARING_ARRAY_MAX || chunk_to_bitset(out);
+}
+
+// Keeps the members of array that are (keep = 1) or are not (keep = 0) set in bits.
+static int filter_array(const RoaringChunk* array, const uint64_t* bits, int keep, RoaringChunk* out) {
+    out->array = (uint16_t*)malloc((array->card ? array->card : 1) * sizeof(uint16_t));
+    if (!out->array) {
+        return 0;
+    }
+    out->cap = array->card ? array->card : 1;
+    for (uint32_t i = 0; i < array->card; ++i) {
+        uint16_t v = array->array[i];
+        if ((int)((bits[v >> 6] >> (v & 63)) & 1) == keep) {
+            out->array[out->card++] = v;
+        }
+    }
+    return 1;
+}
+
+// Builds out = a op b for two chunks with the same key; out may come back empty.
+static int chunk_op(const RoaringChunk* a, const RoaringChunk* b, int op, RoaringChunk* out) {
+    memset(out, 0, sizeof(*out));
+    out->key = a->key;
+    if (!a->bits && !b->bits) {
+        return array_op(a, b, op, out);
+    }
+    if (op == ROARING_AND && (!a->bits || !b->bits)) {
+        return !a->bits ? filter_array(a, b->bits, 1, out) : filter_array(b, a->bits, 1, out);
+    }
+    if (op == ROARING_ANDNOT && !a->bits) {
+        return filter_array(a, b->bits, 0, out);
+    }
+    // The result starts as a copy of a bitset operand and is combined word by word.
+    const RoaringChunk* base = a->bits ? a : b;
+    const RoaringChunk* other = base == a ? b : a;
+    uint64_t* bits = (uint64_t*)malloc(ROARING_WORDS * sizeof(uint64_t));
+    if (!bits) {
+        return 0;
+    }
+    memcpy(bits, base->bits, ROARING_WORDS * sizeof(uint64_t));
+    if (other->bits) {
+        for (uint32_t w = 0; w < ROARING_WORDS; ++w) {
+            bits[w] = op == ROARING_AND ? bits[w] & other->bits[w]
+                : op == ROARING_OR ? bits[w] | other->bits[w] : bits[w] & ~other->bits[w];
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < other->card; ++i) {
+            uint16_t v = other->array[i];
+            if (op == ROARING_OR) {
+                bits[v >> 6] |= 1ULL << (v & 63);
+            }
+            else {
+                bits[v >> 6] &= ~(1ULL << (v & 63));
+            }
+        }
+    }
+    return chunk_from_words(out, a->key, bits);
+}
+
+// Rebuilds r's chunk list as r op other. On failure r is left empty.
+static int roaring_combine(Roaring* r, const Roaring* other, int op) {
+    if (!r || !other) {
+        return 0;
+    }
+    size_t cap = r->count + (op == ROARING_OR ? other->count : 0);
+    RoaringChunk* out = (RoaringChunk*)malloc((cap ? cap : 1) * sizeof(RoaringChunk));
+    if (!out) {
+        return 0;
+    }
+    size_t n = 0;
+    size_t i = 0;
+    size_t j = 0;
+    int ok = 1;
+    while (ok && (i < r->count || j < other->count)) {
+        if (j == other->count || (i < r->count && r->chunks[i].key < other->chunks[j].key)) {
+            if (op == ROARING_AND) {
+                chunk_free(&r->chunks[i]);
+            }
+            else {
+                out[n++] = r->chunks[i];
+            }
+            i++;
+        }
+        else if (i == r->count || other->chunks[j].key < r->chunks[i].key) {
+            if (op == ROARING_OR) {
+                ok = chunk_copy(&out[n], &other->chunks[j]);
+                n += ok;
+            }
+            j++;
+        }
+        else {
+            RoaringChunk c;
+            ok = chunk_op(&r->chunks[i], &other->chunks[j], op, &c);
+            chunk_free(&r->chunks[i]);
+            if (ok && c.card > 0) {
+                out[n++] = c;
+            }
+            else {
+                chunk_free(&c);
+            }
+            i++;
+            j++;
+        }
+    }
+    if (!ok) {
+        for (size_t k = 0; k < n; ++k) {
+            chunk_free(&out[k]);
+        }
+        for (; i < r->count; ++i) {
+            chunk_free(&r->chunks[i]);
+        }
+        n = 0;
+    }
+    free(r->chunks);
+    r->chunks = out;
+    r->count = n;
+    r->cap = cap ? cap : 1;
+    return ok;
+}
+
+int roaring_and(Roaring* r, const Roaring* other) {
+    return r == other ? r != NULL : roaring_combine(r, other, ROARING_AND);
+}
+
+int roaring_or(Roaring* r, const Roaring* other) {
+    return r == other ? r != NULL : roaring_combine(r, other, ROARING_OR);
+}
+
+int roaring_andnot(Roaring* r, const Roaring* other) {
+    if (r && r == other) {
+        Roaring empty = { 0 };
+        return roaring_combine(r, &empty, ROARING_AND);
+    }
+    return roaring_combine(r, other, ROARING_ANDNOT);
+}
+
+int roaring_foreach(const Roaring* r, RoaringFn fn, void* ctx) {
+    if (!r || !fn) {
+        return 0;
+    }
+    for (size_t i = 0; i < r->count; ++i) {
+        const RoaringChunk* c = &r->chunks[i];
+        uint32_t high = (uint32_t)c->key << 16;
+        if (!c->bits) {
+            for (uint32_t k = 0; k < c->card; ++k) {
+                if (!fn(ctx, high | c->array[k])) {
+                    return 1;
+                }
+            }
+            continue;
+        }
+        for (uint32_t w = 0; w < ROARING_WORDS; ++w) {
+            for (uint64_t word = c->bits[w]; word; word &= word - 1) {
+                if (!fn(ctx, high | (w * 64 + (uint32_t)ctz64(word)))) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+size_t roaring_chunk_count(const Roaring* r) {
+    return r ? r->count : 0;
+}
+
+uint16_t roaring_chunk_key(const Roaring* r, size_t i) {
+    return r->chunks[i].key;
+}
+
+static void put_u16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (unsigned char)((v >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint16_t get_u16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t chunk_payload_size(const RoaringChunk* c) {
+    return c->bits ? ROARING_WORDS * 8 : (size_t)c->card * 2;
+}
+
+size_t roaring_serialized_size(const Roaring* r) {
+    size_t size = ROARING_HEADER;
+    for (size_t i = 0; r && i < r->count; ++i) {
+        size += ROARING_CHUNK_HEADER + chunk_payload_size(&r->chunks[i]);
+    }
+    return size;
+}
+
+// Layout: "CRB1", u32 chunk count, then per chunk u16 key, u16 kind (0 array, 1 bitset), u32
+// cardinality and the payload (u16 values or 1024 u64 words). All integers are little-endian.
+void roaring_serialize(const Roaring* r, unsigned char* out) {
+    memcpy(out, ROARING_MAGIC, 4);
+    put_u32(out + 4, (uint32_t)roaring_chunk_count(r));
+    out += ROARING_HEADER;
+    for (size_t i = 0; r && i < r->count; ++i) {
+        const RoaringChunk* c = &r->chunks[i];
+        put_u16(out, c->key);
+        put_u16(out + 2, c->bits ? 1 : 0);
+        put_u32(out + 4, c->card);
+        out += ROARING_CHUNK_HEADER;
+        if (!c->bits) {
+            for (uint32_t k = 0; k < c->card; ++k, out += 2) {
+                put_u16(out, c->array[k]);
+            }
+            continue;
+        }
+        for (uint32_t w = 0; w < ROARING_WORDS; ++w, out += 8) {
+            put_u32(out, (uint32_t)(c->bits[w] & 0xFFFFFFFFu));
+            put_u32(out + 4, (uint32_t)(c->bits[w] >> 32));
+        }
+    }
+}
+
+Roaring* roaring_deserialize(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (!p || len < ROARING_HEADER || memcmp(p, ROARING_MAGIC, 4) != 0) {
+        return NULL;
+    }
+    uint32_t count = get_u32(p + 4);
+    const unsigned char* end = p + len;
+    p += ROARING_HEADER;
+    if (count > (len - ROARING_HEADER) / ROARING_CHUNK_HEADER) {
+        return NULL;
+    }
+    Roaring* r = roaring_create();
+    if (!r || (count > 0 && !(r->chunks = (RoaringChunk*)calloc(count, sizeof(RoaringChunk))))) {
+        roaring_destroy(r);
+        return NULL;
+    }
+    r->cap = count;
+    int ok = 1;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        ok = (size_t)(end - p) >= ROARING_CHUNK_HEADER;
+        if (!ok) {
+            break;
+        }
+        RoaringChunk* c = &r->chunks[i];
+        c->key = get_u16(p);
+        uint16_t kind = get_u16(p + 2);
+        c->card = get_u32(p + 4);
+        p += ROARING_CHUNK_HEADER;
+        r->count++;
+        ok = (i == 0 || c->key > r->chunks[i - 1].key) && c->card >= 1 && kind <= 1 &&
+            (kind == 1 ? c->card > ROARING_ARRAY_MAX && c->card <= 65536 : c->card <= ROARING_ARRAY_MAX);
+        size_t payload = kind == 1 ? ROARING_WORDS * 8 : (size_t)c->card * 2;
+        ok = ok && (size_t)(end - p) >= payload;
+        if (!ok) {
+            break;
+        }
+        if (kind == 0) {
+            c->array = (uint16_t*)malloc(c->card * sizeof(uint16_t));
+            c->cap = c->card;
+            ok = c->array != NULL;
+            for (uint32_t k = 0; ok && k < c->card; ++k) {
+                c->array[k] = get_u16(p + 2 * k);
+                ok = k == 0 || c->array[k] > c->array[k - 1];
+            }
+        }
+        else {
+            c->bits = (uint64_t*)malloc(ROARING_WORDS * sizeof(uint64_t));
+            ok = c->bits != NULL;
+            uint32_t card = 0;
+            for (uint32_t w = 0; ok && w < ROARING_WORDS; ++w) {
+                c->bits[w] = (uint64_t)get_u32(p + 8 * w) | ((uint64_t)get_u32(p + 8 * w + 4) << 32);
+                card += (uint32_t)popcount64(c->bits[w]);
+            }
+            ok = ok && card == c->card;
+        }
+        p += payload;
+    }
+    if (!ok || p != end) {
+        roaring_destroy(r);
+        return NULL;
+    }
+    return r;
+}
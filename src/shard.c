@@ -0,0 +1,224 @@
+// Purpose: Tenant shard map routing contacts across several SQLite files. Author: GitHub Copilot
+#include "shard.h"
+#include "util.h"
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    sqlite3_stmt* stmt;
+    size_t shard;
+    ContactView row;
+} ShardCursor;
+
+static int shard_tenant_valid(const char* tenant) {
+    size_t len = tenant ? strlen(tenant) : 0;
+    return len > 0 && len < DB_TENANT_MAX;
+}
+
+int shard_register(Db* db, const char* tenant, const char* path) {
+    if (!db || !db->handle || !path || !path[0] || strlen(path) >= DB_SHARD_PATH_MAX) {
+        return 0;
+    }
+    if (!shard_tenant_valid(tenant)) {
+        util_error("Tenant names must be 1-%d characters.", DB_TENANT_MAX - 1);
+        return 0;
+    }
+    Db shard;
+    if (!db_open(&shard, path)) {
+        return 0;
+    }
+    int ok = db_init(&shard);
+    db_close(&shard);
+    if (!ok) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "INSERT INTO shards(tenant, path) VALUES(?, ?);", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, tenant, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, path, -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        util_error("Tenant %s is already registered.", tenant);
+        return 0;
+    }
+    return 1;
+}
+
+int shard_open(Db* db, const char* tenant) {
+    if (!db || !db->handle || db->shards) {
+        return 0;
+    }
+    const char* sql = tenant ? "SELECT tenant, path FROM shards WHERE tenant = ?;"
+                             : "SELECT tenant, path FROM shards ORDER BY tenant;";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    if (tenant) {
+        sqlite3_bind_text(stmt, 1, tenant, -1, SQLITE_TRANSIENT);
+    }
+    size_t cap = 0;
+    int ok = 1;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (db->shard_count == cap) {
+            cap = cap ? cap * 2 : 4;
+            DbShard* grown = (DbShard*)realloc(db->shards, cap * sizeof(DbShard));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            db->shards = grown;
+        }
+        DbShard* shard = &db->shards[db->shard_count];
+        util_copy_str(shard->tenant, sizeof(shard->tenant), (const char*)sqlite3_column_text(stmt, 0));
+        util_copy_str(shard->path, sizeof(shard->path), (const char*)sqlite3_column_text(stmt, 1));
+        // Counted before opening so db_close releases a shard that failed half way.
+        db->shard_count++;
+        ok = db->read_only ? db_open_for_read(&shard->db, shard->path)
+            : db_open(&shard->db, shard->path) && db_init(&shard->db);
+    }
+    sqlite3_finalize(stmt);
+    if (ok && tenant && db->shard_count == 0) {
+        util_error("Unknown tenant: %s", tenant);
+        ok = 0;
+    }
+    return ok;
+}
+
+// Mirrors ORDER BY name COLLATE NOCASE, id within a shard; shard order (tenant name) breaks ties.
+static int shard_cursor_less(const ShardCursor* a, const ShardCursor* b) {
+    int cmp = sqlite3_stricmp(a->row.name.ptr, b->row.name.ptr);
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    if (a->shard != b->shard) {
+        return a->shard < b->shard;
+    }
+    return a->row.id < b->row.id;
+}
+
+static void shard_heap_sift(ShardCursor** heap, size_t count, size_t i) {
+    for (;;) {
+        size_t best = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < count && shard_cursor_less(heap[left], heap[best])) {
+            best = left;
+        }
+        if (right < count && shard_cursor_less(heap[right], heap[best])) {
+            best = right;
+        }
+        if (best == i) {
+            return;
+        }
+        ShardCursor* tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+}
+
+static int shard_cursor_next(ShardCursor* c) {
+    if (sqlite3_step(c->stmt) != SQLITE_ROW) {
+        return 0;
+    }
+    // The view stays valid until this cursor steps again, after its row has been printed.
+    contacts_view_row(c->stmt, &c->row);
+    return 1;
+}
+
+int shard_list(Db* db, const char* name_pattern, int json, FILE* out) {
+    if (!db || !out) {
+        return 0;
+    }
+    const char* sql = name_pattern
+        ? "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM contacts"
+          " WHERE name LIKE ? COLLATE NOCASE ORDER BY name COLLATE NOCASE, id;"
+        : "SELECT id, name, phone, address, email, due_amount, due_date, external_id FROM contacts"
+          " ORDER BY name COLLATE NOCASE, id;";
+    size_t count = db->shard_count;
+    ShardCursor* cursors = (ShardCursor*)calloc(count ? count : 1, sizeof(ShardCursor));
+    ShardCursor** heap = (ShardCursor**)calloc(count ? count : 1, sizeof(ShardCursor*));
+    int ok = cursors && heap;
+    size_t live = 0;
+    for (size_t i = 0; ok && i < count; ++i) {
+        cursors[i].shard = i;
+        ok = sqlite3_prepare_v2(db->shards[i].db.handle, sql, -1, &cursors[i].stmt, NULL) == SQLITE_OK;
+        if (ok && name_pattern) {
+            sqlite3_bind_text(cursors[i].stmt, 1, name_pattern, -1, SQLITE_TRANSIENT);
+        }
+        if (ok && shard_cursor_next(&cursors[i])) {
+            heap[live++] = &cursors[i];
+        }
+    }
+    if (ok) {
+        for (size_t i = live / 2; i-- > 0;) {
+            shard_heap_sift(heap, live, i);
+        }
+        int first = 1;
+        if (json) {
+            fprintf(out, "[");
+        }
+        while (live > 0) {
+            ShardCursor* top = heap[0];
+            if (json && !first) {
+                fprintf(out, ",");
+            }
+            contacts_print(out, &top->row, db->shards[top->shard].tenant, json);
+            first = 0;
+            if (!shard_cursor_next(top)) {
+                heap[0] = heap[--live];
+            }
+            shard_heap_sift(heap, live, 0);
+        }
+        if (json) {
+            fprintf(out, "]\n");
+        }
+    }
+    for (size_t i = 0; cursors && i < count; ++i) {
+        sqlite3_finalize(cursors[i].stmt);
+    }
+    free(cursors);
+    free(heap);
+    return ok;
+}
+
+int shard_stats(Db* db, int jobs, ContactStats* out) {
+    if (!db || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        ContactStats part;
+        if (!contacts_stats_parallel(&db->shards[i].db, jobs, &part)) {
+            return 0;
+        }
+        contacts_stats_combine(out, &part);
+    }
+    return 1;
+}
+
+int shard_sketch(Db* db, ContactSketch* out) {
+    if (!db || !out) {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    ContactSketch* part = (ContactSketch*)malloc(sizeof(ContactSketch));
+    if (!part) {
+        return 0;
+    }
+    int ok = 1;
+    for (size_t i = 0; ok && i < db->shard_count; ++i) {
+        ok = sketch_load(&db->shards[i].db, part);
+        if (ok) {
+            sketch_merge(out, part);
+        }
+    }
+    free(part);
+    return ok;
+}
@@ -0,0 +1,546 @@
+// Purpose: Approximate statistics sketches kept current from the change log. Author: GitHub Copilot
+#include "sketch.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SKETCH_MAGIC "CSK1"
+#define SKETCH_REBUILD_RATIO 10
+#define SKETCH_RNG_SEED 0x9E3779B97F4A7C15ULL
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void hll_add(Hll* h, uint64_t hash) {
+    size_t idx = (size_t)(hash >> (64 - SKETCH_HLL_BITS));
+    uint64_t rest = hash << SKETCH_HLL_BITS;
+    uint8_t rank = 1;
+    while (rank <= 64 - SKETCH_HLL_BITS && !(rest & (1ULL << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > h->reg[idx]) {
+        h->reg[idx] = rank;
+    }
+}
+
+void hll_merge(Hll* h, const Hll* other) {
+    for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i) {
+        if (other->reg[i] > h->reg[i]) {
+            h->reg[i] = other->reg[i];
+        }
+    }
+}
+
+uint64_t hll_estimate(const Hll* h) {
+    double m = (double)SKETCH_HLL_REGISTERS;
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i) {
+        sum += ldexp(1.0, -(int)h->reg[i]);
+        zeros += h->reg[i] == 0;
+    }
+    double e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    // Linear counting is more accurate while many registers are still empty.
+    if (e <= 2.5 * m && zeros > 0) {
+        e = m * log(m / (double)zeros);
+    }
+    return (uint64_t)(e + 0.5);
+}
+
+static double dd_gamma(void) {
+    return (1.0 + SKETCH_DD_ALPHA) / (1.0 - SKETCH_DD_ALPHA);
+}
+
+static int dd_bucket(double value) {
+    double i = ceil(log(value) / log(dd_gamma()));
+    if (i < SKETCH_DD_MIN_INDEX) {
+        i = SKETCH_DD_MIN_INDEX;
+    }
+    if (i > SKETCH_DD_MIN_INDEX + SKETCH_DD_BUCKETS - 1) {
+        i = SKETCH_DD_MIN_INDEX + SKETCH_DD_BUCKETS - 1;
+    }
+    return (int)i - SKETCH_DD_MIN_INDEX;
+}
+
+void ddsketch_add(DdSketch* s, double value, int64_t delta) {
+    if (!(value > 0.0) || delta == 0) {
+        return;
+    }
+    int64_t* count = &s->counts[dd_bucket(value)];
+    if (delta < 0 && *count < -delta) {
+        delta = -*count;
+    }
+    *count += delta;
+    s->total += delta;
+}
+
+void ddsketch_merge(DdSketch* s, const DdSketch* other) {
+    for (size_t i = 0; i < SKETCH_DD_BUCKETS; ++i) {
+        s->counts[i] += other->counts[i];
+    }
+    s->total += other->total;
+}
+
+double ddsketch_quantile(const DdSketch* s, double q) {
+    if (s->total <= 0) {
+        return 0.0;
+    }
+    q = q < 0.0 ? 0.0 : q > 1.0 ? 1.0 : q;
+    double rank = q * (double)(s->total - 1);
+    double gamma = dd_gamma();
+    int64_t seen = 0;
+    int last = 0;
+    for (int i = 0; i < SKETCH_DD_BUCKETS; ++i) {
+        if (s->counts[i] == 0) {
+            continue;
+        }
+        last = i;
+        seen += s->counts[i];
+        if ((double)seen > rank) {
+            break;
+        }
+    }
+    // The bucket's relative midpoint is within alpha of every value in it.
+    return 2.0 * pow(gamma, last + SKETCH_DD_MIN_INDEX) / (gamma + 1.0);
+}
+
+static int email_domain_hash(const char* email, uint64_t* out) {
+    const char* at = email ? strrchr(email, '@') : NULL;
+    if (!at || !at[1]) {
+        return 0;
+    }
+    uint64_t h = UTIL_FNV64_INIT;
+    for (const char* p = at + 1; *p; ++p) {
+        unsigned char c = (unsigned char)tolower((unsigned char)*p);
+        h = util_fnv1a64(h, &c, 1);
+    }
+    *out = mix64(h);
+    return 1;
+}
+
+// First three digits of a 10-digit number, after dropping the 1 of an 11-digit +1 number.
+static int area_code_hash(const char* phone, uint64_t* out) {
+    char digits[4];
+    size_t total = 0;
+    for (const char* p = phone; p && *p; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            if (total < sizeof(digits)) {
+                digits[total] = *p;
+            }
+            total++;
+        }
+    }
+    const char* code = digits;
+    if (total == 11 && digits[0] == '1') {
+        code = digits + 1;
+    }
+    else if (total < 10) {
+        return 0;
+    }
+    *out = mix64(util_fnv1a64(UTIL_FNV64_INIT, code, 3));
+    return 1;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state += SKETCH_RNG_SEED;
+    return mix64(*state);
+}
+
+// Algorithm R over contact ids.
+static void sample_offer(ContactSketch* s, int64_t id) {
+    s->sample_seen++;
+    if (s->sample_count < SKETCH_SAMPLE_MAX) {
+        s->sample[s->sample_count++] = id;
+        return;
+    }
+    uint64_t j = next_random(&s->rng) % s->sample_seen;
+    if (j < SKETCH_SAMPLE_MAX) {
+        s->sample[j] = id;
+    }
+}
+
+static void sample_forget(ContactSketch* s, int64_t id) {
+    if (s->sample_seen > 0) {
+        s->sample_seen--;
+    }
+    for (size_t i = 0; i < s->sample_count; ++i) {
+        if (s->sample[i] == id) {
+            s->sample[i] = s->sample[--s->sample_count];
+            break;
+        }
+    }
+}
+
+static void note_values(ContactSketch* s, const char* phone, const char* email) {
+    uint64_t h;
+    if (email_domain_hash(email, &h)) {
+        hll_add(&s->email_domains, h);
+    }
+    if (area_code_hash(phone, &h)) {
+        hll_add(&s->area_codes, h);
+    }
+}
+
+static void note_insert(ContactSketch* s, int64_t id, const char* phone, const char* email, double amount) {
+    s->contacts++;
+    note_values(s, phone, email);
+    ddsketch_add(&s->amounts, amount, 1);
+    sample_offer(s, id);
+}
+
+static void sketch_reset(ContactSketch* s) {
+    memset(s, 0, sizeof(*s));
+    s->rng = SKETCH_RNG_SEED;
+}
+
+static int build_from_contacts(sqlite3* handle, ContactSketch* s) {
+    sqlite3_stmt* seq = NULL;
+    sqlite3_stmt* rows = NULL;
+    if (sqlite3_prepare_v2(handle, "SELECT COALESCE(MAX(seq), 0) FROM contact_changes;", -1, &seq, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(handle, "SELECT id, phone, email, due_amount FROM contacts ORDER BY id;", -1, &rows, NULL) !=
+        SQLITE_OK) {
+        sqlite3_finalize(seq);
+        return 0;
+    }
+    sketch_reset(s);
+    int rc = sqlite3_step(seq);
+    s->seq = rc == SQLITE_ROW ? sqlite3_column_int64(seq, 0) : 0;
+    while (rc == SQLITE_ROW && (rc = sqlite3_step(rows)) == SQLITE_ROW) {
+        note_insert(s, sqlite3_column_int64(rows, 0), (const char*)sqlite3_column_text(rows, 1),
+            (const char*)sqlite3_column_text(rows, 2), sqlite3_column_double(rows, 3));
+    }
+    sqlite3_finalize(seq);
+    sqlite3_finalize(rows);
+    return rc == SQLITE_DONE;
+}
+
+// Applies contact_changes rows after s->seq. The sketch covers the hot table only, so an archive
+// counts as a delete, a restore as an insert, and a delete whose preceding change already took the
+// contact out of the hot table (an archived contact being pruned) is skipped. An update retracts
+// the contact's previous image, found as its preceding change; contacts older than the log have
+// none, which counts as drift.
+static int apply_changes(sqlite3* handle, ContactSketch* s, int* out_applied) {
+    const char* sql = "SELECT seq, op, contact_id, phone, email, due_amount FROM contact_changes"
+        " WHERE seq > ? ORDER BY seq;";
+    const char* prev_sql = "SELECT phone, email, due_amount, op FROM contact_changes"
+        " WHERE contact_id = ? AND seq < ? ORDER BY seq DESC LIMIT 1;";
+    sqlite3_stmt* stmt = NULL;
+    sqlite3_stmt* prev = NULL;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(handle, prev_sql, -1, &prev, NULL) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, s->seq);
+    int applied = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t seq = sqlite3_column_int64(stmt, 0);
+        const char* op = (const char*)sqlite3_column_text(stmt, 1);
+        int64_t id = sqlite3_column_int64(stmt, 2);
+        const char* phone = (const char*)sqlite3_column_text(stmt, 3);
+        const char* email = (const char*)sqlite3_column_text(stmt, 4);
+        double amount = sqlite3_column_double(stmt, 5);
+        int removed = op && strcmp(op, "archive") == 0;
+        sqlite3_bind_int64(prev, 1, id);
+        sqlite3_bind_int64(prev, 2, seq);
+        if (op && strcmp(op, "delete") == 0) {
+            const char* prev_op = sqlite3_step(prev) == SQLITE_ROW ? (const char*)sqlite3_column_text(prev, 3) : NULL;
+            removed = !prev_op || (strcmp(prev_op, "archive") != 0 && strcmp(prev_op, "delete") != 0);
+            sqlite3_reset(prev);
+        }
+        if (op && (strcmp(op, "insert") == 0 || strcmp(op, "restore") == 0)) {
+            note_insert(s, id, phone, email, amount);
+        }
+        else if (removed) {
+            s->contacts--;
+            s->stale++;
+            ddsketch_add(&s->amounts, amount, -1);
+            sample_forget(s, id);
+        }
+        else if (op && strcmp(op, "update") == 0) {
+            if (sqlite3_step(prev) == SQLITE_ROW) {
+                uint64_t old_h, new_h;
+                int old_has = email_domain_hash((const char*)sqlite3_column_text(prev, 1), &old_h);
+                int changed = old_has != email_domain_hash(email, &new_h) || (old_has && old_h != new_h);
+                old_has = area_code_hash((const char*)sqlite3_column_text(prev, 0), &old_h);
+                changed = changed || old_has != area_code_hash(phone, &new_h) || (old_has && old_h != new_h);
+                s->stale += changed;
+                ddsketch_add(&s->amounts, sqlite3_column_double(prev, 2), -1);
+                ddsketch_add(&s->amounts, amount, 1);
+            }
+            else {
+                s->stale++;
+            }
+            sqlite3_reset(prev);
+            note_values(s, phone, email);
+        }
+        s->seq = seq;
+        applied++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(prev);
+    *out_applied = applied;
+    return rc == SQLITE_DONE;
+}
+
+static void put_u64(unsigned char** p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        *(*p)++ = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const unsigned char** p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v |= (uint64_t)*(*p)++ << (8 * i);
+    }
+    return v;
+}
+
+// Layout: magic, seq, contacts, stale, sample_seen, rng, sample_count, sample ids, both HLL register
+// arrays, then DDSketch (bucket, count) pairs for non-empty buckets, all little-endian.
+static size_t sketch_encode(const ContactSketch* s, unsigned char* out) {
+    unsigned char* p = out;
+    memcpy(p, SKETCH_MAGIC, 4);
+    p += 4;
+    put_u64(&p, (uint64_t)s->seq);
+    put_u64(&p, (uint64_t)s->contacts);
+    put_u64(&p, s->stale);
+    put_u64(&p, s->sample_seen);
+    put_u64(&p, s->rng);
+    put_u64(&p, s->sample_count);
+    for (size_t i = 0; i < s->sample_count; ++i) {
+        put_u64(&p, (uint64_t)s->sample[i]);
+    }
+    memcpy(p, s->email_domains.reg, SKETCH_HLL_REGISTERS);
+    p += SKETCH_HLL_REGISTERS;
+    memcpy(p, s->area_codes.reg, SKETCH_HLL_REGISTERS);
+    p += SKETCH_HLL_REGISTERS;
+    for (uint64_t i = 0; i < SKETCH_DD_BUCKETS; ++i) {
+        if (s->amounts.counts[i] != 0) {
+            put_u64(&p, i);
+            put_u64(&p, (uint64_t)s->amounts.counts[i]);
+        }
+    }
+    return (size_t)(p - out);
+}
+
+static int sketch_decode(const unsigned char* data, size_t len, ContactSketch* s) {
+    const size_t fixed = 4 + 6 * 8 + 2 * SKETCH_HLL_REGISTERS;
+    if (!data || len < fixed || memcmp(data, SKETCH_MAGIC, 4) != 0) {
+        return 0;
+    }
+    const unsigned char* p = data + 4;
+    const unsigned char* end = data + len;
+    sketch_reset(s);
+    s->seq = (int64_t)get_u64(&p);
+    s->contacts = (int64_t)get_u64(&p);
+    s->stale = get_u64(&p);
+    s->sample_seen = get_u64(&p);
+    s->rng = get_u64(&p);
+    uint64_t samples = get_u64(&p);
+    if (samples > SKETCH_SAMPLE_MAX || (size_t)(end - p) < samples * 8 + 2 * SKETCH_HLL_REGISTERS) {
+        return 0;
+    }
+    s->sample_count = (size_t)samples;
+    for (size_t i = 0; i < s->sample_count; ++i) {
+        s->sample[i] = (int64_t)get_u64(&p);
+    }
+    memcpy(s->email_domains.reg, p, SKETCH_HLL_REGISTERS);
+    p += SKETCH_HLL_REGISTERS;
+    memcpy(s->area_codes.reg, p, SKETCH_HLL_REGISTERS);
+    p += SKETCH_HLL_REGISTERS;
+    if ((size_t)(end - p) % 16 != 0) {
+        return 0;
+    }
+    while (p < end) {
+        uint64_t bucket = get_u64(&p);
+        int64_t count = (int64_t)get_u64(&p);
+        if (bucket >= SKETCH_DD_BUCKETS || count < 0) {
+            return 0;
+        }
+        s->amounts.counts[bucket] = count;
+        s->amounts.total += count;
+    }
+    return 1;
+}
+
+static int sketch_store(sqlite3* handle, const ContactSketch* s) {
+    unsigned char* blob = (unsigned char*)malloc(4 + 6 * 8 + SKETCH_SAMPLE_MAX * 8 + 2 * SKETCH_HLL_REGISTERS +
+        SKETCH_DD_BUCKETS * 16);
+    if (!blob) {
+        return 0;
+    }
+    size_t len = sketch_encode(s, blob);
+    const char* sql = "INSERT INTO sketches(name, seq, data) VALUES('contacts', ?, ?)"
+        " ON CONFLICT(name) DO UPDATE SET seq = excluded.seq, data = excluded.data;";
+    sqlite3_stmt* stmt = NULL;
+    int ok = sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_int64(stmt, 1, s->seq);
+        sqlite3_bind_blob(stmt, 2, blob, (int)len, SQLITE_STATIC);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+    free(blob);
+    return ok;
+}
+
+// Makes db->sketch match the stored sketch plus every later change. The stored seq is compared
+// first, so a cache left behind by a rolled-back transaction or another connection is reloaded.
+static int sketch_catch_up(Db* db, int* out_dirty) {
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT seq, data FROM sketches WHERE name = 'contacts';", -1, &stmt, NULL) !=
+        SQLITE_OK) {
+        return 0;
+    }
+    int rc = sqlite3_step(stmt);
+    int stored = rc == SQLITE_ROW;
+    int ok = rc == SQLITE_ROW || rc == SQLITE_DONE;
+    if (!db->sketch) {
+        db->sketch = (ContactSketch*)malloc(sizeof(ContactSketch));
+        ok = ok && db->sketch != NULL;
+        if (db->sketch) {
+            db->sketch->seq = -1;
+        }
+    }
+    *out_dirty = 0;
+    if (ok && stored && db->sketch->seq != sqlite3_column_int64(stmt, 0)) {
+        ok = sketch_decode((const unsigned char*)sqlite3_column_blob(stmt, 1), (size_t)sqlite3_column_bytes(stmt, 1),
+            db->sketch);
+    }
+    sqlite3_finalize(stmt);
+    if (ok && !stored) {
+        ok = build_from_contacts(db->handle, db->sketch);
+        *out_dirty = 1;
+    }
+    int applied = 0;
+    ok = ok && apply_changes(db->handle, db->sketch, &applied);
+    if (ok && db->sketch->stale * SKETCH_REBUILD_RATIO > (uint64_t)(db->sketch->contacts > 0 ? db->sketch->contacts : 0)) {
+        ok = build_from_contacts(db->handle, db->sketch);
+        applied = 1;
+    }
+    *out_dirty = *out_dirty || applied > 0;
+    if (!ok) {
+        sketch_invalidate(db);
+    }
+    return ok;
+}
+
+int sketch_apply_pending(Db* db) {
+    if (!db || !db->handle) {
+        return 0;
+    }
+    int dirty = 0;
+    return db->read_only || (sketch_catch_up(db, &dirty) && (!dirty || sketch_store(db->handle, db->sketch)));
+}
+
+static int sketch_write(Db* db, int rebuild) {
+    if (sqlite3_exec(db->handle, "BEGIN IMMEDIATE;", NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int ok;
+    if (rebuild) {
+        if (!db->sketch) {
+            db->sketch = (ContactSketch*)malloc(sizeof(ContactSketch));
+        }
+        ok = db->sketch && build_from_contacts(db->handle, db->sketch) && sketch_store(db->handle, db->sketch);
+    }
+    else {
+        ok = sketch_apply_pending(db);
+    }
+    if (ok && sqlite3_exec(db->handle, "COMMIT;", NULL, NULL, NULL) == SQLITE_OK) {
+        return 1;
+    }
+    sqlite3_exec(db->handle, "ROLLBACK;", NULL, NULL, NULL);
+    sketch_invalidate(db);
+    return 0;
+}
+
+int sketch_refresh(Db* db) {
+    if (!db || !db->handle) {
+        return 0;
+    }
+    if (db->read_only || !sqlite3_get_autocommit(db->handle)) {
+        return 1;
+    }
+    return sketch_write(db, 0);
+}
+
+int sketch_rebuild(Db* db) {
+    if (!db || !db->handle || db->read_only || !sqlite3_get_autocommit(db->handle)) {
+        return 0;
+    }
+    return sketch_write(db, 1);
+}
+
+int sketch_load(Db* db, ContactSketch* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    if (!db->read_only && sqlite3_get_autocommit(db->handle)) {
+        if (!sketch_refresh(db)) {
+            return 0;
+        }
+    }
+    else {
+        // One read transaction so the stored sketch and the changes after it are a consistent snapshot.
+        int own = sqlite3_get_autocommit(db->handle);
+        if (own && sqlite3_exec(db->handle, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
+            return 0;
+        }
+        int dirty = 0;
+        int ok = sketch_catch_up(db, &dirty);
+        if (own) {
+            sqlite3_exec(db->handle, "COMMIT;", NULL, NULL, NULL);
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    *out = *db->sketch;
+    return 1;
+}
+
+void sketch_merge(ContactSketch* into, const ContactSketch* from) {
+    hll_merge(&into->email_domains, &from->email_domains);
+    hll_merge(&into->area_codes, &from->area_codes);
+    ddsketch_merge(&into->amounts, &from->amounts);
+    into->contacts += from->contacts;
+    into->stale += from->stale;
+    into->seq = 0;
+    into->sample_count = 0;
+    into->sample_seen = 0;
+}
+
+void sketch_summarize(const ContactSketch* sketch, SketchStats* out) {
+    memset(out, 0, sizeof(*out));
+    out->seq = sketch->seq;
+    out->contacts = sketch->contacts;
+    out->email_domains = hll_estimate(&sketch->email_domains);
+    out->area_codes = hll_estimate(&sketch->area_codes);
+    out->amounts = sketch->amounts.total;
+    out->p50 = ddsketch_quantile(&sketch->amounts, 0.50);
+    out->p90 = ddsketch_quantile(&sketch->amounts, 0.90);
+    out->p99 = ddsketch_quantile(&sketch->amounts, 0.99);
+    out->sample_count = sketch->sample_count;
+    memcpy(out->sample, sketch->sample, sketch->sample_count * sizeof(int64_t));
+}
+
+void sketch_invalidate(Db* db) {
+    if (db) {
+        free(db->sketch);
+        db->sketch = NULL;
+    }
+}
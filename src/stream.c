@@ -0,0 +1,725 @@
+// Purpose: Buffered byte streams with optional gzip/zstd compression. Author: GitHub Copilot
+#include "stream.h"
+#include "util.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define STREAM_CHUNK (256 * 1024)
+#define STREAM_BUFFERS 4
+
+typedef struct {
+    StreamCodec codec;
+    FILE* file;
+    AioWriter* aio;
+    int writing;
+    unsigned char* io;
+    size_t io_len;
+    size_t io_pos;
+    int file_eof;
+    int frame_open;
+#ifdef HAVE_ZLIB
+    z_stream z;
+    int z_ready;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* zc;
+    ZSTD_DCtx* zd;
+#endif
+} Codec;
+
+#ifdef HAVE_PTHREADS
+typedef struct {
+    unsigned char* data;
+    size_t len;
+} Chunk;
+
+typedef struct {
+    Chunk items[STREAM_BUFFERS];
+    size_t head;
+    size_t count;
+} ChunkQueue;
+
+// Compression runs on a worker thread. Buffers circulate between a spare and a filled queue, so
+// at most STREAM_BUFFERS chunks are in flight and the faster side blocks on the slower one.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    ChunkQueue filled;
+    ChunkQueue spare;
+    unsigned char* arena;
+    Codec* codec;
+    int closing;
+    int finished;
+    int failed;
+} Pipeline;
+#endif
+
+struct Stream {
+    Codec codec;
+    int owns_file;
+    unsigned char* cur;
+    size_t len;
+    size_t pos;
+    // Decoded bytes in chunks before cur, so base + pos is the read offset.
+    uint64_t base;
+    int error;
+    int eof;
+#ifdef HAVE_PTHREADS
+    Pipeline* pipe;
+#endif
+};
+
+static int codec_supported(StreamCodec codec) {
+    if (codec == STREAM_CODEC_GZIP) {
+#ifdef HAVE_ZLIB
+        return 1;
+#else
+        util_error("gzip support is not available in this build.");
+        return 0;
+#endif
+    }
+    if (codec == STREAM_CODEC_ZSTD) {
+#ifdef HAVE_ZSTD
+        return 1;
+#else
+        util_error("zstd support is not available in this build.");
+        return 0;
+#endif
+    }
+    return 1;
+}
+
+static int codec_init(Codec* c) {
+#ifdef HAVE_ZLIB
+    if (c->codec == STREAM_CODEC_GZIP) {
+        memset(&c->z, 0, sizeof(c->z));
+        int rc = c->writing ? deflateInit2(&c->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+                            : inflateInit2(&c->z, 15 + 16);
+        c->z_ready = rc == Z_OK;
+        return c->z_ready;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->codec == STREAM_CODEC_ZSTD) {
+        if (c->writing) {
+            c->zc = ZSTD_createCCtx();
+            return c->zc != NULL;
+        }
+        c->zd = ZSTD_createDCtx();
+        return c->zd != NULL;
+    }
+#endif
+    return c->codec == STREAM_CODEC_PLAIN;
+}
+
+static void codec_free(Codec* c) {
+#ifdef HAVE_ZLIB
+    if (c->z_ready) {
+        if (c->writing) {
+            deflateEnd(&c->z);
+        }
+        else {
+            inflateEnd(&c->z);
+        }
+        c->z_ready = 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(c->zc);
+    ZSTD_freeDCtx(c->zd);
+    c->zc = NULL;
+    c->zd = NULL;
+#endif
+    free(c->io);
+    c->io = NULL;
+}
+
+// Returns 1 when staged input is available, 0 at end of file, -1 on a read error.
+static int codec_fill_io(Codec* c) {
+    if (c->io_pos < c->io_len) {
+        return 1;
+    }
+    if (c->file_eof) {
+        return 0;
+    }
+    c->io_pos = 0;
+    c->io_len = fread(c->io, 1, STREAM_CHUNK, c->file);
+    if (c->io_len == 0) {
+        c->file_eof = 1;
+        return ferror(c->file) ? -1 : 0;
+    }
+    return 1;
+}
+
+// Decodes staged input into dst. Returns 1 while a frame is open, 0 once it has ended, -1 on error.
+static int codec_decode_step(Codec* c, unsigned char* dst, size_t cap, size_t* produced) {
+    size_t avail = c->io_len - c->io_pos;
+    *produced = 0;
+#ifdef HAVE_ZLIB
+    if (c->codec == STREAM_CODEC_GZIP) {
+        c->z.next_in = c->io + c->io_pos;
+        c->z.avail_in = (uInt)avail;
+        c->z.next_out = dst;
+        c->z.avail_out = (uInt)cap;
+        int rc = inflate(&c->z, Z_NO_FLUSH);
+        c->io_pos += avail - c->z.avail_in;
+        *produced = cap - c->z.avail_out;
+        if (rc == Z_STREAM_END) {
+            // Concatenated gzip members decode as one stream.
+            return inflateReset(&c->z) == Z_OK ? 0 : -1;
+        }
+        return (rc == Z_OK || rc == Z_BUF_ERROR) ? 1 : -1;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->codec == STREAM_CODEC_ZSTD) {
+        ZSTD_inBuffer in = { c->io + c->io_pos, avail, 0 };
+        ZSTD_outBuffer out = { dst, cap, 0 };
+        size_t rc = ZSTD_decompressStream(c->zd, &out, &in);
+        if (ZSTD_isError(rc)) {
+            return -1;
+        }
+        c->io_pos += in.pos;
+        *produced = out.pos;
+        return rc != 0;
+    }
+#endif
+    (void)dst;
+    (void)cap;
+    (void)avail;
+    return -1;
+}
+
+static int codec_read(Codec* c, unsigned char* dst, size_t cap, size_t* out_len) {
+    size_t n = 0;
+    while (n < cap) {
+        int have = codec_fill_io(c);
+        if (have < 0) {
+            return 0;
+        }
+        if (c->codec == STREAM_CODEC_PLAIN) {
+            if (!have) {
+                break;
+            }
+            size_t take = c->io_len - c->io_pos;
+            if (take > cap - n) {
+                take = cap - n;
+            }
+            memcpy(dst + n, c->io + c->io_pos, take);
+            c->io_pos += take;
+            n += take;
+            continue;
+        }
+        if (!have && !c->frame_open) {
+            break;
+        }
+        size_t produced = 0;
+        int state = codec_decode_step(c, dst + n, cap - n, &produced);
+        if (state < 0) {
+            return 0;
+        }
+        n += produced;
+        c->frame_open = state > 0;
+        if (!have && produced == 0) {
+            if (c->frame_open) {
+                util_error("Compressed input is truncated.");
+                return 0;
+            }
+            break;
+        }
+    }
+    *out_len = n;
+    return 1;
+}
+
+static int codec_sink(Codec* c, const unsigned char* data, size_t len) {
+    if (c->aio) {
+        return aio_writer_write(c->aio, data, len);
+    }
+    return fwrite(data, 1, len, c->file) == len;
+}
+
+static int codec_write(Codec* c, const unsigned char* src, size_t len, int finish) {
+    if (c->codec == STREAM_CODEC_PLAIN) {
+        return len == 0 || codec_sink(c, src, len);
+    }
+#ifdef HAVE_ZLIB
+    if (c->codec == STREAM_CODEC_GZIP) {
+        c->z.next_in = (Bytef*)src;
+        c->z.avail_in = (uInt)len;
+        int rc = Z_OK;
+        do {
+            c->z.next_out = c->io;
+            c->z.avail_out = STREAM_CHUNK;
+            rc = deflate(&c->z, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR) {
+                return 0;
+            }
+            size_t have = STREAM_CHUNK - c->z.avail_out;
+            if (have && !codec_sink(c, c->io, have)) {
+                return 0;
+            }
+        } while (c->z.avail_out == 0 || (finish && rc != Z_STREAM_END));
+        return 1;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->codec == STREAM_CODEC_ZSTD) {
+        ZSTD_inBuffer in = { src, len, 0 };
+        for (;;) {
+            ZSTD_outBuffer out = { c->io, STREAM_CHUNK, 0 };
+            size_t remaining = ZSTD_compressStream2(c->zc, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                return 0;
+            }
+            if (out.pos && !codec_sink(c, c->io, out.pos)) {
+                return 0;
+            }
+            if (finish ? remaining == 0 : in.pos == in.size) {
+                return 1;
+            }
+        }
+    }
+#endif
+    (void)src;
+    (void)finish;
+    return 0;
+}
+
+#ifdef HAVE_PTHREADS
+static void queue_push(ChunkQueue* q, unsigned char* data, size_t len) {
+    Chunk* slot = &q->items[(q->head + q->count) % STREAM_BUFFERS];
+    slot->data = data;
+    slot->len = len;
+    q->count++;
+}
+
+static Chunk queue_pop(ChunkQueue* q) {
+    Chunk chunk = q->items[q->head];
+    q->head = (q->head + 1) % STREAM_BUFFERS;
+    q->count--;
+    return chunk;
+}
+
+static void* pipeline_write_worker(void* arg) {
+    Pipeline* p = (Pipeline*)arg;
+    int ok = 1;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->filled.count == 0 && !p->closing) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (p->filled.count == 0) {
+            break;
+        }
+        Chunk chunk = queue_pop(&p->filled);
+        pthread_mutex_unlock(&p->lock);
+        ok = codec_write(p->codec, chunk.data, chunk.len, 0);
+        pthread_mutex_lock(&p->lock);
+        queue_push(&p->spare, chunk.data, 0);
+        if (!ok) {
+            p->failed = 1;
+        }
+        pthread_cond_broadcast(&p->changed);
+        if (!ok) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (ok && !codec_write(p->codec, NULL, 0, 1)) {
+        ok = 0;
+    }
+    pthread_mutex_lock(&p->lock);
+    if (!ok) {
+        p->failed = 1;
+    }
+    p->finished = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void* pipeline_read_worker(void* arg) {
+    Pipeline* p = (Pipeline*)arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->spare.count == 0 && !p->closing) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (p->closing) {
+            break;
+        }
+        Chunk chunk = queue_pop(&p->spare);
+        pthread_mutex_unlock(&p->lock);
+        size_t len = 0;
+        int ok = codec_read(p->codec, chunk.data, STREAM_CHUNK, &len);
+        pthread_mutex_lock(&p->lock);
+        if (ok && len > 0) {
+            queue_push(&p->filled, chunk.data, len);
+        }
+        else {
+            queue_push(&p->spare, chunk.data, 0);
+            p->failed = !ok;
+            break;
+        }
+        pthread_cond_broadcast(&p->changed);
+    }
+    p->finished = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static Pipeline* pipeline_start(Codec* codec) {
+    Pipeline* p = (Pipeline*)calloc(1, sizeof(Pipeline));
+    if (!p) {
+        return NULL;
+    }
+    p->arena = (unsigned char*)malloc((size_t)STREAM_BUFFERS * STREAM_CHUNK);
+    if (!p->arena) {
+        free(p);
+        return NULL;
+    }
+    for (size_t i = 0; i < STREAM_BUFFERS; ++i) {
+        queue_push(&p->spare, p->arena + i * STREAM_CHUNK, 0);
+    }
+    p->codec = codec;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+    if (pthread_create(&p->thread, NULL, codec->writing ? pipeline_write_worker : pipeline_read_worker, p) != 0) {
+        pthread_cond_destroy(&p->changed);
+        pthread_mutex_destroy(&p->lock);
+        free(p->arena);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Joins the worker; returns 0 if it reported a failure.
+static int pipeline_stop(Pipeline* p) {
+    pthread_mutex_lock(&p->lock);
+    p->closing = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    int ok = !p->failed;
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+    free(p->arena);
+    free(p);
+    return ok;
+}
+
+static unsigned char* pipeline_take_spare(Pipeline* p) {
+    unsigned char* data = NULL;
+    pthread_mutex_lock(&p->lock);
+    while (p->spare.count == 0 && !p->failed) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    if (!p->failed) {
+        data = queue_pop(&p->spare).data;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return data;
+}
+#endif
+
+static int stream_flush_chunk(Stream* s) {
+#ifdef HAVE_PTHREADS
+    if (s->pipe) {
+        Pipeline* p = s->pipe;
+        pthread_mutex_lock(&p->lock);
+        queue_push(&p->filled, s->cur, s->len);
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+        s->len = 0;
+        s->cur = pipeline_take_spare(p);
+        return s->cur != NULL;
+    }
+#endif
+    int ok = codec_write(&s->codec, s->cur, s->len, 0);
+    s->len = 0;
+    return ok;
+}
+
+static int stream_refill(Stream* s) {
+    if (s->eof || s->error) {
+        return 0;
+    }
+    s->base += s->len;
+    s->pos = 0;
+    s->len = 0;
+#ifdef HAVE_PTHREADS
+    if (s->pipe) {
+        Pipeline* p = s->pipe;
+        pthread_mutex_lock(&p->lock);
+        if (s->cur) {
+            queue_push(&p->spare, s->cur, 0);
+            s->cur = NULL;
+            pthread_cond_broadcast(&p->changed);
+        }
+        while (p->filled.count == 0 && !p->finished) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (p->filled.count > 0) {
+            Chunk chunk = queue_pop(&p->filled);
+            s->cur = chunk.data;
+            s->len = chunk.len;
+        }
+        else {
+            s->eof = 1;
+            s->error = p->failed;
+        }
+        pthread_mutex_unlock(&p->lock);
+        return s->len > 0;
+    }
+#endif
+    if (!codec_read(&s->codec, s->cur, STREAM_CHUNK, &s->len)) {
+        s->error = 1;
+        return 0;
+    }
+    if (s->len == 0) {
+        s->eof = 1;
+    }
+    return s->len > 0;
+}
+
+static Stream* stream_create(FILE* file, AioWriter* aio, StreamCodec codec, int writing, int owns_file) {
+    if (!file && !aio) {
+        return NULL;
+    }
+    Stream* s = (Stream*)calloc(1, sizeof(Stream));
+    if (!s) {
+        return NULL;
+    }
+    s->codec.file = file;
+    s->codec.aio = aio;
+    s->codec.writing = writing;
+    s->owns_file = owns_file;
+    s->codec.io = (unsigned char*)malloc(STREAM_CHUNK);
+    if (!s->codec.io) {
+        free(s);
+        return NULL;
+    }
+    if (codec == STREAM_CODEC_AUTO && !writing) {
+        static const unsigned char gzip_magic[] = { 0x1F, 0x8B };
+        static const unsigned char zstd_magic[] = { 0x28, 0xB5, 0x2F, 0xFD };
+        codec = STREAM_CODEC_PLAIN;
+        if (codec_fill_io(&s->codec) > 0) {
+            size_t n = s->codec.io_len;
+            if (n >= sizeof(gzip_magic) && memcmp(s->codec.io, gzip_magic, sizeof(gzip_magic)) == 0) {
+                codec = STREAM_CODEC_GZIP;
+            }
+            else if (n >= sizeof(zstd_magic) && memcmp(s->codec.io, zstd_magic, sizeof(zstd_magic)) == 0) {
+                codec = STREAM_CODEC_ZSTD;
+            }
+        }
+    }
+    s->codec.codec = codec == STREAM_CODEC_AUTO ? STREAM_CODEC_PLAIN : codec;
+    if (!codec_supported(s->codec.codec) || !codec_init(&s->codec)) {
+        codec_free(&s->codec);
+        free(s);
+        return NULL;
+    }
+#ifdef HAVE_PTHREADS
+    if (s->codec.codec != STREAM_CODEC_PLAIN) {
+        s->pipe = pipeline_start(&s->codec);
+    }
+    if (s->pipe) {
+        if (writing) {
+            s->cur = pipeline_take_spare(s->pipe);
+        }
+        return s;
+    }
+#endif
+    s->cur = (unsigned char*)malloc(STREAM_CHUNK);
+    if (!s->cur) {
+        codec_free(&s->codec);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+StreamCodec stream_codec_for_path(const char* path) {
+    size_t len = path ? strlen(path) : 0;
+    if (len >= 3 && strcmp(path + len - 3, ".gz") == 0) {
+        return STREAM_CODEC_GZIP;
+    }
+    if (len >= 4 && strcmp(path + len - 4, ".zst") == 0) {
+        return STREAM_CODEC_ZSTD;
+    }
+    return STREAM_CODEC_PLAIN;
+}
+
+Stream* stream_open_writer(FILE* file, StreamCodec codec, int owns_file) {
+    return stream_create(file, NULL, codec, 1, owns_file);
+}
+
+Stream* stream_open_file_writer(const char* path, StreamCodec codec, AioBackend backend, int flags) {
+    AioWriter* aio = aio_writer_open(path, backend, flags);
+    if (!aio) {
+        return NULL;
+    }
+    Stream* s = stream_create(NULL, aio, codec, 1, 1);
+    if (!s) {
+        aio_writer_close(aio);
+    }
+    return s;
+}
+
+Stream* stream_open_reader(FILE* file, StreamCodec codec, int owns_file) {
+    return stream_create(file, NULL, codec, 0, owns_file);
+}
+
+int stream_write(Stream* s, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len > 0 && !s->error) {
+        size_t take = STREAM_CHUNK - s->len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(s->cur + s->len, p, take);
+        s->len += take;
+        p += take;
+        len -= take;
+        if (s->len == STREAM_CHUNK && !stream_flush_chunk(s)) {
+            s->error = 1;
+        }
+    }
+    return !s->error;
+}
+
+int stream_puts(Stream* s, const char* str) {
+    return stream_write(s, str, strlen(str));
+}
+
+int stream_putc(Stream* s, int c) {
+    if (s->error) {
+        return 0;
+    }
+    if (s->len < STREAM_CHUNK) {
+        s->cur[s->len++] = (unsigned char)c;
+        if (s->len < STREAM_CHUNK) {
+            return 1;
+        }
+        if (!stream_flush_chunk(s)) {
+            s->error = 1;
+        }
+        return !s->error;
+    }
+    unsigned char byte = (unsigned char)c;
+    return stream_write(s, &byte, 1);
+}
+
+int stream_getc(Stream* s) {
+    if (s->pos < s->len || stream_refill(s)) {
+        return s->cur[s->pos++];
+    }
+    return EOF;
+}
+
+uint64_t stream_tell(const Stream* s) {
+    return s->base + s->pos;
+}
+
+int stream_skip(Stream* s, uint64_t n) {
+    if (n <= s->len - s->pos) {
+        s->pos += (size_t)n;
+        return 1;
+    }
+    // Plain files without a reader thread seek past whatever is not buffered yet.
+    Codec* c = &s->codec;
+    uint64_t staged = c->io_len - c->io_pos;
+    uint64_t rest = n - (s->len - s->pos);
+#ifdef HAVE_PTHREADS
+    int threaded = s->pipe != NULL;
+#else
+    int threaded = 0;
+#endif
+    if (!threaded && !c->writing && c->codec == STREAM_CODEC_PLAIN && c->file && rest >= staged &&
+        rest - staged <= (uint64_t)LONG_MAX && fseek(c->file, (long)(rest - staged), SEEK_CUR) == 0) {
+        s->base = stream_tell(s) + n;
+        s->pos = 0;
+        s->len = 0;
+        c->io_pos = c->io_len;
+        return 1;
+    }
+    while (n > 0) {
+        if (s->pos == s->len && !stream_refill(s)) {
+            return 0;
+        }
+        size_t take = s->len - s->pos;
+        if ((uint64_t)take > n) {
+            take = (size_t)n;
+        }
+        s->pos += take;
+        n -= take;
+    }
+    return 1;
+}
+
+int stream_error(const Stream* s) {
+    return s->error;
+}
+
+void stream_ungetc(Stream* s) {
+    if (s->pos > 0) {
+        s->pos--;
+    }
+}
+
+// Hands the last chunk to the codec and finishes the compressed frame.
+static int stream_finish(Stream* s) {
+#ifdef HAVE_PTHREADS
+    if (s->pipe) {
+        Pipeline* p = s->pipe;
+        if (s->cur) {
+            pthread_mutex_lock(&p->lock);
+            queue_push(s->codec.writing && s->len > 0 ? &p->filled : &p->spare, s->cur, s->len);
+            pthread_mutex_unlock(&p->lock);
+            s->cur = NULL;
+        }
+        s->pipe = NULL;
+        return pipeline_stop(p);
+    }
+#endif
+    return !s->codec.writing || codec_write(&s->codec, s->cur, s->len, 1);
+}
+
+int stream_close(Stream* s) {
+    if (!s) {
+        return 0;
+    }
+    int ok = !s->error;
+    ok = stream_finish(s) && ok;
+    if (s->codec.aio) {
+        ok = aio_writer_close(s->codec.aio) && ok;
+    }
+    else {
+        if (s->codec.writing && fflush(s->codec.file) != 0) {
+            ok = 0;
+        }
+        if (s->owns_file && fclose(s->codec.file) != 0) {
+            ok = 0;
+        }
+    }
+    codec_free(&s->codec);
+    free(s->cur);
+    free(s);
+    return ok;
+}
@@ -0,0 +1,335 @@
+// Purpose: Contact tags with lazily loaded roaring bitmap indexes. Author: GitHub Copilot
+#include "tags.h"
+#include "util.h"
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char name[TAG_NAME_MAX + 1];
+    Roaring* bits;
+} TagCacheEntry;
+
+struct TagCache {
+    TagCacheEntry* entries;
+    size_t count;
+    size_t cap;
+};
+
+int tags_valid_name(const char* tag) {
+    if (!tag || !tag[0] || strlen(tag) > TAG_NAME_MAX) {
+        return 0;
+    }
+    for (const char* p = tag; *p; ++p) {
+        char c = *p;
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.' ||
+            c == ':' || c == '-';
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static TagCacheEntry* cache_find(Db* db, const char* tag) {
+    for (size_t i = 0; db->tag_cache && i < db->tag_cache->count; ++i) {
+        if (strcmp(db->tag_cache->entries[i].name, tag) == 0) {
+            return &db->tag_cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Takes ownership of bits, replacing any loaded copy of the tag.
+static const Roaring* cache_put(Db* db, const char* tag, Roaring* bits) {
+    TagCacheEntry* entry = cache_find(db, tag);
+    if (entry) {
+        roaring_destroy(entry->bits);
+        entry->bits = bits;
+        return bits;
+    }
+    if (!db->tag_cache && !(db->tag_cache = (struct TagCache*)calloc(1, sizeof(struct TagCache)))) {
+        roaring_destroy(bits);
+        return NULL;
+    }
+    struct TagCache* cache = db->tag_cache;
+    if (cache->count == cache->cap) {
+        size_t cap = cache->cap ? cache->cap * 2 : 8;
+        TagCacheEntry* grown = (TagCacheEntry*)realloc(cache->entries, cap * sizeof(TagCacheEntry));
+        if (!grown) {
+            roaring_destroy(bits);
+            return NULL;
+        }
+        cache->entries = grown;
+        cache->cap = cap;
+    }
+    entry = &cache->entries[cache->count++];
+    util_copy_str(entry->name, sizeof(entry->name), tag);
+    entry->bits = bits;
+    return bits;
+}
+
+static void cache_forget(Db* db, const char* tag) {
+    TagCacheEntry* entry = cache_find(db, tag);
+    if (entry) {
+        roaring_destroy(entry->bits);
+        *entry = db->tag_cache->entries[--db->tag_cache->count];
+    }
+}
+
+void tags_invalidate(Db* db) {
+    if (!db || !db->tag_cache) {
+        return;
+    }
+    for (size_t i = 0; i < db->tag_cache->count; ++i) {
+        roaring_destroy(db->tag_cache->entries[i].bits);
+    }
+    free(db->tag_cache->entries);
+    free(db->tag_cache);
+    db->tag_cache = NULL;
+}
+
+static int store_bitmap(Db* db, const char* tag, const Roaring* bits) {
+    size_t size = roaring_serialized_size(bits);
+    unsigned char* blob = (unsigned char*)malloc(size);
+    sqlite3_stmt* stmt = NULL;
+    int ok = blob && sqlite3_prepare_v2(db->handle, "UPDATE tags SET bitmap=? WHERE name=?;", -1, &stmt, NULL) == SQLITE_OK;
+    if (ok) {
+        roaring_serialize(bits, blob);
+        sqlite3_bind_blob(stmt, 1, blob, (int)size, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, tag, -1, SQLITE_TRANSIENT);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+    free(blob);
+    return ok;
+}
+
+// contact_tags is the source of truth; its primary key yields ids in ascending order.
+static Roaring* rebuild_bitmap(Db* db, const char* tag) {
+    sqlite3_stmt* stmt = NULL;
+    Roaring* bits = roaring_create();
+    if (!bits || sqlite3_prepare_v2(db->handle, "SELECT contact_id FROM contact_tags WHERE tag=? ORDER BY contact_id;",
+        -1, &stmt, NULL) != SQLITE_OK) {
+        roaring_destroy(bits);
+        return NULL;
+    }
+    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_TRANSIENT);
+    int ok = 1;
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ok = roaring_add(bits, (uint32_t)sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    if (!ok || rc != SQLITE_DONE) {
+        roaring_destroy(bits);
+        return NULL;
+    }
+    return bits;
+}
+
+int tags_get(Db* db, const char* tag, const Roaring** out) {
+    if (!db || !db->handle || !tag || !out) {
+        return 0;
+    }
+    TagCacheEntry* entry = cache_find(db, tag);
+    if (entry) {
+        *out = entry->bits;
+        return 1;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT bitmap FROM tags WHERE name=?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        util_error("Unknown tag: %s", tag);
+        return 0;
+    }
+    const void* blob = sqlite3_column_blob(stmt, 0);
+    Roaring* bits = blob ? roaring_deserialize(blob, (size_t)sqlite3_column_bytes(stmt, 0)) : NULL;
+    sqlite3_finalize(stmt);
+    if (!bits) {
+        // The stored bitmap is cleared by triggers whenever membership changes.
+        bits = rebuild_bitmap(db, tag);
+        if (!bits) {
+            return 0;
+        }
+        if (!db->read_only) {
+            store_bitmap(db, tag, bits);
+        }
+    }
+    *out = cache_put(db, tag, bits);
+    return *out != NULL;
+}
+
+typedef struct {
+    Db* db;
+    sqlite3_stmt* stmt;
+    Roaring* bits;
+    int add;
+    int changed;
+    int ok;
+} TagUpdate;
+
+static int tag_update_row(void* ctx, const ContactView* row) {
+    TagUpdate* u = (TagUpdate*)ctx;
+    if (row->id < 1 || row->id > (int64_t)UINT32_MAX) {
+        util_error("Contact %lld cannot be tagged; tags support ids up to %lu.", (long long)row->id,
+            (unsigned long)UINT32_MAX);
+        u->ok = 0;
+        return 0;
+    }
+    sqlite3_bind_int64(u->stmt, 2, row->id);
+    u->ok = sqlite3_step(u->stmt) == SQLITE_DONE;
+    if (u->ok && sqlite3_changes(u->db->handle) > 0) {
+        u->changed++;
+        u->ok = u->add ? roaring_add(u->bits, (uint32_t)row->id) : roaring_remove(u->bits, (uint32_t)row->id);
+    }
+    sqlite3_reset(u->stmt);
+    return u->ok;
+}
+
+static int exec_tag(Db* db, const char* sql, const char* tag) {
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_TRANSIENT);
+    int ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+int tags_update(Db* db, const char* tag, int add, const ContactFilter* filter, int* out_changed) {
+    if (!db || !db->handle || !out_changed) {
+        return 0;
+    }
+    *out_changed = 0;
+    if (!tags_valid_name(tag)) {
+        util_error("Invalid tag name. Use 1-%d letters, digits or _ . : -", TAG_NAME_MAX);
+        return 0;
+    }
+    if (!db_begin(db)) {
+        return 0;
+    }
+    const Roaring* current = NULL;
+    int ok = (!add || exec_tag(db, "INSERT OR IGNORE INTO tags(name) VALUES(?);", tag)) && tags_get(db, tag, &current);
+    TagUpdate u = { db, NULL, ok ? roaring_copy(current) : NULL, add, 0, 1 };
+    const char* sql = add ? "INSERT OR IGNORE INTO contact_tags(tag, contact_id) VALUES(?, ?);"
+        : "DELETE FROM contact_tags WHERE tag=? AND contact_id=?;";
+    ok = u.bits && sqlite3_prepare_v2(db->handle, sql, -1, &u.stmt, NULL) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_text(u.stmt, 1, tag, -1, SQLITE_TRANSIENT);
+        ok = contacts_foreach(db, filter, CONTACT_SORT_ID, tag_update_row, &u) && u.ok;
+    }
+    sqlite3_finalize(u.stmt);
+    // Writing the bitmap after the membership rows overrides the triggers that cleared it.
+    if (ok) {
+        ok = roaring_cardinality(u.bits) == 0 ? exec_tag(db, "DELETE FROM tags WHERE name=?;", tag)
+            : store_bitmap(db, tag, u.bits);
+    }
+    if (!ok || !db_commit(db)) {
+        db_rollback(db);
+        roaring_destroy(u.bits);
+        cache_forget(db, tag);
+        return 0;
+    }
+    if (roaring_cardinality(u.bits) == 0) {
+        roaring_destroy(u.bits);
+        cache_forget(db, tag);
+    }
+    else {
+        cache_put(db, tag, u.bits);
+    }
+    *out_changed = u.changed;
+    return 1;
+}
+
+static Roaring* all_contact_ids(Db* db) {
+    sqlite3_stmt* stmt = NULL;
+    Roaring* bits = roaring_create();
+    if (!bits || sqlite3_prepare_v2(db->handle, "SELECT id FROM contacts ORDER BY id;", -1, &stmt, NULL) != SQLITE_OK) {
+        roaring_destroy(bits);
+        return NULL;
+    }
+    int ok = 1;
+    int rc = SQLITE_DONE;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t id = sqlite3_column_int64(stmt, 0);
+        if (id < 1 || id > (int64_t)UINT32_MAX) {
+            util_error("Contact %lld is outside the id range tags support.", (long long)id);
+            ok = 0;
+            break;
+        }
+        ok = roaring_add(bits, (uint32_t)id);
+    }
+    sqlite3_finalize(stmt);
+    if (!ok || rc != SQLITE_DONE) {
+        roaring_destroy(bits);
+        return NULL;
+    }
+    return bits;
+}
+
+Roaring* tags_select(Db* db, const TagsOp* ops, size_t count) {
+    if (!db || !db->handle || !ops || count == 0) {
+        return NULL;
+    }
+    Roaring* result = ops[0].kind == TAGS_OR ? roaring_create() : all_contact_ids(db);
+    for (size_t i = 0; result && i < count; ++i) {
+        const Roaring* set = NULL;
+        int ok = tags_get(db, ops[i].tag, &set);
+        if (ok) {
+            ok = ops[i].kind == TAGS_OR ? roaring_or(result, set)
+                : ops[i].kind == TAGS_AND ? roaring_and(result, set) : roaring_andnot(result, set);
+        }
+        if (!ok) {
+            roaring_destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+int tags_print(Db* db, int json, FILE* out) {
+    if (!db || !db->handle || !out) {
+        return 0;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(db->handle, "SELECT name FROM tags ORDER BY name;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int ok = 1;
+    int first = 1;
+    int rc = SQLITE_DONE;
+    if (json) {
+        fprintf(out, "[");
+    }
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        char tag[TAG_NAME_MAX + 1];
+        util_copy_str(tag, sizeof(tag), (const char*)sqlite3_column_text(stmt, 0));
+        const Roaring* bits = NULL;
+        ok = tags_get(db, tag, &bits);
+        if (!ok) {
+            break;
+        }
+        unsigned long long members = (unsigned long long)roaring_cardinality(bits);
+        if (json) {
+            fprintf(out, "%s{\"tag\":", first ? "" : ",");
+            util_print_json_string(out, tag);
+            fprintf(out, ",\"contacts\":%llu}", members);
+        }
+        else {
+            fprintf(out, "%-24s %llu\n", tag, members);
+        }
+        first = 0;
+    }
+    sqlite3_finalize(stmt);
+    if (json) {
+        fprintf(out, "]\n");
+    }
+    return ok && rc == SQLITE_DONE;
+}
@@ -3,6 +3,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -12,6 +13,37 @@
 #include <wincrypt.h>
 #endif
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#define UTIL_THREAD_LOCAL __declspec(thread)
+#else
+#define UTIL_THREAD_LOCAL _Thread_local
+#endif
+
+static UTIL_THREAD_LOCAL char util_error_message[256];
+static int util_error_echo;
+
+void util_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(util_error_message, sizeof(util_error_message), fmt, args);
+    va_end(args);
+    if (util_error_echo) {
+        fprintf(stderr, "%s\n", util_error_message);
+    }
+}
+
+const char* util_last_error(void) {
+    return util_error_message;
+}
+
+void util_clear_error(void) {
+    util_error_message[0] = '\0';
+}
+
+void util_set_error_echo(int enabled) {
+    util_error_echo = enabled;
+}
+
 int util_read_line(FILE* in, char* buf, size_t len) {
     if (!in || !buf || len == 0) {
         return 0;
@@ -106,6 +138,15 @@ void util_copy_str(char* dest, size_t dest_len, const char* src) {
     dest[dest_len - 1] = '\0';
 }
 
+uint64_t util_fnv1a64(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 int util_random_bytes(uint8_t* buf, size_t len) {
     if (!buf || len == 0) {
         return 0;
@@ -238,6 +279,10 @@ int util_parse_iso_date(const char* input, struct tm* out) {
 }
 
 int util_due_days(const char* due_date, int* days_out) {
+    return util_due_days_at(due_date, time(NULL), days_out);
+}
+
+int util_due_days_at(const char* due_date, time_t now, int* days_out) {
     if (!due_date || !due_date[0] || !days_out) {
         return 0;
     }
@@ -249,7 +294,6 @@ int util_due_days(const char* due_date, int* days_out) {
     if (due_time == (time_t)-1) {
         return 0;
     }
-    time_t now = time(NULL);
     long long seconds = (long long)(due_time - now);
     long days = (long)(seconds / 86400LL);
     if (seconds < 0 && (seconds % 86400LL) != 0) {
@@ -259,6 +303,78 @@ int util_due_days(const char* due_date, int* days_out) {
     return 1;
 }
 
+static int64_t days_from_civil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int util_epoch_day(const char* date, int64_t* out) {
+    if (!date || !out) {
+        return 0;
+    }
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    if (sscanf(date, "%4d-%2d-%2d", &year, &month, &day) != 3) {
+        return 0;
+    }
+    if (year < 1900 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
+    // Like mktime, an out-of-range day such as 02-31 rolls over into the next month.
+    *out = days_from_civil(year, month, 1) + day - 1;
+    return 1;
+}
+
+// Local midnight at the start of an epoch day, or (time_t)-1.
+void util_civil_from_days(int64_t day, int* year, int* month, int* mday) {
+    int64_t z = day + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int)(yoe + era * 400 + (m <= 2));
+    *month = m;
+    *mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+}
+
+void util_format_epoch_day(int64_t day, char* out, size_t len) {
+    int year, month, mday;
+    if (!out || len < 11) {
+        return;
+    }
+    util_civil_from_days(day, &year, &month, &mday);
+    snprintf(out, len, "%04d-%02d-%02d", year, month, mday);
+}
+
+time_t util_epoch_day_start(int64_t day) {
+    int year, month, mday;
+    util_civil_from_days(day, &year, &month, &mday);
+    struct tm tmv;
+    memset(&tmv, 0, sizeof(tmv));
+    tmv.tm_year = year - 1900;
+    tmv.tm_mon = month - 1;
+    tmv.tm_mday = mday;
+    tmv.tm_isdst = -1;
+    return mktime(&tmv);
+}
+
+int64_t util_local_epoch_day(time_t when) {
+    struct tm tmv;
+#if defined(_WIN32)
+    localtime_s(&tmv, &when);
+#else
+    localtime_r(&when, &tmv);
+#endif
+    return days_from_civil(tmv.tm_year + 1900, tmv.tm_mon + 1, tmv.tm_mday);
+}
+
 void util_format_iso_date(time_t when, char* out, size_t len) {
     if (!out || len < 11) {
         return;
@@ -274,3 +390,24 @@ void util_format_iso_date(time_t when, char* out, size_t len) {
         tmv.tm_mon + 1,
         tmv.tm_mday);
 }
+
+uint32_t util_crc32(uint32_t crc, const void* data, size_t len) {
+    static uint32_t table[256];
+    static int table_ready = 0;
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -4,10 +4,14 @@
 // Purpose: Unit tests for CSV parsing/writing. Author: GitHub Copilot
 #include <cmocka.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "archive.h"
+#include "columnar.h"
 #include "csv.h"
 #include "contacts.h"
 #include "db.h"
+#include "ledger.h"
 
 static void test_csv_roundtrip(void** state) {
     (void)state;
@@ -43,9 +47,630 @@ static void test_csv_roundtrip(void** state) {
     db_close(&db);
 }
 
+static FILE* write_snapshot(const char* text) {
+    FILE* f = tmpfile();
+    assert_non_null(f);
+    fputs(text, f);
+    rewind(f);
+    return f;
+}
+
+static void test_csv_sync(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+
+    CsvSyncResult r;
+    FILE* day1 = write_snapshot(
+        "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n"
+        "Ann,1,,,0.00,,p-1\n"
+        "Ben,2,,,5.00,2026-01-01,p-2\n"
+        "Cid,3,,,0.00,,p-3\n");
+    assert_true(csv_sync_contacts(&db, day1, 1, 0, 0, &r));
+    fclose(day1);
+    assert_int_equal(r.inserted, 3);
+    assert_int_equal(r.updated, 0);
+
+    Contact before;
+    assert_true(contacts_get_by_id(&db, 2, &before));
+    assert_string_equal(before.external_id, "p-2");
+
+    FILE* day2 = write_snapshot(
+        "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n"
+        "Ann,1,,,0.00,,p-1\n"
+        "Ben,2,,,7.50,2026-01-01,p-2\n"
+        "Dee,4,,,0.00,,p-4\n");
+    assert_true(csv_sync_contacts(&db, day2, 1, 0, 1, &r));
+    fclose(day2);
+    assert_int_equal(r.inserted, 1);
+    assert_int_equal(r.updated, 1);
+    assert_int_equal(r.unchanged, 1);
+    assert_int_equal(r.deleted, 1);
+    assert_int_equal(r.failed, 0);
+
+    Contact after;
+    assert_true(contacts_get_by_id(&db, 2, &after));
+    assert_true(after.due_amount > 7.49 && after.due_amount < 7.51);
+    assert_false(contacts_get_by_id(&db, 3, &after));
+
+    db_close(&db);
+}
+
+static int64_t archived_count(Db* db) {
+    sqlite3_stmt* stmt = NULL;
+    assert_true(sqlite3_prepare_v2(db->handle, "SELECT COUNT(*) FROM contacts_archive;", -1, &stmt, NULL) == SQLITE_OK);
+    assert_true(sqlite3_step(stmt) == SQLITE_ROW);
+    int64_t count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static void test_csv_sync_archived(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+
+    CsvSyncResult r;
+    FILE* day1 = write_snapshot(
+        "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n"
+        "Ann,1,,,0.00,,p-1\n"
+        "Ben,2,,,5.00,2026-01-01,p-2\n"
+        "Cid,3,,,0.00,,p-3\n"
+        "Eve,5,,,0.00,,p-5\n");
+    assert_true(csv_sync_contacts(&db, day1, 1, 0, 0, &r));
+    fclose(day1);
+    assert_true(sqlite3_exec(db.handle, "UPDATE contact_changes SET changed_at = '2001-01-01T00:00:00.000Z';", NULL,
+        NULL, NULL) == SQLITE_OK);
+    int64_t moved = 0;
+    assert_true(archive_contacts(&db, 365, 0, 0, &moved));
+    assert_int_equal(moved, 3);
+
+    // External ids stay unique across both tiers.
+    FILE* dup = write_snapshot("Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\nAnn again,9,,,0,,p-1\n");
+    int imported = 0, failed = 0;
+    assert_true(csv_import_contacts(&db, dup, 0, 0, &imported, &failed));
+    fclose(dup);
+    assert_int_equal(imported, 0);
+    assert_int_equal(failed, 1);
+
+    // Unchanged archived rows stay put, a changed one is restored under its id and missing ones go.
+    FILE* day2 = write_snapshot(
+        "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n"
+        "Ann,1,,,0.00,,p-1\n"
+        "Ben,2,,,5.00,2026-01-01,p-2\n"
+        "Cid,3,,,9.00,,p-3\n");
+    assert_true(csv_sync_contacts(&db, day2, 1, 0, 1, &r));
+    fclose(day2);
+    assert_int_equal(r.inserted, 0);
+    assert_int_equal(r.updated, 1);
+    assert_int_equal(r.unchanged, 2);
+    assert_int_equal(r.deleted, 1);
+    assert_int_equal(archived_count(&db), 1);
+
+    Contact c;
+    assert_true(contacts_get_by_id(&db, 3, &c));
+    assert_true(c.due_amount > 8.99 && c.due_amount < 9.01);
+    assert_false(contacts_get_by_id(&db, 1, &c));
+    db_close(&db);
+}
+
+static void test_columnar_roundtrip(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    const int rows = COLUMNAR_BLOCK_ROWS + 100;
+    assert_true(db_begin(&db));
+    for (int i = 0; i < rows; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Name%05d", i);
+        snprintf(c.phone, sizeof(c.phone), "555-%04d", i);
+        snprintf(c.address, sizeof(c.address), "%d Main St, City%d", i, i % 3);
+        snprintf(c.email, sizeof(c.email), "user%d@%s", i, i % 2 ? "acme.com" : "example.org");
+        c.due_amount = i * 0.25;
+        if (i % 7 == 0) {
+            snprintf(c.due_date, sizeof(c.due_date), "2026-02-%02d", 1 + i % 28);
+            snprintf(c.external_id, sizeof(c.external_id), "ext-%d", i);
+        }
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    assert_true(db_commit(&db));
+
+    FILE* tmp = tmpfile();
+    assert_non_null(tmp);
+    assert_true(columnar_write_contacts(&db, tmp));
+    rewind(tmp);
+
+    Db db2;
+    assert_true(db_open(&db2, ":memory:"));
+    assert_true(db_init(&db2));
+    int imported = 0;
+    assert_true(columnar_import_contacts(&db2, tmp, 0, &imported));
+    assert_int_equal(imported, rows);
+    for (int64_t id = 1; id <= rows; id += 997) {
+        Contact a, b;
+        assert_true(contacts_get_by_id(&db, id, &a));
+        assert_true(contacts_get_by_id(&db2, id, &b));
+        assert_string_equal(a.name, b.name);
+        assert_string_equal(a.address, b.address);
+        assert_string_equal(a.email, b.email);
+        assert_string_equal(a.due_date, b.due_date);
+        assert_string_equal(a.external_id, b.external_id);
+        assert_true(a.due_amount == b.due_amount);
+    }
+
+    // A flipped byte must fail the checksum and leave the target untouched.
+    long size = ftell(tmp);
+    assert_int_equal(fseek(tmp, size / 2, SEEK_SET), 0);
+    int byte = fgetc(tmp);
+    assert_int_equal(fseek(tmp, size / 2, SEEK_SET), 0);
+    fputc(byte ^ 0x01, tmp);
+    rewind(tmp);
+    Db db3;
+    assert_true(db_open(&db3, ":memory:"));
+    assert_true(db_init(&db3));
+    assert_false(columnar_import_contacts(&db3, tmp, 0, &imported));
+    Contact none;
+    assert_false(contacts_get_by_id(&db3, 1, &none));
+    fclose(tmp);
+
+    db_close(&db3);
+    db_close(&db2);
+    db_close(&db);
+}
+
+static void test_csv_compressed(void** state) {
+    (void)state;
+#ifdef HAVE_ZLIB
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    assert_true(db_begin(&db));
+    for (int i = 0; i < 20000; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Person %d", i);
+        snprintf(c.address, sizeof(c.address), "\"Quoted\", line %d", i);
+        c.due_amount = i;
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    assert_true(db_commit(&db));
+
+    FILE* tmp = tmpfile();
+    assert_non_null(tmp);
+    Stream* out = stream_open_writer(tmp, STREAM_CODEC_GZIP, 0);
+    assert_non_null(out);
+    assert_true(csv_write_contacts_stream(&db, out));
+    assert_true(stream_close(out));
+    long size = ftell(tmp);
+    rewind(tmp);
+    assert_int_equal(fgetc(tmp), 0x1F);
+    rewind(tmp);
+
+    Db db2;
+    assert_true(db_open(&db2, ":memory:"));
+    assert_true(db_init(&db2));
+    int imported = 0, failed = 0;
+    assert_true(csv_import_contacts(&db2, tmp, 1, 0, &imported, &failed));
+    assert_int_equal(imported, 20000);
+    assert_int_equal(failed, 0);
+    Contact c;
+    assert_true(contacts_get_by_id(&db2, 20000, &c));
+    assert_string_equal(c.address, "\"Quoted\", line 9999");
+
+    // Truncated input must not commit the rows decoded before the cut.
+    FILE* cut = tmpfile();
+    assert_non_null(cut);
+    rewind(tmp);
+    for (long i = 0; i < size / 2; ++i) {
+        fputc(fgetc(tmp), cut);
+    }
+    rewind(cut);
+    Db db3;
+    assert_true(db_open(&db3, ":memory:"));
+    assert_true(db_init(&db3));
+    assert_false(csv_import_contacts(&db3, cut, 0, 0, &imported, &failed));
+    assert_false(contacts_get_by_id(&db3, 1, &c));
+    fclose(cut);
+    fclose(tmp);
+
+    db_close(&db3);
+    db_close(&db2);
+    db_close(&db);
+#endif
+}
+
+static void test_csv_ledger_import(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "Ledger");
+    int64_t id = 0;
+    assert_true(contacts_add(&db, &c, &id));
+
+    FILE* tmp = tmpfile();
+    assert_non_null(tmp);
+    fprintf(tmp, "ContactId,Date,Amount,Memo\n%lld,2026-01-05,100,\"Invoice, first\"\n%lld,2026-13-01,5,\n"
+        "%lld,2026-02-01,-40\n", (long long)id, (long long)id, (long long)id);
+    rewind(tmp);
+    Stream* in = stream_open_reader(tmp, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    int imported = 0, failed = 0;
+    assert_true(csv_import_ledger_stream(&db, in, 0, 0, &imported, &failed));
+    assert_true(stream_close(in));
+    assert_int_equal(imported, 2);
+    assert_int_equal(failed, 1);
+    double balance = 0.0;
+    assert_true(ledger_balance(&db, id, &balance));
+    assert_true(balance == 60.0);
+
+    // Strict mode, or an unknown contact, rolls the whole file back.
+    rewind(tmp);
+    in = stream_open_reader(tmp, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    assert_false(csv_import_ledger_stream(&db, in, 1, 0, &imported, &failed));
+    assert_true(stream_close(in));
+    fclose(tmp);
+    tmp = tmpfile();
+    assert_non_null(tmp);
+    fprintf(tmp, "ContactId,Date,Amount\n%lld,2026-03-01,1\n999,2026-03-01,1\n", (long long)id);
+    rewind(tmp);
+    in = stream_open_reader(tmp, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    assert_false(csv_import_ledger_stream(&db, in, 1, 0, &imported, &failed));
+    assert_true(stream_close(in));
+    fclose(tmp);
+    assert_true(ledger_balance(&db, id, &balance));
+    assert_true(balance == 60.0);
+    db_close(&db);
+}
+
+static char* read_all(FILE* f, long* out_len) {
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+    char* data = (char*)malloc((size_t)len + 1);
+    assert_non_null(data);
+    assert_int_equal(fread(data, 1, (size_t)len, f), (size_t)len);
+    *out_len = len;
+    return data;
+}
+
+static void test_csv_parallel_export(void** state) {
+    (void)state;
+    // Worker threads open their own connections, so this test needs an on-disk database.
+    const char* path = "test_csv_parallel.db";
+    remove(path);
+    Db db;
+    assert_true(db_open(&db, path));
+    assert_true(db_init(&db));
+    assert_true(db_begin(&db));
+    for (int i = 0; i < 3000; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), i % 2 ? "person %d" : "Person %d", (i * 7919) % 1000);
+        snprintf(c.address, sizeof(c.address), "\"Line\", %d", i);
+        c.due_amount = i * 0.25;
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    assert_true(db_commit(&db));
+    assert_true(contacts_delete(&db, 1500, NULL));
+
+    FILE* serial = tmpfile();
+    FILE* merged = tmpfile();
+    FILE* unordered = tmpfile();
+    assert_true(serial && merged && unordered);
+    Stream* out = stream_open_writer(serial, STREAM_CODEC_PLAIN, 0);
+    assert_true(csv_write_contacts_stream(&db, out));
+    assert_true(stream_close(out));
+    out = stream_open_writer(merged, STREAM_CODEC_PLAIN, 0);
+    assert_true(csv_write_contacts_parallel(&db, out, 4, 1));
+    assert_true(stream_close(out));
+    out = stream_open_writer(unordered, STREAM_CODEC_PLAIN, 0);
+    assert_true(csv_write_contacts_parallel(&db, out, 3, 0));
+    assert_true(stream_close(out));
+
+    long serial_len = 0, merged_len = 0, unordered_len = 0;
+    char* serial_data = read_all(serial, &serial_len);
+    char* merged_data = read_all(merged, &merged_len);
+    char* unordered_data = read_all(unordered, &unordered_len);
+    assert_int_equal(merged_len, serial_len);
+    assert_memory_equal(merged_data, serial_data, (size_t)serial_len);
+    assert_int_equal(unordered_len, serial_len);
+
+    Db db2;
+    assert_true(db_open(&db2, ":memory:"));
+    assert_true(db_init(&db2));
+    int imported = 0, failed = 0;
+    rewind(unordered);
+    assert_true(csv_import_contacts(&db2, unordered, 1, 0, &imported, &failed));
+    assert_int_equal(imported, 2999);
+
+    free(serial_data);
+    free(merged_data);
+    free(unordered_data);
+    fclose(serial);
+    fclose(merged);
+    fclose(unordered);
+    db_close(&db2);
+    db_close(&db);
+    remove(path);
+}
+
+static void test_stream_file_writer(void** state) {
+    (void)state;
+    const char* path = "test_stream_writer.csv";
+    // Several full writer buffers plus a tail that is not a whole block, for O_DIRECT.
+    size_t total = 3 * 1024 * 1024 + 4096 * 5 + 123;
+    char* expect = (char*)malloc(total);
+    assert_non_null(expect);
+    for (size_t i = 0; i < total; ++i) {
+        expect[i] = (char)('a' + (i * 31 + i / 977) % 26);
+    }
+    const AioBackend backends[] = { AIO_BACKEND_AUTO, AIO_BACKEND_URING, AIO_BACKEND_THREAD, AIO_BACKEND_SYNC };
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b) {
+        for (int flags = 0; flags <= AIO_DIRECT; flags += AIO_DIRECT) {
+            Stream* out = stream_open_file_writer(path, STREAM_CODEC_PLAIN, backends[b], flags);
+            assert_non_null(out);
+            size_t pos = 0;
+            for (size_t step = 1; pos < total; step = step * 3 + 7) {
+                size_t n = step % 70000 + 1;
+                if (n > total - pos) {
+                    n = total - pos;
+                }
+                assert_true(stream_write(out, expect + pos, n));
+                pos += n;
+            }
+            assert_true(stream_close(out));
+            FILE* f = fopen(path, "rb");
+            assert_non_null(f);
+            long len = 0;
+            char* data = read_all(f, &len);
+            fclose(f);
+            assert_int_equal((size_t)len, total);
+            assert_memory_equal(data, expect, total);
+            free(data);
+        }
+    }
+    AioBackend parsed;
+    assert_true(aio_parse_backend("uring", &parsed));
+    assert_int_equal(parsed, AIO_BACKEND_URING);
+    assert_false(aio_parse_backend("mmap", &parsed));
+    free(expect);
+    remove(path);
+}
+
+static int64_t count_contacts(Db* db) {
+    sqlite3_stmt* stmt = NULL;
+    assert_true(sqlite3_prepare_v2(db->handle, "SELECT COUNT(*) FROM contacts;", -1, &stmt, NULL) == SQLITE_OK);
+    assert_true(sqlite3_step(stmt) == SQLITE_ROW);
+    int64_t count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Rows 1..rows with row bad_row missing its required fields.
+static void write_checkpoint_csv(const char* path, StreamCodec codec, int rows, int bad_row) {
+    FILE* f = fopen(path, "wb");
+    assert_non_null(f);
+    Stream* out = stream_open_writer(f, codec, 0);
+    assert_non_null(out);
+    char line[128];
+    int n = snprintf(line, sizeof(line), "Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\n");
+    assert_true(stream_write(out, line, (size_t)n));
+    for (int i = 1; i <= rows; ++i) {
+        n = i == bad_row ? snprintf(line, sizeof(line), "Broken %d\n", i)
+            : snprintf(line, sizeof(line), "Person %d,555-%04d,\"Street, %d\",p%d@example.com,%d,,ck-%d\n", i, i, i,
+                i, i % 50, i);
+        assert_true(stream_write(out, line, (size_t)n));
+    }
+    assert_true(stream_close(out));
+    fclose(f);
+}
+
+static void check_checkpointed_import(const char* path, StreamCodec codec) {
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    write_checkpoint_csv(path, codec, 20000, 15000);
+    int imported = -1, failed = -1;
+    char value[128];
+
+    // Strict stops at the bad row; the first 15000 / 3000 * 3000 rows stay committed.
+    assert_false(csv_import_contacts_checkpointed(&db, path, NULL, 1, 3000, 0, &imported, &failed));
+    assert_int_equal(imported, 12000);
+    assert_int_equal(failed, 0);
+    assert_int_equal(count_contacts(&db), 12000);
+    assert_true(db_get_setting(&db, "import_checkpoint", value, sizeof(value)));
+
+    // Resuming skips the committed rows and counts on from the stored totals.
+    assert_true(csv_import_contacts_checkpointed(&db, path, NULL, 0, 3000, 1, &imported, &failed));
+    assert_int_equal(imported, 19999);
+    assert_int_equal(failed, 1);
+    assert_int_equal(count_contacts(&db), 19999);
+    Contact c;
+    assert_true(contacts_get_by_id(&db, 12001, &c));
+    assert_string_equal(c.name, "Person 12001");
+    assert_false(db_get_setting(&db, "import_checkpoint", value, sizeof(value)));
+    assert_false(csv_import_contacts_checkpointed(&db, path, NULL, 0, 3000, 1, &imported, &failed));
+    db_close(&db);
+}
+
+static void test_csv_checkpointed_import(void** state) {
+    (void)state;
+    const char* path = "test_checkpoint.csv";
+    check_checkpointed_import(path, STREAM_CODEC_PLAIN);
+#ifdef HAVE_ZLIB
+    check_checkpointed_import(path, STREAM_CODEC_GZIP);
+#endif
+
+    // A checkpoint only resumes the file it was taken from.
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    write_checkpoint_csv(path, STREAM_CODEC_PLAIN, 100, 50);
+    int imported = 0, failed = 0;
+    assert_false(csv_import_contacts_checkpointed(&db, path, NULL, 1, 10, 0, &imported, &failed));
+    assert_int_equal(imported, 40);
+    write_checkpoint_csv(path, STREAM_CODEC_PLAIN, 100, 0);
+    assert_false(csv_import_contacts_checkpointed(&db, path, NULL, 0, 10, 1, &imported, &failed));
+    assert_int_equal(count_contacts(&db), 40);
+    db_close(&db);
+    remove(path);
+}
+
+// Imports text through a stream so the column map can be passed.
+static int import_mapped(Db* db, const char* text, const char* column_map, int* imported, int* failed) {
+    FILE* f = write_snapshot(text);
+    Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    int ok = csv_import_contacts_stream(db, in, column_map, 0, 0, imported, failed);
+    assert_true(stream_close(in));
+    return ok;
+}
+
+static void test_csv_mapped_import(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int imported = 0, failed = 0;
+    const char* wide =
+        "Notes,Full Name,Region,Mobile,Home Phone,e-mail,Due_Amount,Work Mail,Street,Partner Id\n"
+        "\"skip, \"\"me\"\"\nplease\",Ann Lee,north,555-1,555-9,ann@a.example,12.50,ann@work.example,1 Main St,P-1\n"
+        ",Ben Ode,south,555-2,,ben@b.example,0,ben@work.example,\"2 Side St, Apt 4\",P-2\n"
+        "x,Cut Short,east\n";
+
+    // Columns are found by name in any order; the short row lacks mapped required columns.
+    assert_true(import_mapped(&db, wide, NULL, &imported, &failed));
+    assert_int_equal(imported, 2);
+    assert_int_equal(failed, 1);
+    Contact c;
+    assert_true(contacts_get_by_id(&db, 1, &c));
+    assert_string_equal(c.name, "Ann Lee");
+    assert_string_equal(c.phone, "555-1");
+    assert_string_equal(c.email, "ann@a.example");
+    assert_true(c.due_amount == 12.5);
+    assert_string_equal(c.address, "");
+    assert_true(contacts_get_by_id(&db, 2, &c));
+    assert_string_equal(c.name, "Ben Ode");
+
+    // Explicit entries override the automatic match of a single field.
+    assert_true(import_mapped(&db, wide, "Email=Work Mail,Address=street,Phone=Home Phone,ExternalId=Partner Id",
+        &imported, &failed));
+    assert_int_equal(imported, 2);
+    assert_true(contacts_get_by_id(&db, 3, &c));
+    assert_string_equal(c.email, "ann@work.example");
+    assert_string_equal(c.address, "1 Main St");
+    assert_string_equal(c.phone, "555-9");
+    assert_string_equal(c.external_id, "P-1");
+    assert_true(contacts_get_by_id(&db, 4, &c));
+    assert_string_equal(c.address, "2 Side St, Apt 4");
+
+    assert_false(import_mapped(&db, wide, "Email=Fax", &imported, &failed));
+    assert_false(import_mapped(&db, wide, "Nickname=Region", &imported, &failed));
+    assert_false(import_mapped(&db, "A,B,C,D,E,F\nZed,1,,,0,\n", "Phone=B", &imported, &failed));
+
+    // Without a Name column the header is skipped and columns stay positional.
+    assert_true(import_mapped(&db, "A,B,C,D,E,F\nZed,1,,,0,\n", NULL, &imported, &failed));
+    assert_int_equal(imported, 1);
+    assert_true(contacts_get_by_id(&db, 5, &c));
+    assert_string_equal(c.name, "Zed");
+
+    // Sync reads the same mapping.
+    FILE* f = write_snapshot(wide);
+    Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    CsvSyncResult r;
+    assert_true(csv_sync_contacts_stream(&db, in, "ExternalId=Partner Id", 0, 0, 0, &r));
+    assert_true(stream_close(in));
+    assert_int_equal(r.unchanged + r.updated, 2);
+    assert_int_equal(r.failed, 1);
+    db_close(&db);
+}
+
+static int import_json(Db* db, const char* text, int strict, int dry_run, int* imported, int* failed) {
+    FILE* f = write_snapshot(text);
+    Stream* in = stream_open_reader(f, STREAM_CODEC_AUTO, 0);
+    assert_non_null(in);
+    int ok = csv_import_contacts_json(db, in, strict, dry_run, imported, failed);
+    assert_true(stream_close(in));
+    return ok;
+}
+
+static void test_json_import(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int imported = 0, failed = 0;
+    const char* lines =
+        "{\"name\":\"Ann \\\"A\\\" Lee\",\"phone\":\"555-1\",\"due_amount\":12.5,\"due_date\":\"2026-03-01\","
+        "\"tags\":[\"x\",{\"deep\":[1,2]}],\"external_id\":\"J-1\"}\n"
+        "\n"
+        "{\"email\":\"nobody@example.com\"}\n"
+        "{\"name\": \"Broken\", \"phone\": }\n"
+        "  {\"Full Name\":\"Caf\\u00e9 \\ud83d\\ude00\",\"address\":\"1 Main St\\nFloor 2\",\"email\":null}\n";
+
+    assert_true(import_json(&db, lines, 0, 1, &imported, &failed));
+    Contact c;
+    assert_false(contacts_get_by_id(&db, 1, &c));
+
+    // A row without a name and a malformed line fail on their own; the rest import.
+    assert_true(import_json(&db, lines, 0, 0, &imported, &failed));
+    assert_int_equal(imported, 2);
+    assert_int_equal(failed, 2);
+    assert_true(contacts_get_by_id(&db, 1, &c));
+    assert_string_equal(c.name, "Ann \"A\" Lee");
+    assert_string_equal(c.phone, "555-1");
+    assert_true(c.due_amount == 12.5);
+    assert_string_equal(c.due_date, "2026-03-01");
+    assert_string_equal(c.external_id, "J-1");
+    assert_true(contacts_get_by_id(&db, 2, &c));
+    assert_string_equal(c.name, "Caf\xc3\xa9 \xf0\x9f\x98\x80");
+    assert_string_equal(c.address, "1 Main St\nFloor 2");
+    assert_string_equal(c.email, "");
+
+    assert_false(import_json(&db, lines, 1, 0, &imported, &failed));
+    assert_false(contacts_get_by_id(&db, 3, &c));
+
+    // A top-level array is read object by object; a syntax error in it stops the import.
+    assert_true(import_json(&db, "[ {\"name\":\"Dee\",\"due_amount\":\"7\"},\n {\"name\":\"Eve\"} ]\n", 1, 0,
+        &imported, &failed));
+    assert_int_equal(imported, 2);
+    assert_true(contacts_get_by_id(&db, 3, &c));
+    assert_true(c.due_amount == 7.0);
+    assert_false(import_json(&db, "[{\"name\":\"Fay\"} {\"name\":\"Gus\"}]", 0, 0, &imported, &failed));
+    assert_false(import_json(&db, "[{\"name\":\"Fay\"}] x", 0, 0, &imported, &failed));
+    assert_false(contacts_get_by_id(&db, 5, &c));
+    assert_true(import_json(&db, "[]", 1, 0, &imported, &failed));
+    assert_int_equal(imported, 0);
+
+    // A line that ends inside its object fails alone instead of swallowing the next one.
+    assert_true(import_json(&db, "{\"name\":\"Hal\",\"phone\":\"1\"\n{\"name\":\"Ida\"}\n{\"name\":\"Jo\"}\n", 0, 0,
+        &imported, &failed));
+    assert_int_equal(imported, 2);
+    assert_int_equal(failed, 1);
+    assert_true(contacts_get_by_id(&db, 5, &c));
+    assert_string_equal(c.name, "Ida");
+    db_close(&db);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_csv_roundtrip),
+        cmocka_unit_test(test_csv_sync),
+        cmocka_unit_test(test_csv_sync_archived),
+        cmocka_unit_test(test_columnar_roundtrip),
+        cmocka_unit_test(test_csv_compressed),
+        cmocka_unit_test(test_csv_ledger_import),
+        cmocka_unit_test(test_csv_parallel_export),
+        cmocka_unit_test(test_stream_file_writer),
+        cmocka_unit_test(test_csv_checkpointed_import),
+        cmocka_unit_test(test_csv_mapped_import),
+        cmocka_unit_test(test_json_import),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
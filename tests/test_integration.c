@@ -4,12 +4,28 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "archive.h"
 #include "auth.h"
+#include "changes.h"
+#include "columnar.h"
 #include "contacts.h"
 #include "csv.h"
 #include "db.h"
+#include "engine.h"
+#include "ledger.h"
+#include "query.h"
+#include "shard.h"
+#include "sketch.h"
+#include "tags.h"
+#include "util.h"
 
 static void format_relative_date(char* buf, size_t len, int offset_days) {
     time_t when = time(NULL) + (time_t)offset_days * 86400;
@@ -87,9 +103,1090 @@ static void test_end_to_end(void** state) {
     db_close(&db);
 }
 
+static void test_record_cache(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    assert_true(contacts_cache_enable(&db, 4096));
+
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "Dana");
+    snprintf(c.phone, sizeof(c.phone), "123");
+    int64_t id = 0;
+    assert_true(contacts_add(&db, &c, &id));
+
+    Contact out;
+    assert_true(contacts_get_by_id(&db, id, &out));
+    assert_true(contacts_get_by_id(&db, id, &out));
+    assert_string_equal(out.phone, "123");
+
+    snprintf(out.phone, sizeof(out.phone), "456");
+    assert_true(contacts_update(&db, &out, NULL));
+    assert_true(contacts_get_by_id(&db, id, &out));
+    assert_string_equal(out.phone, "456");
+
+    ContactStats stats;
+    assert_true(contacts_stats(&db, &stats));
+    assert_int_equal(stats.cache.hits, 1);
+    assert_int_equal(stats.cache.misses, 2);
+    assert_int_equal(stats.cache.entries, 1);
+    assert_int_equal(stats.cache.max_bytes, 4096);
+
+    assert_true(contacts_delete_all(&db));
+    assert_false(contacts_get_by_id(&db, id, &out));
+
+    db_close(&db);
+}
+
+static int64_t add_named(Db* db, const char* name) {
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "%s", name);
+    int64_t id = 0;
+    assert_true(contacts_add(db, &c, &id));
+    return id;
+}
+
+typedef struct {
+    Contact rows[4];
+    int count;
+    int limit;
+} CollectRows;
+
+static int collect_rows(void* ctx, const ContactView* row) {
+    CollectRows* c = (CollectRows*)ctx;
+    assert_int_equal(row->name.len, strlen(row->name.ptr));
+    assert_int_equal(row->external_id.len, strlen(row->external_id.ptr));
+    contacts_view_copy(row, &c->rows[c->count]);
+    return ++c->count < c->limit;
+}
+
+static void test_foreach_views(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+
+    int64_t bob = add_named(&db, "bob");
+    int64_t alice = add_named(&db, "Alice");
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "Carol");
+    snprintf(c.phone, sizeof(c.phone), "000");
+    snprintf(c.external_id, sizeof(c.external_id), "ext-1");
+    c.due_amount = 42.5;
+    int64_t carol = 0;
+    assert_true(contacts_add(&db, &c, &carol));
+
+    CollectRows rows = { 0 };
+    rows.limit = 4;
+    assert_true(contacts_foreach(&db, NULL, CONTACT_SORT_NAME, collect_rows, &rows));
+    assert_int_equal(rows.count, 3);
+    assert_int_equal(rows.rows[0].id, alice);
+    assert_int_equal(rows.rows[1].id, bob);
+    assert_string_equal(rows.rows[2].external_id, "ext-1");
+    assert_true(rows.rows[2].due_amount == 42.5);
+
+    rows.count = 0;
+    assert_true(contacts_foreach(&db, NULL, CONTACT_SORT_PHONE, collect_rows, &rows));
+    assert_int_equal(rows.rows[2].id, carol);
+
+    // Returning 0 stops the walk without reporting an error.
+    rows.count = 0;
+    rows.limit = 1;
+    assert_true(contacts_foreach(&db, NULL, CONTACT_SORT_ID, collect_rows, &rows));
+    assert_int_equal(rows.count, 1);
+    assert_int_equal(rows.rows[0].id, bob);
+
+    ContactFilter filter = { "%o%", "due>10", NULL };
+    rows.count = 0;
+    rows.limit = 4;
+    assert_true(contacts_foreach(&db, &filter, CONTACT_SORT_STORED, collect_rows, &rows));
+    assert_int_equal(rows.count, 1);
+    assert_int_equal(rows.rows[0].id, carol);
+    filter.where = "due>>1";
+    assert_false(contacts_foreach(&db, &filter, CONTACT_SORT_STORED, collect_rows, &rows));
+    db_close(&db);
+}
+
+static void test_prefix_search(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+
+    int64_t john = add_named(&db, "John");
+    add_named(&db, "Mary");
+    int64_t joan = add_named(&db, "joan");
+
+    int64_t ids[8];
+    size_t count = 0;
+    assert_true(contacts_search_prefix(&db, "JO", ids, 8, &count));
+    assert_int_equal(count, 2);
+    assert_int_equal(ids[0], joan);
+    assert_int_equal(ids[1], john);
+
+    int64_t jo = add_named(&db, "Jo");
+    assert_true(contacts_search_prefix(&db, "jo", ids, 8, &count));
+    assert_int_equal(count, 3);
+    assert_int_equal(ids[0], jo);
+
+    Contact c;
+    assert_true(contacts_get_by_id(&db, john, &c));
+    snprintf(c.name, sizeof(c.name), "Zed");
+    assert_true(contacts_update(&db, &c, NULL));
+    assert_true(contacts_delete(&db, joan, NULL));
+    assert_true(contacts_search_prefix(&db, "jo", ids, 8, &count));
+    assert_int_equal(count, 1);
+    assert_true(contacts_search_prefix(&db, "z", ids, 8, &count));
+    assert_int_equal(count, 1);
+    assert_int_equal(ids[0], john);
+
+    db_close(&db);
+}
+
+static void test_fuzzy_search(void** state) {
+    (void)state;
+    assert_int_equal(fuzzy_edit_distance("kitten", 6, "sitting", 7), 3);
+    assert_int_equal(fuzzy_edit_distance("", 0, "abc", 3), 3);
+    const char* long_a = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz";
+    const char* long_b = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxz";
+    assert_int_equal(fuzzy_edit_distance(long_a, 78, long_b, 77), 1);
+
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int64_t john = add_named(&db, "John");
+    add_named(&db, "Mary");
+    int64_t joan = add_named(&db, "Joan");
+
+    FuzzyMatch matches[8];
+    size_t count = 0;
+    assert_true(contacts_search_fuzzy(&db, "jonh", 2, matches, 8, &count));
+    assert_int_equal(count, 2);
+    assert_int_equal(matches[0].id, john);
+    assert_int_equal(matches[0].distance, 2);
+    assert_int_equal(matches[1].id, joan);
+
+    int64_t jon = add_named(&db, "Jon");
+    assert_true(contacts_delete(&db, joan, NULL));
+    assert_true(contacts_search_fuzzy(&db, "jonh", 1, matches, 8, &count));
+    assert_int_equal(count, 1);
+    assert_int_equal(matches[0].id, jon);
+
+    db_close(&db);
+}
+
+static void test_where_filter(void** state) {
+    (void)state;
+    Query q;
+    assert_true(query_compile("due>1 AND email:*@acme.com", &q));
+    assert_string_equal(q.sql, "(due_amount > ? AND email LIKE ? ESCAPE '\\')");
+    assert_false(query_compile("salary>1", &q));
+    assert_non_null(strstr(q.error, "salary"));
+    assert_false(query_compile("due>abc", &q));
+    assert_false(query_compile("(name=a", &q));
+    assert_false(query_compile("due_date<2026-13-01", &q));
+
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "Ann");
+    snprintf(c.email, sizeof(c.email), "ann@acme.com");
+    c.due_amount = 50.0;
+    assert_true(contacts_add(&db, &c, NULL));
+    snprintf(c.name, sizeof(c.name), "Bob");
+    snprintf(c.email, sizeof(c.email), "bob@other.org");
+    c.due_amount = 75.0;
+    assert_true(contacts_add(&db, &c, NULL));
+    snprintf(c.name, sizeof(c.name), "Cy_1");
+    snprintf(c.email, sizeof(c.email), "cy@acme.com");
+    c.due_amount = 0.0;
+    assert_true(contacts_add(&db, &c, NULL));
+
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_list_where(&db, "due>1 AND email:*@ACME.com", 1, out));
+    assert_true(contacts_list_where(&db, "NOT (name=bob OR name:*_*)", 1, out));
+    assert_false(contacts_list_where(&db, "due>>1", 1, out));
+    rewind(out);
+    char line[1024];
+    assert_non_null(fgets(line, sizeof(line), out));
+    assert_non_null(strstr(line, "\"Ann\""));
+    assert_null(strstr(line, "\"Bob\""));
+    assert_non_null(fgets(line, sizeof(line), out));
+    assert_non_null(strstr(line, "\"Ann\""));
+    assert_null(strstr(line, "Cy_1"));
+    assert_null(fgets(line, sizeof(line), out));
+    fclose(out);
+
+    db_close(&db);
+}
+
+static void test_parallel_stats(void** state) {
+    (void)state;
+    // Workers open their own connections, so the database has to live on disk.
+    const char* path = "test_parallel_stats.db";
+    remove(path);
+    Db db;
+    assert_true(db_open(&db, path));
+    assert_true(db_init(&db));
+    assert_true(db_begin(&db));
+    for (int i = 0; i < 10000; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "%c%d", i % 7 ? 'A' + i % 26 : '#', i);
+        if (i % 3) {
+            snprintf(c.email, sizeof(c.email), "p%d@example.com", i);
+        }
+        c.due_amount = (i % 5) ? (i % 97) * 1.1 : 0.0;
+        if (i % 4) {
+            format_relative_date(c.due_date, sizeof(c.due_date), i % 41 - 20);
+        }
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    assert_true(db_commit(&db));
+
+    ContactStats serial;
+    ContactStats parallel;
+    assert_true(contacts_stats(&db, &serial));
+    for (int jobs = 2; jobs <= 5; ++jobs) {
+        assert_true(contacts_stats_parallel(&db, jobs, &parallel));
+        assert_int_equal(parallel.total_contacts, serial.total_contacts);
+        assert_int_equal(parallel.due_contacts, serial.due_contacts);
+        assert_int_equal(parallel.overdue_contacts, serial.overdue_contacts);
+        assert_int_equal(parallel.due_soon_contacts, serial.due_soon_contacts);
+        assert_int_equal(parallel.missing_email, serial.missing_email);
+        assert_true(parallel.total_due_amount == serial.total_due_amount);
+        assert_true(parallel.avg_due_amount == serial.avg_due_amount);
+        assert_true(parallel.min_due_amount == serial.min_due_amount);
+        assert_string_equal(parallel.min_due_name, serial.min_due_name);
+        assert_string_equal(parallel.max_due_name, serial.max_due_name);
+        assert_string_equal(parallel.earliest_due_date, serial.earliest_due_date);
+        assert_string_equal(parallel.latest_due_date, serial.latest_due_date);
+        assert_memory_equal(parallel.by_letter, serial.by_letter, sizeof(serial.by_letter));
+    }
+    // Ties on the minimum keep the lowest id, as the serial scan does.
+    assert_string_equal(serial.min_due_name, "B1");
+
+    db_close(&db);
+    remove(path);
+}
+
+static void test_aging_report(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    const int offsets[] = { -120, -75, -45, -30, 0, 3, 10, 40 };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Aging %zu", i);
+        c.due_amount = 10.0 * (double)(i + 1);
+        format_relative_date(c.due_date, sizeof(c.due_date), offsets[i]);
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    add_named(&db, "No date");
+
+    ContactAging aging;
+    contacts_aging_defaults(&aging);
+    assert_true(contacts_aging(&db, &aging));
+    const int expected[] = { 1, 1, 1, 2, 1, 1, 0, 0, 1 };
+    assert_int_equal(aging.bucket_count, 9);
+    for (size_t i = 0; i < aging.bucket_count; ++i) {
+        assert_int_equal(aging.buckets[i].count, expected[i]);
+    }
+    assert_true(aging.buckets[3].amount > 89.99 && aging.buckets[3].amount < 90.01);
+    assert_int_equal(aging.no_due_date, 1);
+
+    // Custom buckets: overlapping ranges go to the first match, unmatched days are not counted.
+    memset(&aging, 0, sizeof(aging));
+    assert_true(contacts_aging_add_bucket(&aging, "late", -100, -1));
+    assert_true(contacts_aging_add_bucket(&aging, "very late", -1000, -40));
+    assert_false(contacts_aging_add_bucket(&aging, "bad", 5, 1));
+    assert_true(contacts_aging(&db, &aging));
+    assert_int_equal(aging.buckets[0].count, 3);
+    assert_int_equal(aging.buckets[1].count, 1);
+
+    db_close(&db);
+}
+
+static int count_lines_with(FILE* f, const char* needle) {
+    char line[512];
+    int count = 0;
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        count += strstr(line, needle) != NULL;
+    }
+    return count;
+}
+
+static void test_upcoming(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    // Rows from before the due_day column existed are backfilled by db_init.
+    assert_true(sqlite3_exec(db.handle, "INSERT INTO contacts(name, due_date) VALUES('Legacy', '2000-01-02');",
+        NULL, NULL, NULL) == SQLITE_OK);
+    assert_true(sqlite3_exec(db.handle, "DROP INDEX idx_contacts_due_day; ALTER TABLE contacts DROP COLUMN due_day;"
+        "PRAGMA user_version = 0;",
+        NULL, NULL, NULL) == SQLITE_OK);
+    assert_true(db_init(&db));
+    int64_t next = 0;
+    assert_true(contacts_next_due_day(&db, 0, &next));
+    assert_int_equal(next, 10958);
+
+    int64_t today = util_local_epoch_day(time(NULL));
+    const int offsets[] = { 9, -2, 1, 30, 1, 0 };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Upcoming %d", offsets[i]);
+        format_relative_date(c.due_date, sizeof(c.due_date), offsets[i]);
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    Contact bad = { 0 };
+    snprintf(bad.name, sizeof(bad.name), "Undated");
+    assert_true(contacts_add(&db, &bad, NULL));
+
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_list_upcoming(&db, today, INT64_MAX, 3, 1, out));
+    assert_int_equal(count_lines_with(out, "Upcoming"), 1);
+    rewind(out);
+    char json[4096] = { 0 };
+    assert_true(fread(json, 1, sizeof(json) - 1, out) > 0);
+    char* first = strstr(json, "Upcoming 0");
+    char* second = strstr(json, "Upcoming 1");
+    assert_non_null(first);
+    assert_non_null(second);
+    assert_true(first < second);
+    assert_null(strstr(json, "Upcoming 9"));
+    fclose(out);
+
+    out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_list_upcoming(&db, today, today + 10, 0, 0, out));
+    assert_int_equal(count_lines_with(out, "Upcoming"), 4);
+    fclose(out);
+
+    assert_true(contacts_next_due_day(&db, today + 1, &next));
+    assert_int_equal(next, today + 9);
+    assert_false(contacts_next_due_day(&db, today + 30, &next));
+    db_close(&db);
+}
+
+static void read_output(FILE* out, char* buf, size_t len) {
+    rewind(out);
+    size_t n = fread(buf, 1, len - 1, out);
+    buf[n] = '\0';
+    fclose(out);
+}
+
+static void test_top_n(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    const struct {
+        const char* name;
+        double due;
+        const char* date;
+    } rows[] = {
+        { "Thirty", 100.0, "2026-01-01" },
+        { "OneDay", 500.0, "2026-01-30" },
+        { "Twenty", 50.0, "2026-01-11" },
+        { "Future", 900.0, "2026-03-01" },
+        { "Undated", 1000.0, "" },
+        { "Paid", 0.0, "2025-01-01" },
+        { "TieLow", 10.0, "2026-01-01" },
+        { "TieHigh", 10.0, "2026-01-01" },
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "%s", rows[i].name);
+        snprintf(c.due_date, sizeof(c.due_date), "%s", rows[i].date);
+        c.due_amount = rows[i].due;
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    int64_t today = 0;
+    assert_true(util_epoch_day("2026-01-31", &today));
+    char json[4096];
+
+    // Scores: Thirty 3000, Twenty 1000, OneDay 500, TieLow and TieHigh 300 each.
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_top_overdue(&db, today, 3, 1, out));
+    read_output(out, json, sizeof(json));
+    char* a = strstr(json, "Thirty");
+    char* b = strstr(json, "Twenty");
+    char* c = strstr(json, "OneDay");
+    assert_true(a && b && c && a < b && b < c);
+    assert_null(strstr(json, "Tie"));
+
+    out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_top_overdue(&db, today, 10, 0, out));
+    assert_int_equal(count_lines_with(out, "Name"), 5);
+    read_output(out, json, sizeof(json));
+    a = strstr(json, "TieLow");
+    b = strstr(json, "TieHigh");
+    assert_true(a && b && a < b);
+    assert_null(strstr(json, "Future"));
+    assert_null(strstr(json, "Paid"));
+
+    out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_top_debtors(&db, 2, 1, out));
+    read_output(out, json, sizeof(json));
+    a = strstr(json, "Undated");
+    b = strstr(json, "Future");
+    assert_true(a && b && a < b);
+    assert_null(strstr(json, "OneDay"));
+
+    out = tmpfile();
+    assert_non_null(out);
+    assert_true(contacts_top_overdue(&db, today, 0, 1, out));
+    read_output(out, json, sizeof(json));
+    assert_string_equal(json, "[]\n");
+    db_close(&db);
+}
+
+static int64_t day_of(const char* date) {
+    int64_t day = 0;
+    assert_true(util_epoch_day(date, &day));
+    return day;
+}
+
+static double balance_at(Db* db, int64_t id, const char* date) {
+    double balance = 0.0;
+    assert_true(ledger_balance_at(db, id, day_of(date), &balance));
+    return balance;
+}
+
+static void test_ledger(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int64_t alice = add_named(&db, "Alice");
+    int64_t bob = add_named(&db, "Bob");
+
+    assert_int_equal(ledger_month_of(day_of("2026-01-31")), 2026 * 12);
+    assert_int_equal(ledger_month_of(day_of("2026-02-01")), 2026 * 12 + 1);
+    assert_true(ledger_post(&db, alice, day_of("2026-01-05"), 100.0, "Invoice 1", NULL));
+    assert_true(ledger_post(&db, alice, day_of("2026-03-10"), 50.0, NULL, NULL));
+    assert_true(ledger_post(&db, bob, day_of("2026-01-20"), 7.0, NULL, NULL));
+    assert_false(ledger_post(&db, alice, day_of("2026-01-05"), 0.0, NULL, NULL));
+    assert_false(ledger_post(&db, 999, day_of("2026-01-05"), 1.0, NULL, NULL));
+    // Back-dated into a month that already has a later checkpoint.
+    assert_true(ledger_post(&db, alice, day_of("2026-02-01"), -30.0, "paid", NULL));
+
+    double balance = 0.0;
+    assert_true(ledger_balance(&db, alice, &balance));
+    assert_true(balance == 120.0);
+    assert_true(balance_at(&db, alice, "2026-01-04") == 0.0);
+    assert_true(balance_at(&db, alice, "2026-01-05") == 100.0);
+    assert_true(balance_at(&db, alice, "2026-02-28") == 70.0);
+    assert_true(balance_at(&db, alice, "2026-03-09") == 70.0);
+    assert_true(balance_at(&db, alice, "2027-01-01") == 120.0);
+    assert_true(balance_at(&db, 0, "2026-01-31") == 107.0);
+    assert_true(balance_at(&db, 0, "2026-12-31") == 127.0);
+    assert_false(ledger_balance_at(&db, 999, day_of("2026-01-01"), &balance));
+
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    assert_true(ledger_print(&db, alice, 0, out));
+    assert_int_equal(count_lines_with(out, "2026-"), 3);
+    char text[1024];
+    read_output(out, text, sizeof(text));
+    assert_non_null(strstr(text, "-30.00          70.00  paid"));
+
+    // A contact with entries cannot be deleted, so past book balances never change.
+    assert_false(contacts_delete(&db, bob, NULL));
+    Contact kept;
+    assert_true(contacts_get_by_id(&db, bob, &kept));
+    assert_true(balance_at(&db, 0, "2026-12-31") == 127.0);
+    assert_true(balance_at(&db, 0, "2026-01-31") == 107.0);
+    int64_t carol = add_named(&db, "Carol");
+    assert_true(contacts_delete(&db, carol, NULL));
+    assert_true(balance_at(&db, 0, "2026-12-31") == 127.0);
+    // --delete-all is the one way to drop ledger history.
+    assert_true(contacts_delete_all(&db));
+    assert_true(balance_at(&db, 0, "2026-12-31") == 0.0);
+    db_close(&db);
+}
+
+static int sketch_has(const ContactSketch* s, int64_t id) {
+    for (size_t i = 0; i < s->sample_count; ++i) {
+        if (s->sample[i] == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void test_sketches(void** state) {
+    (void)state;
+    const char* path = "test_sketches.db";
+    remove(path);
+    Db db;
+    assert_true(db_open(&db, path));
+    assert_true(db_init(&db));
+    for (int i = 1; i <= 20; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Person %d", i);
+        snprintf(c.email, sizeof(c.email), "p%d@Domain%d.example", i, i % 4);
+        snprintf(c.phone, sizeof(c.phone), i % 2 ? "(212) 555-01%02d" : "1-415-555-01%02d", i);
+        c.due_amount = i * 10.0;
+        assert_true(contacts_add(&db, &c, NULL));
+    }
+    ContactSketch* sk = malloc(sizeof(*sk));
+    assert_non_null(sk);
+    SketchStats stats;
+    assert_true(sketch_load(&db, sk));
+    sketch_summarize(sk, &stats);
+    assert_int_equal(stats.seq, 20);
+    assert_int_equal(stats.contacts, 20);
+    assert_int_equal(stats.email_domains, 4);
+    assert_int_equal(stats.area_codes, 2);
+    assert_int_equal(stats.amounts, 20);
+    assert_int_equal(stats.sample_count, 20);
+    assert_true(stats.p50 > 98.0 && stats.p50 < 102.0);
+
+    // An edited amount moves instead of being counted twice.
+    Contact c;
+    assert_true(contacts_get_by_id(&db, 1, &c));
+    c.due_amount = 5000.0;
+    assert_true(contacts_update(&db, &c, NULL));
+    assert_true(sketch_load(&db, sk));
+    sketch_summarize(sk, &stats);
+    assert_int_equal(stats.amounts, 20);
+    assert_int_equal(sk->stale, 0);
+    double top = ddsketch_quantile(&sk->amounts, 1.0);
+    assert_true(top > 4950.0 && top < 5050.0);
+    assert_true(stats.p50 > 108.0 && stats.p50 < 112.0);
+
+    // A changed domain stays counted until a rebuild.
+    assert_true(contacts_get_by_id(&db, 3, &c));
+    snprintf(c.email, sizeof(c.email), "three@elsewhere.example");
+    assert_true(contacts_update(&db, &c, NULL));
+    assert_true(sketch_load(&db, sk));
+    sketch_summarize(sk, &stats);
+    assert_int_equal(stats.email_domains, 5);
+    assert_int_equal(sk->stale, 1);
+
+    // The second removal crosses a tenth of the book and the rebuild forgets it.
+    assert_true(contacts_delete(&db, 3, NULL));
+    assert_true(sketch_load(&db, sk));
+    sketch_summarize(sk, &stats);
+    assert_int_equal(stats.contacts, 19);
+    assert_int_equal(stats.email_domains, 4);
+    assert_int_equal(sk->stale, 0);
+
+    assert_true(contacts_delete(&db, 2, NULL));
+    assert_true(sketch_load(&db, sk));
+    sketch_summarize(sk, &stats);
+    assert_int_equal(stats.contacts, 18);
+    assert_int_equal(stats.amounts, 18);
+    assert_int_equal(sk->stale, 1);
+    assert_int_equal(stats.seq, 24);
+    assert_false(sketch_has(sk, 2));
+
+    // Single-row writes store the sketch in their own transaction, so a read-only poller replays nothing.
+    assert_true(contacts_get_by_id(&db, 4, &c));
+    c.due_amount = 1.0;
+    assert_true(contacts_update(&db, &c, NULL));
+    sqlite3_stmt* stored = NULL;
+    assert_true(sqlite3_prepare_v2(db.handle, "SELECT seq FROM sketches WHERE name = 'contacts';", -1, &stored, NULL) ==
+        SQLITE_OK);
+    assert_true(sqlite3_step(stored) == SQLITE_ROW);
+    assert_int_equal(sqlite3_column_int64(stored, 0), 25);
+    sqlite3_finalize(stored);
+
+    // Writes inside an open transaction are caught up on the next refresh.
+    assert_true(db_begin(&db));
+    int64_t id = add_named(&db, "Late");
+    assert_true(sketch_load(&db, sk));
+    assert_int_equal(sk->contacts, 19);
+    assert_true(db_commit(&db));
+    db_close(&db);
+
+    assert_true(db_open_for_read(&db, path));
+    assert_true(db.read_only);
+    assert_true(sketch_load(&db, sk));
+    assert_int_equal(sk->contacts, 19);
+    assert_int_equal(sk->seq, 26);
+    assert_true(sketch_has(sk, id));
+    db_close(&db);
+    free(sk);
+    remove(path);
+}
+
+static void test_change_log(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int64_t id = add_named(&db, "Eve");
+    Contact c;
+    assert_true(contacts_get_by_id(&db, id, &c));
+    snprintf(c.phone, sizeof(c.phone), "555");
+    assert_true(contacts_update(&db, &c, NULL));
+    // Derived columns are not part of the row image.
+    assert_true(sqlite3_exec(db.handle, "UPDATE contacts SET due_day = 1;", NULL, NULL, NULL) == SQLITE_OK);
+
+    FILE* csv = tmpfile();
+    assert_non_null(csv);
+    fputs("Name,Phone,Address,Email,DueAmount,DueDate,ExternalId\nFrank,1,,,2.5,,F-1\nGina,2,,,0,,\n", csv);
+    rewind(csv);
+    int imported = 0, failed = 0;
+    assert_true(csv_import_contacts(&db, csv, 1, 0, &imported, &failed));
+    assert_int_equal(imported, 2);
+    fclose(csv);
+    assert_true(contacts_delete(&db, id, NULL));
+
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    int64_t last = 0;
+    assert_true(changes_print_since(&db, 0, CHANGES_FORMAT_NDJSON, out, &last));
+    assert_int_equal(last, 5);
+    assert_int_equal(count_lines_with(out, "\"seq\""), 5);
+    assert_int_equal(count_lines_with(out, "\"op\":\"insert\""), 3);
+    assert_int_equal(count_lines_with(out, "\"op\":\"update\",\"id\":1,"), 1);
+    assert_int_equal(count_lines_with(out, "\"seq\":5,\"op\":\"delete\",\"id\":1,"), 1);
+    assert_int_equal(count_lines_with(out, "\"external_id\":\"F-1\""), 1);
+    fclose(out);
+
+    // Consumers resume from the last sequence they saw; delete-all logs one entry per row.
+    assert_true(contacts_delete_all(&db));
+    out = tmpfile();
+    assert_non_null(out);
+    assert_true(changes_print_since(&db, last, CHANGES_FORMAT_NDJSON, out, &last));
+    assert_int_equal(last, 7);
+    assert_int_equal(count_lines_with(out, "\"op\":\"delete\""), 2);
+    fclose(out);
+    db_close(&db);
+}
+
+static int user_version(Db* db) {
+    sqlite3_stmt* stmt = NULL;
+    assert_true(sqlite3_prepare_v2(db->handle, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK);
+    assert_true(sqlite3_step(stmt) == SQLITE_ROW);
+    int version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static void test_tags(void** state) {
+    (void)state;
+    const char* path = "test_tags.db";
+    remove(path);
+    Db db;
+    assert_true(db_open(&db, path));
+    assert_true(db_init(&db));
+    int64_t alice = add_named(&db, "Alice");
+    int64_t bob = add_named(&db, "Bob");
+    int64_t carol = add_named(&db, "Carol");
+
+    int changed = 0;
+    ContactFilter by_name = { "%o%", NULL, NULL };
+    assert_true(tags_update(&db, "lapsed", 1, &by_name, &changed));
+    assert_int_equal(changed, 2);
+    ContactFilter everyone = { NULL, "due>=0", NULL };
+    assert_true(tags_update(&db, "vip", 1, &everyone, &changed));
+    assert_int_equal(changed, 3);
+    assert_false(tags_update(&db, "bad tag", 1, &everyone, &changed));
+
+    TagsOp ops[] = { { TAGS_OR, "vip" }, { TAGS_NOT, "lapsed" } };
+    Roaring* selected = tags_select(&db, ops, 2);
+    assert_non_null(selected);
+    assert_int_equal(roaring_cardinality(selected), 1);
+    assert_true(roaring_contains(selected, (uint32_t)alice));
+    roaring_destroy(selected);
+    TagsOp unknown[] = { { TAGS_AND, "nope" } };
+    assert_null(tags_select(&db, unknown, 1));
+
+    // Filtered walks and stats only see members.
+    TagsOp lapsed[] = { { TAGS_AND, "lapsed" } };
+    selected = tags_select(&db, lapsed, 1);
+    assert_non_null(selected);
+    ContactFilter filter = { NULL, NULL, selected };
+    CollectRows rows = { 0 };
+    rows.limit = 4;
+    assert_true(contacts_foreach(&db, &filter, CONTACT_SORT_NAME, collect_rows, &rows));
+    assert_int_equal(rows.count, 2);
+    assert_int_equal(rows.rows[0].id, bob);
+    assert_int_equal(rows.rows[1].id, carol);
+    ContactStats stats;
+    assert_true(contacts_stats_subset(&db, selected, &stats));
+    assert_int_equal(stats.total_contacts, 2);
+    roaring_destroy(selected);
+
+    // Deleting a contact drops its memberships; the stale bitmap is rebuilt on the next read.
+    const Roaring* members = NULL;
+    assert_true(tags_get(&db, "vip", &members));
+    assert_int_equal(roaring_cardinality(members), 3);
+    assert_true(contacts_delete(&db, bob, NULL));
+    assert_true(tags_get(&db, "vip", &members));
+    assert_int_equal(roaring_cardinality(members), 2);
+    assert_false(roaring_contains(members, (uint32_t)bob));
+
+    // Removing the last member deletes the tag.
+    ContactFilter carol_only = { "Carol", NULL, NULL };
+    assert_true(tags_update(&db, "lapsed", 0, &carol_only, &changed));
+    assert_int_equal(changed, 1);
+    assert_false(tags_get(&db, "lapsed", &members));
+    db_close(&db);
+
+    assert_true(db_open_for_read(&db, path));
+    assert_true(db.read_only);
+    assert_true(tags_get(&db, "vip", &members));
+    assert_int_equal(roaring_cardinality(members), 2);
+    assert_true(roaring_contains(members, (uint32_t)carol));
+    db_close(&db);
+    remove(path);
+}
+
+static int64_t count_sql(Db* db, const char* sql) {
+    sqlite3_stmt* stmt = NULL;
+    assert_true(sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) == SQLITE_OK);
+    assert_true(sqlite3_step(stmt) == SQLITE_ROW);
+    int64_t count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static void test_archive(void** state) {
+    (void)state;
+    Db db;
+    assert_true(db_open(&db, ":memory:"));
+    assert_true(db_init(&db));
+    int64_t ann = add_named(&db, "Ann");
+    Contact ben = { 0 };
+    snprintf(ben.name, sizeof(ben.name), "Ben");
+    ben.due_amount = 50.0;
+    assert_true(contacts_add(&db, &ben, NULL));
+    int64_t cid = add_named(&db, "Cid");
+    int64_t dee = add_named(&db, "Dee");
+    assert_true(ledger_post(&db, dee, day_of("2001-01-01"), 10.0, NULL, NULL));
+    assert_true(ledger_post(&db, dee, day_of("2001-01-02"), -10.0, NULL, NULL));
+    int changed = 0;
+    ContactFilter by_name = { "Cid", NULL, NULL };
+    assert_true(tags_update(&db, "old", 1, &by_name, &changed));
+    char sql[128];
+    snprintf(sql, sizeof(sql), "UPDATE contact_changes SET changed_at = '2001-01-01T00:00:00.000Z' WHERE contact_id <> %lld;",
+        (long long)ann);
+    assert_true(sqlite3_exec(db.handle, sql, NULL, NULL, NULL) == SQLITE_OK);
+
+    // Ann changed recently, Ben owes money and Dee has ledger history, so only Cid is cold.
+    int64_t moved = 0;
+    assert_true(archive_contacts(&db, 365, 1, 1, &moved));
+    assert_int_equal(moved, 1);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contacts_archive;"), 0);
+    assert_true(archive_contacts(&db, 365, 1, 0, &moved));
+    assert_int_equal(moved, 1);
+    assert_true(archive_contacts(&db, 365, 1, 0, &moved));
+    assert_int_equal(moved, 0);
+    // Moving a row between tiers is not a user delete, and the sketch follows the hot table.
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'delete';"), 0);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'archive';"), 1);
+    ContactSketch* sk = malloc(sizeof(*sk));
+    assert_non_null(sk);
+    assert_true(sketch_load(&db, sk));
+    assert_int_equal(sk->contacts, 3);
+    Contact c;
+    assert_false(contacts_get_by_id(&db, cid, &c));
+    const Roaring* members = NULL;
+    assert_true(tags_get(&db, "old", &members));
+    assert_int_equal(roaring_cardinality(members), 0);
+
+    ContactStats stats;
+    assert_true(contacts_stats(&db, &stats));
+    assert_int_equal(stats.total_contacts, 3);
+    CollectRows rows = { 0 };
+    rows.limit = 4;
+    assert_true(contacts_foreach(&db, &by_name, CONTACT_SORT_NAME, collect_rows, &rows));
+    assert_int_equal(rows.count, 0);
+    db.include_archived = 1;
+    assert_true(contacts_stats(&db, &stats));
+    assert_int_equal(stats.total_contacts, 4);
+    assert_true(contacts_foreach(&db, &by_name, CONTACT_SORT_NAME, collect_rows, &rows));
+    assert_int_equal(rows.count, 1);
+    assert_int_equal(rows.rows[0].id, cid);
+    // A snapshot refuses to leave the archive tier out, and carries it when asked to.
+    FILE* snapshot = tmpfile();
+    assert_non_null(snapshot);
+    assert_true(columnar_write_contacts(&db, snapshot));
+    rewind(snapshot);
+    Db copy;
+    assert_true(db_open(&copy, ":memory:"));
+    assert_true(db_init(&copy));
+    int imported = 0;
+    assert_true(columnar_import_contacts(&copy, snapshot, 0, &imported));
+    assert_int_equal(imported, 4);
+    db_close(&copy);
+    fclose(snapshot);
+    db.include_archived = 0;
+    snapshot = tmpfile();
+    assert_non_null(snapshot);
+    assert_false(columnar_write_contacts(&db, snapshot));
+    fclose(snapshot);
+
+    assert_true(archive_restore(&db, cid));
+    assert_false(archive_restore(&db, cid));
+    assert_true(contacts_get_by_id(&db, cid, &c));
+    assert_true(tags_get(&db, "old", &members));
+    assert_true(roaring_contains(members, (uint32_t)cid));
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'insert';"), 4);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'restore';"), 1);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'delete';"), 0);
+    assert_true(sketch_load(&db, sk));
+    assert_int_equal(sk->contacts, 4);
+
+    // Deleting everything empties both tiers.
+    assert_true(sqlite3_exec(db.handle, "UPDATE contact_changes SET changed_at = '2001-01-01T00:00:00.000Z';", NULL,
+        NULL, NULL) == SQLITE_OK);
+    assert_true(archive_contacts(&db, 365, 0, 0, &moved));
+    assert_int_equal(moved, 2);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_tags_archive;"), 1);
+    assert_true(contacts_delete_all(&db));
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contacts_archive;"), 0);
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_tags_archive;"), 0);
+    // Both tiers' rows are logged as deletes; the archived ones no longer count against the sketch.
+    assert_int_equal(count_sql(&db, "SELECT COUNT(*) FROM contact_changes WHERE op = 'delete';"), 4);
+    assert_true(sketch_load(&db, sk));
+    assert_int_equal(sk->contacts, 0);
+    free(sk);
+    db_close(&db);
+}
+
+static void test_read_only_open(void** state) {
+    (void)state;
+    const char* path = "test_read_only.db";
+    remove(path);
+    // A missing file is created and initialised by the fallback.
+    Db db;
+    assert_true(db_open_for_read(&db, path));
+    assert_false(db.read_only);
+    assert_int_equal(user_version(&db), DB_SCHEMA_VERSION);
+    add_named(&db, "Reader");
+    db_close(&db);
+
+    assert_true(db_open_for_read(&db, path));
+    assert_true(db.read_only);
+    Contact c;
+    assert_true(contacts_get_by_id(&db, 1, &c));
+    assert_string_equal(c.name, "Reader");
+    assert_false(contacts_delete(&db, 1, NULL));
+    db_close(&db);
+
+    // An older schema version takes the writable path and is brought up to date.
+    assert_true(db_open(&db, path));
+    assert_true(sqlite3_exec(db.handle, "PRAGMA user_version = 0;", NULL, NULL, NULL) == SQLITE_OK);
+    db_close(&db);
+    assert_true(db_open_for_read(&db, path));
+    assert_false(db.read_only);
+    assert_int_equal(user_version(&db), DB_SCHEMA_VERSION);
+    db_close(&db);
+    remove(path);
+}
+
+static void test_tenant_shards(void** state) {
+    (void)state;
+    const char* paths[] = { "test_shard_main.db", "test_shard_b.db", "test_shard_a.db" };
+    for (int i = 0; i < 3; ++i) {
+        remove(paths[i]);
+    }
+    Db db;
+    assert_true(db_open(&db, paths[0]));
+    assert_true(db_init(&db));
+    assert_true(shard_register(&db, "beta", paths[1]));
+    assert_true(shard_register(&db, "alpha", paths[2]));
+    assert_false(shard_register(&db, "alpha", paths[1]));
+    assert_false(shard_register(&db, "", paths[1]));
+
+    // Writes go to the routed tenant only.
+    const char* beta_names[] = { "carol", "Bob", "alice" };
+    assert_true(shard_open(&db, "beta"));
+    assert_int_equal(db.shard_count, 1);
+    for (int i = 0; i < 3; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "%s", beta_names[i]);
+        c.due_amount = 10.0 * (i + 1);
+        assert_true(contacts_add(&db.shards[0].db, &c, NULL));
+    }
+    db_close(&db);
+    assert_true(db_open(&db, paths[0]));
+    assert_true(shard_open(&db, "alpha"));
+    add_named(&db.shards[0].db, "Bob");
+    add_named(&db.shards[0].db, "dave");
+    db_close(&db);
+    assert_true(db_open(&db, paths[0]));
+    assert_false(shard_open(&db, "gamma"));
+    db_close(&db);
+
+    assert_true(db_open(&db, paths[0]));
+    assert_true(shard_open(&db, NULL));
+    assert_int_equal(db.shard_count, 2);
+    assert_string_equal(db.shards[0].tenant, "alpha");
+    FILE* out = tmpfile();
+    assert_non_null(out);
+    assert_true(shard_list(&db, NULL, 1, out));
+    rewind(out);
+    char json[2048] = { 0 };
+    assert_true(fread(json, 1, sizeof(json) - 1, out) > 0);
+    fclose(out);
+    // Merged by name without case, then tenant.
+    const char* order[] = { "\"alice\"", "\"alpha\",\"name\":\"Bob\"", "\"beta\",\"name\":\"Bob\"", "\"carol\"", "\"dave\"" };
+    const char* pos = json;
+    for (int i = 0; i < 5; ++i) {
+        const char* hit = strstr(pos, order[i]);
+        assert_non_null(hit);
+        pos = hit;
+    }
+
+    ContactStats stats;
+    assert_true(shard_stats(&db, 1, &stats));
+    assert_int_equal(stats.total_contacts, 5);
+    assert_int_equal(stats.due_contacts, 3);
+    assert_true(stats.total_due_amount > 59.99 && stats.total_due_amount < 60.01);
+    assert_string_equal(stats.max_due_name, "alice");
+    assert_int_equal(stats.by_letter[1], 2);
+    db_close(&db);
+    for (int i = 0; i < 3; ++i) {
+        remove(paths[i]);
+    }
+}
+
+typedef struct {
+    Engine* engine;
+    int base;
+    int failures;
+} EngineWorker;
+
+static void* engine_worker(void* arg) {
+    EngineWorker* w = (EngineWorker*)arg;
+    for (int i = 0; i < 50; ++i) {
+        Contact c = { 0 };
+        snprintf(c.name, sizeof(c.name), "Worker %d", w->base + i);
+        c.due_amount = 1.0;
+        int64_t id = 0;
+        Contact back;
+        if (engine_add(w->engine, &c, &id, NULL) != ENGINE_OK || engine_get(w->engine, id, &back, NULL) != ENGINE_OK ||
+            strcmp(back.name, c.name) != 0) {
+            w->failures++;
+        }
+    }
+    return NULL;
+}
+
+static int count_rows(void* ctx, const ContactView* row) {
+    (void)row;
+    int* count = (int*)ctx;
+    return ++*count < 120;
+}
+
+static void test_engine_api(void** state) {
+    (void)state;
+    const char* path = "test_engine.db";
+    remove(path);
+    Db db;
+    assert_true(db_open(&db, path));
+    assert_true(db_init(&db));
+    EngineError err;
+    Engine* engine = NULL;
+    assert_int_equal(engine_open(path, "secret", 4, &engine, &err), ENGINE_AUTH);
+    assert_string_equal(err.message, "Password not set.");
+    assert_true(auth_set_password(&db, "secret"));
+    db_close(&db);
+    assert_int_equal(engine_open(path, "wrong", 4, &engine, &err), ENGINE_AUTH);
+    assert_null(engine);
+    assert_int_equal(engine_open(path, "secret", 4, &engine, &err), ENGINE_OK);
+    assert_non_null(engine);
+
+    // Each thread borrows its own pooled connection.
+    EngineWorker workers[4];
+    for (int t = 0; t < 4; ++t) {
+        workers[t].engine = engine;
+        workers[t].base = t * 100;
+        workers[t].failures = 0;
+    }
+#ifdef HAVE_PTHREADS
+    pthread_t threads[4];
+    for (int t = 0; t < 4; ++t) {
+        assert_int_equal(pthread_create(&threads[t], NULL, engine_worker, &workers[t]), 0);
+    }
+    for (int t = 0; t < 4; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+#else
+    for (int t = 0; t < 4; ++t) {
+        engine_worker(&workers[t]);
+    }
+#endif
+    for (int t = 0; t < 4; ++t) {
+        assert_int_equal(workers[t].failures, 0);
+    }
+
+    int count = 0;
+    assert_int_equal(engine_list(engine, count_rows, &count, &err), ENGINE_OK);
+    assert_int_equal(count, 120);
+    count = 0;
+    assert_int_equal(engine_search(engine, "Worker 1%", count_rows, &count, &err), ENGINE_OK);
+    assert_int_equal(count, 61);
+    count = 0;
+    assert_int_equal(engine_where(engine, "name:\"Worker 3??\"", count_rows, &count, &err), ENGINE_OK);
+    assert_int_equal(count, 50);
+    assert_int_equal(engine_where(engine, "due>>1", count_rows, &count, &err), ENGINE_INVALID);
+    ContactStats stats;
+    assert_int_equal(engine_stats(engine, &stats, &err), ENGINE_OK);
+    assert_int_equal(stats.total_contacts, 200);
+
+    Contact c = { 0 };
+    snprintf(c.name, sizeof(c.name), "Bad date");
+    snprintf(c.due_date, sizeof(c.due_date), "2024-13-01");
+    assert_int_equal(engine_add(engine, &c, NULL, &err), ENGINE_INVALID);
+    assert_string_equal(err.message, "Invalid due date format. Use YYYY-MM-DD.");
+    assert_int_equal(engine_get(engine, 9999, &c, &err), ENGINE_NOT_FOUND);
+    assert_int_equal(engine_delete(engine, 9999, &err), ENGINE_NOT_FOUND);
+    c.id = 9999;
+    c.due_date[0] = '\0';
+    assert_int_equal(engine_update(engine, &c, &err), ENGINE_NOT_FOUND);
+    assert_int_equal(engine_delete(engine, 1, &err), ENGINE_OK);
+    assert_int_equal(err.code, ENGINE_OK);
+    assert_int_equal(engine_get(engine, 1, &c, NULL), ENGINE_NOT_FOUND);
+    // A write from another connection leaves change rows the sketch has not absorbed; the status
+    // must come from the mutation itself, not from whatever ran last on the connection.
+    Db other;
+    assert_true(db_open(&other, path));
+    assert_true(contacts_add(&other, &c, NULL));
+    db_close(&other);
+    assert_int_equal(engine_delete(engine, 9999, &err), ENGINE_NOT_FOUND);
+    assert_int_equal(engine_update(engine, &c, &err), ENGINE_NOT_FOUND);
+    engine_close(engine);
+    remove(path);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_end_to_end),
+        cmocka_unit_test(test_record_cache),
+        cmocka_unit_test(test_foreach_views),
+        cmocka_unit_test(test_prefix_search),
+        cmocka_unit_test(test_fuzzy_search),
+        cmocka_unit_test(test_where_filter),
+        cmocka_unit_test(test_parallel_stats),
+        cmocka_unit_test(test_aging_report),
+        cmocka_unit_test(test_upcoming),
+        cmocka_unit_test(test_top_n),
+        cmocka_unit_test(test_ledger),
+        cmocka_unit_test(test_sketches),
+        cmocka_unit_test(test_change_log),
+        cmocka_unit_test(test_tags),
+        cmocka_unit_test(test_archive),
+        cmocka_unit_test(test_read_only_open),
+        cmocka_unit_test(test_tenant_shards),
+        cmocka_unit_test(test_engine_api),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
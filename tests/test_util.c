@@ -3,6 +3,10 @@
 #include <stdarg.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "roaring.h"
+#include "sketch.h"
 #include "util.h"
 
 static void test_parse_long(void** state) {
@@ -21,10 +25,141 @@ static void test_parse_double(void** state) {
     assert_false(util_parse_double("bad", &v, 0, 100));
 }
 
+static void test_crc32(void** state) {
+    (void)state;
+    assert_int_equal(util_crc32(0, "123456789", 9), 0xCBF43926u);
+    uint32_t crc = util_crc32(0, "1234", 4);
+    assert_int_equal(util_crc32(crc, "56789", 5), 0xCBF43926u);
+}
+
+static void test_epoch_day(void** state) {
+    (void)state;
+    int64_t day = 0;
+    assert_true(util_epoch_day("1970-01-01", &day));
+    assert_int_equal(day, 0);
+    assert_true(util_epoch_day("2000-03-01", &day));
+    assert_int_equal(day, 11017);
+    assert_true(util_epoch_day("2024-02-31", &day));
+    int64_t march = 0;
+    assert_true(util_epoch_day("2024-03-02", &march));
+    assert_int_equal(day, march);
+    assert_false(util_epoch_day("2024-13-01", &day));
+    assert_false(util_epoch_day("soon", &day));
+}
+
+static void test_roaring(void** state) {
+    (void)state;
+    Roaring* a = roaring_create();
+    Roaring* b = roaring_create();
+    assert_non_null(a);
+    // 5000 members in one chunk push it from an array to a bitset.
+    for (uint32_t v = 0; v < 10000; v += 2) {
+        assert_true(roaring_add(a, v));
+    }
+    assert_true(roaring_add(a, 70000));
+    assert_true(roaring_add(a, 4000000000u));
+    assert_int_equal(roaring_cardinality(a), 5002);
+    assert_int_equal(roaring_chunk_count(a), 3);
+    assert_int_equal(roaring_chunk_key(a, 1), 1);
+    assert_true(roaring_contains(a, 9998));
+    assert_false(roaring_contains(a, 9999));
+    assert_true(roaring_remove(a, 4000000000u));
+    assert_false(roaring_contains(a, 4000000000u));
+
+    for (uint32_t v = 0; v < 10000; v += 3) {
+        assert_true(roaring_add(b, v));
+    }
+    Roaring* both = roaring_copy(a);
+    assert_true(roaring_and(both, b));
+    assert_int_equal(roaring_cardinality(both), 1667);
+    assert_true(roaring_contains(both, 6));
+    assert_false(roaring_contains(both, 4));
+    Roaring* only_a = roaring_copy(a);
+    assert_true(roaring_andnot(only_a, b));
+    assert_int_equal(roaring_cardinality(only_a), 5001 - 1667);
+    assert_true(roaring_or(only_a, both));
+    assert_int_equal(roaring_cardinality(only_a), 5001);
+
+    size_t len = roaring_serialized_size(a);
+    unsigned char* buf = malloc(len);
+    assert_non_null(buf);
+    roaring_serialize(a, buf);
+    Roaring* back = roaring_deserialize(buf, len);
+    assert_non_null(back);
+    assert_int_equal(roaring_cardinality(back), 5001);
+    assert_true(roaring_contains(back, 70000));
+    assert_null(roaring_deserialize(buf, len - 1));
+    buf[0] = 'X';
+    assert_null(roaring_deserialize(buf, len));
+    free(buf);
+
+    roaring_destroy(back);
+    roaring_destroy(only_a);
+    roaring_destroy(both);
+    roaring_destroy(b);
+    roaring_destroy(a);
+}
+
+static void test_sketches(void** state) {
+    (void)state;
+    Hll* h = calloc(1, sizeof(Hll));
+    Hll* other = calloc(1, sizeof(Hll));
+    assert_non_null(h);
+    assert_non_null(other);
+    assert_int_equal(hll_estimate(h), 0);
+    for (int v = 1; v <= 10000; ++v) {
+        char key[32];
+        int len = snprintf(key, sizeof(key), "user%d.example", v);
+        uint64_t hash = util_fnv1a64(UTIL_FNV64_INIT, key, (size_t)len);
+        hll_add(h, hash);
+        hll_add(h, hash);
+        if (v > 5000) {
+            hll_add(other, hash);
+        }
+    }
+    uint64_t estimate = hll_estimate(h);
+    assert_true(estimate > 9500 && estimate < 10500);
+    hll_merge(other, h);
+    assert_int_equal(hll_estimate(other), estimate);
+
+    DdSketch* a = calloc(1, sizeof(DdSketch));
+    DdSketch* b = calloc(1, sizeof(DdSketch));
+    assert_non_null(a);
+    assert_non_null(b);
+    assert_true(ddsketch_quantile(a, 0.5) == 0.0);
+    for (int v = 1; v <= 1000; ++v) {
+        ddsketch_add(v <= 500 ? a : b, (double)v, 1);
+    }
+    ddsketch_add(a, 0.0, 1);
+    assert_int_equal(a->total, 500);
+    ddsketch_merge(a, b);
+    double p50 = ddsketch_quantile(a, 0.5);
+    double p99 = ddsketch_quantile(a, 0.99);
+    assert_true(p50 > 495.0 && p50 < 505.0);
+    assert_true(p99 > 980.0 && p99 < 1000.0);
+    // Moving the top half down to 1 drags the median with it.
+    for (int v = 501; v <= 1000; ++v) {
+        ddsketch_add(a, (double)v, -1);
+        ddsketch_add(a, 1.0, 1);
+    }
+    assert_int_equal(a->total, 1000);
+    p99 = ddsketch_quantile(a, 0.99);
+    assert_true(p99 > 485.0 && p99 < 500.0);
+    assert_true(ddsketch_quantile(a, 0.5) < 1.02);
+    free(b);
+    free(a);
+    free(other);
+    free(h);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_parse_long),
         cmocka_unit_test(test_parse_double),
+        cmocka_unit_test(test_crc32),
+        cmocka_unit_test(test_epoch_day),
+        cmocka_unit_test(test_roaring),
+        cmocka_unit_test(test_sketches),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }